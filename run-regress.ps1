@@ -0,0 +1,18 @@
+[CmdletBinding()]
+param(
+    [Parameter(Mandatory = $false)]
+    [ValidateSet("Debug", "Release")]
+    [string]$Config = "Release",
+    [Parameter(Mandatory = $false)]
+    [bool]$Update = $false
+)
+
+$regress_path = Resolve-Path -Path "build\${Config}\chip8regress.exe"
+
+if ($Update) {
+    & $regress_path --update --golden tests\golden.txt
+} else {
+    & $regress_path --golden tests\golden.txt
+}
+
+exit $LASTEXITCODE
@@ -2,24 +2,46 @@
 param(
     [Parameter(Mandatory = $false)]
     [ValidateSet("Debug", "Release")]
-    [string]$Config = "Release"
+    [string]$Config = "Release",
+    [Parameter(Mandatory = $false)]
+    [string]$JUnit = ""
 )
 
 $vm_path = Resolve-Path -Path "build\${Config}\chip8tests.exe"
+$json_path = Join-Path ([System.IO.Path]::GetTempPath()) "chip8tests.json"
+$env:CHIP8_TEST_JSON = $json_path
+
+if ($JUnit) {
+    $env:CHIP8_TEST_JUNIT = $JUnit
+}
+
 $output = & $vm_path
-$outputArray = $output -split "`n"
+$exit_code = $LASTEXITCODE
+Remove-Item Env:\CHIP8_TEST_JSON
+Remove-Item Env:\CHIP8_TEST_JUNIT -ErrorAction SilentlyContinue
+
+if (-not (Test-Path $json_path)) {
+    $output | Write-Host
+    exit 1
+}
+
+$results = Get-Content $json_path -Raw | ConvertFrom-Json
+Remove-Item $json_path
 
-for ($i = 0; $i -lt $outputArray.Length; $i += 2) {
-    $testName = $outputArray[$i]
-    $dots = '.' * (40 - $testName.Length)
-    Write-Host -NoNewline "$testName$dots"
-    $line = $outputArray[$i + 1]
-    if ($line -match "PASSED") {
-        Write-Host $line -NoNewline -ForegroundColor Green
+foreach ($test in $results.tests) {
+    $dots = '.' * [Math]::Max(1, 40 - $test.name.Length)
+    $time = "{0,9:N3} ms" -f $test.ms
+    Write-Host -NoNewline "$($test.name)$dots"
+    if ($test.status -eq "passed") {
+        Write-Host -NoNewline "PASSED" -ForegroundColor Green
+    } elseif ($test.status -eq "timed_out") {
+        Write-Host -NoNewline "TIMED OUT after $($test.instructions) instructions" -ForegroundColor Red
     } else {
-        Write-Host $line -NoNewline -ForegroundColor Red
+        Write-Host -NoNewline "FAILED" -ForegroundColor Red
     }
-    Write-Host
+    Write-Host $time
 }
 
-Write-Host
\ No newline at end of file
+Write-Host
+$output | Select-Object -Last 2 | Write-Host
+exit $exit_code
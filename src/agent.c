@@ -0,0 +1,210 @@
+#include "agent.h"
+#include "hash.h"
+#include "pool.h"
+#include "timing.h"
+
+#include <stdlib.h>
+
+// No keys plus each key on its own
+#define AGENT_ACTION_COUNT 17
+// Losing outweighs any score
+#define AGENT_DONE_PENALTY ((int64_t)1 << 40)
+// Scores are scaled so the tie break noise below never reorders different scores
+#define AGENT_SCORE_SCALE 1024
+
+typedef struct AgentNode
+{
+    Chip8 vm;
+    int64_t value;
+    int32_t score;
+    uint16_t first_action;
+    bool done;
+} AgentNode;
+
+struct Agent
+{
+    AgentConfig config;
+    ThreadPool* pool;
+    AgentNode* beam;
+    AgentNode* children;
+    uint32_t* order;
+    uint32_t beam_count;
+    uint32_t searches;
+    const Chip8* root;
+};
+
+static void agent_expand_task(void* context, uint32_t index);
+static bool agent_is_before(uint32_t left, uint32_t right, const AgentNode* children);
+static void agent_sort(uint32_t* order, uint32_t count, const AgentNode* children);
+
+Agent* agent_create(const AgentConfig* config)
+{
+    Agent* agent = calloc(1, sizeof(Agent));
+
+    if(!agent)
+    {
+        return NULL;
+    }
+
+    agent->config = *config;
+    agent->config.beam_width = config->beam_width > 0 ? config->beam_width : 1;
+    agent->config.depth = config->depth > 0 ? config->depth : 1;
+    agent->config.hold_frames = config->hold_frames > 0 ? config->hold_frames : 1;
+
+    const uint32_t child_count = agent->config.beam_width * AGENT_ACTION_COUNT;
+    agent->beam = calloc(agent->config.beam_width, sizeof(AgentNode));
+    agent->children = calloc(child_count, sizeof(AgentNode));
+    agent->order = calloc(child_count, sizeof(uint32_t));
+    agent->pool = pool_create(config->threads);
+
+    if(!agent->beam || !agent->children || !agent->order || !agent->pool)
+    {
+        agent_destroy(agent);
+        return NULL;
+    }
+
+    return agent;
+}
+
+void agent_destroy(Agent* agent)
+{
+    if(!agent)
+    {
+        return;
+    }
+
+    if(agent->pool)
+    {
+        pool_destroy(agent->pool);
+    }
+
+    for(uint32_t i = 0; agent->beam && i < agent->config.beam_width; ++i)
+    {
+        chip8_release(&agent->beam[i].vm);
+    }
+
+    for(uint32_t i = 0; agent->children && i < agent->config.beam_width * AGENT_ACTION_COUNT; ++i)
+    {
+        chip8_release(&agent->children[i].vm);
+    }
+
+    free(agent->order);
+    free(agent->children);
+    free(agent->beam);
+    free(agent);
+}
+
+uint16_t agent_choose(Agent* agent, const Chip8* vm, AgentStats* stats)
+{
+    const uint64_t start = timing_now_ns();
+    uint64_t nodes = 0;
+
+    agent->beam_count = 0;
+    ++agent->searches;
+
+    for(uint32_t generation = 0; generation < agent->config.depth; ++generation)
+    {
+        // The first generation expands the root, later ones every machine in the beam
+        agent->root = generation == 0 ? vm : NULL;
+        const uint32_t parents = generation == 0 ? 1 : agent->beam_count;
+        const uint32_t count = parents * AGENT_ACTION_COUNT;
+        pool_for(agent->pool, count, agent_expand_task, agent);
+        nodes += count;
+
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            agent->order[i] = i;
+        }
+
+        agent_sort(agent->order, count, agent->children);
+
+        // Swapping keeps every machine owned by exactly one node, so no pages are copied
+        agent->beam_count = count < agent->config.beam_width ? count : agent->config.beam_width;
+
+        for(uint32_t i = 0; i < agent->beam_count; ++i)
+        {
+            const AgentNode swap = agent->beam[i];
+            agent->beam[i] = agent->children[agent->order[i]];
+            agent->children[agent->order[i]] = swap;
+        }
+    }
+
+    agent->root = NULL;
+
+    if(stats)
+    {
+        stats->nodes = nodes;
+        stats->elapsed_ns = timing_now_ns() - start;
+        stats->best_score = agent->beam[0].score;
+    }
+
+    return agent->beam[0].first_action;
+}
+
+static void agent_expand_task(void* context, const uint32_t index)
+{
+    Agent* agent = (Agent*)context;
+    const uint32_t parent = index / AGENT_ACTION_COUNT;
+    const uint32_t action_index = index % AGENT_ACTION_COUNT;
+    const uint16_t action = action_index == 0 ? 0 : (uint16_t)(1u << (action_index - 1));
+    const AgentNode* source = agent->root ? NULL : &agent->beam[parent];
+    AgentNode* child = &agent->children[index];
+
+    chip8_copy(&child->vm, agent->root ? agent->root : &source->vm);
+    child->vm.muted = true;
+    child->first_action = source ? source->first_action : action;
+    child->done = source && source->done;
+
+    Chip8* vm = &child->vm;
+
+    for(uint32_t frame = 0; frame < agent->config.hold_frames && !child->done; ++frame)
+    {
+        vm->keys_pressed = frame == 0 ? action & (uint16_t)~vm->keys : 0;
+        vm->keys = action;
+        chip8_step(vm);
+        child->done = chip8_env_default_done(vm);
+    }
+
+    if(agent->config.score)
+    {
+        child->score = agent->config.score(vm);
+    }
+    else
+    {
+        child->score = agent->config.score_address != 0 ? chip8_env_bcd_at(vm, agent->config.score_address) : 0;
+    }
+
+    // Equal scores are broken by noise fixed per search and first key, so a ROM
+    // without a score still gets varied play that steers clear of losing
+    const uint32_t key[2] = {agent->searches, child->first_action};
+    const int64_t noise = (int64_t)(hash_fnv1a64(key, sizeof(key), HASH_FNV1A64_SEED) % AGENT_SCORE_SCALE);
+    child->value = (int64_t)child->score * AGENT_SCORE_SCALE + noise - (child->done ? AGENT_DONE_PENALTY : 0);
+}
+
+static bool agent_is_before(const uint32_t left, const uint32_t right, const AgentNode* children)
+{
+    if(children[left].value != children[right].value)
+    {
+        return children[left].value > children[right].value;
+    }
+
+    return left < right;
+}
+
+// Insertion sort, a few hundred children and qsort has no context argument in C11
+static void agent_sort(uint32_t* order, const uint32_t count, const AgentNode* children)
+{
+    for(uint32_t i = 1; i < count; ++i)
+    {
+        const uint32_t value = order[i];
+        uint32_t j = i;
+
+        while(j > 0 && agent_is_before(value, order[j - 1], children))
+        {
+            order[j] = order[j - 1];
+            --j;
+        }
+
+        order[j] = value;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include "chip8.h"
+#include "env.h"
+
+#include <stdint.h>
+
+// Beam search player. Each search forks the machine once per candidate key, holds
+// the key for a few frames, keeps the best beam_width machines by score and expands
+// them again for depth generations. Forks share RAM pages, so a fork costs one
+// struct copy, and each generation runs across a worker pool. The choice only
+// depends on the machine and the number of searches made, not on the worker count.
+
+typedef struct AgentConfig
+{
+    // Machines kept per generation
+    uint32_t beam_width;
+    // Generations searched, the lookahead is depth * hold_frames frames
+    uint32_t depth;
+    // Frames each key is held for
+    uint32_t hold_frames;
+    // Worker threads, 0 uses one per hardware thread
+    uint32_t threads;
+    // Score read from RAM, NULL reads the BCD score at score_address, or no score when 0
+    Chip8ScoreFunc score;
+    uint16_t score_address;
+} AgentConfig;
+
+typedef struct AgentStats
+{
+    // Machines simulated and time spent by the last search
+    uint64_t nodes;
+    uint64_t elapsed_ns;
+    int32_t best_score;
+} AgentStats;
+
+typedef struct Agent Agent;
+
+Agent* agent_create(const AgentConfig* config);
+void agent_destroy(Agent* agent);
+// Searches ahead of vm and returns the keys to hold for the next frame
+uint16_t agent_choose(Agent* agent, const Chip8* vm, AgentStats* stats);
+
+#endif
@@ -0,0 +1,555 @@
+#include "analyze.h"
+#include "codes.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANALYSIS_CACHE_MAGIC 0x4e413843u // "C8AN"
+#define ANALYSIS_CACHE_VERSION 1
+#define ANALYSIS_MAX_PATH 512
+#define ANALYSIS_INDEX_UNKNOWN (-1)
+
+typedef struct AnalysisCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t reserved;
+    uint64_t rom_hash;
+} AnalysisCacheHeader;
+
+// A path still to walk, with the value of I on entry when it is known
+typedef struct AnalysisPath
+{
+    uint16_t pc;
+    int32_t index;
+} AnalysisPath;
+
+typedef struct AnalysisWalk
+{
+    Chip8Analysis* analysis;
+    const uint8_t* ram;
+    uint16_t rom_end;
+    AnalysisPath* paths;
+    uint32_t path_count;
+    uint32_t path_capacity;
+} AnalysisWalk;
+
+static AnalysisExit analysis_exit(uint16_t instruction, uint16_t pc, uint16_t* successors, uint8_t* successor_count);
+static uint16_t analysis_fetch(const uint8_t* ram, uint16_t pc);
+static void analysis_push(AnalysisWalk* walk, uint16_t pc, int32_t index, uint8_t flags);
+static void analysis_walk(AnalysisWalk* walk, AnalysisPath path);
+static void analysis_mark(Chip8Analysis* analysis, int32_t index, uint32_t count, uint8_t flag);
+static void analysis_build_blocks(Chip8Analysis* analysis, const uint8_t* ram);
+
+void chip8_analyze(const uint8_t* rom, size_t rom_size, Chip8Analysis* analysis)
+{
+    static const size_t capacity = CHIP8_RAM_SIZE - PROGRAM_START;
+    uint8_t ram[CHIP8_RAM_SIZE] = {0};
+
+    rom_size = rom_size < capacity ? rom_size : capacity;
+    memcpy(&ram[PROGRAM_START], rom, rom_size);
+    memset(analysis, 0, sizeof(*analysis));
+    analysis->rom_hash = hash_fnv1a64(rom, rom_size, HASH_FNV1A64_SEED);
+    analysis->rom_size = (uint32_t)rom_size;
+
+    // Every instruction pushes at most two paths and only unvisited ones are walked
+    AnalysisPath paths[CHIP8_RAM_SIZE * 2];
+    AnalysisWalk walk = {
+        .analysis = analysis,
+        .ram = ram,
+        .rom_end = (uint16_t)(PROGRAM_START + rom_size),
+        .paths = paths,
+        .path_count = 0,
+        .path_capacity = sizeof(paths) / sizeof(paths[0])
+    };
+
+    analysis_push(&walk, PROGRAM_START, ANALYSIS_INDEX_UNKNOWN, ANALYSIS_BLOCK_START);
+
+    while(walk.path_count > 0)
+    {
+        analysis_walk(&walk, walk.paths[--walk.path_count]);
+    }
+
+    for(uint32_t address = 0; address < CHIP8_RAM_SIZE; ++address)
+    {
+        const uint8_t flags = analysis->flags[address];
+        analysis->instruction_count += (flags & ANALYSIS_CODE) != 0;
+        analysis->data_bytes += (flags & ANALYSIS_DATA) && !(flags & (ANALYSIS_CODE | ANALYSIS_OPERAND));
+        analysis->indirect_jumps += (flags & ANALYSIS_INDIRECT) != 0;
+        analysis->self_modifying_writes += (flags & ANALYSIS_WRITTEN) && (flags & (ANALYSIS_CODE | ANALYSIS_OPERAND));
+    }
+
+    analysis_build_blocks(analysis, ram);
+}
+
+bool chip8_analyze_file(const char* rom_path, const bool use_cache, Chip8Analysis* analysis)
+{
+    uint8_t rom[CHIP8_RAM_SIZE - PROGRAM_START];
+    FILE* file = fopen(rom_path, "rb");
+
+    if(!file)
+    {
+        return false;
+    }
+
+    const size_t rom_size = fread(rom, sizeof(uint8_t), sizeof(rom), file);
+    fclose(file);
+
+    char cache_path[ANALYSIS_MAX_PATH];
+
+    if(!use_cache || snprintf(cache_path, sizeof(cache_path), "%s.analysis", rom_path) >= (int)sizeof(cache_path))
+    {
+        chip8_analyze(rom, rom_size, analysis);
+        return true;
+    }
+
+    // The cache is keyed by the same hash as the quirk profiles, so an edited ROM is reanalyzed
+    const uint64_t rom_hash = hash_fnv1a64(rom, rom_size, HASH_FNV1A64_SEED);
+    AnalysisCacheHeader header;
+    FILE* cache = fopen(cache_path, "rb");
+
+    if(cache)
+    {
+        const bool hit = fread(&header, sizeof(header), 1, cache) == 1
+            && header.magic == ANALYSIS_CACHE_MAGIC
+            && header.version == ANALYSIS_CACHE_VERSION
+            && header.size == sizeof(Chip8Analysis)
+            && header.rom_hash == rom_hash
+            && fread(analysis, sizeof(Chip8Analysis), 1, cache) == 1;
+        fclose(cache);
+
+        if(hit)
+        {
+            return true;
+        }
+    }
+
+    chip8_analyze(rom, rom_size, analysis);
+
+    header = (AnalysisCacheHeader){
+        .magic = ANALYSIS_CACHE_MAGIC,
+        .version = ANALYSIS_CACHE_VERSION,
+        .size = sizeof(Chip8Analysis),
+        .reserved = 0,
+        .rom_hash = rom_hash
+    };
+
+    // A read only ROM directory only costs the cache
+    cache = fopen(cache_path, "wb");
+
+    if(cache)
+    {
+        fwrite(&header, sizeof(header), 1, cache);
+        fwrite(analysis, sizeof(Chip8Analysis), 1, cache);
+        fclose(cache);
+    }
+
+    return true;
+}
+
+const AnalysisBlock* chip8_analysis_block_at(const Chip8Analysis* analysis, const uint16_t address)
+{
+    if(!(analysis->flags[address & (CHIP8_RAM_SIZE - 1)] & (ANALYSIS_CODE | ANALYSIS_OPERAND)))
+    {
+        return NULL;
+    }
+
+    // Blocks are sorted by start, find the last one starting at or before address
+    uint32_t low = 0;
+    uint32_t high = analysis->block_count;
+
+    while(low < high)
+    {
+        const uint32_t middle = (low + high) / 2;
+
+        if(analysis->blocks[middle].start <= address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    for(uint32_t i = low; i-- > 0;)
+    {
+        if(analysis->blocks[i].end > address)
+        {
+            return &analysis->blocks[i];
+        }
+
+        // Blocks only overlap around misaligned code, so a short look back is enough
+        if(low - i > 4)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+void chip8_disassemble(const uint16_t instruction, char* out, const size_t size)
+{
+    const uint8_t x = X(instruction);
+    const uint8_t y = Y(instruction);
+    const uint16_t addr = ADDR(instruction);
+    const uint8_t byte = BYTE(instruction);
+
+    switch(instruction & 0xF000)
+    {
+        case 0x0000:
+            if(instruction == 0x00E0)
+            {
+                snprintf(out, size, "CLS");
+            }
+            else if(instruction == 0x00EE)
+            {
+                snprintf(out, size, "RET");
+            }
+            else
+            {
+                snprintf(out, size, "SYS 0x%.03x", addr);
+            }
+            return;
+        case 0x1000: snprintf(out, size, "JP 0x%.03x", addr); return;
+        case 0x2000: snprintf(out, size, "CALL 0x%.03x", addr); return;
+        case 0x3000: snprintf(out, size, "SE V%X, 0x%.02x", x, byte); return;
+        case 0x4000: snprintf(out, size, "SNE V%X, 0x%.02x", x, byte); return;
+        case 0x5000: snprintf(out, size, "SE V%X, V%X", x, y); return;
+        case 0x6000: snprintf(out, size, "LD V%X, 0x%.02x", x, byte); return;
+        case 0x7000: snprintf(out, size, "ADD V%X, 0x%.02x", x, byte); return;
+        case 0x8000:
+        {
+            static const char* Names[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN", NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL};
+            const char* name = Names[NIBBLE(instruction)];
+
+            if(name)
+            {
+                snprintf(out, size, "%s V%X, V%X", name, x, y);
+                return;
+            }
+
+            break;
+        }
+        case 0x9000: snprintf(out, size, "SNE V%X, V%X", x, y); return;
+        case 0xA000: snprintf(out, size, "LD I, 0x%.03x", addr); return;
+        case 0xB000: snprintf(out, size, "JP V0, 0x%.03x", addr); return;
+        case 0xC000: snprintf(out, size, "RND V%X, 0x%.02x", x, byte); return;
+        case 0xD000: snprintf(out, size, "DRW V%X, V%X, %d", x, y, NIBBLE(instruction)); return;
+        case 0xE000:
+            if(byte == 0x9E || byte == 0xA1)
+            {
+                snprintf(out, size, "%s V%X", byte == 0x9E ? "SKP" : "SKNP", x);
+                return;
+            }
+
+            break;
+        case 0xF000:
+            switch(byte)
+            {
+                case 0x02:
+                    if(x == 0)
+                    {
+                        snprintf(out, size, "AUDIO");
+                        return;
+                    }
+
+                    break;
+                case 0x07: snprintf(out, size, "LD V%X, DT", x); return;
+                case 0x0A: snprintf(out, size, "LD V%X, K", x); return;
+                case 0x15: snprintf(out, size, "LD DT, V%X", x); return;
+                case 0x18: snprintf(out, size, "LD ST, V%X", x); return;
+                case 0x1E: snprintf(out, size, "ADD I, V%X", x); return;
+                case 0x29: snprintf(out, size, "LD F, V%X", x); return;
+                case 0x33: snprintf(out, size, "LD B, V%X", x); return;
+                case 0x3A: snprintf(out, size, "PITCH V%X", x); return;
+                case 0x55: snprintf(out, size, "LD [I], V%X", x); return;
+                case 0x65: snprintf(out, size, "LD V%X, [I]", x); return;
+            }
+
+            break;
+    }
+
+    snprintf(out, size, "DW 0x%.04x", instruction);
+}
+
+const char* chip8_analysis_exit_name(const AnalysisExit exit)
+{
+    switch(exit)
+    {
+        case ANALYSIS_EXIT_FALLTHROUGH: return "fallthrough";
+        case ANALYSIS_EXIT_JUMP: return "jump";
+        case ANALYSIS_EXIT_SKIP: return "skip";
+        case ANALYSIS_EXIT_CALL: return "call";
+        case ANALYSIS_EXIT_RETURN: return "return";
+        case ANALYSIS_EXIT_INDIRECT: return "indirect";
+        case ANALYSIS_EXIT_HALT: return "halt";
+    }
+
+    return "unknown";
+}
+
+// Control flow of one instruction, matching what the interpreters treat as valid.
+// Plain instructions return ANALYSIS_EXIT_FALLTHROUGH with the next pc as successor.
+static AnalysisExit analysis_exit(const uint16_t instruction, const uint16_t pc, uint16_t* successors, uint8_t* successor_count)
+{
+    const uint16_t next = (uint16_t)((pc + 2) & (CHIP8_RAM_SIZE - 1));
+    const uint8_t byte = BYTE(instruction);
+
+    *successor_count = 0;
+
+    switch(instruction & 0xF000)
+    {
+        case 0x0000:
+            if(instruction == 0x00EE)
+            {
+                return ANALYSIS_EXIT_RETURN;
+            }
+
+            if(instruction != 0x00E0)
+            {
+                return ANALYSIS_EXIT_HALT;
+            }
+
+            break;
+        case 0x1000:
+            if(ADDR(instruction) == pc)
+            {
+                return ANALYSIS_EXIT_HALT;
+            }
+
+            successors[(*successor_count)++] = ADDR(instruction);
+            return ANALYSIS_EXIT_JUMP;
+        case 0x2000:
+            successors[(*successor_count)++] = ADDR(instruction);
+            successors[(*successor_count)++] = next;
+            return ANALYSIS_EXIT_CALL;
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+            successors[(*successor_count)++] = next;
+            successors[(*successor_count)++] = (uint16_t)((pc + 4) & (CHIP8_RAM_SIZE - 1));
+            return ANALYSIS_EXIT_SKIP;
+        case 0x8000:
+            if(NIBBLE(instruction) > 0x7 && NIBBLE(instruction) != 0xE)
+            {
+                return ANALYSIS_EXIT_HALT;
+            }
+
+            break;
+        case 0xB000:
+            // V0 is usually 0 on the first entry into a jump table, so the base is worth following
+            successors[(*successor_count)++] = ADDR(instruction);
+            return ANALYSIS_EXIT_INDIRECT;
+        case 0xE000:
+            if(byte != 0x9E && byte != 0xA1)
+            {
+                return ANALYSIS_EXIT_HALT;
+            }
+
+            successors[(*successor_count)++] = next;
+            successors[(*successor_count)++] = (uint16_t)((pc + 4) & (CHIP8_RAM_SIZE - 1));
+            return ANALYSIS_EXIT_SKIP;
+        case 0xF000:
+            switch(byte)
+            {
+                case 0x02:
+                    if(X(instruction) != 0)
+                    {
+                        return ANALYSIS_EXIT_HALT;
+                    }
+
+                    break;
+                case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E:
+                case 0x29: case 0x33: case 0x3A: case 0x55: case 0x65:
+                    break;
+                default:
+                    return ANALYSIS_EXIT_HALT;
+            }
+
+            break;
+    }
+
+    successors[(*successor_count)++] = next;
+    return ANALYSIS_EXIT_FALLTHROUGH;
+}
+
+static uint16_t analysis_fetch(const uint8_t* ram, const uint16_t pc)
+{
+    return (uint16_t)((ram[pc & (CHIP8_RAM_SIZE - 1)] << 8) | ram[(pc + 1) & (CHIP8_RAM_SIZE - 1)]);
+}
+
+static void analysis_push(AnalysisWalk* walk, const uint16_t pc, const int32_t index, const uint8_t flags)
+{
+    uint8_t* target = &walk->analysis->flags[pc & (CHIP8_RAM_SIZE - 1)];
+    *target |= flags;
+
+    if(!(*target & ANALYSIS_CODE) && walk->path_count < walk->path_capacity)
+    {
+        walk->paths[walk->path_count++] = (AnalysisPath){.pc = pc, .index = index};
+    }
+}
+
+// Walks one path until it leaves straight line code, queueing the paths it branches to
+static void analysis_walk(AnalysisWalk* walk, AnalysisPath path)
+{
+    Chip8Analysis* analysis = walk->analysis;
+    uint16_t pc = path.pc;
+    int32_t index = path.index;
+
+    // Code outside the ROM image is only reachable through self modification
+    while(pc >= PROGRAM_START && pc + 1 < walk->rom_end && !(analysis->flags[pc] & ANALYSIS_CODE))
+    {
+        const uint16_t instruction = analysis_fetch(walk->ram, pc);
+        const uint8_t x = X(instruction);
+        uint16_t successors[2];
+        uint8_t successor_count;
+        const AnalysisExit exit = analysis_exit(instruction, pc, successors, &successor_count);
+
+        analysis->flags[pc] |= ANALYSIS_CODE;
+        analysis->flags[pc + 1] |= ANALYSIS_OPERAND;
+
+        switch(instruction & 0xF000)
+        {
+            case 0xA000:
+                index = ADDR(instruction);
+                analysis_mark(analysis, index, 1, ANALYSIS_DATA);
+                break;
+            case 0xD000:
+                analysis_mark(analysis, index, NIBBLE(instruction), ANALYSIS_DATA);
+                break;
+            case 0xF000:
+                switch(BYTE(instruction))
+                {
+                    case 0x02:
+                        analysis_mark(analysis, index, 16, ANALYSIS_DATA);
+                        break;
+                    case 0x33:
+                        analysis->unknown_writes += index == ANALYSIS_INDEX_UNKNOWN;
+                        analysis_mark(analysis, index, 3, ANALYSIS_WRITTEN);
+                        break;
+                    case 0x55:
+                        analysis->unknown_writes += index == ANALYSIS_INDEX_UNKNOWN;
+                        analysis_mark(analysis, index, x + 1u, ANALYSIS_WRITTEN);
+                        // Whether I moves depends on the quirk profile
+                        index = ANALYSIS_INDEX_UNKNOWN;
+                        break;
+                    case 0x65:
+                        analysis_mark(analysis, index, x + 1u, ANALYSIS_DATA);
+                        index = ANALYSIS_INDEX_UNKNOWN;
+                        break;
+                    case 0x1E:
+                    case 0x29:
+                        index = ANALYSIS_INDEX_UNKNOWN;
+                        break;
+                }
+                break;
+        }
+
+        switch(exit)
+        {
+            case ANALYSIS_EXIT_FALLTHROUGH:
+                pc = successors[0];
+                continue;
+            case ANALYSIS_EXIT_JUMP:
+            case ANALYSIS_EXIT_SKIP:
+                for(uint8_t i = 0; i < successor_count; ++i)
+                {
+                    analysis_push(walk, successors[i], index, ANALYSIS_BLOCK_START);
+                }
+                break;
+            case ANALYSIS_EXIT_CALL:
+                analysis_push(walk, successors[0], index, ANALYSIS_BLOCK_START | ANALYSIS_CALL_TARGET);
+                // The callee may have changed I by the time it returns
+                analysis_push(walk, successors[1], ANALYSIS_INDEX_UNKNOWN, ANALYSIS_BLOCK_START);
+                break;
+            case ANALYSIS_EXIT_INDIRECT:
+                analysis->flags[pc] |= ANALYSIS_INDIRECT;
+                analysis_push(walk, successors[0], index, ANALYSIS_BLOCK_START);
+                break;
+            case ANALYSIS_EXIT_RETURN:
+            case ANALYSIS_EXIT_HALT:
+                break;
+        }
+
+        return;
+    }
+}
+
+static void analysis_mark(Chip8Analysis* analysis, const int32_t index, const uint32_t count, const uint8_t flag)
+{
+    if(index == ANALYSIS_INDEX_UNKNOWN)
+    {
+        return;
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        analysis->flags[(index + i) & (CHIP8_RAM_SIZE - 1)] |= flag;
+    }
+}
+
+static void analysis_build_blocks(Chip8Analysis* analysis, const uint8_t* ram)
+{
+    const uint32_t capacity = sizeof(analysis->blocks) / sizeof(analysis->blocks[0]);
+
+    for(uint16_t address = PROGRAM_START; address < CHIP8_RAM_SIZE - 1 && analysis->block_count < capacity; ++address)
+    {
+        const uint8_t flags = analysis->flags[address];
+
+        if(!(flags & ANALYSIS_CODE))
+        {
+            continue;
+        }
+
+        // Instructions that straight line code runs into belong to the block before them
+        if(!(flags & ANALYSIS_BLOCK_START) && (analysis->flags[address - 2] & ANALYSIS_CODE))
+        {
+            uint16_t successors[2];
+            uint8_t successor_count;
+
+            if(analysis_exit(analysis_fetch(ram, address - 2), address - 2, successors, &successor_count) == ANALYSIS_EXIT_FALLTHROUGH)
+            {
+                continue;
+            }
+        }
+
+        AnalysisBlock* block = &analysis->blocks[analysis->block_count++];
+        uint16_t pc = address;
+
+        block->start = address;
+
+        for(;;)
+        {
+            const AnalysisExit exit = analysis_exit(analysis_fetch(ram, pc), pc, block->successors, &block->successor_count);
+            pc += 2;
+
+            if(exit != ANALYSIS_EXIT_FALLTHROUGH)
+            {
+                block->exit = (uint8_t)exit;
+                break;
+            }
+
+            if(pc >= CHIP8_RAM_SIZE - 1 || !(analysis->flags[pc] & ANALYSIS_CODE))
+            {
+                // Runs off the end of the ROM
+                block->exit = ANALYSIS_EXIT_HALT;
+                block->successor_count = 0;
+                break;
+            }
+
+            if(analysis->flags[pc] & ANALYSIS_BLOCK_START)
+            {
+                block->exit = ANALYSIS_EXIT_FALLTHROUGH;
+                break;
+            }
+        }
+
+        block->end = pc;
+    }
+}
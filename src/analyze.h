@@ -0,0 +1,82 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Static analysis of a ROM image. Recursive descent from 0x200 follows every jump,
+// call and skip to find which bytes are instructions, splits them into basic blocks
+// and tracks I through each path, so the bytes Annn points at and Dxyn/Fx65 read are
+// marked as data and the bytes Fx33/Fx55 write are marked as written.
+
+enum
+{
+    // First byte of a reachable instruction
+    ANALYSIS_CODE = 1 << 0,
+    // Second byte of a reachable instruction
+    ANALYSIS_OPERAND = 1 << 1,
+    // Pointed at by Annn or read as a sprite or by Fx65
+    ANALYSIS_DATA = 1 << 2,
+    // Written by Fx33 or Fx55 with a known I
+    ANALYSIS_WRITTEN = 1 << 3,
+    ANALYSIS_BLOCK_START = 1 << 4,
+    ANALYSIS_CALL_TARGET = 1 << 5,
+    // Bnnn, the target depends on a register
+    ANALYSIS_INDIRECT = 1 << 6,
+};
+
+typedef enum AnalysisExit
+{
+    // Runs into the next block
+    ANALYSIS_EXIT_FALLTHROUGH,
+    ANALYSIS_EXIT_JUMP,
+    // Skip instruction, continues at the next or the one after
+    ANALYSIS_EXIT_SKIP,
+    // Continues at the target and, after the callee returns, at the next instruction
+    ANALYSIS_EXIT_CALL,
+    ANALYSIS_EXIT_RETURN,
+    ANALYSIS_EXIT_INDIRECT,
+    // Bad opcode, a jump to itself or the end of the ROM
+    ANALYSIS_EXIT_HALT,
+} AnalysisExit;
+
+typedef struct AnalysisBlock
+{
+    uint16_t start;
+    // One past the last byte
+    uint16_t end;
+    uint16_t successors[2];
+    uint8_t successor_count;
+    uint8_t exit;
+} AnalysisBlock;
+
+typedef struct Chip8Analysis
+{
+    uint64_t rom_hash;
+    uint32_t rom_size;
+    uint32_t instruction_count;
+    uint32_t data_bytes;
+    uint32_t block_count;
+    // Fx33/Fx55 reached with I unknown, any byte may be written
+    uint32_t unknown_writes;
+    uint32_t indirect_jumps;
+    // Known writes that land on instructions
+    uint32_t self_modifying_writes;
+    uint8_t flags[CHIP8_RAM_SIZE];
+    AnalysisBlock blocks[CHIP8_RAM_SIZE / 2];
+} Chip8Analysis;
+
+void chip8_analyze(const uint8_t* rom, size_t rom_size, Chip8Analysis* analysis);
+// Reads the analysis cached next to the ROM as rom_path.analysis, or analyzes the
+// ROM and writes the cache when it is missing or stale. use_cache false skips the cache.
+bool chip8_analyze_file(const char* rom_path, bool use_cache, Chip8Analysis* analysis);
+// Block containing address, NULL if it is not code
+const AnalysisBlock* chip8_analysis_block_at(const Chip8Analysis* analysis, uint16_t address);
+// Writes the mnemonic of instruction, e.g. "LD V1, 0x20"
+void chip8_disassemble(uint16_t instruction, char* out, size_t size);
+const char* chip8_analysis_exit_name(AnalysisExit exit);
+
+#endif
@@ -0,0 +1,127 @@
+#include "ansi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ANSI_DISPLAY_COLUMNS 64
+#define ANSI_DISPLAY_ROWS 32
+
+static size_t ansi_move(uint32_t row, uint32_t column, char* out);
+
+void ansi_screen_init(AnsiScreen* screen, const AnsiCells cells, const uint32_t top, const uint32_t left)
+{
+    screen->cells = cells;
+    screen->columns = cells == ANSI_BRAILLE ? ANSI_DISPLAY_COLUMNS / 2 : ANSI_DISPLAY_COLUMNS;
+    screen->rows = cells == ANSI_BRAILLE ? ANSI_DISPLAY_ROWS / 4 : ANSI_DISPLAY_ROWS / 2;
+    screen->top = top;
+    screen->left = left;
+    ansi_screen_invalidate(screen);
+}
+
+void ansi_screen_invalidate(AnsiScreen* screen)
+{
+    for(uint32_t r = 0; r < ANSI_MAX_ROWS; ++r)
+    {
+        for(uint32_t c = 0; c < ANSI_MAX_COLUMNS; ++c)
+        {
+            screen->shown[r][c] = ANSI_CELL_UNKNOWN;
+        }
+    }
+
+    screen->cursor_row = 0;
+    screen->cursor_column = 0;
+}
+
+size_t ansi_screen_draw(AnsiScreen* screen, const uint32_t* display, char* out)
+{
+    size_t length = 0;
+
+    for(uint32_t r = 0; r < screen->rows; ++r)
+    {
+        for(uint32_t c = 0; c < screen->columns; ++c)
+        {
+            const uint16_t cell = ansi_screen_cell(screen, display, r, c);
+
+            if(cell == screen->shown[r][c])
+            {
+                continue;
+            }
+
+            const uint32_t row = screen->top + r;
+            const uint32_t column = screen->left + c;
+
+            if(screen->cursor_row != row || screen->cursor_column != column)
+            {
+                // A short run of unchanged cells on the same row is cheaper to write again
+                // than to jump over
+                char scratch[16];
+                const size_t move_length = ansi_move(row, column, scratch);
+                size_t gap_length = SIZE_MAX;
+
+                if(screen->cursor_row == row && screen->cursor_column > screen->left && screen->cursor_column < column)
+                {
+                    gap_length = 0;
+
+                    for(uint32_t g = screen->cursor_column - screen->left; g < c && gap_length < move_length; ++g)
+                    {
+                        gap_length += ansi_glyph(screen->cells, screen->shown[r][g], scratch);
+                    }
+                }
+
+                if(gap_length < move_length)
+                {
+                    for(uint32_t g = screen->cursor_column - screen->left; g < c; ++g)
+                    {
+                        length += ansi_glyph(screen->cells, screen->shown[r][g], &out[length]);
+                    }
+                }
+                else
+                {
+                    length += ansi_move(row, column, &out[length]);
+                }
+            }
+
+            length += ansi_glyph(screen->cells, cell, &out[length]);
+            screen->shown[r][c] = cell;
+            screen->cursor_row = row;
+            screen->cursor_column = column + 1;
+        }
+    }
+
+    return length;
+}
+
+uint16_t ansi_screen_cell(const AnsiScreen* screen, const uint32_t* display, const uint32_t row, const uint32_t column)
+{
+    if(screen->cells == ANSI_HALF_BLOCK)
+    {
+        return (uint16_t)((display[column] >> (row * 2)) & 0x3);
+    }
+
+    // Braille numbers the dots down the left column, down the right, then the bottom row
+    const uint32_t left = (display[column * 2] >> (row * 4)) & 0xF;
+    const uint32_t right = (display[column * 2 + 1] >> (row * 4)) & 0xF;
+    return (uint16_t)((left & 0x7) | ((right & 0x7) << 3) | ((left & 0x8) << 3) | ((right & 0x8) << 4));
+}
+
+size_t ansi_glyph(const AnsiCells cells, const uint16_t cell, char* out)
+{
+    // Empty cells are spaces either way, fonts agree on how wide those are
+    if(cell == 0)
+    {
+        out[0] = ' ';
+        return 1;
+    }
+
+    // U+2580 upper half, U+2584 lower half, U+2588 full block, U+2800 + dots for braille
+    const uint32_t code = cells == ANSI_HALF_BLOCK ? (cell == 1 ? 0x2580 : cell == 2 ? 0x2584 : 0x2588) : 0x2800u + cell;
+    out[0] = (char)(0xE0 | (code >> 12));
+    out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (code & 0x3F));
+    return 3;
+}
+
+static size_t ansi_move(const uint32_t row, const uint32_t column, char* out)
+{
+    return (size_t)sprintf(out, "\x1b[%u;%uH", row, column);
+}
@@ -0,0 +1,54 @@
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Draws the display as Unicode text for a VT100 style terminal. Half blocks put two
+// pixels in a cell and braille eight, and a frame only holds the cells that changed
+// since the last one, each behind a cursor move unless the cursor is already there.
+
+typedef enum AnsiCells
+{
+    // 64x16 cells of upper and lower half blocks
+    ANSI_HALF_BLOCK,
+    // 32x8 cells of 2x4 braille dots
+    ANSI_BRAILLE,
+} AnsiCells;
+
+#define ANSI_MAX_COLUMNS 64
+#define ANSI_MAX_ROWS 16
+// Bytes a frame can take, a cursor move and a three byte glyph for every cell
+#define ANSI_FRAME_BYTES (ANSI_MAX_COLUMNS * ANSI_MAX_ROWS * 16)
+
+typedef struct AnsiScreen
+{
+    AnsiCells cells;
+    uint32_t columns;
+    uint32_t rows;
+    // Terminal row and column of the top left cell, from 1
+    uint32_t top;
+    uint32_t left;
+    // Cell last drawn at each position, ANSI_CELL_UNKNOWN before the first frame
+    uint16_t shown[ANSI_MAX_ROWS][ANSI_MAX_COLUMNS];
+    // Where the terminal cursor is, 0 when unknown
+    uint32_t cursor_row;
+    uint32_t cursor_column;
+} AnsiScreen;
+
+#define ANSI_CELL_UNKNOWN 0xFFFF
+
+void ansi_screen_init(AnsiScreen* screen, AnsiCells cells, uint32_t top, uint32_t left);
+// Forgets what the terminal shows, so the next frame draws every cell
+void ansi_screen_invalidate(AnsiScreen* screen);
+// Writes the changes to bring the terminal to the column major display into out, which
+// holds ANSI_FRAME_BYTES, and returns their length
+size_t ansi_screen_draw(AnsiScreen* screen, const uint32_t* display, char* out);
+// Pixel bits of the cell at row and column, bit n set for the nth pixel in the order
+// the glyph encodes them
+uint16_t ansi_screen_cell(const AnsiScreen* screen, const uint32_t* display, uint32_t row, uint32_t column);
+// Writes the UTF-8 glyph of a cell, returns its length
+size_t ansi_glyph(AnsiCells cells, uint16_t cell, char* out);
+
+#endif
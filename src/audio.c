@@ -0,0 +1,324 @@
+#include "audio.h"
+#include "timing.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define AUDIO_QUEUE_SIZE 256
+#define AUDIO_PATTERN_BITS (AUDIO_PATTERN_BYTES * 8)
+#define AUDIO_FRAME_HZ 60.0
+// Frames the playback trails the newest one by, on top of the buffer being filled
+#define AUDIO_LEAD_FRAMES 2.0
+// Where playback should be is only known to the frame, errors within this are left
+// alone so the position never jitters, drift past it is pulled back a share per buffer,
+// and further than AUDIO_SNAP_FRAMES off playback jumps
+#define AUDIO_SLACK_FRAMES 1.0
+#define AUDIO_PULL 0.05
+#define AUDIO_SNAP_FRAMES 8.0
+#define AUDIO_AMPLITUDE 8000.0f
+// A step takes 2 * AUDIO_STEP_HALF + 1 samples to settle and is delayed by AUDIO_STEP_HALF
+#define AUDIO_STEP_HALF 8
+#define AUDIO_STEP_TAPS (2 * AUDIO_STEP_HALF + 1)
+#define AUDIO_STEP_PHASES 64
+// Integration points per phase while building the table
+#define AUDIO_STEP_OVERSAMPLE 8
+// Cutoff of the steps as a share of the sample rate, a little under half
+#define AUDIO_STEP_CUTOFF 0.45
+#define AUDIO_RING_SIZE 32
+
+typedef struct AudioEvent
+{
+    uint64_t frame;
+    AudioState state;
+} AudioEvent;
+
+struct AudioEngine
+{
+    uint32_t sample_rate;
+    AudioEvent queue[AUDIO_QUEUE_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint_fast64_t latest_frame;
+    atomic_uint_fast64_t events;
+    atomic_uint_fast64_t dropped;
+    atomic_uint_fast64_t late;
+    atomic_uint_fast64_t samples;
+    atomic_uint_fast64_t render_ns;
+
+    // Owned by the audio thread
+    AudioState state;
+    bool is_playing;
+    double position;
+    double phase;
+    double bits_per_sample;
+    double samples_per_bit;
+    float level;
+    // The output is the level every step will settle at, plus what is still missing from
+    // or overshooting it on each upcoming sample
+    float held;
+    float ring[AUDIO_RING_SIZE];
+    uint32_t ring_at;
+    float steps[AUDIO_STEP_PHASES + 1][AUDIO_STEP_TAPS];
+};
+
+static void audio_build_steps(AudioEngine* engine);
+static void audio_apply_due(AudioEngine* engine);
+static void audio_set_state(AudioEngine* engine, const AudioState* state);
+static void audio_synthesize(AudioEngine* engine);
+static void audio_add_step(AudioEngine* engine, float delta, double offset);
+static float audio_bit_level(const AudioEngine* engine, uint32_t bit);
+
+AudioEngine* audio_create(const uint32_t sample_rate)
+{
+    if(sample_rate == 0)
+    {
+        return NULL;
+    }
+
+    AudioEngine* engine = calloc(1, sizeof(AudioEngine));
+
+    if(!engine)
+    {
+        return NULL;
+    }
+
+    engine->sample_rate = sample_rate;
+    atomic_init(&engine->head, 0);
+    atomic_init(&engine->tail, 0);
+    atomic_init(&engine->latest_frame, 0);
+    atomic_init(&engine->events, 0);
+    atomic_init(&engine->dropped, 0);
+    atomic_init(&engine->late, 0);
+    atomic_init(&engine->samples, 0);
+    atomic_init(&engine->render_ns, 0);
+
+    AudioState state = {.pitch = AUDIO_DEFAULT_PITCH, .is_sounding = false};
+    audio_default_pattern(state.pattern);
+    audio_set_state(engine, &state);
+    audio_build_steps(engine);
+    return engine;
+}
+
+void audio_destroy(AudioEngine* engine)
+{
+    free(engine);
+}
+
+void audio_push(AudioEngine* engine, const uint64_t frame, const AudioState* state)
+{
+    const uint32_t head = atomic_load_explicit(&engine->head, memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&engine->tail, memory_order_acquire);
+
+    if(head - tail == AUDIO_QUEUE_SIZE)
+    {
+        atomic_fetch_add_explicit(&engine->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    AudioEvent* event = &engine->queue[head & (AUDIO_QUEUE_SIZE - 1)];
+    event->frame = frame;
+    event->state = *state;
+    atomic_store_explicit(&engine->head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&engine->events, 1, memory_order_relaxed);
+}
+
+void audio_advance(AudioEngine* engine, const uint64_t frame)
+{
+    atomic_store_explicit(&engine->latest_frame, frame, memory_order_release);
+}
+
+void audio_render(AudioEngine* engine, int16_t* out, const uint32_t count)
+{
+    const uint64_t start = timing_now_ns();
+    const double frames_per_sample = AUDIO_FRAME_HZ / (double)engine->sample_rate;
+    const double latest = (double)atomic_load_explicit(&engine->latest_frame, memory_order_acquire);
+    // Everything this buffer plays has been queued already, its last sample lands a
+    // couple of frames before the newest one
+    const double target = latest - (double)count * frames_per_sample - AUDIO_LEAD_FRAMES;
+    const double error = target - engine->position;
+
+    if(!engine->is_playing || fabs(error) > AUDIO_SNAP_FRAMES)
+    {
+        engine->position = target;
+        engine->is_playing = true;
+    }
+    else if(fabs(error) > AUDIO_SLACK_FRAMES)
+    {
+        engine->position += (error - copysign(AUDIO_SLACK_FRAMES, error)) * AUDIO_PULL;
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        audio_apply_due(engine);
+        audio_synthesize(engine);
+
+        const uint32_t at = engine->ring_at;
+        const float sample = engine->held + engine->ring[at];
+        engine->ring[at] = 0.0f;
+        engine->ring_at = (at + 1) & (AUDIO_RING_SIZE - 1);
+
+        out[i] = (int16_t)(sample > 32767.0f ? 32767.0f : sample < -32768.0f ? -32768.0f : sample);
+        engine->position += frames_per_sample;
+    }
+
+    atomic_fetch_add_explicit(&engine->samples, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&engine->render_ns, timing_now_ns() - start, memory_order_relaxed);
+}
+
+void audio_get_stats(AudioEngine* engine, AudioStats* out)
+{
+    out->events = atomic_load_explicit(&engine->events, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&engine->dropped, memory_order_relaxed);
+    out->late = atomic_load_explicit(&engine->late, memory_order_relaxed);
+    out->samples = atomic_load_explicit(&engine->samples, memory_order_relaxed);
+    out->render_ns = atomic_load_explicit(&engine->render_ns, memory_order_relaxed);
+}
+
+double audio_pattern_rate(const uint8_t pitch)
+{
+    return 4000.0 * pow(2.0, ((double)pitch - 64.0) / 48.0);
+}
+
+void audio_default_pattern(uint8_t* pattern)
+{
+    memset(pattern, 0xF0, AUDIO_PATTERN_BYTES);
+}
+
+// Row p holds a unit step starting p / AUDIO_STEP_PHASES of a sample after a sample, as
+// it is heard on the following taps: the running integral of a Blackman windowed sinc
+static void audio_build_steps(AudioEngine* engine)
+{
+    enum { Points = 2 * AUDIO_STEP_HALF * AUDIO_STEP_PHASES };
+    double integral[Points + 1];
+    const double dx = 1.0 / (AUDIO_STEP_PHASES * AUDIO_STEP_OVERSAMPLE);
+    double previous = 0.0;
+    double sum = 0.0;
+
+    for(uint32_t i = 0; i <= Points * AUDIO_STEP_OVERSAMPLE; ++i)
+    {
+        const double x = -AUDIO_STEP_HALF + i * dx;
+        const double arg = M_PI * 2.0 * AUDIO_STEP_CUTOFF * x;
+        const double sinc = fabs(arg) < 1e-9 ? 1.0 : sin(arg) / arg;
+        const double window = 0.42 + 0.5 * cos(M_PI * x / AUDIO_STEP_HALF) + 0.08 * cos(2.0 * M_PI * x / AUDIO_STEP_HALF);
+        const double value = sinc * window;
+
+        sum += i > 0 ? (previous + value) * 0.5 * dx : 0.0;
+        previous = value;
+
+        if(i % AUDIO_STEP_OVERSAMPLE == 0)
+        {
+            integral[i / AUDIO_STEP_OVERSAMPLE] = sum;
+        }
+    }
+
+    for(uint32_t p = 0; p <= AUDIO_STEP_PHASES; ++p)
+    {
+        for(int32_t k = 0; k < AUDIO_STEP_TAPS; ++k)
+        {
+            // Tap k is at k - AUDIO_STEP_HALF - p / AUDIO_STEP_PHASES from the step's centre
+            const int32_t i = k * AUDIO_STEP_PHASES - (int32_t)p;
+            const double value = i <= 0 ? 0.0 : i >= Points ? integral[Points] : integral[i];
+            engine->steps[p][k] = (float)(value / integral[Points]);
+        }
+    }
+}
+
+static void audio_apply_due(AudioEngine* engine)
+{
+    const uint32_t head = atomic_load_explicit(&engine->head, memory_order_acquire);
+    const uint32_t first = atomic_load_explicit(&engine->tail, memory_order_relaxed);
+    uint32_t tail = first;
+
+    while(tail != head)
+    {
+        const AudioEvent* event = &engine->queue[tail & (AUDIO_QUEUE_SIZE - 1)];
+
+        if((double)event->frame > engine->position)
+        {
+            break;
+        }
+
+        if(engine->position - (double)event->frame > AUDIO_FRAME_HZ / (double)engine->sample_rate)
+        {
+            atomic_fetch_add_explicit(&engine->late, 1, memory_order_relaxed);
+        }
+
+        audio_set_state(engine, &event->state);
+        ++tail;
+    }
+
+    if(tail != first)
+    {
+        atomic_store_explicit(&engine->tail, tail, memory_order_release);
+    }
+}
+
+static void audio_set_state(AudioEngine* engine, const AudioState* state)
+{
+    engine->state = *state;
+    engine->bits_per_sample = audio_pattern_rate(state->pitch) / (double)engine->sample_rate;
+    engine->samples_per_bit = 1.0 / engine->bits_per_sample;
+}
+
+// Adds a step for every level change within the next sample. The pattern only moves
+// while it sounds, so a silent machine costs nothing but the settling steps.
+static void audio_synthesize(AudioEngine* engine)
+{
+    if(!engine->state.is_sounding)
+    {
+        if(engine->level != 0.0f)
+        {
+            audio_add_step(engine, -engine->level, 0.0);
+            engine->level = 0.0f;
+        }
+
+        return;
+    }
+
+    uint32_t bit = (uint32_t)engine->phase;
+    const float first = audio_bit_level(engine, bit);
+
+    if(first != engine->level)
+    {
+        audio_add_step(engine, first - engine->level, 0.0);
+        engine->level = first;
+    }
+
+    for(double edge = (bit + 1.0 - engine->phase) * engine->samples_per_bit; edge < 1.0; edge += engine->samples_per_bit)
+    {
+        bit = (bit + 1) & (AUDIO_PATTERN_BITS - 1);
+        const float level = audio_bit_level(engine, bit);
+
+        if(level != engine->level)
+        {
+            audio_add_step(engine, level - engine->level, edge);
+            engine->level = level;
+        }
+    }
+
+    engine->phase += engine->bits_per_sample;
+    engine->phase -= engine->phase >= AUDIO_PATTERN_BITS ? AUDIO_PATTERN_BITS : 0.0;
+}
+
+static void audio_add_step(AudioEngine* engine, const float delta, const double offset)
+{
+    const float* step = engine->steps[(uint32_t)(offset * AUDIO_STEP_PHASES + 0.5)];
+
+    for(uint32_t k = 0; k < AUDIO_STEP_TAPS; ++k)
+    {
+        engine->ring[(engine->ring_at + k) & (AUDIO_RING_SIZE - 1)] += delta * (step[k] - 1.0f);
+    }
+
+    engine->held += delta;
+}
+
+static float audio_bit_level(const AudioEngine* engine, const uint32_t bit)
+{
+    return (engine->state.pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+}
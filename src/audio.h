@@ -0,0 +1,57 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// XO-CHIP audio. The tone is a 128 bit pattern played one bit at a time, at
+// 4000 * 2^((pitch - 64) / 48) bits per second, a set bit is high and a clear one low.
+//
+// The emulation thread queues every change of the pattern, pitch or sound timer,
+// stamped with the frame it happened in, and marks each frame it finished. The audio
+// callback plays those frames back at 60 per second, a buffer and a couple of frames
+// behind the newest, and applies each change on the sample its frame starts at. The
+// bit edges are band limited steps from a table, so high pitches do not alias. The
+// queue is a single producer single consumer ring, neither side ever waits.
+
+#define AUDIO_PATTERN_BYTES 16
+#define AUDIO_DEFAULT_PITCH 64
+
+typedef struct AudioState
+{
+    uint8_t pattern[AUDIO_PATTERN_BYTES];
+    uint8_t pitch;
+    bool is_sounding;
+} AudioState;
+
+typedef struct AudioStats
+{
+    uint64_t events;
+    // Changes lost to a full queue, and ones applied more than a sample after their frame
+    uint64_t dropped;
+    uint64_t late;
+    uint64_t samples;
+    uint64_t render_ns;
+} AudioStats;
+
+typedef struct AudioEngine AudioEngine;
+
+AudioEngine* audio_create(uint32_t sample_rate);
+void audio_destroy(AudioEngine* engine);
+
+// Emulation thread. The state the machine sounds from frame on, then the last frame run.
+void audio_push(AudioEngine* engine, uint64_t frame, const AudioState* state);
+void audio_advance(AudioEngine* engine, uint64_t frame);
+
+// Audio thread, fills mono samples
+void audio_render(AudioEngine* engine, int16_t* out, uint32_t count);
+
+// Either thread, the counters are only approximate while the other side runs
+void audio_get_stats(AudioEngine* engine, AudioStats* out);
+
+// Pattern bits played per second
+double audio_pattern_rate(uint8_t pitch);
+// The pattern a machine starts with, a square wave of 8 bits period
+void audio_default_pattern(uint8_t* pattern);
+
+#endif
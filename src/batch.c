@@ -0,0 +1,611 @@
+#include "batch.h"
+#include "codes.h"
+#include "simd.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Lanes are padded to this so every vector width divides the stride
+#define BATCH_LANE_ALIGN 32
+
+#define vec_nonzero(a) vec_xor(vec_eq((a), vec_set1(0)), vec_set1(0xFF))
+
+static uint16_t batch_fetch(const Chip8Batch* batch, uint32_t lane);
+static bool batch_is_lockstep_opcode(uint16_t instruction);
+static void batch_load_lane(const Chip8Batch* batch, uint32_t lane, Chip8* vm, bool with_display);
+static void batch_store_lane(Chip8Batch* batch, uint32_t lane, const Chip8* vm, bool with_display);
+static bool batch_execute_lane(Chip8Batch* batch, uint32_t lane);
+static void batch_set_pc(Chip8Batch* batch, uint16_t pc);
+static void batch_leave_group(Chip8Batch* batch, uint32_t lane, uint32_t remaining, uint32_t* members);
+static void batch_run_group(Chip8Batch* batch, uint32_t leader);
+static void batch_run_alu(Chip8Batch* batch, uint16_t instruction, const Chip8Quirks* quirks);
+static void batch_run_skip(Chip8Batch* batch, uint16_t instruction);
+static void batch_run_keys(Chip8Batch* batch, uint16_t instruction);
+static void batch_run_timers_and_index(Chip8Batch* batch, uint16_t instruction);
+static uint32_t batch_sprite_columns(uint8_t vx, uint8_t vy, const uint8_t* sprite, uint8_t rows, bool clip, uint8_t* column_index, uint32_t* column_bits);
+static bool batch_run_draw(Chip8Batch* batch, uint16_t instruction, uint32_t leader, const Chip8Quirks* quirks);
+
+Chip8Batch* chip8_batch_create(const uint32_t lane_count, const Chip8* prototype)
+{
+    Chip8Batch* batch = calloc(1, sizeof(Chip8Batch));
+
+    if(!batch || lane_count == 0)
+    {
+        free(batch);
+        return NULL;
+    }
+
+    batch->lane_count = lane_count;
+    batch->stride = (lane_count + BATCH_LANE_ALIGN - 1) / BATCH_LANE_ALIGN * BATCH_LANE_ALIGN;
+    batch->speed = prototype->speed;
+    batch->written_low = 0xFFFF;
+    batch->written_high = 0;
+    batch->pc = calloc(batch->stride, sizeof(uint16_t));
+    batch->index = calloc(batch->stride, sizeof(uint16_t));
+    batch->keys = calloc(batch->stride, sizeof(uint16_t));
+    batch->delay_timer = calloc(batch->stride, 1);
+    batch->sound_timer = calloc(batch->stride, 1);
+    batch->display = calloc((size_t)batch->stride * CHIP8_DISPLAY_COLUMNS, sizeof(uint32_t));
+    batch->machines = calloc(lane_count, sizeof(Chip8));
+    batch->remaining = calloc(batch->stride, sizeof(uint32_t));
+    batch->group = calloc(batch->stride, 1);
+    batch->ticks = calloc(batch->stride, 1);
+    batch->scratch = calloc(batch->stride, 1);
+    bool allocated = batch->pc && batch->index && batch->keys && batch->delay_timer && batch->sound_timer
+        && batch->display && batch->machines && batch->remaining && batch->group && batch->ticks && batch->scratch;
+
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        batch->v[i] = calloc(batch->stride, 1);
+        allocated = allocated && batch->v[i];
+    }
+
+    if(!allocated)
+    {
+        chip8_batch_destroy(batch);
+        return NULL;
+    }
+
+    for(uint32_t lane = 0; lane < lane_count; ++lane)
+    {
+        chip8_copy(&batch->machines[lane], prototype);
+        batch->keys[lane] = prototype->keys;
+        batch_store_lane(batch, lane, prototype, true);
+    }
+
+    return batch;
+}
+
+void chip8_batch_destroy(Chip8Batch* batch)
+{
+    if(!batch)
+    {
+        return;
+    }
+
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        free(batch->v[i]);
+    }
+
+    free(batch->scratch);
+    free(batch->ticks);
+    free(batch->group);
+    free(batch->remaining);
+
+    for(uint32_t lane = 0; batch->machines && lane < batch->lane_count; ++lane)
+    {
+        chip8_release(&batch->machines[lane]);
+    }
+
+    free(batch->machines);
+    free(batch->display);
+    free(batch->sound_timer);
+    free(batch->delay_timer);
+    free(batch->keys);
+    free(batch->index);
+    free(batch->pc);
+    free(batch);
+}
+
+void chip8_batch_set_keys(Chip8Batch* batch, const uint32_t lane, const uint16_t keys, const uint16_t keys_pressed)
+{
+    batch->keys[lane] = keys;
+    batch->machines[lane].keys = keys;
+    batch->machines[lane].keys_pressed = keys_pressed;
+}
+
+void chip8_batch_step(Chip8Batch* batch)
+{
+    for(uint32_t lane = 0; lane < batch->lane_count; ++lane)
+    {
+        Chip8* vm = &batch->machines[lane];
+        const bool running = !vm->halted && !vm->paused;
+        batch->remaining[lane] = running ? batch->speed : 0;
+        batch->ticks[lane] = running;
+
+        if(vm->paused)
+        {
+            // Key waits resolve through the scalar frame, which returns right after
+            batch_load_lane(batch, lane, vm, false);
+            chip8_step(vm);
+            batch_store_lane(batch, lane, vm, false);
+        }
+    }
+
+    // Lanes never interact within a frame, so each group runs through its whole
+    // instruction budget and only splits where its lanes branch apart
+    for(uint32_t leader = 0; leader < batch->lane_count; ++leader)
+    {
+        while(batch->remaining[leader] > 0)
+        {
+            batch_run_group(batch, leader);
+        }
+    }
+
+    for(uint32_t lane = 0; lane < batch->stride; ++lane)
+    {
+        batch->delay_timer[lane] -= batch->ticks[lane] & (batch->delay_timer[lane] > 0);
+        batch->sound_timer[lane] -= batch->ticks[lane] & (batch->sound_timer[lane] > 0);
+    }
+}
+
+void chip8_batch_get(const Chip8Batch* batch, const uint32_t lane, Chip8* out)
+{
+    chip8_copy(out, &batch->machines[lane]);
+    batch_load_lane(batch, lane, out, true);
+}
+
+static uint16_t batch_fetch(const Chip8Batch* batch, const uint32_t lane)
+{
+    return chip8_fetch(&batch->machines[lane], batch->pc[lane]);
+}
+
+// Opcodes with a lockstep kernel, everything else touches cold state and runs per lane
+static bool batch_is_lockstep_opcode(const uint16_t instruction)
+{
+    switch(instruction & 0xF000)
+    {
+        case 0x1000:
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x6000:
+        case 0x7000:
+        case 0x9000:
+        case 0xA000:
+        case 0xD000:
+            return true;
+        case 0xE000:
+            return BYTE(instruction) == 0x9E || BYTE(instruction) == 0xA1;
+        case 0xF000:
+            return BYTE(instruction) == 0x07 || BYTE(instruction) == 0x15 || BYTE(instruction) == 0x18
+                || BYTE(instruction) == 0x1E || BYTE(instruction) == 0x29;
+        case 0x8000:
+            // The scalar code orders the VF write differently per opcode, so VF operands stay scalar
+            return X(instruction) != 0xF && Y(instruction) != 0xF && (NIBBLE(instruction) <= 0x7 || NIBBLE(instruction) == 0xE);
+        default:
+            return false;
+    }
+}
+
+static void batch_load_lane(const Chip8Batch* batch, const uint32_t lane, Chip8* vm, const bool with_display)
+{
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        vm->v[i] = batch->v[i][lane];
+    }
+
+    vm->pc = batch->pc[lane];
+    vm->index = batch->index[lane];
+    vm->delay_timer = batch->delay_timer[lane];
+    vm->sound_timer = batch->sound_timer[lane];
+
+    for(uint32_t c = 0; with_display && c < CHIP8_DISPLAY_COLUMNS; ++c)
+    {
+        vm->display[c] = batch->display[c * batch->stride + lane];
+    }
+}
+
+static void batch_store_lane(Chip8Batch* batch, const uint32_t lane, const Chip8* vm, const bool with_display)
+{
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        batch->v[i][lane] = vm->v[i];
+    }
+
+    batch->pc[lane] = vm->pc;
+    batch->index[lane] = vm->index;
+    batch->delay_timer[lane] = vm->delay_timer;
+    batch->sound_timer[lane] = vm->sound_timer;
+
+    for(uint32_t c = 0; with_display && c < CHIP8_DISPLAY_COLUMNS; ++c)
+    {
+        batch->display[c * batch->stride + lane] = vm->display[c];
+    }
+}
+
+// Returns true when the lane halted or started waiting for a key
+static bool batch_execute_lane(Chip8Batch* batch, const uint32_t lane)
+{
+    Chip8* vm = &batch->machines[lane];
+    const uint16_t instruction = batch_fetch(batch, lane);
+    const bool with_display = (instruction & 0xF000) == 0xD000 || instruction == 0x00E0;
+
+    if((instruction & 0xF0FF) == 0xF033 || (instruction & 0xF0FF) == 0xF055)
+    {
+        const uint16_t last = batch->index[lane] + ((instruction & 0xF0FF) == 0xF033 ? 2 : X(instruction));
+        batch->written_low = batch->index[lane] < batch->written_low ? batch->index[lane] : batch->written_low;
+        batch->written_high = last > batch->written_high ? last : batch->written_high;
+    }
+
+    batch_load_lane(batch, lane, vm, with_display);
+    chip8_execute(vm);
+    batch_store_lane(batch, lane, vm, with_display);
+    ++batch->scalar_instructions;
+
+    if(vm->halted || vm->paused)
+    {
+        // Like chip8_step, a halt still ticks the timers and a key wait does not
+        batch->ticks[lane] = vm->halted;
+        return true;
+    }
+
+    return false;
+}
+
+static void batch_set_pc(Chip8Batch* batch, const uint16_t pc)
+{
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; ++lane)
+    {
+        batch->pc[lane] = batch->group[lane] ? pc : batch->pc[lane];
+    }
+}
+
+// Takes a lane out of the running group, it regroups later with what it has left
+static void batch_leave_group(Chip8Batch* batch, const uint32_t lane, const uint32_t remaining, uint32_t* members)
+{
+    batch->group[lane] = 0;
+    batch->remaining[lane] = remaining;
+    --*members;
+}
+
+// Forms a group of the lanes at the leader's pc with the leader's budget and runs it
+// until the budget is spent, dropping lanes whenever they branch away from the group
+static void batch_run_group(Chip8Batch* batch, const uint32_t leader)
+{
+    const uint32_t budget = batch->remaining[leader];
+    const uint16_t start_pc = batch->pc[leader];
+    // Every lane is a copy of the same prototype, so they share one profile
+    const Chip8Quirks* quirks = &Chip8ProfileQuirks[batch->machines[0].profile];
+    uint32_t members = 0;
+    uint32_t last = leader;
+
+    memset(batch->group, 0, batch->stride);
+
+    for(uint32_t lane = leader; lane < batch->lane_count; ++lane)
+    {
+        const bool member = batch->remaining[lane] == budget && batch->pc[lane] == start_pc;
+        batch->group[lane] = member ? 0xFF : 0x00;
+        members += member;
+        last = member ? lane : last;
+    }
+
+    batch->group_begin = leader / BATCH_LANE_ALIGN * BATCH_LANE_ALIGN;
+    batch->group_end = (last / BATCH_LANE_ALIGN + 1) * BATCH_LANE_ALIGN;
+    uint32_t first = leader;
+
+    for(uint32_t executed = 0; executed < budget && members > 0; ++executed)
+    {
+        const uint16_t pc = batch->pc[first];
+        const uint16_t instruction = batch_fetch(batch, first);
+
+        // Lanes only run different code at the same pc after writing to it, so the
+        // opcodes are compared only when pc is inside the range written so far
+        if(pc + 1 >= batch->written_low && pc <= batch->written_high)
+        {
+            for(uint32_t lane = first; lane <= last; ++lane)
+            {
+                if(batch->group[lane] && batch_fetch(batch, lane) != instruction)
+                {
+                    batch_leave_group(batch, lane, budget - executed, &members);
+                }
+            }
+        }
+
+        bool ran = batch_is_lockstep_opcode(instruction);
+        bool branched = false;
+
+        switch(ran ? instruction & 0xF000 : 0)
+        {
+            case 0x1000:
+                batch_set_pc(batch, ADDR(instruction));
+                break;
+            case 0x3000:
+            case 0x4000:
+            case 0x5000:
+            case 0x9000:
+                batch_run_skip(batch, instruction);
+                branched = true;
+                break;
+            case 0xA000:
+                for(uint32_t lane = batch->group_begin; lane < batch->group_end; ++lane)
+                {
+                    batch->index[lane] = batch->group[lane] ? ADDR(instruction) : batch->index[lane];
+                }
+
+                batch_set_pc(batch, (uint16_t)(pc + 2));
+                break;
+            case 0xD000:
+                ran = batch_run_draw(batch, instruction, first, quirks);
+                break;
+            case 0xE000:
+                batch_run_keys(batch, instruction);
+                branched = true;
+                break;
+            case 0xF000:
+                batch_run_timers_and_index(batch, instruction);
+                break;
+            case 0x6000:
+            case 0x7000:
+            case 0x8000:
+                batch_run_alu(batch, instruction, quirks);
+                break;
+        }
+
+        if(ran)
+        {
+            batch->lockstep_instructions += members;
+        }
+        else
+        {
+            branched = true;
+
+            for(uint32_t lane = first; lane <= last; ++lane)
+            {
+                if(batch->group[lane] && batch_execute_lane(batch, lane))
+                {
+                    batch_leave_group(batch, lane, 0, &members);
+                }
+            }
+        }
+
+        while(members > 0 && !batch->group[first])
+        {
+            ++first;
+        }
+
+        for(uint32_t lane = first + 1; branched && lane <= last; ++lane)
+        {
+            if(batch->group[lane] && batch->pc[lane] != batch->pc[first])
+            {
+                batch_leave_group(batch, lane, budget - executed - 1, &members);
+            }
+        }
+    }
+
+    for(uint32_t lane = leader; lane <= last; ++lane)
+    {
+        batch->remaining[lane] = batch->group[lane] ? 0 : batch->remaining[lane];
+    }
+}
+
+static void batch_run_alu(Chip8Batch* batch, const uint16_t instruction, const Chip8Quirks* quirks)
+{
+    const uint8_t x = X(instruction);
+    const uint8_t y = Y(instruction);
+    // 6xkk and 7xkk get their own codes next to the 8xy_ nibbles
+    const uint8_t op = (instruction & 0xF000) == 0x8000 ? NIBBLE(instruction) : (uint8_t)(0x10 | (instruction >> 12));
+    const SimdVec byte = vec_set1(BYTE(instruction));
+    const SimdVec one = vec_set1(0x01);
+    const SimdVec zero = vec_set1(0x00);
+    uint8_t* vx_lanes = batch->v[x];
+    const uint8_t* vy_lanes = batch->v[y];
+    uint8_t* vf_lanes = batch->v[0xF];
+
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; lane += SIMD_VEC_BYTES)
+    {
+        const SimdVec mask = vec_load(batch->group + lane);
+        const SimdVec vx = vec_load(vx_lanes + lane);
+        const SimdVec vy = vec_load(vy_lanes + lane);
+        const SimdVec vf = vec_load(vf_lanes + lane);
+        const SimdVec shifted = quirks->shift_vy ? vy : vx;
+        SimdVec result = vx;
+        SimdVec flag = vf;
+
+        switch(op)
+        {
+            case 0x16: result = byte; break;
+            case 0x17: result = vec_add(vx, byte); break;
+            case 0x0: result = vy; break;
+            case 0x1: result = vec_or(vx, vy); flag = quirks->vf_reset ? zero : vf; break;
+            case 0x2: result = vec_and(vx, vy); flag = quirks->vf_reset ? zero : vf; break;
+            case 0x3: result = vec_xor(vx, vy); flag = quirks->vf_reset ? zero : vf; break;
+            case 0x4:
+                result = vec_add(vx, vy);
+                flag = vec_and(vec_xor(vec_eq(vec_adds(vx, vy), result), vec_set1(0xFF)), one);
+                break;
+            case 0x5:
+                result = vec_sub(vx, vy);
+                flag = vec_and(vec_nonzero(vec_subs(vx, vy)), one);
+                break;
+            case 0x6:
+                result = vec_srl1(shifted);
+                flag = vec_and(shifted, one);
+                break;
+            case 0x7:
+                result = vec_sub(vy, vx);
+                flag = vec_and(vec_nonzero(vec_subs(vy, vx)), one);
+                break;
+            case 0xE:
+                result = vec_add(shifted, shifted);
+                flag = vec_and(vec_nonzero(vec_and(shifted, vec_set1(0x80))), one);
+                break;
+        }
+
+        vec_store(vx_lanes + lane, vec_select(mask, result, vx));
+
+        if(x != 0xF)
+        {
+            vec_store(vf_lanes + lane, vec_select(mask, flag, vf));
+        }
+    }
+
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; ++lane)
+    {
+        batch->pc[lane] += batch->group[lane] & 0x2;
+    }
+}
+
+static void batch_run_skip(Chip8Batch* batch, const uint16_t instruction)
+{
+    const SimdVec byte = vec_set1(BYTE(instruction));
+    const SimdVec two = vec_set1(0x02);
+    const uint8_t* vx_lanes = batch->v[X(instruction)];
+    const uint8_t* vy_lanes = batch->v[Y(instruction)];
+    const bool compare_register = (instruction & 0xF000) == 0x5000 || (instruction & 0xF000) == 0x9000;
+    const bool skip_if_equal = (instruction & 0xF000) == 0x3000 || (instruction & 0xF000) == 0x5000;
+
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; lane += SIMD_VEC_BYTES)
+    {
+        const SimdVec mask = vec_load(batch->group + lane);
+        const SimdVec equal = vec_eq(vec_load(vx_lanes + lane), compare_register ? vec_load(vy_lanes + lane) : byte);
+        const SimdVec taken = skip_if_equal ? equal : vec_xor(equal, vec_set1(0xFF));
+        vec_store(batch->scratch + lane, vec_and(mask, vec_add(two, vec_and(taken, two))));
+    }
+
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; ++lane)
+    {
+        batch->pc[lane] += batch->scratch[lane];
+    }
+}
+
+static void batch_run_keys(Chip8Batch* batch, const uint16_t instruction)
+{
+    const uint8_t* vx_lanes = batch->v[X(instruction)];
+    const uint16_t not_down = BYTE(instruction) == 0xA1;
+
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; ++lane)
+    {
+        const uint16_t taken = ((batch->keys[lane] >> (vx_lanes[lane] & 0xF)) & 0x1) ^ not_down;
+        batch->pc[lane] += batch->group[lane] & (2 + (taken << 1));
+    }
+}
+
+static void batch_run_timers_and_index(Chip8Batch* batch, const uint16_t instruction)
+{
+    uint8_t* vx_lanes = batch->v[X(instruction)];
+
+    for(uint32_t lane = batch->group_begin; lane < batch->group_end; ++lane)
+    {
+        const bool member = batch->group[lane] != 0;
+
+        switch(BYTE(instruction))
+        {
+            case 0x07: vx_lanes[lane] = member ? batch->delay_timer[lane] : vx_lanes[lane]; break;
+            case 0x15: batch->delay_timer[lane] = member ? vx_lanes[lane] : batch->delay_timer[lane]; break;
+            case 0x18: batch->sound_timer[lane] = member ? vx_lanes[lane] : batch->sound_timer[lane]; break;
+            case 0x1E: batch->index[lane] += member ? vx_lanes[lane] : 0; break;
+            case 0x29: batch->index[lane] = member ? (uint16_t)(D0 + (vx_lanes[lane] & 0xF) * 5) : batch->index[lane]; break;
+        }
+
+        batch->pc[lane] += batch->group[lane] & 0x2;
+    }
+}
+
+// Columns and bits a sprite covers, matching monitor_draw_sprite and its clipped
+// variant. Sprite pixels never overlap each other, so XORing whole columns is exact.
+static uint32_t batch_sprite_columns(const uint8_t vx, const uint8_t vy, const uint8_t* sprite, uint8_t rows,
+    const bool clip, uint8_t* column_index, uint32_t* column_bits)
+{
+    const uint8_t x = vx % CHIP8_DISPLAY_COLUMNS;
+    const uint8_t y = vy % CHIP8_DISPLAY_ROWS;
+    uint32_t columns = 8;
+
+    if(clip)
+    {
+        columns = CHIP8_DISPLAY_COLUMNS - x < 8 ? CHIP8_DISPLAY_COLUMNS - x : 8;
+        rows = CHIP8_DISPLAY_ROWS - y < rows ? CHIP8_DISPLAY_ROWS - y : rows;
+    }
+
+    for(uint32_t i = 0; i < columns; ++i)
+    {
+        uint32_t bits = 0;
+
+        for(uint32_t j = 0; j < rows; ++j)
+        {
+            bits |= (uint32_t)((sprite[j] >> (7 - i)) & 0x1) << ((y + j) % CHIP8_DISPLAY_ROWS);
+        }
+
+        column_index[i] = (uint8_t)((x + i) % CHIP8_DISPLAY_COLUMNS);
+        column_bits[i] = bits;
+    }
+
+    return columns;
+}
+
+// XORs each lane's sprite straight into the strided display. Lanes drawing the same
+// sprite at the same spot as the previous lane reuse its columns.
+static bool batch_run_draw(Chip8Batch* batch, const uint16_t instruction, const uint32_t leader, const Chip8Quirks* quirks)
+{
+    const uint8_t* vx_lanes = batch->v[X(instruction)];
+    const uint8_t* vy_lanes = batch->v[Y(instruction)];
+    const uint8_t rows = NIBBLE(instruction);
+    uint8_t* vf_lanes = batch->v[0xF];
+
+    for(uint32_t lane = leader; lane < batch->group_end; ++lane)
+    {
+        if(batch->group[lane] && batch->index[lane] + rows > CHIP8_RAM_SIZE)
+        {
+            return false;
+        }
+    }
+
+    uint8_t column_index[8];
+    uint32_t column_bits[8];
+    uint32_t columns = 0;
+    // Taken before the draw, Vx or Vy may be VF, which each lane overwrites with its collision
+    bool is_cached = false;
+    uint8_t cached_x = 0;
+    uint8_t cached_y = 0;
+    uint16_t cached_index = 0;
+
+    for(uint32_t lane = leader; lane < batch->group_end; ++lane)
+    {
+        if(!batch->group[lane])
+        {
+            continue;
+        }
+
+        const uint16_t index = batch->index[lane];
+        const uint8_t x = vx_lanes[lane];
+        const uint8_t y = vy_lanes[lane];
+        // Sprites only differ between lanes at the same I once one of them wrote there
+        const bool shared_sprite = index + rows <= batch->written_low || index > batch->written_high;
+
+        if(!is_cached || x != cached_x || y != cached_y || index != cached_index || !shared_sprite)
+        {
+            uint8_t scratch[16];
+            const uint8_t* sprite = chip8_span(&batch->machines[lane], index, rows, scratch);
+            columns = batch_sprite_columns(x, y, sprite, rows, quirks->clip_sprites, column_index, column_bits);
+            is_cached = true;
+            cached_x = x;
+            cached_y = y;
+            cached_index = index;
+        }
+
+        uint32_t collisions = 0;
+
+        for(uint32_t i = 0; i < columns; ++i)
+        {
+            uint32_t* column = &batch->display[column_index[i] * batch->stride + lane];
+            collisions |= *column & column_bits[i];
+            *column ^= column_bits[i];
+        }
+
+        vf_lanes[lane] = collisions != 0;
+    }
+
+    batch_set_pc(batch, (uint16_t)(batch->pc[leader] + 2));
+    return true;
+}
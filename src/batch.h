@@ -0,0 +1,53 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+// Many copies of one ROM stepped in lockstep. The registers, pc, I, timers, keys and
+// display are kept in structure-of-arrays form so lanes sharing a pc run ALU, skip,
+// key, timer and draw instructions as SIMD kernels. Everything else (calls, memory
+// and random numbers) falls back to chip8_execute one lane at a time.
+typedef struct Chip8Batch
+{
+    uint32_t lane_count;
+    // lane_count rounded up to the widest vector, padding lanes never run
+    uint32_t stride;
+    uint32_t speed;
+    uint8_t* v[16];
+    uint16_t* pc;
+    uint16_t* index;
+    uint16_t* keys;
+    uint8_t* delay_timer;
+    uint8_t* sound_timer;
+    // display[column * stride + lane]
+    uint32_t* display;
+    // Cold per lane state (ram, stack, flags). Its copies of the arrays above
+    // are only current while a lane runs on the scalar path.
+    Chip8* machines;
+    // Instructions each lane has left in the current frame
+    uint32_t* remaining;
+    // Lanes of the running group are 0xFF, only [group_begin, group_end) is scanned
+    uint8_t* group;
+    uint32_t group_begin;
+    uint32_t group_end;
+    uint8_t* ticks;
+    uint8_t* scratch;
+    // Address range any lane has stored to with Fx33/Fx55
+    uint16_t written_low;
+    uint16_t written_high;
+    uint64_t lockstep_instructions;
+    uint64_t scalar_instructions;
+} Chip8Batch;
+
+// Every lane starts as a copy of prototype
+Chip8Batch* chip8_batch_create(uint32_t lane_count, const Chip8* prototype);
+void chip8_batch_destroy(Chip8Batch* batch);
+void chip8_batch_set_keys(Chip8Batch* batch, uint32_t lane, uint16_t keys, uint16_t keys_pressed);
+// Runs one frame on every lane, equivalent to chip8_step on each of them
+void chip8_batch_step(Chip8Batch* batch);
+// Copies the full state of a lane out, for inspection and validation
+void chip8_batch_get(const Chip8Batch* batch, uint32_t lane, Chip8* out);
+
+#endif
@@ -1,7 +1,17 @@
+#include "analyze.h"
 #include "codes.h"
 #include "chip8.h"
+#include "export.h"
+#include "hash.h"
+#include "heatmap.h"
 #include "monitor.h"
+#include "netplay.h"
+#include "plugin.h"
+#include "speculate.h"
+#include "stream.h"
+#include "timing.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,40 +21,110 @@
 #define vm_default default:
 #define vm_break break;
 
+#define CHIP8_DEFAULT_SEED 0x2545F491
+#define CHIP8_DEFAULT_RUN_AHEAD 0
+
+// Only the frontend publishes g_chip8, the tests and headless tools drive their own machines
+#if !defined(RUN_TESTS) && !defined(CHIP8_HEADLESS)
+#define CHIP8_FRONTEND
+#endif
+
 Chip8 g_chip8;
 
-static void chip8_load_rom(const char* rom_path);
-static void chip8_vm_run(const uint16_t instruction);
-static void chip8_shutdown(void);
-void chip8_initialize(const char* rom);
-void chip8_cycle(void);
-void chip8_load_program(uint16_t* program, size_t program_size);
+#ifdef CHIP8_FRONTEND
+// Read by the debugger disassembly view
+Chip8Analysis g_chip8_analysis;
+static Exporter* s_exporter = NULL;
+static StreamServer* s_stream = NULL;
+// Frames run traced while the debug window shows the RAM heatmap or a plugin hooks instructions
+Chip8Trace g_chip8_trace = {.heatmap = NULL, .breakpoints = NULL};
+static PluginHost* s_plugins = NULL;
+// Set by CHIP8_SPECULATE, forks the machine while it waits for a key, see speculate.h
+KeySpeculator* g_chip8_speculator = NULL;
+static NetplaySession* s_netplay = NULL;
+static uint64_t s_netplay_desyncs = 0;
+// Set from the F1 panel, frames come from the ROM unless CHIP8_RUNAHEAD overrides them
+Chip8RunAhead g_chip8_runahead = {.mode = CHIP8_RUNAHEAD_OFF, .frames = 0, .cost_ns = 0};
+static int32_t s_runahead_frames = -1;
+static Chip8 s_runahead_scratch;
+// What the renderer draws, the display of g_chip8 or of the frame run ahead to
+static uint32_t s_presented[CHIP8_DISPLAY_COLUMNS];
+#endif
 
-#ifndef RUN_TESTS
-void chip8_run(void)
-{
-    monitor_initialize(chip8_initialize, chip8_cycle, chip8_shutdown);
-}
-#else
-void chip8_run_tests(void);
-void chip8_run(void)
+// ROMs that need a quirk profile other than modern, keyed by FNV-1a hash of the ROM image
+static const struct RomProfile
 {
-    chip8_run_tests();
-}
-#endif
+    uint64_t Hash;
+    Chip8Profile Profile;
+} RomProfiles[] = {
+    {0x4136390c5e362b68ull, CHIP8_PROFILE_COSMAC_VIP}, // Animal Race [Brian Astle]
+    {0x48f83df46b8ebcebull, CHIP8_PROFILE_COSMAC_VIP}, // Breakout [Carmelo Cortez, 1979]
+    {0xc346f686f56ab7d6ull, CHIP8_PROFILE_COSMAC_VIP}, // Coin Flipping [Carmelo Cortez, 1978]
+    {0x6a01b16d00737853ull, CHIP8_PROFILE_COSMAC_VIP}, // Craps [Camerlo Cortez, 1978]
+    {0x4c139ba88896ede1ull, CHIP8_PROFILE_COSMAC_VIP}, // Hi-Lo [Jef Winsor, 1978]
+    {0xd4911604c3f935c7ull, CHIP8_PROFILE_COSMAC_VIP}, // Kaleidoscope [Joseph Weisbecker, 1978]
+    {0x8bdf18db083ef860ull, CHIP8_PROFILE_COSMAC_VIP}, // Lunar Lander (Udo Pernisz, 1979)
+    {0xc1799734d41fd3f5ull, CHIP8_PROFILE_COSMAC_VIP}, // Mastermind FourRow (Robert Lindley, 1978)
+    {0x289ce14a5119ddbfull, CHIP8_PROFILE_COSMAC_VIP}, // Nim [Carmelo Cortez, 1978]
+    {0xd1c88acd90ba4541ull, CHIP8_PROFILE_COSMAC_VIP}, // Rocket [Joseph Weisbecker, 1978]
+    {0xd134b4cd125a3684ull, CHIP8_PROFILE_COSMAC_VIP}, // Russian Roulette [Carmelo Cortez, 1978]
+    {0xd1ae8ca64a995d4full, CHIP8_PROFILE_COSMAC_VIP}, // Sequence Shoot [Joyce Weisbecker]
+    {0x9e5eb66bf9a0eec0ull, CHIP8_PROFILE_COSMAC_VIP}, // Shooting Stars [Philip Baltzer, 1978]
+    {0x4baf9e72329a0a16ull, CHIP8_PROFILE_COSMAC_VIP}, // Slide [Joyce Weisbecker]
+    {0x9bf79e68b91a56d9ull, CHIP8_PROFILE_COSMAC_VIP}, // Space Intercept [Joseph Weisbecker, 1978]
+    {0x6a500484e148e957ull, CHIP8_PROFILE_COSMAC_VIP}, // Spooky Spot [Joseph Weisbecker, 1978]
+    {0x757373f9296128f5ull, CHIP8_PROFILE_COSMAC_VIP}, // Submarine [Carmelo Cortez, 1978]
+    {0x847ee1947d13f660ull, CHIP8_PROFILE_COSMAC_VIP}, // Sum Fun [Joyce Weisbecker]
+    {0xb7e1d74b387bede6ull, CHIP8_PROFILE_COSMAC_VIP}, // Wipe Off [Joseph Weisbecker]
+    {0x29bcab9b664d212bull, CHIP8_PROFILE_CHIP48}, // Blitz [David Winter]
+    {0xc86e8ff63fce668cull, CHIP8_PROFILE_CHIP48}, // Brix [Andreas Gustafsson, 1990]
+    {0x624b3eed64313f42ull, CHIP8_PROFILE_CHIP48}, // Pong [Paul Vervalin, 1990]
+    {0xec7ca0de3e110327ull, CHIP8_PROFILE_CHIP48}, // Syzygy [Roy Trevino, 1990]
+    {0x8d8a02fa3a2ed293ull, CHIP8_PROFILE_CHIP48}, // UFO [Lutz V, 1992]
+    {0xeae1357f230d90c5ull, CHIP8_PROFILE_CHIP48}, // Vers [JMN, 1991]
+    {0xcdaa32787deaa913ull, CHIP8_PROFILE_CHIP48}, // Vertical Brix [Paul Robson, 1996]
+    {0x0fd332d0bc68c9f2ull, CHIP8_PROFILE_SCHIP}, // Blinky [Hans Christian Egeberg, 1991]
+    {0x81d773ea7eb667bdull, CHIP8_PROFILE_SCHIP}, // Blinky [Hans Christian Egeberg] (alt)
+};
 
-void chip8_initialize(const char* rom)
+// Frames of run-ahead for ROMs that take more than a frame to show a key press,
+// measured with Chip8RunAhead --measure. Most games draw it the frame it is read.
+static const struct RomRunAhead
 {
-    memset(&g_chip8, 0, sizeof(g_chip8));
-    g_chip8.index = 0;
-    g_chip8.pc = PROGRAM_START;
-    g_chip8.sp = 0;
-    g_chip8.speed = 10;
-    g_chip8.halted = false;
-    g_chip8.paused = false;
+    uint64_t Hash;
+    uint8_t Frames;
+} RomRunAheads[] = {
+    {0x258f2c95d6adadc2ull, 4}, // Worm V4 [RB-Revival Studios, 2007]
+    {0x094d3e70a183482bull, 1}, // 15 Puzzle [Roger Ivie] (alt)
+    {0xe59fd57fa44ecb40ull, 1}, // 15 Puzzle [Roger Ivie]
+    {0x0180bf666f0b0f29ull, 1}, // Addition Problems [Paul C. Moews]
+    {0x4136390c5e362b68ull, 1}, // Animal Race [Brian Astle]
+    {0x3a88eb66f94c1482ull, 1}, // Biorhythm [Jef Winsor]
+    {0x29bcab9b664d212bull, 1}, // Blitz [David Winter]
+    {0xdd723d5d3554d0b9ull, 1}, // Deflection [John Fort]
+    {0xfec122e80d6cd1e3ull, 1}, // Figures
+    {0x1bbb10c8e5cadbb5ull, 1}, // Guess [David Winter] (alt)
+    {0x4e0489618c9c143aull, 1}, // Guess [David Winter]
+    {0x3f58eb4fa83dcd98ull, 1}, // Hidden [David Winter, 1996]
+    {0xd4911604c3f935c7ull, 3}, // Kaleidoscope [Joseph Weisbecker, 1978]
+    {0x8bdf18db083ef860ull, 3}, // Lunar Lander (Udo Pernisz, 1979)
+    {0xc1799734d41fd3f5ull, 1}, // Mastermind FourRow (Robert Lindley, 1978)
+    {0x2ee3a4a2d183c87eull, 1}, // Programmable Spacefighters [Jef Winsor]
+    {0x0e5b77e4bfa2356dull, 1}, // Rush Hour [Hap, 2006] (alt)
+    {0xc5a3bef40139590cull, 1}, // Rush Hour [Hap, 2006]
+    {0xd134b4cd125a3684ull, 1}, // Russian Roulette [Carmelo Cortez, 1978]
+    {0xd1ae8ca64a995d4full, 1}, // Sequence Shoot [Joyce Weisbecker]
+    {0x4baf9e72329a0a16ull, 3}, // Slide [Joyce Weisbecker]
+    {0x9bf79e68b91a56d9ull, 1}, // Space Intercept [Joseph Weisbecker, 1978]
+    {0x847ee1947d13f660ull, 4}, // Sum Fun [Joyce Weisbecker]
+    {0x3e2c2d43b296b74cull, 1}, // Tank
+    {0x6a1d654e47e39441ull, 1}, // Timebomb
+    {0xeae1357f230d90c5ull, 1}, // Vers [JMN, 1991]
+};
 
-    // Store font set into interpreter area of memory (0x000 to 0x1FF)
-    const uint8_t digits[] = {
+// Font set in the interpreter area of memory (0x000 to 0x1FF)
+static Chip8Page s_font_page = {
+    .bytes = {
         /*0*/0xF0, 0x90, 0x90, 0x90, 0xF0,
         /*1*/0x20, 0x60, 0x20, 0x20, 0x70,
         /*2*/0xF0, 0x10, 0xF0, 0x80, 0xF0,
@@ -61,501 +141,877 @@ void chip8_initialize(const char* rom)
         /*D*/0xE0, 0x90, 0x90, 0x90, 0xE0,
         /*E*/0xF0, 0x80, 0xF0, 0x80, 0xF0,
         /*F*/0xF0, 0x80, 0xF0, 0x80, 0x80
-    };
+    },
+    .refs = CHIP8_PAGE_STATIC
+};
+static Chip8Page s_zero_page = {.bytes = {0}, .refs = CHIP8_PAGE_STATIC};
 
-    memcpy(&g_chip8.ram[D0], digits, sizeof(digits));
+static void chip8_load_rom(Chip8* vm, const char* rom_path);
+static Chip8Page* chip8_page_create(const uint8_t* bytes, size_t size);
+static void chip8_page_retain(Chip8Page* page);
+static void chip8_page_release(Chip8Page* page);
+static void chip8_fault(Chip8* vm, Chip8Fault fault, uint16_t pc);
+static uint8_t chip8_random(Chip8* vm);
+static void chip8_step_with(Chip8* vm, bool (*frame)(Chip8* vm, const Chip8Trace* trace), const Chip8Trace* trace);
+static bool (*const Chip8Interpreters[CHIP8_PROFILE_COUNT])(Chip8* vm, const Chip8Trace* trace);
+static bool (*const Chip8TracedInterpreters[CHIP8_PROFILE_COUNT])(Chip8* vm, const Chip8Trace* trace);
+static void (*const Chip8Executors[CHIP8_PROFILE_COUNT])(Chip8* vm, uint16_t instruction, const Chip8Trace* trace);
+static void chip8_shutdown(void);
+#ifdef CHIP8_FRONTEND
+static void chip8_open_netplay(const char* netplay);
+static void chip8_open_plugins(const char* path);
+static void chip8_plugin_log(const char* name, const char* text);
+#endif
+void chip8_initialize(const char* rom);
+void chip8_cycle(void);
+void chip8_load_program(Chip8* vm, const uint16_t* program, size_t program_size);
 
-    if(strlen(rom) > 0)
+#ifndef RUN_TESTS
+void chip8_run(void)
+{
+#ifdef CHIP8_FRONTEND
+    // Setting CHIP8_LOG_LEVEL to debug, info, warn or error raises or lowers the level
+    // logged, levels below the one built with stay compiled out
+    static const char* LogLevelNames[] = {"debug", "info", "warn", "error"};
+    const char* log_level = getenv("CHIP8_LOG_LEVEL");
+
+    for(int level = LOG_DEBUG; log_level && level <= LOG_ERROR; ++level)
     {
-        monitor_log(LOG_INFO, "Loading ROM %s", rom);
-        chip8_load_rom(rom);
+        if(strcmp(log_level, LogLevelNames[level]) == 0)
+        {
+            logger_set_level(level);
+            log_level = NULL;
+        }
     }
 
-    monitor_clear();
-}
+    if(log_level)
+    {
+        monitor_log(LOG_WARNING, "Unknown CHIP8_LOG_LEVEL %s, expected debug, info, warn or error", log_level);
+    }
 
-void chip8_cycle(void)
-{
-    if(g_chip8.halted)
+    // Setting CHIP8_EXPORT publishes every frame to the named shared memory segment
+    const char* export_name = getenv("CHIP8_EXPORT");
+
+    if(export_name)
     {
-        return;
+        s_exporter = export_open(export_name);
+        monitor_log(s_exporter ? LOG_INFO : LOG_ERROR, "Exporting frames to shared memory %s", export_name);
     }
 
-    if(g_chip8.paused)
+    // Setting CHIP8_STREAM to a socket path or tcp:port streams the display to local viewers
+    const char* stream_address = getenv("CHIP8_STREAM");
+
+    if(stream_address)
     {
-        // The only instruction that pauses machine is waiting for key press
-        // The reason the code is removed from the main chip_vm_run function is because
-        // raylib returns true each time GetKeyPressed is called in the current frame.
-        // Because the vm may run more than one cycle per frame this caused back to back
-        // get key instructions to not wait for input.
+        s_stream = stream_open(stream_address, 1);
+        monitor_log(s_stream ? LOG_INFO : LOG_ERROR, "Streaming frames on %s", stream_address);
+    }
 
-        const uint16_t upper = (uint16_t)g_chip8.ram[g_chip8.pc];
-        const uint16_t lower = (uint16_t)g_chip8.ram[g_chip8.pc + 1];
-        const uint8_t x = X((upper << 8) | lower);
+    // Setting CHIP8_NETPLAY to player:local_port:host:remote_port plays against a remote peer
+    const char* netplay = getenv("CHIP8_NETPLAY");
 
-        uint8_t key;
-        const bool is_pressed = monitor_get_key(&key);
+    if(netplay)
+    {
+        chip8_open_netplay(netplay);
+    }
 
-        if(is_pressed)
-        {
-            g_chip8.v[x] = key;
-            g_chip8.paused = false;
-        }
+    // Setting CHIP8_PLUGINS to a directory loads the plugins in it, see chip8_plugin.h
+    const char* plugins = getenv("CHIP8_PLUGINS");
 
-        return;
+    if(plugins)
+    {
+        chip8_open_plugins(plugins);
+    }
+
+    // Setting CHIP8_SPECULATE forks key waits on that many threads, 0 for one per core
+    const char* speculate = getenv("CHIP8_SPECULATE");
+
+    if(speculate)
+    {
+        g_chip8_speculator = speculate_create((uint32_t)strtoul(speculate, NULL, 10));
+        monitor_log(g_chip8_speculator ? LOG_INFO : LOG_ERROR, "Speculating on key waits");
     }
 
-    for(uint32_t i = 0; i < g_chip8.speed; ++i)
+    // Setting CHIP8_RUNAHEAD to frames[:single|secondary] runs ahead from the start
+    const char* runahead = getenv("CHIP8_RUNAHEAD");
+
+    if(runahead)
     {
-        const uint16_t upper = (uint16_t)g_chip8.ram[g_chip8.pc];
-        const uint16_t lower = (uint16_t)g_chip8.ram[g_chip8.pc + 1];
-        chip8_vm_run((upper << 8) | lower);
+        char mode[16] = {0};
+        unsigned frames = 0;
 
-        if(g_chip8.paused)
+        if(sscanf(runahead, "%u:%15s", &frames, mode) >= 1)
         {
-            return;
+            s_runahead_frames = (int32_t)frames;
+            g_chip8_runahead.mode = strcmp(mode, "secondary") == 0 ? CHIP8_RUNAHEAD_SECONDARY : CHIP8_RUNAHEAD_SINGLE;
         }
     }
 
-    if(g_chip8.delay_timer > 0)
+    monitor_initialize(s_presented, chip8_initialize, chip8_cycle, chip8_shutdown);
+#else
+    monitor_initialize(g_chip8.display, chip8_initialize, chip8_cycle, chip8_shutdown);
+#endif
+}
+#else
+bool chip8_run_tests(void);
+void chip8_run(void)
+{
+    exit(chip8_run_tests() ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+#endif
+
+void chip8_initialize(const char* rom)
+{
+    chip8_reset(&g_chip8, CHIP8_DEFAULT_SEED);
+
+    if(strlen(rom) > 0)
     {
-        --g_chip8.delay_timer;
+        monitor_log(LOG_INFO, "Loading ROM %s", rom);
+        chip8_load_rom(&g_chip8, rom);
     }
 
-    if(g_chip8.sound_timer > 0)
+#ifdef CHIP8_FRONTEND
+    if(s_netplay)
     {
-        --g_chip8.sound_timer;
-        monitor_play_tone();
+        netplay_reset(s_netplay);
+        s_netplay_desyncs = 0;
     }
-    else
+
+    if(s_plugins)
     {
-        monitor_stop_tone();
+        plugin_rom_loaded(s_plugins, &g_chip8, rom);
+    }
+
+    if(g_chip8_speculator)
+    {
+        speculate_reset(g_chip8_speculator);
     }
+
+    g_chip8_runahead.frames = s_runahead_frames >= 0 ? (uint32_t)s_runahead_frames : g_chip8.run_ahead;
+    g_chip8_runahead.cost_ns = 0;
+    memcpy(s_presented, g_chip8.display, sizeof(s_presented));
+    monitor_log(LOG_INFO, "Run-ahead %s, %u frames", chip8_run_ahead_mode_name(g_chip8_runahead.mode), g_chip8_runahead.frames);
+#endif
 }
 
-void chip8_load_program(uint16_t* program, size_t program_size)
+void chip8_reset(Chip8* vm, const uint32_t seed)
 {
-    for(size_t i = 0, j = 0; i < program_size; ++i, j += 2)
+    chip8_release(vm);
+    memset(vm, 0, sizeof(*vm));
+    vm->index = 0;
+    vm->pc = PROGRAM_START;
+    vm->sp = 0;
+    vm->speed = 10;
+    vm->rng = seed != 0 ? seed : CHIP8_DEFAULT_SEED;
+    vm->fault = CHIP8_FAULT_NONE;
+    vm->halted = false;
+    vm->paused = false;
+    // A square wave of 8 bits period, 500 Hz at the default pitch
+    memset(vm->audio_pattern, 0xF0, sizeof(vm->audio_pattern));
+    vm->pitch = 64;
+    vm->pages[0] = &s_font_page;
+
+    for(uint32_t i = 1; i < CHIP8_PAGE_COUNT; ++i)
     {
-        const uint16_t instruction = program[i];
-        const uint8_t lower = (uint8_t)(instruction & 0xFF);
-        const uint8_t upper = (uint8_t)((instruction & 0xFF00) >> 8);
-        g_chip8.ram[g_chip8.pc + j] = upper;
-        g_chip8.ram[g_chip8.pc + j + 1] = lower;
+        vm->pages[i] = &s_zero_page;
     }
+
+    monitor_clear(vm->display);
 }
 
-static void chip8_vm_run(const uint16_t instruction)
+void chip8_copy(Chip8* dst, const Chip8* src)
 {
-    const uint16_t currentPC = g_chip8.pc;
+    if(dst == src)
+    {
+        return;
+    }
 
-    g_chip8.pc += 2;
+    for(uint32_t i = 0; i < CHIP8_PAGE_COUNT; ++i)
+    {
+        chip8_page_retain(src->pages[i]);
+    }
 
-    const uint8_t x = X(instruction);
-    const uint8_t y = Y(instruction);
+    chip8_release(dst);
+    *dst = *src;
+}
 
-    vm_switch(instruction, 0xF000)
+void chip8_release(Chip8* vm)
+{
+    for(uint32_t i = 0; i < CHIP8_PAGE_COUNT; ++i)
     {
-        vm_case(0x0000)
-        {
-            vm_switch(instruction, 0x00FF)
-            {
-                vm_case(0xE0)
-                {
-                    // CLS
-                    monitor_log(LOG_DEBUG, "%.04x: CLS", currentPC);
-                    monitor_clear();
-                    vm_break;
-                }
-                
-                vm_case(0xEE)
-                {
-                    // RET
-                    monitor_log(LOG_DEBUG, "%.04x: RET", currentPC);
-                    g_chip8.sp--;
-                    g_chip8.pc = g_chip8.stack[g_chip8.sp];
-                    g_chip8.stack[g_chip8.sp] = 0;
-                    vm_break;
-                }
-
-                vm_default
-                {
-                    // halt
-                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
-                    g_chip8.halted = true;
-                    vm_break;
-                }
-            }
+        chip8_page_release(vm->pages[i]);
+        vm->pages[i] = NULL;
+    }
+}
 
-            vm_break;
-        }
+bool chip8_load_rom_file(Chip8* vm, const char* rom_path)
+{
+    FILE* rom = fopen(rom_path, "rb");
 
-        vm_case(0x1000)
-        {
-            // JP addr
-            monitor_log(LOG_DEBUG, "%.04x: JP(0x%.04x)", currentPC, ADDR(instruction));
-            g_chip8.pc = ADDR(instruction);
-            vm_break;
-        }
+    if(!rom)
+    {
+        monitor_log(LOG_ERROR, "Failed to open ROM %s", rom_path);
+        return false;
+    }
 
-        vm_case(0x2000)
-        {
-            // CALL addr
-            monitor_log(LOG_DEBUG, "%.04x: CALL(0x%.04x)", currentPC, ADDR(instruction));
-            g_chip8.stack[g_chip8.sp] = g_chip8.pc;
-            g_chip8.sp++;
-            g_chip8.pc = ADDR(instruction);
-            vm_break;
-        }
+    uint8_t image[CHIP8_RAM_SIZE - PROGRAM_START];
+    const size_t capacity = sizeof(image);
+    const size_t rom_size = fread(image, sizeof(uint8_t), capacity, rom);
+    const bool too_large = rom_size == capacity && fgetc(rom) != EOF;
+    fclose(rom);
+
+    if(too_large)
+    {
+        monitor_log(LOG_ERROR, "ROM too large to fit in memory");
+    }
+
+    // The ROM pages belong to this machine and are shared with every copy made of it
+    for(size_t offset = 0; offset < rom_size; offset += CHIP8_PAGE_SIZE)
+    {
+        const size_t page_size = rom_size - offset < CHIP8_PAGE_SIZE ? rom_size - offset : CHIP8_PAGE_SIZE;
+        Chip8Page* page = chip8_page_create(&image[offset], page_size);
 
-        vm_case(0x3000)
+        if(!page)
         {
-            // SE Vx, byte
-            monitor_log(LOG_DEBUG, "%.04x: SE1(%d, 0x%.02x) // Skip if x == byte", currentPC, x, BYTE(instruction));
-            g_chip8.pc += (uint16_t)(g_chip8.v[x] == BYTE(instruction)) << 1;
-            vm_break;
+            monitor_log(LOG_ERROR, "Failed to allocate ROM pages");
+            return false;
         }
-        
-        vm_case(0x4000)
+
+        const size_t page_index = (PROGRAM_START + offset) / CHIP8_PAGE_SIZE;
+        chip8_page_release(vm->pages[page_index]);
+        vm->pages[page_index] = page;
+    }
+
+    vm->profile = chip8_profile_for_rom(image, rom_size);
+    vm->run_ahead = chip8_run_ahead_for_rom(image, rom_size);
+    monitor_log(LOG_INFO, "Using %s quirk profile", chip8_profile_name(vm->profile));
+
+    return rom_size > 0 && !too_large;
+}
+
+void chip8_cycle(void)
+{
+    uint8_t key = 0;
+    g_chip8.keys = monitor_get_keys_down();
+    g_chip8.keys_pressed = monitor_get_key(&key) ? (uint16_t)(1 << key) : 0;
+
+#ifdef CHIP8_FRONTEND
+    if(s_plugins)
+    {
+        plugin_keys(s_plugins, &g_chip8);
+    }
+
+    if(s_netplay)
+    {
+        // Frames only run once the remote keys are close enough to predict
+        if(!netplay_advance(s_netplay, &g_chip8, g_chip8.keys, timing_now_ns()))
         {
-            // SNE Vx, byte
-            monitor_log(LOG_DEBUG, "%.04x: SNE1(%d, 0x%.02x) // Skip if x != byte", currentPC, x, BYTE(instruction));
-            g_chip8.pc += (uint16_t)(g_chip8.v[x] != BYTE(instruction)) << 1;
-            vm_break;
+            return;
         }
-        
-        vm_case(0x5000)
+
+        NetplayStats stats;
+        netplay_get_stats(s_netplay, &stats);
+
+        if(stats.desyncs > s_netplay_desyncs)
         {
-            // SE Vx, Vy
-            monitor_log(LOG_DEBUG, "%.04x: SE2(%d, %d) // Skip if x == y", currentPC, x, y);
-            g_chip8.pc += (uint16_t)(g_chip8.v[x] == g_chip8.v[y]) << 1;
-            vm_break;
+            monitor_log(LOG_ERROR, "Netplay desync, machine hashes differ from frame %u", stats.desync_frame);
+            s_netplay_desyncs = stats.desyncs;
         }
-        
-        vm_case(0x6000)
+    }
+    else if(g_chip8_trace.heatmap || g_chip8_trace.breakpoints)
+    {
+        chip8_step_traced(&g_chip8, &g_chip8_trace);
+    }
+    else if(g_chip8_speculator && speculate_resolve(g_chip8_speculator, &g_chip8))
+    {
+        // The fork ran muted, the tone catches up with the frame it ran
+        monitor_set_audio(g_chip8.audio_pattern, g_chip8.pitch);
+
+        if(g_chip8.sound_timer > 0)
         {
-            // LD Vx, byte
-            monitor_log(LOG_DEBUG, "%.04x: LD1(%d, 0x%.02x) // x = byte", currentPC, x, BYTE(instruction));
-            g_chip8.v[x] = BYTE(instruction);
-            vm_break;
+            monitor_play_tone();
         }
-        
-        vm_case(0x7000)
+        else
         {
-            // ADD Vx, byte
-            monitor_log(LOG_DEBUG, "%.04x: ADD1(%d, 0x%.02x) // x += byte", currentPC, x, BYTE(instruction));
-            g_chip8.v[x] += BYTE(instruction);
-            vm_break;
+            monitor_stop_tone();
         }
-        
-        vm_case(0x8000)
+    }
+    else
+    {
+        chip8_step(&g_chip8);
+    }
+
+    // Netplay and traced frames are never adopted, so they are not forked either
+    if(g_chip8_speculator && !s_netplay && !g_chip8_trace.heatmap && !g_chip8_trace.breakpoints)
+    {
+        speculate_prepare(g_chip8_speculator, &g_chip8);
+    }
+
+    if(s_plugins)
+    {
+        plugin_frame_end(s_plugins, &g_chip8);
+    }
+
+    // Rolling back already shows netplay frames late, so netplay never runs ahead
+    const uint64_t start = timing_now_ns();
+    chip8_run_ahead(&g_chip8, &s_runahead_scratch, s_netplay ? CHIP8_RUNAHEAD_OFF : g_chip8_runahead.mode, g_chip8_runahead.frames, s_presented);
+    g_chip8_runahead.cost_ns = timing_now_ns() - start;
+#else
+    chip8_step(&g_chip8);
+#endif
+
+#ifdef CHIP8_FRONTEND
+    if(s_exporter)
+    {
+        export_publish(s_exporter, &g_chip8);
+    }
+
+    if(s_stream)
+    {
+        stream_publish(s_stream, 0, s_presented);
+    }
+#endif
+}
+
+void chip8_step(Chip8* vm)
+{
+    chip8_step_with(vm, Chip8Interpreters[vm->profile], NULL);
+}
+
+void chip8_step_traced(Chip8* vm, const Chip8Trace* trace)
+{
+    chip8_step_with(vm, Chip8TracedInterpreters[vm->profile], trace);
+}
+
+static void chip8_step_with(Chip8* vm, bool (*const frame)(Chip8* vm, const Chip8Trace* trace), const Chip8Trace* trace)
+{
+    vm->keys_read = 0;
+    vm->executed = 0;
+
+    if(vm->halted)
+    {
+        return;
+    }
+
+    if(vm->paused)
+    {
+        // The only instruction that pauses machine is waiting for key press
+        // The reason the code is removed from the main chip_vm_run function is because
+        // raylib returns true each time GetKeyPressed is called in the current frame.
+        // Because the vm may run more than one cycle per frame this caused back to back
+        // get key instructions to not wait for input.
+
+        const uint8_t x = chip8_read(vm, vm->pc) & 0x0F;
+
+        if(vm->keys_pressed)
         {
-            vm_switch(instruction, 0xF)
+            uint8_t key = 0;
+            while(!(vm->keys_pressed & (1 << key)))
             {
-                vm_case(0x0)
-                {
-                    // LD Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: LD2(%d, %d) // x = y", currentPC, x, y);
-                    g_chip8.v[x] = g_chip8.v[y];
-                    vm_break;
-                }
-                
-                vm_case(0x1)
-                {
-                    // OR Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: OR(%d, %d) // x |= y", currentPC, x, y);
-                    g_chip8.v[x] |= g_chip8.v[y];
-                    vm_break;
-                }
-                
-                vm_case(0x2)
-                {
-                    // AND Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: AND(%d, %d) // x &= y", currentPC, x, y);
-                    g_chip8.v[x] &= g_chip8.v[y];
-                    vm_break;
-                }
-                
-                vm_case(0x3)
-                {
-                    // XOR Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: XOR(%d, %d) // x ^= y", currentPC, x, y);
-                    g_chip8.v[x] ^= g_chip8.v[y];
-                    vm_break;
-                }
-                
-                vm_case(0x4)
-                {
-                    // ADD Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: ADD2(%d, %d) // x += y", currentPC, x, y);
-                    const uint8_t max_value = 0xFF - g_chip8.v[x];
-                    g_chip8.v[0xF] = max_value < g_chip8.v[y]; // Set carry flag
-                    g_chip8.v[x] += g_chip8.v[y];
-                    vm_break;
-                }
-                
-                vm_case(0x5)
-                {
-                    // SUB Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: SUB(%d, %d) // x -= y", currentPC, x, y);
-                    g_chip8.v[0xF] = g_chip8.v[x] > g_chip8.v[y]; // Set borrow flag
-                    g_chip8.v[x] -= g_chip8.v[y];
-                    vm_break;
-                }
-                
-                vm_case(0x6)
-                {
-                    // SHR Vx {, Vy}
-                    monitor_log(LOG_DEBUG, "%.04x: SHR(%d) // x >>= 1", currentPC, x);
-                    g_chip8.v[0xF] = g_chip8.v[x] & 0x1; // Set carry flag
-                    g_chip8.v[x] >>= 1;
-                    vm_break;
-                }
-                
-                vm_case(0x7)
-                {
-                    // SUBN Vx, Vy
-                    monitor_log(LOG_DEBUG, "%.04x: SUBN(%d, %d) // x = y - x", currentPC, x, y);
-                    g_chip8.v[0xF] = g_chip8.v[y] > g_chip8.v[x]; // Set borrow flag
-                    g_chip8.v[x] = g_chip8.v[y] - g_chip8.v[x];
-                    vm_break;
-                }
-                
-                vm_case(0xE)
-                {
-                    // SHL Vx {, Vy}
-                    monitor_log(LOG_DEBUG, "%.04x: SHL(%d) // x <<= 1", currentPC, x);
-                    g_chip8.v[0xF] = (g_chip8.v[x] & 0x80) > 0; // Set carry flag
-                    g_chip8.v[x] <<= 1;
-                    vm_break;
-                }
-
-                vm_default
-                {
-                    // halt
-                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
-                    g_chip8.halted = true;
-                    vm_break;
-                }
+                ++key;
             }
-            vm_break;
-        }
-        
-        vm_case(0x9000)
-        {
-            // SNE Vx, Vy
-            monitor_log(LOG_DEBUG, "%.04x: SNE2(%d, %d) // Skip if x != y", currentPC, x, y);
-            g_chip8.pc += (uint16_t)(g_chip8.v[x] != g_chip8.v[y]) << 1;
-            vm_break;
-        }
-        
-        vm_case(0xA000)
-        {
-            // LD I, addr
-            monitor_log(LOG_DEBUG, "%.04x: LDB(%d) // index = addr", currentPC, ADDR(instruction));
-            g_chip8.index = ADDR(instruction);
-            vm_break;
+
+            vm->v[x] = key;
+            vm->paused = false;
+            vm->keys_read = (uint16_t)(1u << key);
+            vm->key_read_pc = (uint16_t)(vm->pc - 2);
         }
-        
-        vm_case(0xB000)
+
+        return;
+    }
+
+    if(!frame(vm, trace))
+    {
+        return;
+    }
+
+    if(vm->delay_timer > 0)
+    {
+        --vm->delay_timer;
+    }
+
+    if(!vm->muted)
+    {
+        monitor_set_audio(vm->audio_pattern, vm->pitch);
+    }
+
+    if(vm->sound_timer > 0)
+    {
+        --vm->sound_timer;
+
+        if(!vm->muted)
         {
-            // JP V0, addr
-            monitor_log(LOG_DEBUG, "%.04x: JP1(%d) // pc = addr + V0", currentPC, ADDR(instruction));
-            g_chip8.pc = ADDR(instruction) + g_chip8.v[0];
-            vm_break;
+            monitor_play_tone();
         }
-        
-        vm_case(0xC000)
+    }
+    else if(!vm->muted)
+    {
+        monitor_stop_tone();
+    }
+}
+
+// Executes the single instruction at pc, for callers that interleave machines
+void chip8_execute(Chip8* vm)
+{
+    Chip8Executors[vm->profile](vm, chip8_fetch(vm, vm->pc), NULL);
+}
+
+void chip8_write(Chip8* vm, const uint16_t address, const uint8_t value)
+{
+    const uint16_t masked = address & (CHIP8_RAM_SIZE - 1);
+    Chip8Page** page = &vm->pages[masked / CHIP8_PAGE_SIZE];
+
+    // Shared pages are copied on the first write, a machine's own pages are written in place
+    if(atomic_load_explicit(&(*page)->refs, memory_order_acquire) != 1)
+    {
+        Chip8Page* copy = chip8_page_create((*page)->bytes, CHIP8_PAGE_SIZE);
+
+        if(!copy)
         {
-            // RND Vx, byte
-            monitor_log(LOG_DEBUG, "%.04x: RND(%d, 0x%.02x) // x = rand()", currentPC, x, BYTE(instruction));
-            g_chip8.v[x] = (rand() % 256) & BYTE(instruction);
-            vm_break;
+            monitor_log(LOG_ERROR, "Failed to copy page %.03x, write dropped", masked & ~(CHIP8_PAGE_SIZE - 1));
+            return;
         }
-        
-        vm_case(0xD000)
-        {
-            // DRW Vx, Vy, nibble
-            monitor_log(LOG_DEBUG, "%.04x: DRW(%d, %d, %d)", currentPC, x, y, NIBBLE(instruction));
-            monitor_draw_sprite(g_chip8.v[x], g_chip8.v[y], g_chip8.ram + g_chip8.index, NIBBLE(instruction), (bool*)&g_chip8.v[0xF]);
 
-            if(g_chip8.v[0xF])
-            {
-                monitor_log(LOG_DEBUG, "Collision detected");
-            }
+        chip8_page_release(*page);
+        *page = copy;
+    }
 
-            vm_break;
-        }
-        
-        // Keyboard instructions
-        vm_case(0xE000)
+    (*page)->bytes[masked % CHIP8_PAGE_SIZE] = value;
+}
+
+void chip8_read_range(const Chip8* vm, const uint16_t address, uint8_t* out, const size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        out[i] = chip8_read(vm, (uint16_t)(address + i));
+    }
+}
+
+const uint8_t* chip8_span(const Chip8* vm, const uint16_t address, const size_t count, uint8_t* scratch)
+{
+    const uint16_t masked = address & (CHIP8_RAM_SIZE - 1);
+
+    if(masked % CHIP8_PAGE_SIZE + count <= CHIP8_PAGE_SIZE)
+    {
+        return &vm->pages[masked / CHIP8_PAGE_SIZE]->bytes[masked % CHIP8_PAGE_SIZE];
+    }
+
+    chip8_read_range(vm, address, scratch, count);
+    return scratch;
+}
+
+uint32_t chip8_private_page_count(const Chip8* vm)
+{
+    uint32_t count = 0;
+
+    for(uint32_t i = 0; i < CHIP8_PAGE_COUNT; ++i)
+    {
+        count += atomic_load_explicit(&vm->pages[i]->refs, memory_order_relaxed) == 1;
+    }
+
+    return count;
+}
+
+const char* chip8_fault_name(const Chip8Fault fault)
+{
+    switch(fault)
+    {
+        case CHIP8_FAULT_NONE: return "none";
+        case CHIP8_FAULT_BAD_OPCODE: return "unknown opcode";
+        case CHIP8_FAULT_STACK_OVERFLOW: return "stack overflow";
+        case CHIP8_FAULT_STACK_UNDERFLOW: return "stack underflow";
+    }
+
+    return "unknown";
+}
+
+const char* chip8_profile_name(const Chip8Profile profile)
+{
+    switch(profile)
+    {
+        case CHIP8_PROFILE_MODERN: return "modern";
+        case CHIP8_PROFILE_COSMAC_VIP: return "COSMAC VIP";
+        case CHIP8_PROFILE_CHIP48: return "CHIP-48";
+        case CHIP8_PROFILE_SCHIP: return "SCHIP";
+        case CHIP8_PROFILE_COUNT: break;
+    }
+
+    return "unknown";
+}
+
+Chip8Profile chip8_profile_for_rom(const uint8_t* rom, const size_t rom_size)
+{
+    const uint64_t hash = hash_fnv1a64(rom, rom_size, HASH_FNV1A64_SEED);
+
+    for(size_t i = 0; i < sizeof(RomProfiles) / sizeof(RomProfiles[0]); ++i)
+    {
+        if(RomProfiles[i].Hash == hash)
         {
-            vm_switch(instruction, 0x00FF)
-            {
-                vm_case(0x9E)
-                {
-                    // SKP Vx
-                    monitor_log(LOG_DEBUG, "%.04x: SKP(%d) // Skip if key down", currentPC, x);
-                    g_chip8.pc += (uint16_t)(monitor_is_key_down(g_chip8.v[x])) << 1;
-                    vm_break;
-                }
-                
-                vm_case(0xA1)
-                {
-                    // SKNP Vx
-                    monitor_log(LOG_DEBUG, "%.04x: SKNP(%d) // Skip if key not down", currentPC, x);
-                    g_chip8.pc += (uint16_t)(monitor_is_key_down(g_chip8.v[x]) == 0) << 1;
-                    vm_break;
-                }
-
-                vm_default
-                {
-                    // halt
-                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
-                    g_chip8.halted = true;
-                    vm_break;
-                }
-            }
-            
-            vm_break;
+            return RomProfiles[i].Profile;
         }
-        
-        vm_case(0xF000)
-        {
-            vm_switch(instruction, 0x00FF)
-            {
-                vm_case(0x07)
-                {
-                    // LD Vx, DT
-                    monitor_log(LOG_DEBUG, "%.04x: LD6(%d) // x = delay timer", currentPC, x);
-                    g_chip8.v[x] = g_chip8.delay_timer;
-                    vm_break;
-                }
-                
-                vm_case(0x0A)
-                {
-                    // LD Vx, K
-                    monitor_log(LOG_DEBUG, "%.04x: LD3(%d) // x = get_key()", currentPC, x);
-                    g_chip8.paused = true;
-                    vm_break;
-                }
-                
-                vm_case(0x15)
-                {
-                    // LD DT, Vx
-                    monitor_log(LOG_DEBUG, "%.04x: LD5(%d) // delay timer = x", currentPC, x);
-                    g_chip8.delay_timer = g_chip8.v[x];
-                    vm_break;
-                }
-                
-                vm_case(0x18)
-                {
-                    // LD ST, Vx
-                    monitor_log(LOG_DEBUG, "%.04x: LD4(%d) // sound timer = x", currentPC, x);
-                    g_chip8.sound_timer = g_chip8.v[x];
-                    vm_break;
-                }
-                
-                vm_case(0x1E)
-                {
-                    // ADD I, Vx
-                    monitor_log(LOG_DEBUG, "%.04x: ADD3(%d) // index += x", currentPC, x);
-                    g_chip8.index += (uint16_t)g_chip8.v[x];
-                    vm_break;
-                }
-                
-                vm_case(0x29)
-                {
-                    // LD F, Vx
-                    monitor_log(LOG_DEBUG, "%.04x: LD7(%d) // index = font at x", currentPC, x);
-                    g_chip8.index = D0 + NIBBLE(g_chip8.v[x]) * 5;
-                    vm_break;
-                }
-                
-                vm_case(0x33)
-                {
-                    // LD B, Vx
-                    monitor_log(LOG_DEBUG, "%.04x: LD8(%d) // Store BCD of x at index", currentPC, x);
-                    const uint8_t value = g_chip8.v[x];
-                    const uint8_t ones = value % 10;
-                    const uint8_t tens = (value % 100) / 10;
-                    const uint8_t hundreds = value / 100;
-                    
-                    if(g_chip8.index >= PROGRAM_START)
-                    {
-                        g_chip8.ram[g_chip8.index] = hundreds;
-                        g_chip8.ram[g_chip8.index + 1] = tens;
-                        g_chip8.ram[g_chip8.index + 2] = ones;
-                    }
-                    else
-                    {
-                        monitor_log(LOG_WARNING, "LD8 failed: index out of bounds");
-                        g_chip8.paused = true;
-                    }
-                    
-                    vm_break;
-                }
-                
-                vm_case(0x55)
-                {
-                    // LD [I], Vx
-                    monitor_log(LOG_DEBUG, "%.04x: LD9(%d) // Store register 0 thru x into index", currentPC, x);
-                    for(uint8_t i = 0; i <= x; ++i)
-                    {
-                        if((g_chip8.index + i) >= PROGRAM_START)
-                        {
-                            g_chip8.ram[g_chip8.index + i] = g_chip8.v[i];
-                        }
-                        else
-                        {
-                            monitor_log(LOG_WARNING, "LD9 failed: index out of bounds");
-                            g_chip8.paused = true;
-                        }
-                    }
-                    
-                    vm_break;
-                }
-                
-                vm_case(0x65)
-                {
-                    // LD Vx, [I]
-                    monitor_log(LOG_DEBUG, "%.04x: LDA(%d) // load registers 0 thru x with values starting at index", currentPC, x);
-                    for(uint8_t i = 0; i <= x; ++i)
-                    {
-                        g_chip8.v[i] = g_chip8.ram[g_chip8.index + i];
-                    }
-
-                    vm_break;
-                }
-
-                vm_default
-                {
-                    // halt
-                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
-                    g_chip8.halted = true;
-                    vm_break;
-                }
-            }
+    }
 
-            vm_break;
-        }
+    return CHIP8_PROFILE_MODERN;
+}
+
+uint8_t chip8_run_ahead_for_rom(const uint8_t* rom, const size_t rom_size)
+{
+    const uint64_t hash = hash_fnv1a64(rom, rom_size, HASH_FNV1A64_SEED);
 
-        vm_default
+    for(size_t i = 0; i < sizeof(RomRunAheads) / sizeof(RomRunAheads[0]); ++i)
+    {
+        if(RomRunAheads[i].Hash == hash)
         {
-            // halt
-            monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
-            g_chip8.halted = true;
-            vm_break;
+            return RomRunAheads[i].Frames;
         }
     }
+
+    return CHIP8_DEFAULT_RUN_AHEAD;
 }
 
+void chip8_run_ahead(Chip8* vm, Chip8* scratch, const Chip8RunAheadMode mode, const uint32_t frames, uint32_t* display)
+{
+    if(mode == CHIP8_RUNAHEAD_OFF || frames == 0)
+    {
+        memcpy(display, vm->display, sizeof(vm->display));
+        return;
+    }
+
+    // Copies share RAM pages, so saving the machine costs one struct copy
+    chip8_copy(scratch, vm);
+    Chip8* ahead = mode == CHIP8_RUNAHEAD_SECONDARY ? scratch : vm;
+    ahead->muted = mode == CHIP8_RUNAHEAD_SECONDARY;
+    // The key press was taken by the frame that really ran, later frames only see keys held
+    ahead->keys_pressed = 0;
+
+    for(uint32_t i = 0; i < frames; ++i)
+    {
+        chip8_step(ahead);
+    }
+
+    memcpy(display, ahead->display, sizeof(ahead->display));
+
+    if(mode == CHIP8_RUNAHEAD_SINGLE)
+    {
+        chip8_copy(vm, scratch);
+    }
+}
+
+const char* chip8_run_ahead_mode_name(const Chip8RunAheadMode mode)
+{
+    switch(mode)
+    {
+        case CHIP8_RUNAHEAD_OFF: return "off";
+        case CHIP8_RUNAHEAD_SINGLE: return "single";
+        case CHIP8_RUNAHEAD_SECONDARY: return "secondary";
+        case CHIP8_RUNAHEAD_MODE_COUNT: break;
+    }
+
+    return "unknown";
+}
+
+void chip8_load_program(Chip8* vm, const uint16_t* program, const size_t program_size)
+{
+    for(size_t i = 0, j = 0; i < program_size; ++i, j += 2)
+    {
+        const uint16_t instruction = program[i];
+        const uint8_t lower = (uint8_t)(instruction & 0xFF);
+        const uint8_t upper = (uint8_t)((instruction & 0xFF00) >> 8);
+        chip8_write(vm, (uint16_t)(vm->pc + j), upper);
+        chip8_write(vm, (uint16_t)(vm->pc + j + 1), lower);
+    }
+}
+
+static Chip8Page* chip8_page_create(const uint8_t* bytes, const size_t size)
+{
+    Chip8Page* page = malloc(sizeof(Chip8Page));
+
+    if(!page)
+    {
+        return NULL;
+    }
+
+    memcpy(page->bytes, bytes, size);
+    memset(page->bytes + size, 0, CHIP8_PAGE_SIZE - size);
+    atomic_init(&page->refs, 1);
+    return page;
+}
+
+static void chip8_page_retain(Chip8Page* page)
+{
+    if(page && atomic_load_explicit(&page->refs, memory_order_relaxed) != CHIP8_PAGE_STATIC)
+    {
+        atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+    }
+}
+
+static void chip8_page_release(Chip8Page* page)
+{
+    if(page && atomic_load_explicit(&page->refs, memory_order_relaxed) != CHIP8_PAGE_STATIC
+        && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1)
+    {
+        free(page);
+    }
+}
+
+static void chip8_fault(Chip8* vm, const Chip8Fault fault, const uint16_t pc)
+{
+    vm->fault = fault;
+    vm->fault_pc = pc;
+    vm->halted = true;
+}
+
+static uint8_t chip8_random(Chip8* vm)
+{
+    // xorshift32, kept per machine so runs are reproducible and thread safe
+    uint32_t state = vm->rng;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    vm->rng = state;
+    return (uint8_t)(state >> 24);
+}
+
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_modern
+#define CHIP8_INTERPRETER_FRAME chip8_frame_modern
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_LOAD_STORE_INDEX(x) 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_JUMP_VX 0
+#define QUIRK_DRAW_SPRITE monitor_draw_sprite
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#define CHIP8_INTERPRETER_TRACE
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_modern_traced
+#define CHIP8_INTERPRETER_FRAME chip8_frame_modern_traced
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_TRACE
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_LOAD_STORE_INDEX
+#undef QUIRK_VF_RESET
+#undef QUIRK_JUMP_VX
+#undef QUIRK_DRAW_SPRITE
+
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_cosmac_vip
+#define CHIP8_INTERPRETER_FRAME chip8_frame_cosmac_vip
+#define QUIRK_SHIFT_VY 1
+#define QUIRK_LOAD_STORE_INDEX(x) ((x) + 1)
+#define QUIRK_VF_RESET 1
+#define QUIRK_JUMP_VX 0
+#define QUIRK_DRAW_SPRITE monitor_draw_sprite_clipped
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#define CHIP8_INTERPRETER_TRACE
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_cosmac_vip_traced
+#define CHIP8_INTERPRETER_FRAME chip8_frame_cosmac_vip_traced
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_TRACE
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_LOAD_STORE_INDEX
+#undef QUIRK_VF_RESET
+#undef QUIRK_JUMP_VX
+#undef QUIRK_DRAW_SPRITE
+
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_chip48
+#define CHIP8_INTERPRETER_FRAME chip8_frame_chip48
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_LOAD_STORE_INDEX(x) (x)
+#define QUIRK_VF_RESET 0
+#define QUIRK_JUMP_VX 1
+#define QUIRK_DRAW_SPRITE monitor_draw_sprite_clipped
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#define CHIP8_INTERPRETER_TRACE
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_chip48_traced
+#define CHIP8_INTERPRETER_FRAME chip8_frame_chip48_traced
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_TRACE
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_LOAD_STORE_INDEX
+#undef QUIRK_VF_RESET
+#undef QUIRK_JUMP_VX
+#undef QUIRK_DRAW_SPRITE
+
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_schip
+#define CHIP8_INTERPRETER_FRAME chip8_frame_schip
+#define QUIRK_SHIFT_VY 0
+#define QUIRK_LOAD_STORE_INDEX(x) 0
+#define QUIRK_VF_RESET 0
+#define QUIRK_JUMP_VX 1
+#define QUIRK_DRAW_SPRITE monitor_draw_sprite_clipped
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#define CHIP8_INTERPRETER_TRACE
+#define CHIP8_INTERPRETER_RUN chip8_vm_run_schip_traced
+#define CHIP8_INTERPRETER_FRAME chip8_frame_schip_traced
+#include "chip8_interpreter.h"
+#undef CHIP8_INTERPRETER_TRACE
+#undef CHIP8_INTERPRETER_RUN
+#undef CHIP8_INTERPRETER_FRAME
+#undef QUIRK_SHIFT_VY
+#undef QUIRK_LOAD_STORE_INDEX
+#undef QUIRK_VF_RESET
+#undef QUIRK_JUMP_VX
+#undef QUIRK_DRAW_SPRITE
+
+// Indexed by Chip8Profile
+static bool (*const Chip8Interpreters[CHIP8_PROFILE_COUNT])(Chip8* vm, const Chip8Trace* trace) = {
+    chip8_frame_modern,
+    chip8_frame_cosmac_vip,
+    chip8_frame_chip48,
+    chip8_frame_schip
+};
+
+static bool (*const Chip8TracedInterpreters[CHIP8_PROFILE_COUNT])(Chip8* vm, const Chip8Trace* trace) = {
+    chip8_frame_modern_traced,
+    chip8_frame_cosmac_vip_traced,
+    chip8_frame_chip48_traced,
+    chip8_frame_schip_traced
+};
+
+static void (*const Chip8Executors[CHIP8_PROFILE_COUNT])(Chip8* vm, uint16_t instruction, const Chip8Trace* trace) = {
+    chip8_vm_run_modern,
+    chip8_vm_run_cosmac_vip,
+    chip8_vm_run_chip48,
+    chip8_vm_run_schip
+};
+
+// Keep in sync with the QUIRK_* constants above
+const Chip8Quirks Chip8ProfileQuirks[CHIP8_PROFILE_COUNT] = {
+    [CHIP8_PROFILE_MODERN] = {.shift_vy = false, .vf_reset = false, .jump_vx = false, .clip_sprites = false, .load_store_extra = -1},
+    [CHIP8_PROFILE_COSMAC_VIP] = {.shift_vy = true, .vf_reset = true, .jump_vx = false, .clip_sprites = true, .load_store_extra = 1},
+    [CHIP8_PROFILE_CHIP48] = {.shift_vy = false, .vf_reset = false, .jump_vx = true, .clip_sprites = true, .load_store_extra = 0},
+    [CHIP8_PROFILE_SCHIP] = {.shift_vy = false, .vf_reset = false, .jump_vx = true, .clip_sprites = true, .load_store_extra = -1},
+};
+
 static void chip8_shutdown(void)
 {
     printf("Shutdown chip8 emulation\n");
+
+#ifdef CHIP8_FRONTEND
+    export_close(s_exporter);
+    s_exporter = NULL;
+
+    if(s_stream)
+    {
+        StreamStats stats;
+        stream_get_stats(s_stream, &stats);
+        monitor_log(LOG_INFO, "Stream: %llu frames, %llu viewers, %llu keyframes, %llu deltas, %llu frames dropped, %llu bytes",
+            (unsigned long long)stats.frames_published, (unsigned long long)stats.viewers_served, (unsigned long long)stats.keyframes,
+            (unsigned long long)stats.deltas, (unsigned long long)stats.dropped, (unsigned long long)stats.bytes);
+        stream_close(s_stream);
+        s_stream = NULL;
+    }
+
+    chip8_release(&s_runahead_scratch);
+
+    // The breakpoint table belongs to the plugin host
+    g_chip8_trace.breakpoints = NULL;
+    plugin_host_destroy(s_plugins);
+    s_plugins = NULL;
+
+    if(g_chip8_speculator)
+    {
+        SpeculateStats stats;
+        speculate_get_stats(g_chip8_speculator, &stats);
+        monitor_log(LOG_INFO, "Speculation: %llu of %llu key presses adopted a fork, %llu forks, %.3f ms forking",
+            (unsigned long long)stats.hits, (unsigned long long)stats.presses, (unsigned long long)stats.forks,
+            (double)stats.fork_ns / 1e6);
+        speculate_destroy(g_chip8_speculator);
+        g_chip8_speculator = NULL;
+    }
+
+    if(s_netplay)
+    {
+        NetplayStats stats;
+        netplay_get_stats(s_netplay, &stats);
+        monitor_log(LOG_INFO, "Netplay: %llu frames, %llu stalls, %llu rollbacks, %llu frames re-simulated, longest rollback %.3f ms, %llu desyncs",
+            (unsigned long long)stats.frames, (unsigned long long)stats.stalls, (unsigned long long)stats.rollbacks,
+            (unsigned long long)stats.resimulated_frames, (double)stats.max_rollback_ns / 1e6, (unsigned long long)stats.desyncs);
+        netplay_destroy(s_netplay);
+        s_netplay = NULL;
+    }
+#endif
+}
+
+#ifdef CHIP8_FRONTEND
+static void chip8_open_plugins(const char* path)
+{
+    s_plugins = plugin_host_create(chip8_plugin_log);
+
+    if(!s_plugins)
+    {
+        return;
+    }
+
+    const uint32_t loaded = plugin_load_directory(s_plugins, path);
+    monitor_log(loaded > 0 ? LOG_INFO : LOG_WARNING, "Loaded %u plugins from %s", loaded, path);
+
+    if(loaded == 0)
+    {
+        plugin_host_destroy(s_plugins);
+        s_plugins = NULL;
+        return;
+    }
+
+    // Marked instructions only stop frames while a plugin hooks any, the rest run untraced
+    g_chip8_trace.breakpoints = plugin_breakpoints(s_plugins);
+}
+
+static void chip8_plugin_log(const char* name, const char* text)
+{
+    monitor_log(LOG_INFO, "Plugin %s: %s", name, text);
+}
+
+static void chip8_open_netplay(const char* netplay)
+{
+    unsigned player = 0;
+    unsigned local_port = 0;
+    unsigned remote_port = 0;
+    char host[64] = {0};
+
+    if(sscanf(netplay, "%u:%u:%63[^:]:%u", &player, &local_port, host, &remote_port) != 4 || player > 1)
+    {
+        monitor_log(LOG_ERROR, "CHIP8_NETPLAY must be player:local_port:host:remote_port, got %s", netplay);
+        return;
+    }
+
+    NetplayConfig config = {
+        .local_port = (uint16_t)local_port,
+        .remote_host = host,
+        .remote_port = (uint16_t)remote_port,
+        .local_player = (uint8_t)player,
+        .max_prediction = 0,
+        .delay_ms = 0,
+        .jitter_ms = 0,
+        .loss_percent = 0,
+        .seed = 1
+    };
+
+    // CHIP8_NETPLAY_SIM=delay_ms:jitter_ms:loss_percent simulates a bad network over loopback
+    const char* sim = getenv("CHIP8_NETPLAY_SIM");
+
+    if(sim)
+    {
+        sscanf(sim, "%u:%u:%u", &config.delay_ms, &config.jitter_ms, &config.loss_percent);
+    }
+
+    s_netplay = netplay_create(&config);
+    monitor_log(s_netplay ? LOG_INFO : LOG_ERROR, "Netplay as player %u on port %u with %s:%u", player, local_port, host, remote_port);
 }
+#endif
 
-static void chip8_load_rom(const char* rom_path)
+static void chip8_load_rom(Chip8* vm, const char* rom_path)
 {
 // If you want to write your own test program then uncomment the following #define and update program.h with your Chip8 program.
 //#define TEST_PROGRAM
@@ -567,42 +1023,23 @@ static void chip8_load_rom(const char* rom_path)
         const uint16_t instruction = program[i];
         const uint8_t lower = (uint8_t)(instruction & 0xFF);
         const uint8_t upper = (uint8_t)((instruction & 0xFF00) >> 8);
-        g_chip8.ram[g_chip8.pc + i * 2] = upper;
-        g_chip8.ram[g_chip8.pc + i * 2 + 1] = lower;
+        chip8_write(vm, (uint16_t)(vm->pc + i * 2), upper);
+        chip8_write(vm, (uint16_t)(vm->pc + i * 2 + 1), lower);
     }
 #else
-    FILE* rom = fopen(rom_path, "rb");
-    uint8_t* write_ptr = &g_chip8.ram[g_chip8.pc];
-    size_t rom_size = 0;
-
-    if(rom)
+    if(chip8_load_rom_file(vm, rom_path))
     {
-        monitor_log(LOG_INFO, "ROM opened");
-        uint8_t buffer[256];
-        size_t bytes_read = fread(buffer, sizeof(uint8_t), sizeof(buffer), rom);
-        
-        while(bytes_read > 0)
-        {
-            if(write_ptr - &g_chip8.ram[g_chip8.pc] >= (ptrdiff_t)(0xFFF - PROGRAM_START))
-            {
-                monitor_log(LOG_ERROR, "ROM too large to fit in memory");
-                break;
-            }
+        monitor_log(LOG_INFO, "ROM loaded");
 
-            memcpy(write_ptr, buffer, bytes_read);
-            write_ptr += bytes_read;
-            rom_size += bytes_read;
-
-            if(feof(rom))
-            {
-                monitor_log(LOG_DEBUG, "EOF reached");
-                break;
-            }
-            
-            bytes_read = fread(buffer, sizeof(uint8_t), sizeof(buffer), rom);
+#ifdef CHIP8_FRONTEND
+        // Cached next to the ROM, so only the first load of a ROM pays for the analysis
+        if(chip8_analyze_file(rom_path, true, &g_chip8_analysis))
+        {
+            monitor_log(LOG_INFO, "ROM analysis: %u instructions in %u blocks, %u data bytes, %u indirect jumps, %u self-modifying writes",
+                g_chip8_analysis.instruction_count, g_chip8_analysis.block_count, g_chip8_analysis.data_bytes,
+                g_chip8_analysis.indirect_jumps, g_chip8_analysis.self_modifying_writes);
         }
-        
-        monitor_log(LOG_INFO, "ROM close %s", fclose(rom) == 0 ? "successful" : "failed");
+#endif
     }
 #endif
 }
@@ -1,12 +1,63 @@
 #ifndef CHIP8_H
 #define CHIP8_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#define CHIP8_RAM_SIZE 4096
+#define CHIP8_PAGE_SIZE 256
+#define CHIP8_PAGE_COUNT (CHIP8_RAM_SIZE / CHIP8_PAGE_SIZE)
+#define CHIP8_DISPLAY_COLUMNS 64
+#define CHIP8_DISPLAY_ROWS 32
+
+typedef enum Chip8Fault
+{
+    CHIP8_FAULT_NONE,
+    CHIP8_FAULT_BAD_OPCODE,
+    CHIP8_FAULT_STACK_OVERFLOW,
+    CHIP8_FAULT_STACK_UNDERFLOW,
+} Chip8Fault;
+
+// Quirk profiles, each runs on its own specialized interpreter
+typedef enum Chip8Profile
+{
+    CHIP8_PROFILE_MODERN,
+    CHIP8_PROFILE_COSMAC_VIP,
+    CHIP8_PROFILE_CHIP48,
+    CHIP8_PROFILE_SCHIP,
+    CHIP8_PROFILE_COUNT
+} Chip8Profile;
+
+// Quirk flags of each profile, matching the constants the interpreters are specialized with
+typedef struct Chip8Quirks
+{
+    bool shift_vy;
+    bool vf_reset;
+    bool jump_vx;
+    bool clip_sprites;
+    // Fx55/Fx65 add x + load_store_extra to I, or leave I alone when negative
+    int8_t load_store_extra;
+} Chip8Quirks;
+
+extern const Chip8Quirks Chip8ProfileQuirks[CHIP8_PROFILE_COUNT];
+
+// Guest RAM is a table of pages shared copy on write between machines. Reset points
+// every page at the shared font and zero pages, a loaded ROM owns the pages it fills
+// and copies of the machine share them, and Fx33/Fx55 copy a page on its first write.
+typedef struct Chip8Page
+{
+    uint8_t bytes[CHIP8_PAGE_SIZE];
+    // Machines using the page, CHIP8_PAGE_STATIC for the font and zero pages
+    atomic_uint refs;
+} Chip8Page;
+
+#define CHIP8_PAGE_STATIC 0xFFFFFFFFu
+
 typedef struct Chip8
 {
-    uint8_t ram[4096];
+    Chip8Page* pages[CHIP8_PAGE_COUNT];
     uint8_t v[16];
     uint16_t stack[16];
     uint16_t index;
@@ -14,11 +65,121 @@ typedef struct Chip8
     uint8_t sp;
     uint8_t delay_timer;
     uint8_t sound_timer;
+    // XO-CHIP audio, the 128 bit pattern F002 loads from I and the pitch Fx3A sets
+    uint8_t audio_pattern[16];
+    uint8_t pitch;
     uint32_t speed;
+    // Instructions the last frame ran, fewer than speed when it waited for a key or halted
+    uint32_t executed;
+    // Display is stored column major, bit n of a column is row n
+    uint32_t display[CHIP8_DISPLAY_COLUMNS];
+    uint32_t rng;
+    // Keypad state for the current frame, bit n is key n
+    uint16_t keys;
+    uint16_t keys_pressed;
+    // Keys SKP, SKNP and Fx0A looked at in the last frame, and the first of them to do so
+    uint16_t keys_read;
+    uint16_t key_read_pc;
+    uint16_t fault_pc;
+    Chip8Fault fault;
+    Chip8Profile profile;
+    // Frames the ROM takes to show a key press, the run-ahead recommended for it
+    uint8_t run_ahead;
     bool halted;
     bool paused;
+    // Leaves the tone alone, for machines running ahead of the one that is heard
+    bool muted;
 } Chip8;
 
+// Run-ahead shows the frame N frames past the current one, so games that read keys a
+// few frames before drawing the result feel as responsive as those that do not
+typedef enum Chip8RunAheadMode
+{
+    CHIP8_RUNAHEAD_OFF,
+    // Runs the machine itself ahead and restores it, the tone follows the future frames
+    CHIP8_RUNAHEAD_SINGLE,
+    // Runs a muted copy ahead, the machine and its tone are left alone
+    CHIP8_RUNAHEAD_SECONDARY,
+    CHIP8_RUNAHEAD_MODE_COUNT
+} Chip8RunAheadMode;
+
+typedef struct Chip8RunAhead
+{
+    Chip8RunAheadMode mode;
+    // Frames run ahead, the ROM's recommendation unless overridden
+    uint32_t frames;
+    // Time the last frame spent running ahead
+    uint64_t cost_ns;
+} Chip8RunAhead;
+
+// Access counters, see heatmap.h
+typedef struct Heatmap Heatmap;
+
+// Instructions a traced frame calls func before, marked by address and by the top nibble
+// of the opcode. Unmarked instructions cost one table lookup, func sorts out the rest.
+typedef struct Chip8Breakpoints
+{
+    uint8_t pcs[CHIP8_RAM_SIZE];
+    uint8_t opcodes[16];
+    void (*func)(const Chip8* vm, uint16_t instruction, void* context);
+    void* context;
+} Chip8Breakpoints;
+
+// What a traced frame reports to, either may be NULL
+typedef struct Chip8Trace
+{
+    Heatmap* heatmap;
+    const Chip8Breakpoints* breakpoints;
+} Chip8Trace;
+
 void chip8_run(void);
 
+// Reentrant machine API used by the frontend and the headless tools.
+// A Chip8 must start zeroed, reset and copy release the pages it held before.
+void chip8_reset(Chip8* vm, uint32_t seed);
+// Copies src into dst sharing its pages, the way to duplicate a machine
+void chip8_copy(Chip8* dst, const Chip8* src);
+// Drops the pages of a machine that is no longer used
+void chip8_release(Chip8* vm);
+bool chip8_load_rom_file(Chip8* vm, const char* rom_path);
+void chip8_step(Chip8* vm);
+// chip8_step on interpreters that count every fetch and memory access in the heatmap
+// and stop at the breakpoints of trace
+void chip8_step_traced(Chip8* vm, const Chip8Trace* trace);
+void chip8_execute(Chip8* vm);
+const char* chip8_fault_name(Chip8Fault fault);
+const char* chip8_profile_name(Chip8Profile profile);
+Chip8Profile chip8_profile_for_rom(const uint8_t* rom, size_t rom_size);
+uint8_t chip8_run_ahead_for_rom(const uint8_t* rom, size_t rom_size);
+// Runs frames frames past vm with its keys held and copies the last display into
+// display, scratch holds the saved state or the secondary machine between calls
+void chip8_run_ahead(Chip8* vm, Chip8* scratch, Chip8RunAheadMode mode, uint32_t frames, uint32_t* display);
+const char* chip8_run_ahead_mode_name(Chip8RunAheadMode mode);
+
+void chip8_write(Chip8* vm, uint16_t address, uint8_t value);
+void chip8_read_range(const Chip8* vm, uint16_t address, uint8_t* out, size_t count);
+// count bytes at address, read in place unless they cross a page and are gathered into scratch
+const uint8_t* chip8_span(const Chip8* vm, uint16_t address, size_t count, uint8_t* scratch);
+// Pages only this machine uses, what it costs on top of the shared ones
+uint32_t chip8_private_page_count(const Chip8* vm);
+
+static inline uint8_t chip8_read(const Chip8* vm, const uint16_t address)
+{
+    const uint16_t masked = address & (CHIP8_RAM_SIZE - 1);
+    return vm->pages[masked / CHIP8_PAGE_SIZE]->bytes[masked % CHIP8_PAGE_SIZE];
+}
+
+static inline uint16_t chip8_fetch(const Chip8* vm, const uint16_t address)
+{
+    const uint16_t masked = address & (CHIP8_RAM_SIZE - 1);
+    const uint8_t* bytes = &vm->pages[masked / CHIP8_PAGE_SIZE]->bytes[masked % CHIP8_PAGE_SIZE];
+
+    if(masked % CHIP8_PAGE_SIZE != CHIP8_PAGE_SIZE - 1)
+    {
+        return (uint16_t)((bytes[0] << 8) | bytes[1]);
+    }
+
+    return (uint16_t)((bytes[0] << 8) | chip8_read(vm, masked + 1));
+}
+
 #endif
@@ -0,0 +1,574 @@
+// Interpreter template. chip8.c includes this file once per quirk profile with
+// CHIP8_INTERPRETER_RUN, CHIP8_INTERPRETER_FRAME and the QUIRK_* macros defined.
+// The quirks are compile time constants, so each profile gets its own dispatch
+// loop with no quirk checks left in it.
+//
+// QUIRK_SHIFT_VY           8xy6/8xyE shift Vy into Vx instead of shifting Vx in place
+// QUIRK_LOAD_STORE_INDEX   amount Fx55/Fx65 add to I, given x
+// QUIRK_VF_RESET           8xy1/8xy2/8xy3 reset VF
+// QUIRK_JUMP_VX            Bxnn jumps to xnn + Vx instead of nnn + V0
+// QUIRK_DRAW_SPRITE        monitor function used by Dxyn, wrapping or clipping
+//
+// With CHIP8_INTERPRETER_TRACE defined the fetches and the memory Dxyn, F002, Fx33,
+// Fx55 and Fx65 touch are counted in the heatmap of trace, and the breakpoints of trace
+// are checked before every instruction. Otherwise trace is never read.
+
+#ifdef CHIP8_INTERPRETER_TRACE
+#define TRACE_EXECUTE(address) (heatmap ? heatmap_touch(heatmap->executes, (address), 2) : (void)0)
+#define TRACE_READ(address, count) (heatmap ? heatmap_touch(heatmap->reads, (address), (count)) : (void)0)
+#define TRACE_WRITE(address, count) (heatmap ? heatmap_touch(heatmap->writes, (address), (count)) : (void)0)
+#else
+#define TRACE_EXECUTE(address) ((void)trace)
+#define TRACE_READ(address, count)
+#define TRACE_WRITE(address, count)
+#endif
+
+static inline void CHIP8_INTERPRETER_RUN(Chip8* vm, const uint16_t instruction, const Chip8Trace* trace)
+{
+#ifdef CHIP8_INTERPRETER_TRACE
+    Heatmap* const heatmap = trace->heatmap;
+#endif
+    const uint16_t currentPC = vm->pc;
+    TRACE_EXECUTE(currentPC);
+
+    vm->pc += 2;
+
+    const uint8_t x = X(instruction);
+    const uint8_t y = Y(instruction);
+
+    vm_switch(instruction, 0xF000)
+    {
+        vm_case(0x0000)
+        {
+            vm_switch(instruction, 0x00FF)
+            {
+                vm_case(0xE0)
+                {
+                    // CLS
+                    monitor_log(LOG_DEBUG, "%.04x: CLS", currentPC);
+                    monitor_clear(vm->display);
+                    vm_break;
+                }
+                
+                vm_case(0xEE)
+                {
+                    // RET
+                    monitor_log(LOG_DEBUG, "%.04x: RET", currentPC);
+                    if(vm->sp == 0)
+                    {
+                        monitor_log(LOG_WARNING, "%.04x: RET with empty stack", currentPC);
+                        chip8_fault(vm, CHIP8_FAULT_STACK_UNDERFLOW, currentPC);
+                        vm_break;
+                    }
+
+                    vm->sp--;
+                    vm->pc = vm->stack[vm->sp];
+                    vm->stack[vm->sp] = 0;
+                    vm_break;
+                }
+
+                vm_default
+                {
+                    // halt
+                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
+                    chip8_fault(vm, CHIP8_FAULT_BAD_OPCODE, currentPC);
+                    vm_break;
+                }
+            }
+
+            vm_break;
+        }
+
+        vm_case(0x1000)
+        {
+            // JP addr
+            monitor_log(LOG_DEBUG, "%.04x: JP(0x%.04x)", currentPC, ADDR(instruction));
+            vm->pc = ADDR(instruction);
+            vm_break;
+        }
+
+        vm_case(0x2000)
+        {
+            // CALL addr
+            monitor_log(LOG_DEBUG, "%.04x: CALL(0x%.04x)", currentPC, ADDR(instruction));
+            if(vm->sp >= sizeof(vm->stack) / sizeof(vm->stack[0]))
+            {
+                monitor_log(LOG_WARNING, "%.04x: CALL with full stack", currentPC);
+                chip8_fault(vm, CHIP8_FAULT_STACK_OVERFLOW, currentPC);
+                vm_break;
+            }
+
+            vm->stack[vm->sp] = vm->pc;
+            vm->sp++;
+            vm->pc = ADDR(instruction);
+            vm_break;
+        }
+
+        vm_case(0x3000)
+        {
+            // SE Vx, byte
+            monitor_log(LOG_DEBUG, "%.04x: SE1(%d, 0x%.02x) // Skip if x == byte", currentPC, x, BYTE(instruction));
+            vm->pc += (uint16_t)(vm->v[x] == BYTE(instruction)) << 1;
+            vm_break;
+        }
+        
+        vm_case(0x4000)
+        {
+            // SNE Vx, byte
+            monitor_log(LOG_DEBUG, "%.04x: SNE1(%d, 0x%.02x) // Skip if x != byte", currentPC, x, BYTE(instruction));
+            vm->pc += (uint16_t)(vm->v[x] != BYTE(instruction)) << 1;
+            vm_break;
+        }
+        
+        vm_case(0x5000)
+        {
+            // SE Vx, Vy
+            monitor_log(LOG_DEBUG, "%.04x: SE2(%d, %d) // Skip if x == y", currentPC, x, y);
+            vm->pc += (uint16_t)(vm->v[x] == vm->v[y]) << 1;
+            vm_break;
+        }
+        
+        vm_case(0x6000)
+        {
+            // LD Vx, byte
+            monitor_log(LOG_DEBUG, "%.04x: LD1(%d, 0x%.02x) // x = byte", currentPC, x, BYTE(instruction));
+            vm->v[x] = BYTE(instruction);
+            vm_break;
+        }
+        
+        vm_case(0x7000)
+        {
+            // ADD Vx, byte
+            monitor_log(LOG_DEBUG, "%.04x: ADD1(%d, 0x%.02x) // x += byte", currentPC, x, BYTE(instruction));
+            vm->v[x] += BYTE(instruction);
+            vm_break;
+        }
+        
+        vm_case(0x8000)
+        {
+            vm_switch(instruction, 0xF)
+            {
+                vm_case(0x0)
+                {
+                    // LD Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: LD2(%d, %d) // x = y", currentPC, x, y);
+                    vm->v[x] = vm->v[y];
+                    vm_break;
+                }
+                
+                vm_case(0x1)
+                {
+                    // OR Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: OR(%d, %d) // x |= y", currentPC, x, y);
+                    vm->v[x] |= vm->v[y];
+#if QUIRK_VF_RESET
+                    vm->v[0xF] = 0;
+#endif
+                    vm_break;
+                }
+                
+                vm_case(0x2)
+                {
+                    // AND Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: AND(%d, %d) // x &= y", currentPC, x, y);
+                    vm->v[x] &= vm->v[y];
+#if QUIRK_VF_RESET
+                    vm->v[0xF] = 0;
+#endif
+                    vm_break;
+                }
+                
+                vm_case(0x3)
+                {
+                    // XOR Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: XOR(%d, %d) // x ^= y", currentPC, x, y);
+                    vm->v[x] ^= vm->v[y];
+#if QUIRK_VF_RESET
+                    vm->v[0xF] = 0;
+#endif
+                    vm_break;
+                }
+                
+                vm_case(0x4)
+                {
+                    // ADD Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: ADD2(%d, %d) // x += y", currentPC, x, y);
+                    const uint8_t max_value = 0xFF - vm->v[x];
+                    vm->v[0xF] = max_value < vm->v[y]; // Set carry flag
+                    vm->v[x] += vm->v[y];
+                    vm_break;
+                }
+                
+                vm_case(0x5)
+                {
+                    // SUB Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: SUB(%d, %d) // x -= y", currentPC, x, y);
+                    vm->v[0xF] = vm->v[x] > vm->v[y]; // Set borrow flag
+                    vm->v[x] -= vm->v[y];
+                    vm_break;
+                }
+                
+                vm_case(0x6)
+                {
+                    // SHR Vx {, Vy}
+                    monitor_log(LOG_DEBUG, "%.04x: SHR(%d) // x >>= 1", currentPC, x);
+#if QUIRK_SHIFT_VY
+                    const uint8_t value = vm->v[y];
+#else
+                    const uint8_t value = vm->v[x];
+#endif
+                    vm->v[x] = value >> 1;
+                    vm->v[0xF] = value & 0x1; // Set carry flag
+                    vm_break;
+                }
+                
+                vm_case(0x7)
+                {
+                    // SUBN Vx, Vy
+                    monitor_log(LOG_DEBUG, "%.04x: SUBN(%d, %d) // x = y - x", currentPC, x, y);
+                    vm->v[0xF] = vm->v[y] > vm->v[x]; // Set borrow flag
+                    vm->v[x] = vm->v[y] - vm->v[x];
+                    vm_break;
+                }
+                
+                vm_case(0xE)
+                {
+                    // SHL Vx {, Vy}
+                    monitor_log(LOG_DEBUG, "%.04x: SHL(%d) // x <<= 1", currentPC, x);
+#if QUIRK_SHIFT_VY
+                    const uint8_t value = vm->v[y];
+#else
+                    const uint8_t value = vm->v[x];
+#endif
+                    vm->v[x] = (uint8_t)(value << 1);
+                    vm->v[0xF] = (value & 0x80) > 0; // Set carry flag
+                    vm_break;
+                }
+
+                vm_default
+                {
+                    // halt
+                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
+                    chip8_fault(vm, CHIP8_FAULT_BAD_OPCODE, currentPC);
+                    vm_break;
+                }
+            }
+            vm_break;
+        }
+        
+        vm_case(0x9000)
+        {
+            // SNE Vx, Vy
+            monitor_log(LOG_DEBUG, "%.04x: SNE2(%d, %d) // Skip if x != y", currentPC, x, y);
+            vm->pc += (uint16_t)(vm->v[x] != vm->v[y]) << 1;
+            vm_break;
+        }
+        
+        vm_case(0xA000)
+        {
+            // LD I, addr
+            monitor_log(LOG_DEBUG, "%.04x: LDB(%d) // index = addr", currentPC, ADDR(instruction));
+            vm->index = ADDR(instruction);
+            vm_break;
+        }
+        
+        vm_case(0xB000)
+        {
+            // JP V0, addr
+#if QUIRK_JUMP_VX
+            monitor_log(LOG_DEBUG, "%.04x: JP1(%d) // pc = addr + Vx", currentPC, ADDR(instruction));
+            vm->pc = ADDR(instruction) + vm->v[x];
+#else
+            monitor_log(LOG_DEBUG, "%.04x: JP1(%d) // pc = addr + V0", currentPC, ADDR(instruction));
+            vm->pc = ADDR(instruction) + vm->v[0];
+#endif
+            vm_break;
+        }
+        
+        vm_case(0xC000)
+        {
+            // RND Vx, byte
+            monitor_log(LOG_DEBUG, "%.04x: RND(%d, 0x%.02x) // x = rand()", currentPC, x, BYTE(instruction));
+            vm->v[x] = chip8_random(vm) & BYTE(instruction);
+            vm_break;
+        }
+        
+        vm_case(0xD000)
+        {
+            // DRW Vx, Vy, nibble
+            monitor_log(LOG_DEBUG, "%.04x: DRW(%d, %d, %d)", currentPC, x, y, NIBBLE(instruction));
+            uint8_t scratch[16];
+            const uint8_t* sprite = chip8_span(vm, vm->index, NIBBLE(instruction), scratch);
+            TRACE_READ(vm->index, NIBBLE(instruction));
+            QUIRK_DRAW_SPRITE(vm->display, vm->v[x], vm->v[y], sprite, NIBBLE(instruction), (bool*)&vm->v[0xF]);
+
+            if(vm->v[0xF])
+            {
+                monitor_log(LOG_DEBUG, "Collision detected");
+            }
+
+            vm_break;
+        }
+        
+        // Keyboard instructions
+        vm_case(0xE000)
+        {
+            vm_switch(instruction, 0x00FF)
+            {
+                vm_case(0x9E)
+                {
+                    // SKP Vx
+                    monitor_log(LOG_DEBUG, "%.04x: SKP(%d) // Skip if key down", currentPC, x);
+                    vm->key_read_pc = vm->keys_read ? vm->key_read_pc : currentPC;
+                    vm->keys_read |= (uint16_t)(1u << NIBBLE(vm->v[x]));
+                    vm->pc += (uint16_t)(((vm->keys >> NIBBLE(vm->v[x])) & 0x1)) << 1;
+                    vm_break;
+                }
+                
+                vm_case(0xA1)
+                {
+                    // SKNP Vx
+                    monitor_log(LOG_DEBUG, "%.04x: SKNP(%d) // Skip if key not down", currentPC, x);
+                    vm->key_read_pc = vm->keys_read ? vm->key_read_pc : currentPC;
+                    vm->keys_read |= (uint16_t)(1u << NIBBLE(vm->v[x]));
+                    vm->pc += (uint16_t)(((vm->keys >> NIBBLE(vm->v[x])) & 0x1) == 0) << 1;
+                    vm_break;
+                }
+
+                vm_default
+                {
+                    // halt
+                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
+                    chip8_fault(vm, CHIP8_FAULT_BAD_OPCODE, currentPC);
+                    vm_break;
+                }
+            }
+            
+            vm_break;
+        }
+        
+        vm_case(0xF000)
+        {
+            vm_switch(instruction, 0x00FF)
+            {
+                vm_case(0x02)
+                {
+                    // AUDIO
+                    monitor_log(LOG_DEBUG, "%.04x: AUDIO // audio pattern = 16 bytes at index", currentPC);
+                    if(x == 0)
+                    {
+                        chip8_read_range(vm, vm->index, vm->audio_pattern, sizeof(vm->audio_pattern));
+                        TRACE_READ(vm->index, sizeof(vm->audio_pattern));
+                    }
+                    else
+                    {
+                        monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
+                        chip8_fault(vm, CHIP8_FAULT_BAD_OPCODE, currentPC);
+                    }
+
+                    vm_break;
+                }
+
+                vm_case(0x07)
+                {
+                    // LD Vx, DT
+                    monitor_log(LOG_DEBUG, "%.04x: LD6(%d) // x = delay timer", currentPC, x);
+                    vm->v[x] = vm->delay_timer;
+                    vm_break;
+                }
+                
+                vm_case(0x0A)
+                {
+                    // LD Vx, K
+                    monitor_log(LOG_DEBUG, "%.04x: LD3(%d) // x = get_key()", currentPC, x);
+                    vm->paused = true;
+                    vm_break;
+                }
+                
+                vm_case(0x15)
+                {
+                    // LD DT, Vx
+                    monitor_log(LOG_DEBUG, "%.04x: LD5(%d) // delay timer = x", currentPC, x);
+                    vm->delay_timer = vm->v[x];
+                    vm_break;
+                }
+                
+                vm_case(0x18)
+                {
+                    // LD ST, Vx
+                    monitor_log(LOG_DEBUG, "%.04x: LD4(%d) // sound timer = x", currentPC, x);
+                    vm->sound_timer = vm->v[x];
+                    vm_break;
+                }
+                
+                vm_case(0x1E)
+                {
+                    // ADD I, Vx
+                    monitor_log(LOG_DEBUG, "%.04x: ADD3(%d) // index += x", currentPC, x);
+                    vm->index += (uint16_t)vm->v[x];
+                    vm_break;
+                }
+                
+                vm_case(0x29)
+                {
+                    // LD F, Vx
+                    monitor_log(LOG_DEBUG, "%.04x: LD7(%d) // index = font at x", currentPC, x);
+                    vm->index = D0 + NIBBLE(vm->v[x]) * 5;
+                    vm_break;
+                }
+                
+                vm_case(0x33)
+                {
+                    // LD B, Vx
+                    monitor_log(LOG_DEBUG, "%.04x: LD8(%d) // Store BCD of x at index", currentPC, x);
+                    const uint8_t value = vm->v[x];
+                    const uint8_t ones = value % 10;
+                    const uint8_t tens = (value % 100) / 10;
+                    const uint8_t hundreds = value / 100;
+                    
+                    if(vm->index >= PROGRAM_START && vm->index + 2 < CHIP8_RAM_SIZE)
+                    {
+                        chip8_write(vm, vm->index, hundreds);
+                        chip8_write(vm, vm->index + 1, tens);
+                        chip8_write(vm, vm->index + 2, ones);
+                        TRACE_WRITE(vm->index, 3);
+                    }
+                    else
+                    {
+                        monitor_log(LOG_WARNING, "LD8 failed: index out of bounds");
+                        vm->paused = true;
+                    }
+                    
+                    vm_break;
+                }
+                
+                vm_case(0x3A)
+                {
+                    // PITCH Vx
+                    monitor_log(LOG_DEBUG, "%.04x: PITCH(%d) // audio pitch = x", currentPC, x);
+                    vm->pitch = vm->v[x];
+                    vm_break;
+                }
+                
+                vm_case(0x55)
+                {
+                    // LD [I], Vx
+                    monitor_log(LOG_DEBUG, "%.04x: LD9(%d) // Store register 0 thru x into index", currentPC, x);
+                    for(uint8_t i = 0; i <= x; ++i)
+                    {
+                        if((vm->index + i) >= PROGRAM_START && (vm->index + i) < CHIP8_RAM_SIZE)
+                        {
+                            chip8_write(vm, vm->index + i, vm->v[i]);
+                            TRACE_WRITE(vm->index + i, 1);
+                        }
+                        else
+                        {
+                            monitor_log(LOG_WARNING, "LD9 failed: index out of bounds");
+                            vm->paused = true;
+                        }
+                    }
+
+                    vm->index += QUIRK_LOAD_STORE_INDEX(x);
+                    vm_break;
+                }
+                
+                vm_case(0x65)
+                {
+                    // LD Vx, [I]
+                    monitor_log(LOG_DEBUG, "%.04x: LDA(%d) // load registers 0 thru x with values starting at index", currentPC, x);
+                    for(uint8_t i = 0; i <= x; ++i)
+                    {
+                        vm->v[i] = chip8_read(vm, vm->index + i);
+                    }
+
+                    TRACE_READ(vm->index, x + 1u);
+
+                    vm->index += QUIRK_LOAD_STORE_INDEX(x);
+
+                    vm_break;
+                }
+
+                vm_default
+                {
+                    // halt
+                    monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
+                    chip8_fault(vm, CHIP8_FAULT_BAD_OPCODE, currentPC);
+                    vm_break;
+                }
+            }
+
+            vm_break;
+        }
+
+        vm_default
+        {
+            // halt
+            monitor_log(LOG_INFO, "%.04x: HALTED 0x%.04x", currentPC, instruction);
+            chip8_fault(vm, CHIP8_FAULT_BAD_OPCODE, currentPC);
+            vm_break;
+        }
+    }
+}
+
+// Runs up to speed instructions, returns false if the frame ended early on a key wait
+static bool CHIP8_INTERPRETER_FRAME(Chip8* vm, const Chip8Trace* trace)
+{
+    // The page holding pc is kept across instructions, saving a dependent load per fetch.
+    // Only Fx33/Fx55 swap pages within a frame, so they drop it.
+    const uint8_t* code = NULL;
+    uint16_t code_page = CHIP8_PAGE_COUNT;
+    uint32_t i = 0;
+#ifdef CHIP8_INTERPRETER_TRACE
+    const Chip8Breakpoints* breakpoints = trace->breakpoints;
+#endif
+
+    for(; i < vm->speed; ++i)
+    {
+        const uint16_t pc = vm->pc & (CHIP8_RAM_SIZE - 1);
+        uint16_t instruction;
+
+        if(pc / CHIP8_PAGE_SIZE == code_page && pc % CHIP8_PAGE_SIZE != CHIP8_PAGE_SIZE - 1)
+        {
+            instruction = (uint16_t)((code[pc % CHIP8_PAGE_SIZE] << 8) | code[pc % CHIP8_PAGE_SIZE + 1]);
+        }
+        else
+        {
+            code_page = pc / CHIP8_PAGE_SIZE;
+            code = vm->pages[code_page]->bytes;
+            instruction = chip8_fetch(vm, pc);
+        }
+
+        if((instruction & 0xF0FF) == 0xF033 || (instruction & 0xF0FF) == 0xF055)
+        {
+            code_page = CHIP8_PAGE_COUNT;
+        }
+
+#ifdef CHIP8_INTERPRETER_TRACE
+        if(breakpoints && (breakpoints->pcs[pc] | breakpoints->opcodes[instruction >> 12]))
+        {
+            breakpoints->func(vm, instruction, breakpoints->context);
+        }
+#endif
+
+        CHIP8_INTERPRETER_RUN(vm, instruction, trace);
+
+        if(vm->paused)
+        {
+            vm->executed = i + 1;
+            return false;
+        }
+
+        if(vm->halted)
+        {
+            ++i;
+            break;
+        }
+    }
+
+    vm->executed = i;
+    return true;
+}
+
+#undef TRACE_EXECUTE
+#undef TRACE_READ
+#undef TRACE_WRITE
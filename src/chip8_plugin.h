@@ -0,0 +1,96 @@
+#ifndef CHIP8_PLUGIN_H
+#define CHIP8_PLUGIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Native plugin interface. A plugin is a shared library in the directory CHIP8_PLUGINS
+// names, built against this header alone. The emulator calls its chip8_plugin_load with
+// the host table once at startup, where the plugin registers the hooks it wants, and its
+// chip8_plugin_unload, if it has one, at shutdown. Every hook runs on the emulation
+// thread and sees the machine through a read-only view valid for that call only.
+//
+// Frame, ROM, halt and key hooks cost nothing while no plugin registers them. PC and
+// opcode hooks mark a breakpoint table, frames only run on the traced interpreter while
+// one is marked, and then unmarked instructions cost a single table lookup.
+//
+// The ABI only grows. New members are appended to the structs, a host fills size with
+// the size of the table it passes, and bumps CHIP8_PLUGIN_ABI_VERSION when it breaks
+// compatibility. Every plugin exports the version it was built against with
+// CHIP8_PLUGIN_DEFINE_ABI_VERSION, and the loader refuses plugins without it or built
+// against another version.
+
+#define CHIP8_PLUGIN_ABI_VERSION 1
+
+#ifdef _WIN32
+#define CHIP8_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define CHIP8_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef struct Chip8PluginView
+{
+    uint32_t size;
+    uint64_t frame;
+    uint16_t pc;
+    uint16_t index;
+    uint8_t v[16];
+    uint16_t stack[16];
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint16_t keys;
+    // Non zero once the machine halted, the fault and where it happened
+    uint8_t fault;
+    uint16_t fault_pc;
+    // 64 columns, bit n of a column is row n
+    const uint32_t* display;
+    // Host handle read_ram takes
+    const void* machine;
+} Chip8PluginView;
+
+typedef void (*Chip8FrameHook)(const Chip8PluginView* view, void* user);
+typedef void (*Chip8RomHook)(const Chip8PluginView* view, const char* path, void* user);
+typedef void (*Chip8HaltHook)(const Chip8PluginView* view, void* user);
+typedef void (*Chip8KeyHook)(const Chip8PluginView* view, uint8_t key, bool is_down, void* user);
+// Called before the instruction at view->pc runs
+typedef void (*Chip8InstructionHook)(const Chip8PluginView* view, uint16_t instruction, void* user);
+
+typedef struct Chip8Plugin Chip8Plugin;
+
+typedef struct Chip8PluginHost
+{
+    uint32_t size;
+    uint32_t abi_version;
+    // Identifies the calling plugin to the functions below
+    Chip8Plugin* plugin;
+
+    // Registration, only during chip8_plugin_load. Each returns false when the host is
+    // out of hook slots.
+    bool (*on_frame_end)(Chip8Plugin* plugin, Chip8FrameHook hook, void* user);
+    bool (*on_rom_load)(Chip8Plugin* plugin, Chip8RomHook hook, void* user);
+    bool (*on_halt)(Chip8Plugin* plugin, Chip8HaltHook hook, void* user);
+    bool (*on_key)(Chip8Plugin* plugin, Chip8KeyHook hook, void* user);
+    bool (*on_pc)(Chip8Plugin* plugin, uint16_t pc, Chip8InstructionHook hook, void* user);
+    // Fires for every instruction where (instruction & mask) == value
+    bool (*on_opcode)(Chip8Plugin* plugin, uint16_t mask, uint16_t value, Chip8InstructionHook hook, void* user);
+
+    // Guest RAM, addresses wrap at 4 KiB
+    uint8_t (*read_ram)(const Chip8PluginView* view, uint16_t address);
+    void (*read_ram_range)(const Chip8PluginView* view, uint16_t address, uint8_t* out, uint32_t count);
+    // Written to the emulator log
+    void (*log)(Chip8Plugin* plugin, const char* text);
+} Chip8PluginHost;
+
+// What a plugin exports, returning false unloads it again
+typedef bool (*Chip8PluginLoadFunc)(const Chip8PluginHost* host);
+typedef void (*Chip8PluginUnloadFunc)(void);
+
+#define CHIP8_PLUGIN_LOAD_SYMBOL "chip8_plugin_load"
+#define CHIP8_PLUGIN_UNLOAD_SYMBOL "chip8_plugin_unload"
+#define CHIP8_PLUGIN_ABI_SYMBOL "chip8_plugin_abi_version"
+
+// Put once in a plugin's source, at file scope
+#define CHIP8_PLUGIN_DEFINE_ABI_VERSION CHIP8_PLUGIN_EXPORT const uint32_t chip8_plugin_abi_version = CHIP8_PLUGIN_ABI_VERSION
+
+#endif
@@ -44,6 +44,8 @@
 #define SUBN(x, y) (0x8007 | REGX(x) | REGY(y)),
 #define SHR(x) (0x8006 | REGX(x)),
 #define SHL(x) (0x800E | REGX(x)),
+#define SHR2(x, y) (0x8006 | REGX(x) | REGY(y)),
+#define SHL2(x, y) (0x800E | REGX(x) | REGY(y)),
 #define SKP(x) (0xE09E | REGX(x)),
 #define SKNP(x) (0xE0A1 | REGX(x)),
 
@@ -64,6 +66,8 @@
 #define LD9(x) (0xF055 | REGX(x)),
 #define LDA(x) (0xF065 | REGX(x)),
 #define LDB(addr) (0xA000 | ADDR(addr)),
+#define AUDIO() (0xF002),
+#define PITCH(x) (0xF03A | REGX(x)),
 
 #define ADD1(x, byte) (0x7000 | REGX(x) | BYTE(byte)),
 #define ADD2(x, y) (0x8004 | REGX(x) | REGY(y)),
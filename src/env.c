@@ -0,0 +1,321 @@
+#include "env.h"
+#include "codes.h"
+#include "hash.h"
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Per ROM score locations, keyed by the same ROM hash as the quirk profiles
+static const struct EnvGame
+{
+    uint64_t Hash;
+    uint16_t ScoreAddress;
+} EnvGames[] = {
+    {0xc86e8ff63fce668cull, 0x314}, // Brix [Andreas Gustafsson, 1990], F533 at 0x2F8
+};
+
+typedef struct EnvSlot
+{
+    uint32_t sticky_rng;
+    uint32_t episode;
+    uint32_t frames;
+    int32_t score;
+    uint16_t action;
+} EnvSlot;
+
+struct Chip8Env
+{
+    Chip8EnvConfig config;
+    Chip8 prototype;
+    Chip8* machines;
+    EnvSlot* slots;
+    ThreadPool* pool;
+    uint64_t seed;
+    uint16_t score_address;
+    const uint16_t* actions;
+    uint8_t* obs;
+    float* rewards;
+    uint8_t* dones;
+};
+
+static uint32_t env_seed(uint64_t seed, uint32_t index, uint32_t episode, uint32_t stream);
+static int32_t env_score(const Chip8Env* env, const Chip8* vm);
+static bool env_done(const Chip8Env* env, const Chip8* vm);
+static void env_reset_one(Chip8Env* env, uint32_t index);
+static void env_write_obs(const Chip8Env* env, const Chip8* vm, uint8_t* obs);
+static void env_reset_task(void* context, uint32_t index);
+static void env_step_task(void* context, uint32_t index);
+
+Chip8Env* chip8_env_create(const Chip8EnvConfig* config)
+{
+    if(config->env_count == 0)
+    {
+        return NULL;
+    }
+
+    Chip8Env* env = calloc(1, sizeof(Chip8Env));
+
+    if(!env)
+    {
+        return NULL;
+    }
+
+    env->config = *config;
+    env->config.frame_skip = config->frame_skip > 0 ? config->frame_skip : 1;
+    env->config.sticky_percent = config->sticky_percent < 100 ? config->sticky_percent : 100;
+    chip8_reset(&env->prototype, 0);
+
+    if(!chip8_load_rom_file(&env->prototype, config->rom_path))
+    {
+        chip8_release(&env->prototype);
+        free(env);
+        return NULL;
+    }
+
+    env->score_address = chip8_env_score_address(config->rom_path);
+    env->machines = calloc(config->env_count, sizeof(Chip8));
+    env->slots = calloc(config->env_count, sizeof(EnvSlot));
+    env->pool = pool_create(config->threads);
+
+    if(!env->machines || !env->slots || !env->pool)
+    {
+        chip8_env_destroy(env);
+        return NULL;
+    }
+
+    chip8_env_reset(env, 0, NULL);
+    return env;
+}
+
+void chip8_env_destroy(Chip8Env* env)
+{
+    if(!env)
+    {
+        return;
+    }
+
+    if(env->pool)
+    {
+        pool_destroy(env->pool);
+    }
+
+    for(uint32_t i = 0; env->machines && i < env->config.env_count; ++i)
+    {
+        chip8_release(&env->machines[i]);
+    }
+
+    chip8_release(&env->prototype);
+    free(env->slots);
+    free(env->machines);
+    free(env);
+}
+
+uint32_t chip8_env_count(const Chip8Env* env)
+{
+    return env->config.env_count;
+}
+
+size_t chip8_env_obs_size(const Chip8Env* env)
+{
+    const size_t pixels = CHIP8_DISPLAY_COLUMNS * CHIP8_DISPLAY_ROWS;
+    return env->config.obs_format == CHIP8_OBS_BITS ? pixels / 8 : pixels;
+}
+
+void chip8_env_reset(Chip8Env* env, const uint64_t seed, uint8_t* obs)
+{
+    env->seed = seed;
+    env->obs = obs;
+    pool_for(env->pool, env->config.env_count, env_reset_task, env);
+    env->obs = NULL;
+}
+
+void chip8_env_step(Chip8Env* env, const uint16_t* actions, uint8_t* obs, float* rewards, uint8_t* dones)
+{
+    env->actions = actions;
+    env->obs = obs;
+    env->rewards = rewards;
+    env->dones = dones;
+    pool_for(env->pool, env->config.env_count, env_step_task, env);
+    env->actions = NULL;
+    env->obs = NULL;
+    env->rewards = NULL;
+    env->dones = NULL;
+}
+
+const Chip8* chip8_env_machine(const Chip8Env* env, const uint32_t index)
+{
+    return &env->machines[index];
+}
+
+int32_t chip8_env_bcd_at(const Chip8* vm, const uint16_t address)
+{
+    return chip8_read(vm, address) * 100 + chip8_read(vm, address + 1) * 10 + chip8_read(vm, address + 2);
+}
+
+bool chip8_env_default_done(const Chip8* vm)
+{
+    // Most games end by halting or by parking on a jump to itself
+    const uint16_t pc = vm->pc & (CHIP8_RAM_SIZE - 1);
+    const uint16_t instruction = (uint16_t)((chip8_read(vm, pc) << 8) | chip8_read(vm, pc + 1));
+    return vm->halted || instruction == (0x1000 | pc);
+}
+
+uint16_t chip8_env_score_address(const char* rom_path)
+{
+    FILE* rom = fopen(rom_path, "rb");
+    uint8_t image[CHIP8_RAM_SIZE - PROGRAM_START];
+
+    if(!rom)
+    {
+        return 0;
+    }
+
+    const size_t rom_size = fread(image, sizeof(uint8_t), sizeof(image), rom);
+    fclose(rom);
+
+    const uint64_t hash = hash_fnv1a64(image, rom_size, HASH_FNV1A64_SEED);
+
+    for(size_t i = 0; i < sizeof(EnvGames) / sizeof(EnvGames[0]); ++i)
+    {
+        if(EnvGames[i].Hash == hash)
+        {
+            return EnvGames[i].ScoreAddress;
+        }
+    }
+
+    return 0;
+}
+
+// Every environment, episode and use gets its own stream, so no two environments
+// share random numbers and the order they run in does not matter
+static uint32_t env_seed(const uint64_t seed, const uint32_t index, const uint32_t episode, const uint32_t stream)
+{
+    const uint32_t key[3] = {index, episode, stream};
+    const uint32_t value = (uint32_t)hash_fnv1a64(key, sizeof(key), hash_fnv1a64(&seed, sizeof(seed), HASH_FNV1A64_SEED));
+    return value != 0 ? value : 1;
+}
+
+static int32_t env_score(const Chip8Env* env, const Chip8* vm)
+{
+    if(env->config.score)
+    {
+        return env->config.score(vm);
+    }
+
+    return env->score_address != 0 ? chip8_env_bcd_at(vm, env->score_address) : 0;
+}
+
+static bool env_done(const Chip8Env* env, const Chip8* vm)
+{
+    return env->config.done ? env->config.done(vm) : chip8_env_default_done(vm);
+}
+
+static void env_reset_one(Chip8Env* env, const uint32_t index)
+{
+    Chip8* vm = &env->machines[index];
+    EnvSlot* slot = &env->slots[index];
+
+    chip8_copy(vm, &env->prototype);
+    vm->rng = env_seed(env->seed, index, slot->episode, 0);
+    slot->sticky_rng = env_seed(env->seed, index, slot->episode, 1);
+    slot->frames = 0;
+    slot->action = 0;
+    slot->score = env_score(env, vm);
+}
+
+static void env_write_obs(const Chip8Env* env, const Chip8* vm, uint8_t* obs)
+{
+    if(env->config.obs_format == CHIP8_OBS_BITS)
+    {
+        for(uint32_t row = 0; row < CHIP8_DISPLAY_ROWS; ++row)
+        {
+            for(uint32_t byte = 0; byte < CHIP8_DISPLAY_COLUMNS / 8; ++byte)
+            {
+                const uint32_t* columns = &vm->display[byte * 8];
+                uint8_t bits = 0;
+
+                for(uint32_t i = 0; i < 8; ++i)
+                {
+                    bits |= (uint8_t)(((columns[i] >> row) & 0x1) << (7 - i));
+                }
+
+                *obs++ = bits;
+            }
+        }
+
+        return;
+    }
+
+    for(uint32_t row = 0; row < CHIP8_DISPLAY_ROWS; ++row)
+    {
+        for(uint32_t column = 0; column < CHIP8_DISPLAY_COLUMNS; ++column)
+        {
+            *obs++ = (uint8_t)(0 - ((vm->display[column] >> row) & 0x1));
+        }
+    }
+}
+
+static void env_reset_task(void* context, const uint32_t index)
+{
+    Chip8Env* env = (Chip8Env*)context;
+    env->slots[index].episode = 0;
+    env_reset_one(env, index);
+
+    if(env->obs)
+    {
+        env_write_obs(env, &env->machines[index], env->obs + index * chip8_env_obs_size(env));
+    }
+}
+
+static void env_step_task(void* context, const uint32_t index)
+{
+    Chip8Env* env = (Chip8Env*)context;
+    Chip8* vm = &env->machines[index];
+    EnvSlot* slot = &env->slots[index];
+    bool done = false;
+
+    for(uint32_t frame = 0; frame < env->config.frame_skip && !done; ++frame)
+    {
+        // Sticky actions repeat the previous keys now and then, like a human's reaction lag
+        slot->sticky_rng ^= slot->sticky_rng << 13;
+        slot->sticky_rng ^= slot->sticky_rng >> 17;
+        slot->sticky_rng ^= slot->sticky_rng << 5;
+        const bool sticky = slot->sticky_rng % 100 < env->config.sticky_percent;
+        const uint16_t action = sticky ? slot->action : env->actions[index];
+
+        vm->keys_pressed = action & (uint16_t)~slot->action;
+        vm->keys = action;
+        slot->action = action;
+        chip8_step(vm);
+
+        ++slot->frames;
+        done = env_done(env, vm) || (env->config.max_frames > 0 && slot->frames >= env->config.max_frames);
+    }
+
+    const int32_t score = env_score(env, vm);
+
+    if(env->rewards)
+    {
+        env->rewards[index] = (float)(score - slot->score);
+    }
+
+    if(env->dones)
+    {
+        env->dones[index] = done;
+    }
+
+    slot->score = score;
+
+    if(done)
+    {
+        ++slot->episode;
+        env_reset_one(env, index);
+    }
+
+    if(env->obs)
+    {
+        env_write_obs(env, vm, env->obs + index * chip8_env_obs_size(env));
+    }
+}
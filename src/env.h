@@ -0,0 +1,70 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "chip8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Batched reinforcement learning environments over one ROM. Every step runs all
+// environments across a worker pool and writes observations, rewards and done flags
+// straight into caller owned arrays, so stepping never copies or allocates.
+// Results only depend on the seed, not on the number of workers.
+
+// Observation layouts, one contiguous block per environment
+typedef enum Chip8ObsFormat
+{
+    // 256 bytes, row major, 8 pixels per byte with the leftmost pixel in the top bit
+    CHIP8_OBS_BITS,
+    // 2048 bytes, row major, one byte per pixel that is 0x00 or 0xFF
+    CHIP8_OBS_BYTES,
+} Chip8ObsFormat;
+
+// Reward is the change of score between steps, done ends the episode
+typedef int32_t (*Chip8ScoreFunc)(const Chip8* vm);
+typedef bool (*Chip8DoneFunc)(const Chip8* vm);
+
+typedef struct Chip8EnvConfig
+{
+    const char* rom_path;
+    uint32_t env_count;
+    // Frames run per step with the same action, 0 is treated as 1
+    uint32_t frame_skip;
+    // Percent chance per frame that an environment keeps its previous action
+    uint32_t sticky_percent;
+    // Episodes are cut off after this many frames, 0 for no limit
+    uint32_t max_frames;
+    // Worker threads, 0 uses one per hardware thread
+    uint32_t threads;
+    Chip8ObsFormat obs_format;
+    // Optional hooks, NULL uses the ROM's built in extractor or the defaults
+    // (no score, done when the machine halts or spins on a self jump)
+    Chip8ScoreFunc score;
+    Chip8DoneFunc done;
+} Chip8EnvConfig;
+
+typedef struct Chip8Env Chip8Env;
+
+Chip8Env* chip8_env_create(const Chip8EnvConfig* config);
+void chip8_env_destroy(Chip8Env* env);
+uint32_t chip8_env_count(const Chip8Env* env);
+size_t chip8_env_obs_size(const Chip8Env* env);
+
+// Starts a new episode in every environment and writes the first observations,
+// obs holds chip8_env_count * chip8_env_obs_size bytes
+void chip8_env_reset(Chip8Env* env, uint64_t seed, uint8_t* obs);
+
+// actions[i] is the bitmask of keys held by environment i. Environments that finish
+// report done and are reset right away, obs then holds the first frame of the next episode.
+void chip8_env_step(Chip8Env* env, const uint16_t* actions, uint8_t* obs, float* rewards, uint8_t* dones);
+
+// Machine of one environment, for inspection between steps
+const Chip8* chip8_env_machine(const Chip8Env* env, uint32_t index);
+
+// Reads the three digit BCD number Fx33 stored at address
+int32_t chip8_env_bcd_at(const Chip8* vm, uint16_t address);
+// Address the built in extractor reads the score of the ROM from, 0 if it has none
+uint16_t chip8_env_score_address(const char* rom_path);
+bool chip8_env_default_done(const Chip8* vm);
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "export.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define EXPORT_MAX_NAME 128
+// A writer finishes a frame in well under a microsecond, one still mid-write after
+// this many yields has most likely died there
+#define EXPORT_READ_ATTEMPTS 64
+
+struct Exporter
+{
+    ExportSegment* segment;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+    char name[EXPORT_MAX_NAME];
+    uint64_t frame;
+};
+
+static bool export_segment_name(const char* name, char* out);
+static void* export_map(const char* name, bool writable, void** handle);
+static void export_unmap(const char* name, const void* segment, void* handle, bool remove);
+
+Exporter* export_open(const char* name)
+{
+    Exporter* exporter = calloc(1, sizeof(Exporter));
+
+    if(!exporter || !export_segment_name(name, exporter->name))
+    {
+        free(exporter);
+        return NULL;
+    }
+
+    void* handle = NULL;
+    exporter->segment = export_map(exporter->name, true, &handle);
+
+    if(!exporter->segment)
+    {
+        free(exporter);
+        return NULL;
+    }
+
+#ifdef _WIN32
+    exporter->mapping = handle;
+#endif
+
+    ExportSegment* segment = exporter->segment;
+    segment->size = sizeof(ExportSegment);
+    segment->version = EXPORT_VERSION;
+    atomic_store_explicit(&segment->sequence, 0, memory_order_relaxed);
+    memset(&segment->frame, 0, sizeof(segment->frame));
+    // Readers check the magic last, so they never see a half initialized header
+    atomic_thread_fence(memory_order_release);
+    segment->magic = EXPORT_MAGIC;
+    return exporter;
+}
+
+void export_close(Exporter* exporter)
+{
+    if(!exporter)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    export_unmap(exporter->name, exporter->segment, exporter->mapping, true);
+#else
+    export_unmap(exporter->name, exporter->segment, NULL, true);
+#endif
+    free(exporter);
+}
+
+void export_publish(Exporter* exporter, const Chip8* vm)
+{
+    ExportSegment* segment = exporter->segment;
+    ExportFrame* frame = &segment->frame;
+    const unsigned sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    frame->frame = ++exporter->frame;
+    memcpy(frame->display, vm->display, sizeof(frame->display));
+    memcpy(frame->stack, vm->stack, sizeof(frame->stack));
+    memcpy(frame->v, vm->v, sizeof(frame->v));
+    frame->index = vm->index;
+    frame->pc = vm->pc;
+    frame->keys = vm->keys;
+    frame->sp = vm->sp;
+    frame->delay_timer = vm->delay_timer;
+    frame->sound_timer = vm->sound_timer;
+    frame->profile = (uint8_t)vm->profile;
+    frame->flags = (uint8_t)((vm->halted ? EXPORT_FLAG_HALTED : 0) | (vm->paused ? EXPORT_FLAG_PAUSED : 0));
+    frame->publish_ns = timing_now_ns();
+
+    atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+}
+
+const ExportSegment* export_attach(const char* name)
+{
+    char segment_name[EXPORT_MAX_NAME];
+    void* handle = NULL;
+
+    if(!export_segment_name(name, segment_name))
+    {
+        return NULL;
+    }
+
+    const ExportSegment* segment = export_map(segment_name, false, &handle);
+
+    if(segment && (segment->magic != EXPORT_MAGIC || segment->version != EXPORT_VERSION))
+    {
+        fprintf(stderr, "Shared memory %s is not a version %d chip8 export\n", segment_name, EXPORT_VERSION);
+        export_unmap(segment_name, segment, handle, false);
+        return NULL;
+    }
+
+#ifdef _WIN32
+    // The view keeps the mapping alive, so the handle is not needed any more
+    CloseHandle(handle);
+#endif
+    return segment;
+}
+
+void export_detach(const ExportSegment* segment)
+{
+    if(segment)
+    {
+        export_unmap(NULL, segment, NULL, false);
+    }
+}
+
+bool export_read(const ExportSegment* segment, ExportFrame* out)
+{
+    atomic_uint* sequence = (atomic_uint*)&segment->sequence;
+
+    for(uint32_t attempt = 0; attempt < EXPORT_READ_ATTEMPTS; ++attempt)
+    {
+        const unsigned before = atomic_load_explicit(sequence, memory_order_acquire);
+
+        if(before == 0)
+        {
+            return false;
+        }
+
+        if(before & 1)
+        {
+            thrd_yield();
+            continue;
+        }
+
+        memcpy(out, &segment->frame, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+
+        if(atomic_load_explicit(sequence, memory_order_relaxed) == before)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool export_segment_name(const char* name, char* out)
+{
+    name = name && name[0] != '\0' ? name : EXPORT_DEFAULT_NAME;
+    name += name[0] == '/' ? 1 : 0;
+
+#ifdef _WIN32
+    const int written = snprintf(out, EXPORT_MAX_NAME, "Local\\%s", name);
+#else
+    const int written = snprintf(out, EXPORT_MAX_NAME, "/%s", name);
+#endif
+    return written > 0 && written < EXPORT_MAX_NAME;
+}
+
+static void* export_map(const char* name, const bool writable, void** handle)
+{
+#ifdef _WIN32
+    HANDLE mapping = writable
+        ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(ExportSegment), name)
+        : OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+
+    if(!mapping)
+    {
+        fprintf(stderr, "Failed to open shared memory %s (%lu)\n", name, GetLastError());
+        return NULL;
+    }
+
+    void* view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(ExportSegment));
+
+    if(!view)
+    {
+        CloseHandle(mapping);
+        return NULL;
+    }
+
+    *handle = mapping;
+    return view;
+#else
+    (void)handle;
+    const int fd = shm_open(name, writable ? O_CREAT | O_RDWR : O_RDONLY, 0644);
+
+    if(fd < 0)
+    {
+        perror(name);
+        return NULL;
+    }
+
+    if(writable && ftruncate(fd, sizeof(ExportSegment)) != 0)
+    {
+        perror(name);
+        close(fd);
+        return NULL;
+    }
+
+    void* view = mmap(NULL, sizeof(ExportSegment), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return view != MAP_FAILED ? view : NULL;
+#endif
+}
+
+static void export_unmap(const char* name, const void* segment, void* handle, const bool remove)
+{
+#ifdef _WIN32
+    (void)name;
+    (void)remove;
+    UnmapViewOfFile(segment);
+
+    if(handle)
+    {
+        CloseHandle(handle);
+    }
+#else
+    (void)handle;
+    munmap((void*)segment, sizeof(ExportSegment));
+
+    if(remove)
+    {
+        shm_unlink(name);
+    }
+#endif
+}
@@ -0,0 +1,69 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "chip8.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Live machine state published to a shared memory segment once per frame. The
+// emulator writes the segment in place under a seqlock: sequence is odd while a
+// frame is being written, so readers retry until they see the same even value
+// before and after copying. Readers never block the emulator and neither side
+// makes a syscall per frame.
+
+#define EXPORT_MAGIC 0x48533843u // "C8SH"
+#define EXPORT_VERSION 1
+#define EXPORT_DEFAULT_NAME "chip8"
+
+enum
+{
+    EXPORT_FLAG_HALTED = 1 << 0,
+    EXPORT_FLAG_PAUSED = 1 << 1,
+};
+
+typedef struct ExportFrame
+{
+    uint64_t frame;
+    // timing_now_ns when the frame was published, same clock as the reader's
+    uint64_t publish_ns;
+    // Column major, bit n of a column is row n
+    uint32_t display[CHIP8_DISPLAY_COLUMNS];
+    uint16_t stack[16];
+    uint8_t v[16];
+    uint16_t index;
+    uint16_t pc;
+    uint16_t keys;
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint8_t profile;
+    uint8_t flags;
+    uint8_t reserved;
+} ExportFrame;
+
+typedef struct ExportSegment
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    atomic_uint sequence;
+    ExportFrame frame;
+} ExportSegment;
+
+typedef struct Exporter Exporter;
+
+// Emulator side, creates or takes over the named segment
+Exporter* export_open(const char* name);
+void export_close(Exporter* exporter);
+void export_publish(Exporter* exporter, const Chip8* vm);
+
+// Reader side, maps the named segment read only
+const ExportSegment* export_attach(const char* name);
+void export_detach(const ExportSegment* segment);
+// Copies the latest consistent frame. False if no frame has been published yet, or if
+// the writer stays mid-write through a bounded number of tries, as when it died there.
+bool export_read(const ExportSegment* segment, ExportFrame* out);
+
+#endif
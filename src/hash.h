@@ -0,0 +1,23 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_FNV1A64_SEED 0xcbf29ce484222325ull
+
+// FNV-1a, pass the previous result as seed to hash several buffers as one
+static inline uint64_t hash_fnv1a64(const void* data, const size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    for(size_t i = 0; i < size; ++i)
+    {
+        seed ^= bytes[i];
+        seed *= 0x100000001b3ull;
+    }
+
+    return seed;
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "heatmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Added to every channel of a byte that is not zero
+#define HEATMAP_CONTENT_GRAY 40
+
+static void heatmap_decay_counters(uint8_t* counters);
+
+Heatmap* heatmap_create(void)
+{
+    return calloc(1, sizeof(Heatmap));
+}
+
+void heatmap_destroy(Heatmap* heatmap)
+{
+    free(heatmap);
+}
+
+void heatmap_clear(Heatmap* heatmap)
+{
+    memset(heatmap, 0, sizeof(*heatmap));
+}
+
+void heatmap_decay(Heatmap* heatmap)
+{
+    heatmap_decay_counters(heatmap->reads);
+    heatmap_decay_counters(heatmap->writes);
+    heatmap_decay_counters(heatmap->executes);
+}
+
+void heatmap_render(const Heatmap* heatmap, const Chip8* vm, uint8_t* rgba)
+{
+    for(uint32_t page = 0; page < CHIP8_PAGE_COUNT; ++page)
+    {
+        const uint8_t* bytes = vm->pages[page]->bytes;
+
+        for(uint32_t i = 0; i < CHIP8_PAGE_SIZE; ++i)
+        {
+            const uint32_t address = page * CHIP8_PAGE_SIZE + i;
+            const uint32_t gray = bytes[i] != 0 ? HEATMAP_CONTENT_GRAY : 0;
+            const uint32_t red = heatmap->writes[address] + gray;
+            const uint32_t green = heatmap->reads[address] + gray;
+            const uint32_t blue = heatmap->executes[address] + gray;
+            uint8_t* pixel = &rgba[address * 4];
+            pixel[0] = (uint8_t)(red > 255 ? 255 : red);
+            pixel[1] = (uint8_t)(green > 255 ? 255 : green);
+            pixel[2] = (uint8_t)(blue > 255 ? 255 : blue);
+            pixel[3] = 255;
+        }
+    }
+}
+
+// Rounds up so every counter reaches zero, the loop has no branches and vectorizes
+static void heatmap_decay_counters(uint8_t* counters)
+{
+    for(uint32_t i = 0; i < CHIP8_RAM_SIZE; ++i)
+    {
+        counters[i] = (uint8_t)(counters[i] - ((counters[i] + 15) >> 4));
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+// Read, write and execute counters for every byte of guest RAM, kept by the traced
+// interpreters that chip8_step_traced runs. An access adds HEATMAP_HIT to a byte's
+// counter, saturating at 255, and heatmap_decay takes a sixteenth away every frame, so
+// a byte touched once fades out in about a second and one touched every frame stays
+// lit. chip8_step never looks at a heatmap, the plain interpreters have no counters.
+
+#define HEATMAP_SIDE 64
+#define HEATMAP_HIT 64
+
+struct Heatmap
+{
+    uint8_t reads[CHIP8_RAM_SIZE];
+    uint8_t writes[CHIP8_RAM_SIZE];
+    uint8_t executes[CHIP8_RAM_SIZE];
+};
+
+Heatmap* heatmap_create(void);
+void heatmap_destroy(Heatmap* heatmap);
+void heatmap_clear(Heatmap* heatmap);
+// Called once per frame
+void heatmap_decay(Heatmap* heatmap);
+// HEATMAP_SIDE squared RGBA pixels, one per byte in address order, rows of 64 bytes.
+// Writes are red, reads green and executes blue, on a gray telling bytes that are not
+// zero apart from those that are.
+void heatmap_render(const Heatmap* heatmap, const Chip8* vm, uint8_t* rgba);
+
+static inline void heatmap_touch(uint8_t* counters, const uint16_t address, const uint32_t count)
+{
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        uint8_t* counter = &counters[(address + i) & (CHIP8_RAM_SIZE - 1)];
+        *counter = (uint8_t)(*counter > 255 - HEATMAP_HIT ? 255 : *counter + HEATMAP_HIT);
+    }
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include "latency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Presses followed at once, more are ignored until some are answered
+#define LATENCY_MAX_PENDING 32
+// Frames a press may wait to be looked at and drawn before it counts as unanswered
+#define LATENCY_TIMEOUT_FRAMES 120
+
+typedef enum LatencyState
+{
+    LATENCY_FREE,
+    LATENCY_WAIT_DELIVER,
+    LATENCY_WAIT_OBSERVE,
+    LATENCY_WAIT_CHANGE,
+    LATENCY_WAIT_PRESENT,
+} LatencyState;
+
+typedef struct LatencyPending
+{
+    LatencyRecord record;
+    LatencyState state;
+    uint32_t frames;
+} LatencyPending;
+
+struct LatencyTracker
+{
+    LatencyPending pending[LATENCY_MAX_PENDING];
+    LatencyRecord* records;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t next;
+    uint32_t unanswered;
+};
+
+static void latency_percentiles(double* values, uint32_t count, LatencyPercentiles* out);
+static int latency_compare(const void* left, const void* right);
+
+LatencyTracker* latency_create(const uint32_t capacity)
+{
+    LatencyTracker* tracker = calloc(1, sizeof(LatencyTracker));
+
+    if(!tracker)
+    {
+        return NULL;
+    }
+
+    tracker->capacity = capacity > 0 ? capacity : 1;
+    tracker->records = calloc(tracker->capacity, sizeof(LatencyRecord));
+
+    if(!tracker->records)
+    {
+        free(tracker);
+        return NULL;
+    }
+
+    return tracker;
+}
+
+void latency_destroy(LatencyTracker* tracker)
+{
+    if(!tracker)
+    {
+        return;
+    }
+
+    free(tracker->records);
+    free(tracker);
+}
+
+void latency_reset(LatencyTracker* tracker)
+{
+    memset(tracker->pending, 0, sizeof(tracker->pending));
+    tracker->count = 0;
+    tracker->next = 0;
+    tracker->unanswered = 0;
+}
+
+void latency_key_down(LatencyTracker* tracker, const uint8_t key, const uint64_t event_ns)
+{
+    for(uint32_t i = 0; i < LATENCY_MAX_PENDING; ++i)
+    {
+        LatencyPending* pending = &tracker->pending[i];
+
+        if(pending->state == LATENCY_FREE)
+        {
+            memset(pending, 0, sizeof(*pending));
+            pending->record.key = key & 0xF;
+            pending->record.event_ns = event_ns;
+            pending->state = LATENCY_WAIT_DELIVER;
+            return;
+        }
+    }
+}
+
+void latency_frame_start(LatencyTracker* tracker, const uint64_t now_ns)
+{
+    for(uint32_t i = 0; i < LATENCY_MAX_PENDING; ++i)
+    {
+        LatencyPending* pending = &tracker->pending[i];
+
+        if(pending->state == LATENCY_WAIT_DELIVER)
+        {
+            pending->record.delivered_ns = now_ns;
+            pending->state = LATENCY_WAIT_OBSERVE;
+        }
+    }
+}
+
+void latency_frame_end(LatencyTracker* tracker, const uint16_t keys_down, const uint16_t keys_read, const uint16_t read_pc, const bool display_changed, const uint64_t now_ns)
+{
+    for(uint32_t i = 0; i < LATENCY_MAX_PENDING; ++i)
+    {
+        LatencyPending* pending = &tracker->pending[i];
+
+        if(pending->state == LATENCY_WAIT_OBSERVE && (keys_read & keys_down) >> pending->record.key & 1)
+        {
+            pending->record.observed_ns = now_ns;
+            pending->record.observed_pc = read_pc;
+            pending->state = LATENCY_WAIT_CHANGE;
+        }
+        else if(pending->state == LATENCY_WAIT_OBSERVE && !(keys_down >> pending->record.key & 1))
+        {
+            pending->state = LATENCY_FREE;
+            ++tracker->unanswered;
+            continue;
+        }
+
+        // A change drawn the same frame the key was looked at counts
+        if(pending->state == LATENCY_WAIT_CHANGE && display_changed)
+        {
+            pending->record.changed_ns = now_ns;
+            pending->state = LATENCY_WAIT_PRESENT;
+        }
+
+        if((pending->state == LATENCY_WAIT_OBSERVE || pending->state == LATENCY_WAIT_CHANGE) &&
+            ++pending->frames > LATENCY_TIMEOUT_FRAMES)
+        {
+            pending->state = LATENCY_FREE;
+            ++tracker->unanswered;
+        }
+    }
+}
+
+void latency_present(LatencyTracker* tracker, const uint64_t now_ns)
+{
+    for(uint32_t i = 0; i < LATENCY_MAX_PENDING; ++i)
+    {
+        LatencyPending* pending = &tracker->pending[i];
+
+        if(pending->state == LATENCY_WAIT_PRESENT)
+        {
+            pending->record.presented_ns = now_ns;
+            pending->state = LATENCY_FREE;
+            tracker->records[tracker->next] = pending->record;
+            tracker->next = (tracker->next + 1) % tracker->capacity;
+
+            if(tracker->count < tracker->capacity)
+            {
+                ++tracker->count;
+            }
+        }
+    }
+}
+
+void latency_summarize(const LatencyTracker* tracker, LatencySummary* summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    summary->events = tracker->count;
+    summary->unanswered = tracker->unanswered;
+
+    if(tracker->count == 0)
+    {
+        return;
+    }
+
+    double* values = malloc(sizeof(double) * tracker->count);
+
+    if(!values)
+    {
+        return;
+    }
+
+    LatencyPercentiles* stages[4] = {&summary->polling, &summary->emulation, &summary->present, &summary->total};
+
+    for(uint32_t stage = 0; stage < 4; ++stage)
+    {
+        for(uint32_t i = 0; i < tracker->count; ++i)
+        {
+            const LatencyRecord* record = &tracker->records[i];
+            const uint64_t spans[4] = {
+                record->delivered_ns - record->event_ns,
+                record->changed_ns - record->delivered_ns,
+                record->presented_ns - record->changed_ns,
+                record->presented_ns - record->event_ns
+            };
+            values[i] = (double)spans[stage] / 1e6;
+        }
+
+        latency_percentiles(values, tracker->count, stages[stage]);
+    }
+
+    free(values);
+}
+
+bool latency_write_csv(const LatencyTracker* tracker, const char* path)
+{
+    FILE* csv = fopen(path, "w");
+
+    if(!csv)
+    {
+        return false;
+    }
+
+    fprintf(csv, "key,observed_pc,event_ns,delivered_ns,observed_ns,changed_ns,presented_ns,total_ms\n");
+
+    // Oldest first, the ring starts at next once it has wrapped
+    const uint32_t first = tracker->count < tracker->capacity ? 0 : tracker->next;
+
+    for(uint32_t i = 0; i < tracker->count; ++i)
+    {
+        const LatencyRecord* record = &tracker->records[(first + i) % tracker->capacity];
+        fprintf(csv, "%X,%03x,%llu,%llu,%llu,%llu,%llu,%.3f\n", record->key, record->observed_pc,
+            (unsigned long long)record->event_ns, (unsigned long long)record->delivered_ns,
+            (unsigned long long)record->observed_ns, (unsigned long long)record->changed_ns,
+            (unsigned long long)record->presented_ns, (double)(record->presented_ns - record->event_ns) / 1e6);
+    }
+
+    return fclose(csv) == 0;
+}
+
+// Nearest rank percentiles
+static void latency_percentiles(double* values, const uint32_t count, LatencyPercentiles* out)
+{
+    qsort(values, count, sizeof(double), latency_compare);
+    out->p50_ms = values[(count - 1) * 50 / 100];
+    out->p95_ms = values[(count - 1) * 95 / 100];
+    out->p99_ms = values[(count - 1) * 99 / 100];
+}
+
+static int latency_compare(const void* left, const void* right)
+{
+    const double a = *(const double*)left;
+    const double b = *(const double*)right;
+    return (a > b) - (a < b);
+}
@@ -0,0 +1,61 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Input to photon latency. Each key press is followed through the pipeline: when the
+// frontend learned of it, the frame that handed it to the guest, the first SKP, SKNP
+// or Fx0A that looked at the key, the first frame after that whose display changed and
+// the present that showed it. Times come from the caller, so the frontend passes the
+// real clock and headless runs a synthetic one.
+
+typedef struct LatencyRecord
+{
+    uint64_t event_ns;
+    uint64_t delivered_ns;
+    uint64_t observed_ns;
+    uint64_t changed_ns;
+    uint64_t presented_ns;
+    // Instruction that first looked at the key
+    uint16_t observed_pc;
+    uint8_t key;
+} LatencyRecord;
+
+typedef struct LatencyPercentiles
+{
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+} LatencyPercentiles;
+
+typedef struct LatencySummary
+{
+    uint32_t events;
+    // Presses the guest never looked at or never drew a change for
+    uint32_t unanswered;
+    // Event to the frame that hands the key to the guest
+    LatencyPercentiles polling;
+    // That frame to the first display change after the guest looked at the key
+    LatencyPercentiles emulation;
+    // Display change to the present showing it
+    LatencyPercentiles present;
+    LatencyPercentiles total;
+} LatencySummary;
+
+typedef struct LatencyTracker LatencyTracker;
+
+// Keeps the last capacity records
+LatencyTracker* latency_create(uint32_t capacity);
+void latency_destroy(LatencyTracker* tracker);
+void latency_reset(LatencyTracker* tracker);
+void latency_key_down(LatencyTracker* tracker, uint8_t key, uint64_t event_ns);
+void latency_frame_start(LatencyTracker* tracker, uint64_t now_ns);
+// keys_read is the keys the guest looked at this frame, read_pc the first instruction that
+// did. A press released before the guest looked at it counts as unanswered.
+void latency_frame_end(LatencyTracker* tracker, uint16_t keys_down, uint16_t keys_read, uint16_t read_pc, bool display_changed, uint64_t now_ns);
+void latency_present(LatencyTracker* tracker, uint64_t now_ns);
+void latency_summarize(const LatencyTracker* tracker, LatencySummary* summary);
+bool latency_write_csv(const LatencyTracker* tracker, const char* path);
+
+#endif
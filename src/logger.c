@@ -0,0 +1,542 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "logger.h"
+#include "monitor.h"
+#include "timing.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+#define LOGGER_QUEUE_SIZE 1024
+#define LOGGER_MAX_ARGS 8
+#define LOGGER_STRING_BYTES 128
+#define LOGGER_LINE_BYTES 1024
+#define LOGGER_DEFAULT_RATE 100
+#define LOGGER_IDLE_WAIT_NS 10000000
+
+typedef enum LoggerArgType
+{
+    LOGGER_ARG_INT,
+    LOGGER_ARG_LONG,
+    LOGGER_ARG_LONG_LONG,
+    LOGGER_ARG_SIZE,
+    LOGGER_ARG_DOUBLE,
+    LOGGER_ARG_STRING,
+    LOGGER_ARG_POINTER,
+} LoggerArgType;
+
+// One conversion of a format string, parsed the same way when capturing and formatting
+typedef struct LoggerSpec
+{
+    const char* begin;
+    const char* end;
+    bool star_width;
+    bool star_precision;
+    LoggerArgType type;
+} LoggerSpec;
+
+typedef union LoggerArg
+{
+    long long i;
+    double d;
+    const void* p;
+    size_t s;
+} LoggerArg;
+
+typedef struct LoggerRecord
+{
+    const char* format;
+    uint32_t suppressed;
+    uint8_t level;
+    uint8_t arg_count;
+    bool truncated;
+    uint16_t string_bytes;
+    LoggerArg args[LOGGER_MAX_ARGS];
+    char strings[LOGGER_STRING_BYTES];
+} LoggerRecord;
+
+// Bounded MPSC queue, each cell's sequence says whether it is free for the producer
+// of a given position or holds a record for the consumer
+typedef struct LoggerCell
+{
+    atomic_size_t sequence;
+    LoggerRecord record;
+} LoggerCell;
+
+atomic_int g_logger_level = CHIP8_LOGLEVEL;
+
+static struct LoggerContext
+{
+    LoggerCell cells[LOGGER_QUEUE_SIZE];
+    atomic_size_t enqueue_position;
+    size_t dequeue_position;
+    atomic_uint dropped;
+    atomic_uint rate_limit;
+    atomic_bool stopping;
+    atomic_bool is_stdout_enabled;
+    once_flag started;
+    bool running;
+    thrd_t thread;
+    mtx_t lock;
+    cnd_t wake;
+    FILE* file;
+} s_logger = {
+    .dequeue_position = 0,
+    .started = ONCE_FLAG_INIT,
+    .running = false,
+    .file = NULL
+};
+
+static const char* LoggerLevelNames[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+
+static void logger_start(void);
+static int logger_thread(void* arg);
+static bool logger_admit(LoggerSite* site, uint32_t* suppressed);
+static const char* logger_parse_spec(const char* c, LoggerSpec* spec);
+static void logger_capture(LoggerRecord* record, va_list args);
+static size_t logger_format(const LoggerRecord* record, char* line, size_t size);
+static void logger_emit(const char* line, size_t length);
+
+void logger_set_level(const int level)
+{
+    atomic_store_explicit(&g_logger_level, level, memory_order_relaxed);
+}
+
+void logger_set_rate_limit(const uint32_t per_second)
+{
+    call_once(&s_logger.started, logger_start);
+    atomic_store_explicit(&s_logger.rate_limit, per_second, memory_order_relaxed);
+}
+
+void logger_set_stdout(const bool enabled)
+{
+    call_once(&s_logger.started, logger_start);
+    atomic_store_explicit(&s_logger.is_stdout_enabled, enabled, memory_order_relaxed);
+}
+
+void logger_write(LoggerSite* site, const int level, const char* format, ...)
+{
+    call_once(&s_logger.started, logger_start);
+    uint32_t suppressed = 0;
+
+    if(!logger_admit(site, &suppressed))
+    {
+        return;
+    }
+
+    size_t position = atomic_load_explicit(&s_logger.enqueue_position, memory_order_relaxed);
+    LoggerCell* cell;
+
+    for(;;)
+    {
+        cell = &s_logger.cells[position % LOGGER_QUEUE_SIZE];
+        const size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        const ptrdiff_t difference = (ptrdiff_t)(sequence - position);
+
+        if(difference == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&s_logger.enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(difference < 0)
+        {
+            // Full, the writer is behind
+            atomic_fetch_add_explicit(&s_logger.dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = atomic_load_explicit(&s_logger.enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    LoggerRecord* record = &cell->record;
+    record->format = format;
+    record->suppressed = suppressed;
+    record->level = (uint8_t)level;
+
+    va_list args;
+    va_start(args, format);
+    logger_capture(record, args);
+    va_end(args);
+
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+}
+
+void logger_shutdown(void)
+{
+    if(!s_logger.running)
+    {
+        return;
+    }
+
+    mtx_lock(&s_logger.lock);
+    atomic_store(&s_logger.stopping, true);
+    cnd_signal(&s_logger.wake);
+    mtx_unlock(&s_logger.lock);
+
+    thrd_join(s_logger.thread, NULL);
+    s_logger.running = false;
+
+    if(s_logger.file)
+    {
+        fclose(s_logger.file);
+        s_logger.file = NULL;
+    }
+}
+
+static void logger_start(void)
+{
+    for(size_t i = 0; i < LOGGER_QUEUE_SIZE; ++i)
+    {
+        atomic_init(&s_logger.cells[i].sequence, i);
+    }
+
+    atomic_init(&s_logger.enqueue_position, 0);
+    atomic_init(&s_logger.dropped, 0);
+    atomic_init(&s_logger.rate_limit, LOGGER_DEFAULT_RATE);
+    atomic_init(&s_logger.stopping, false);
+    atomic_init(&s_logger.is_stdout_enabled, true);
+
+    const char* path = getenv("CHIP8_LOG_FILE");
+    s_logger.file = path && path[0] != '\0' ? fopen(path, "w") : NULL;
+
+    mtx_init(&s_logger.lock, mtx_plain);
+    cnd_init(&s_logger.wake);
+    s_logger.running = thrd_create(&s_logger.thread, logger_thread, NULL) == thrd_success;
+}
+
+static int logger_thread(void* arg)
+{
+    (void)arg;
+    char line[LOGGER_LINE_BYTES];
+
+    for(;;)
+    {
+        LoggerCell* cell = &s_logger.cells[s_logger.dequeue_position % LOGGER_QUEUE_SIZE];
+        const size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+
+        if(sequence == s_logger.dequeue_position + 1)
+        {
+            logger_emit(line, logger_format(&cell->record, line, sizeof(line)));
+            atomic_store_explicit(&cell->sequence, s_logger.dequeue_position + LOGGER_QUEUE_SIZE, memory_order_release);
+            ++s_logger.dequeue_position;
+            continue;
+        }
+
+        const uint32_t dropped = atomic_exchange_explicit(&s_logger.dropped, 0, memory_order_relaxed);
+
+        if(dropped > 0)
+        {
+            logger_emit(line, (size_t)snprintf(line, sizeof(line), "WARNING: %u log messages dropped, the log writer fell behind\n", dropped));
+        }
+
+        fflush(stdout);
+
+        if(s_logger.file)
+        {
+            fflush(s_logger.file);
+        }
+
+        // A record that is claimed but not yet published is picked up after the next wait
+        if(atomic_load(&s_logger.stopping) && atomic_load(&s_logger.enqueue_position) == s_logger.dequeue_position)
+        {
+            break;
+        }
+
+        // Producers never signal, so the queue is polled while idle
+        struct timespec until;
+        timespec_get(&until, TIME_UTC);
+        until.tv_nsec += LOGGER_IDLE_WAIT_NS;
+        until.tv_sec += until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+
+        mtx_lock(&s_logger.lock);
+
+        if(!atomic_load(&s_logger.stopping))
+        {
+            cnd_timedwait(&s_logger.wake, &s_logger.lock, &until);
+        }
+
+        mtx_unlock(&s_logger.lock);
+    }
+
+    return 0;
+}
+
+static bool logger_admit(LoggerSite* site, uint32_t* suppressed)
+{
+    const uint32_t limit = atomic_load_explicit(&s_logger.rate_limit, memory_order_relaxed);
+
+    if(limit == 0)
+    {
+        return true;
+    }
+
+    // Windows are whole seconds, the first message of a window resets the count
+    const uint64_t window = timing_now_ns() / 1000000000 + 1;
+    uint_least64_t current = atomic_load_explicit(&site->window, memory_order_relaxed);
+
+    if(current != window && atomic_compare_exchange_strong(&site->window, &current, window))
+    {
+        atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+    }
+
+    if(atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed) >= limit)
+    {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+
+    *suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    return true;
+}
+
+static const char* logger_parse_spec(const char* c, LoggerSpec* spec)
+{
+    spec->begin = c++;
+    spec->star_width = false;
+    spec->star_precision = false;
+
+    while(*c != '\0' && strchr("-+ #0", *c))
+    {
+        ++c;
+    }
+
+    if(*c == '*')
+    {
+        spec->star_width = true;
+        ++c;
+    }
+
+    while(isdigit((unsigned char)*c))
+    {
+        ++c;
+    }
+
+    if(*c == '.')
+    {
+        ++c;
+
+        if(*c == '*')
+        {
+            spec->star_precision = true;
+            ++c;
+        }
+
+        while(isdigit((unsigned char)*c))
+        {
+            ++c;
+        }
+    }
+
+    LoggerArgType integer = LOGGER_ARG_INT;
+
+    if(*c == 'h')
+    {
+        c += c[1] == 'h' ? 2 : 1;
+    }
+    else if(*c == 'l')
+    {
+        integer = c[1] == 'l' ? LOGGER_ARG_LONG_LONG : LOGGER_ARG_LONG;
+        c += c[1] == 'l' ? 2 : 1;
+    }
+    else if(*c == 'z')
+    {
+        integer = LOGGER_ARG_SIZE;
+        ++c;
+    }
+
+    switch(*c)
+    {
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec->type = LOGGER_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->type = LOGGER_ARG_STRING;
+            break;
+        case 'p':
+            spec->type = LOGGER_ARG_POINTER;
+            break;
+        default:
+            spec->type = integer;
+            break;
+    }
+
+    spec->end = *c != '\0' ? c + 1 : c;
+    return spec->end;
+}
+
+static void logger_capture(LoggerRecord* record, va_list args)
+{
+    record->arg_count = 0;
+    record->string_bytes = 0;
+    record->truncated = false;
+
+    for(const char* c = strchr(record->format, '%'); c; c = strchr(c, '%'))
+    {
+        if(c[1] == '%')
+        {
+            c += 2;
+            continue;
+        }
+
+        LoggerSpec spec;
+        c = logger_parse_spec(c, &spec);
+        const uint8_t needed = (uint8_t)(1 + spec.star_width + spec.star_precision);
+
+        if(record->arg_count + needed > LOGGER_MAX_ARGS)
+        {
+            record->truncated = true;
+            return;
+        }
+
+        if(spec.star_width)
+        {
+            record->args[record->arg_count++].i = va_arg(args, int);
+        }
+
+        if(spec.star_precision)
+        {
+            record->args[record->arg_count++].i = va_arg(args, int);
+        }
+
+        LoggerArg* arg = &record->args[record->arg_count++];
+
+        switch(spec.type)
+        {
+            case LOGGER_ARG_INT: arg->i = va_arg(args, int); break;
+            case LOGGER_ARG_LONG: arg->i = va_arg(args, long); break;
+            case LOGGER_ARG_LONG_LONG: arg->i = va_arg(args, long long); break;
+            case LOGGER_ARG_SIZE: arg->s = va_arg(args, size_t); break;
+            case LOGGER_ARG_DOUBLE: arg->d = va_arg(args, double); break;
+            case LOGGER_ARG_POINTER: arg->p = va_arg(args, const void*); break;
+            case LOGGER_ARG_STRING:
+            {
+                // Strings are copied since the caller's buffer may be gone by the time the line is written.
+                // The last byte stays an empty string for the arguments that no longer fit.
+                const char* text = va_arg(args, const char*);
+                const size_t space = LOGGER_STRING_BYTES - 1 - record->string_bytes;
+
+                if(space <= 1)
+                {
+                    arg->s = LOGGER_STRING_BYTES - 1;
+                    record->strings[LOGGER_STRING_BYTES - 1] = '\0';
+                    record->truncated = true;
+                    break;
+                }
+
+                const size_t length = text ? strnlen(text, space - 1) : 0;
+                record->truncated = record->truncated || (text && text[length] != '\0');
+
+                arg->s = record->string_bytes;
+                memcpy(&record->strings[record->string_bytes], text ? text : "", length);
+                record->strings[record->string_bytes + length] = '\0';
+                record->string_bytes = (uint16_t)(record->string_bytes + length + 1);
+                break;
+            }
+        }
+    }
+}
+
+static size_t logger_format(const LoggerRecord* record, char* line, const size_t size)
+{
+    // Keeps one byte for the newline
+    const size_t limit = size - 1;
+    const char* level = record->level < sizeof(LoggerLevelNames) / sizeof(LoggerLevelNames[0]) ? LoggerLevelNames[record->level] : "LOG";
+    size_t length = (size_t)snprintf(line, limit, "%s: ", level);
+    uint8_t next = 0;
+
+    for(const char* c = record->format; *c != '\0' && length < limit - 1;)
+    {
+        if(*c != '%' || c[1] == '%')
+        {
+            line[length++] = *c;
+            c += *c == '%' ? 2 : 1;
+            continue;
+        }
+
+        LoggerSpec spec;
+        c = logger_parse_spec(c, &spec);
+        const uint8_t needed = (uint8_t)(1 + spec.star_width + spec.star_precision);
+
+        if(next + needed > record->arg_count)
+        {
+            break;
+        }
+
+        // Each conversion is formatted on its own, with * replaced by the captured value
+        char format[64];
+        size_t format_length = 0;
+
+        for(const char* s = spec.begin; s < spec.end && format_length < sizeof(format) - 16; ++s)
+        {
+            if(*s == '*')
+            {
+                format_length += (size_t)snprintf(&format[format_length], 16, "%lld", record->args[next++].i);
+            }
+            else
+            {
+                format[format_length++] = *s;
+            }
+        }
+
+        format[format_length] = '\0';
+
+        const LoggerArg* arg = &record->args[next++];
+        char* out = &line[length];
+        const size_t space = limit - length;
+        int written = 0;
+
+        switch(spec.type)
+        {
+            case LOGGER_ARG_INT: written = snprintf(out, space, format, (int)arg->i); break;
+            case LOGGER_ARG_LONG: written = snprintf(out, space, format, (long)arg->i); break;
+            case LOGGER_ARG_LONG_LONG: written = snprintf(out, space, format, arg->i); break;
+            case LOGGER_ARG_SIZE: written = snprintf(out, space, format, arg->s); break;
+            case LOGGER_ARG_DOUBLE: written = snprintf(out, space, format, arg->d); break;
+            case LOGGER_ARG_POINTER: written = snprintf(out, space, format, arg->p); break;
+            case LOGGER_ARG_STRING: written = snprintf(out, space, format, &record->strings[arg->s]); break;
+        }
+
+        length += written > 0 ? ((size_t)written < space ? (size_t)written : space - 1) : 0;
+    }
+
+    if(record->truncated && length + 4 < limit)
+    {
+        memcpy(&line[length], " ...", 4);
+        length += 4;
+    }
+
+    if(record->suppressed > 0 && length < limit)
+    {
+        const int written = snprintf(&line[length], limit - length, " (%u similar messages suppressed)", record->suppressed);
+        length += written > 0 ? ((size_t)written < limit - length ? (size_t)written : limit - length - 1) : 0;
+    }
+
+    line[length++] = '\n';
+    return length;
+}
+
+static void logger_emit(const char* line, const size_t length)
+{
+    if(atomic_load_explicit(&s_logger.is_stdout_enabled, memory_order_relaxed))
+    {
+        fwrite(line, 1, length, stdout);
+    }
+
+    if(s_logger.file)
+    {
+        fwrite(line, 1, length, s_logger.file);
+    }
+}
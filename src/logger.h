@@ -0,0 +1,34 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Asynchronous logger behind monitor_log. Callers copy the format string pointer and
+// the raw arguments into a bounded lock-free queue, a background thread formats them
+// and writes stdout and the file named by CHIP8_LOG_FILE. Messages are dropped and
+// counted when the queue is full, so a slow terminal never stalls emulation.
+
+// Per call site state for rate limiting, zero initialized
+typedef struct LoggerSite
+{
+    atomic_uint_least64_t window;
+    atomic_uint count;
+    atomic_uint suppressed;
+} LoggerSite;
+
+// Lowest level that is logged, read by the monitor_log macro before it evaluates anything
+extern atomic_int g_logger_level;
+
+void logger_set_level(int level);
+// Messages per second each call site may log, 0 for no limit
+void logger_set_rate_limit(uint32_t per_second);
+// format must outlive the program, like a string literal. %s arguments are copied.
+void logger_write(LoggerSite* site, int level, const char* format, ...);
+// Whether messages go to stdout as well as CHIP8_LOG_FILE, for frontends drawing there
+void logger_set_stdout(bool enabled);
+// Writes out everything queued and stops the logger thread
+void logger_shutdown(void);
+
+#endif
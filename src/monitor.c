@@ -1,42 +1,74 @@
 #include "monitor.h"
 #include "renderer.h"
 
-#include <stdarg.h>
+#if !defined(RUN_TESTS) && !defined(CHIP8_HEADLESS)
+#include "terminal.h"
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define MONITOR_COLUMNS 64
 #define MONITOR_ROWS 32
 
-static uint32_t MONITOR[MONITOR_COLUMNS];
-
-static void monitor_set_pixel(uint8_t x, uint8_t y, bool set, bool* did_collide);
-
-void monitor_initialize(const InitFunc init_func, const UpdateFunc update_func, const ShutdownFunc shutdown_func)
+// The frontend behind every monitor call, the raylib window unless the terminal is picked
+typedef struct MonitorFrontend
 {
-    renderer_initialize(MONITOR);
-    renderer_set_init_func(init_func);
-    renderer_set_update_func(update_func);
-    renderer_set_shutdown_func(shutdown_func);
-    renderer_do_update();
-    renderer_shutdown();
-}
-
-void monitor_log(const LogLevel level, const char* text, ...)
+    void (*initialize)(const uint32_t* monitor);
+    void (*do_update)(void);
+    void (*shutdown)(void);
+    void (*set_init_func)(InitFunc init_func);
+    void (*set_update_func)(UpdateFunc update_func);
+    void (*set_shutdown_func)(ShutdownFunc shutdown_func);
+    bool (*get_key)(uint8_t* out_key);
+    bool (*is_key_down)(uint8_t key);
+    void (*play_tone)(void);
+    void (*stop_tone)(void);
+    void (*set_audio)(const uint8_t* pattern, uint8_t pitch);
+} MonitorFrontend;
+
+static const MonitorFrontend WindowFrontend = {
+    renderer_initialize, renderer_do_update, renderer_shutdown,
+    renderer_set_init_func, renderer_set_update_func, renderer_set_shutdown_func,
+    renderer_get_key, renderer_is_key_down, renderer_play_tone, renderer_stop_tone, renderer_set_audio
+};
+
+#if !defined(RUN_TESTS) && !defined(CHIP8_HEADLESS)
+static const MonitorFrontend TerminalFrontend = {
+    terminal_initialize, terminal_do_update, terminal_shutdown,
+    terminal_set_init_func, terminal_set_update_func, terminal_set_shutdown_func,
+    terminal_get_key, terminal_is_key_down, terminal_play_tone, terminal_stop_tone, terminal_set_audio
+};
+#endif
+
+static const MonitorFrontend* s_frontend = &WindowFrontend;
+
+static const MonitorFrontend* monitor_select_frontend(void);
+static void monitor_set_pixel(uint32_t* monitor, uint8_t x, uint8_t y, bool set, bool* did_collide);
+
+void monitor_initialize(const uint32_t* monitor, const InitFunc init_func, const UpdateFunc update_func, const ShutdownFunc shutdown_func)
 {
-    va_list args;
-    va_start(args, text);
-    renderer_log(level, text, args);
-    va_end(args);
+    s_frontend = monitor_select_frontend();
+    s_frontend->initialize(monitor);
+    s_frontend->set_init_func(init_func);
+    s_frontend->set_update_func(update_func);
+    s_frontend->set_shutdown_func(shutdown_func);
+    s_frontend->do_update();
+    s_frontend->shutdown();
+
+#if !defined(RUN_TESTS) && !defined(CHIP8_HEADLESS)
+    logger_shutdown();
+#endif
 }
 
-void monitor_clear(void)
+void monitor_clear(uint32_t* monitor)
 {
-    memset(MONITOR, 0, sizeof(MONITOR));
+    memset(monitor, 0, MONITOR_COLUMNS * sizeof(monitor[0]));
 }
 
-void monitor_draw_sprite(const uint8_t x, const uint8_t y, const uint8_t* sprite, const uint8_t sprite_size_in_bytes, bool* did_collide)
+void monitor_draw_sprite(uint32_t* monitor, const uint8_t x, const uint8_t y, const uint8_t* sprite, const uint8_t sprite_size_in_bytes, bool* did_collide)
 {
     *did_collide = false;
     
@@ -52,36 +84,108 @@ void monitor_draw_sprite(const uint8_t x, const uint8_t y, const uint8_t* sprite
                 continue;
             }
 
-            monitor_set_pixel(x + i, y + j, set, did_collide);
+            monitor_set_pixel(monitor, x + i, y + j, set, did_collide);
+        }
+    }
+}
+
+// The sprite origin wraps but pixels past the right and bottom edges are dropped
+void monitor_draw_sprite_clipped(uint32_t* monitor, uint8_t x, uint8_t y, const uint8_t* sprite, const uint8_t sprite_size_in_bytes, bool* did_collide)
+{
+    x %= MONITOR_COLUMNS;
+    y %= MONITOR_ROWS;
+
+    const uint8_t columns = MONITOR_COLUMNS - x < 8 ? MONITOR_COLUMNS - x : 8;
+    const uint8_t rows = MONITOR_ROWS - y < sprite_size_in_bytes ? MONITOR_ROWS - y : sprite_size_in_bytes;
+    uint32_t collisions = 0;
+
+    for(uint8_t i = 0; i < columns; ++i)
+    {
+        uint32_t column_bits = 0;
+
+        for(uint8_t j = 0; j < rows; ++j)
+        {
+            column_bits |= (uint32_t)((sprite[j] >> (7 - i)) & 0x1) << (y + j);
         }
+
+        collisions |= monitor[x + i] & column_bits;
+        monitor[x + i] ^= column_bits;
     }
+
+    *did_collide = collisions != 0;
 }
 
-static void monitor_set_pixel(uint8_t x, uint8_t y, const bool set, bool* did_collide)
+static void monitor_set_pixel(uint32_t* monitor, uint8_t x, uint8_t y, const bool set, bool* did_collide)
 {
     x = x >= MONITOR_COLUMNS ? x % MONITOR_COLUMNS : x;
     y = y >= MONITOR_ROWS ? y % MONITOR_ROWS : y;
 
-    MONITOR[x] ^= (set << y);
-    *did_collide = *did_collide || (MONITOR[x] & (1 << y)) == 0;
+    monitor[x] ^= ((uint32_t)set << y);
+    *did_collide = *did_collide || (monitor[x] & ((uint32_t)1 << y)) == 0;
 }
 
 bool monitor_get_key(uint8_t* out_key)
 {
-    return renderer_get_key(out_key);
+    return s_frontend->get_key(out_key);
 }
 
 bool monitor_is_key_down(const uint8_t key)
 {
-    return renderer_is_key_down(key);
+    return s_frontend->is_key_down(key);
+}
+
+uint16_t monitor_get_keys_down(void)
+{
+    uint16_t keys = 0;
+
+    for(uint8_t key = 0; key < 16; ++key)
+    {
+        keys |= (uint16_t)(s_frontend->is_key_down(key) << key);
+    }
+
+    return keys;
 }
 
 void monitor_play_tone(void)
 {
-    renderer_play_tone();
+    s_frontend->play_tone();
 }
 
 void monitor_stop_tone(void)
 {
-    renderer_stop_tone();
+    s_frontend->stop_tone();
+}
+
+void monitor_set_audio(const uint8_t* pattern, const uint8_t pitch)
+{
+    s_frontend->set_audio(pattern, pitch);
+}
+
+// CHIP8_FRONTEND set to terminal or braille draws in the terminal and window forces the
+// window. Unset, a POSIX session without a display, such as SSH, gets the terminal.
+static const MonitorFrontend* monitor_select_frontend(void)
+{
+#if !defined(RUN_TESTS) && !defined(CHIP8_HEADLESS)
+    const char* frontend = getenv("CHIP8_FRONTEND");
+
+    if(frontend && strcmp(frontend, "braille") == 0)
+    {
+        terminal_set_cells(ANSI_BRAILLE);
+        return &TerminalFrontend;
+    }
+
+    if(frontend && strcmp(frontend, "terminal") == 0)
+    {
+        return &TerminalFrontend;
+    }
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+    if(!frontend && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY"))
+    {
+        return &TerminalFrontend;
+    }
+#endif
+#endif
+
+    return &WindowFrontend;
 }
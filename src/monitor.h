@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifndef CHIP8_LOGLEVEL
+#define CHIP8_LOGLEVEL 0
+#endif
+
 typedef enum LogLevel
 {
     LOG_DEBUG,
@@ -16,13 +20,36 @@ typedef void (*InitFunc)(const char*);
 typedef void (*UpdateFunc)(void);
 typedef void (*ShutdownFunc)(void);
 
-void monitor_initialize(InitFunc init_func, UpdateFunc update_func, ShutdownFunc shutdown_func);
-void monitor_clear(void);
-void monitor_draw_sprite(uint8_t x, uint8_t y, const uint8_t* sprite, uint8_t sprite_size_in_bytes, bool* did_collide);
+void monitor_initialize(const uint32_t* monitor, InitFunc init_func, UpdateFunc update_func, ShutdownFunc shutdown_func);
+void monitor_clear(uint32_t* monitor);
+void monitor_draw_sprite(uint32_t* monitor, uint8_t x, uint8_t y, const uint8_t* sprite, uint8_t sprite_size_in_bytes, bool* did_collide);
+void monitor_draw_sprite_clipped(uint32_t* monitor, uint8_t x, uint8_t y, const uint8_t* sprite, uint8_t sprite_size_in_bytes, bool* did_collide);
 bool monitor_get_key(uint8_t* out_key);
 bool monitor_is_key_down(uint8_t key);
+uint16_t monitor_get_keys_down(void);
 void monitor_play_tone(void);
 void monitor_stop_tone(void);
-void monitor_log(LogLevel level, const char* text, ...);
+// The XO-CHIP pattern of 16 bytes and pitch the tone plays, sent every frame
+void monitor_set_audio(const uint8_t* pattern, uint8_t pitch);
+
+// Checks the level before any argument is evaluated, levels below CHIP8_LOGLEVEL compile
+// away entirely. text must be a string literal, formatting happens on the logger thread.
+// The tests and headless tools have no log output.
+#if defined(RUN_TESTS) || defined(CHIP8_HEADLESS)
+#define monitor_log(level, ...) ((void)0)
+#else
+#include "logger.h"
+
+#define monitor_log(level, ...)                                                                         \
+    do                                                                                                  \
+    {                                                                                                   \
+        if((int)(level) >= CHIP8_LOGLEVEL                                                               \
+            && (int)(level) >= atomic_load_explicit(&g_logger_level, memory_order_relaxed))             \
+        {                                                                                               \
+            static LoggerSite monitor_log_site;                                                         \
+            logger_write(&monitor_log_site, (int)(level), __VA_ARGS__);                                  \
+        }                                                                                               \
+    } while(0)
+#endif
 
 #endif
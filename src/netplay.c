@@ -0,0 +1,580 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "netplay.h"
+#include "hash.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET NetplaySocket;
+#define NETPLAY_INVALID_SOCKET INVALID_SOCKET
+#define netplay_close_socket closesocket
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int NetplaySocket;
+#define NETPLAY_INVALID_SOCKET -1
+#define netplay_close_socket close
+#endif
+
+#define NETPLAY_MAGIC 0x504E3843u // "C8NP"
+// Inputs resent per packet, the remote peer stalls before more are unacknowledged
+#define NETPLAY_MAX_INPUTS (NETPLAY_WINDOW / 2)
+#define NETPLAY_HEADER_SIZE 28
+#define NETPLAY_MAX_PACKET (NETPLAY_HEADER_SIZE + NETPLAY_MAX_INPUTS * 2)
+// Packets held back by the simulated delay
+#define NETPLAY_QUEUE_SIZE 256
+// Confirmed frames hashed for desync detection, and how many hashes are kept
+#define NETPLAY_HASH_INTERVAL 16
+#define NETPLAY_HASH_SLOTS 8
+#define NETPLAY_NO_FRAME 0xFFFFFFFFu
+
+typedef struct NetplayDelayed
+{
+    uint64_t release_ns;
+    uint32_t size;
+    bool used;
+    uint8_t bytes[NETPLAY_MAX_PACKET];
+} NetplayDelayed;
+
+typedef struct NetplayHash
+{
+    uint32_t frame;
+    uint64_t hash;
+} NetplayHash;
+
+struct NetplaySession
+{
+    NetplayConfig config;
+    NetplaySocket socket;
+    struct sockaddr_storage remote;
+    socklen_t remote_size;
+    // State before each frame in the window, and the keys it ran with
+    Chip8 states[NETPLAY_WINDOW];
+    uint16_t local_keys[NETPLAY_WINDOW];
+    uint16_t remote_keys[NETPLAY_WINDOW];
+    // Next frame to run
+    uint32_t frame;
+    // Remote inputs are known for frames before remote_count
+    uint32_t remote_count;
+    // The remote peer has our inputs for frames before remote_ack
+    uint32_t remote_ack;
+    // Earliest frame that ran with a mispredicted input
+    uint32_t rollback_frame;
+    uint32_t next_hash_frame;
+    NetplayHash local_hashes[NETPLAY_HASH_SLOTS];
+    NetplayHash remote_hashes[NETPLAY_HASH_SLOTS];
+    NetplayHash last_hash;
+    NetplayDelayed queue[NETPLAY_QUEUE_SIZE];
+    uint32_t rng;
+    NetplayStats stats;
+};
+
+static bool netplay_open_socket(NetplaySession* session);
+static void netplay_receive(NetplaySession* session);
+static void netplay_read_packet(NetplaySession* session, const uint8_t* bytes, size_t size);
+static void netplay_rollback(NetplaySession* session, Chip8* vm);
+static void netplay_run_frame(NetplaySession* session, Chip8* vm, uint32_t frame);
+static void netplay_hash_confirmed(NetplaySession* session);
+static void netplay_compare_hash(NetplaySession* session, uint32_t frame);
+static void netplay_send(NetplaySession* session, uint64_t now_ns);
+static void netplay_flush(NetplaySession* session, uint64_t now_ns);
+static uint32_t netplay_random(NetplaySession* session);
+static void netplay_put16(uint8_t* out, uint16_t value);
+static void netplay_put32(uint8_t* out, uint32_t value);
+static uint16_t netplay_get16(const uint8_t* in);
+static uint32_t netplay_get32(const uint8_t* in);
+
+NetplaySession* netplay_create(const NetplayConfig* config)
+{
+    NetplaySession* session = calloc(1, sizeof(NetplaySession));
+
+    if(!session)
+    {
+        return NULL;
+    }
+
+    session->config = *config;
+    session->config.max_prediction = config->max_prediction > 0 ? config->max_prediction : NETPLAY_DEFAULT_PREDICTION;
+
+    if(session->config.max_prediction >= NETPLAY_WINDOW / 2)
+    {
+        session->config.max_prediction = NETPLAY_WINDOW / 2 - 1;
+    }
+
+    session->socket = NETPLAY_INVALID_SOCKET;
+
+    if(!netplay_open_socket(session))
+    {
+        netplay_destroy(session);
+        return NULL;
+    }
+
+    netplay_reset(session);
+    return session;
+}
+
+void netplay_destroy(NetplaySession* session)
+{
+    if(!session)
+    {
+        return;
+    }
+
+    if(session->socket != NETPLAY_INVALID_SOCKET)
+    {
+        netplay_close_socket(session->socket);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    for(uint32_t i = 0; i < NETPLAY_WINDOW; ++i)
+    {
+        chip8_release(&session->states[i]);
+    }
+
+    free(session);
+}
+
+void netplay_reset(NetplaySession* session)
+{
+    // Packets still queued belong to the previous game
+    netplay_receive(session);
+
+    session->frame = 0;
+    session->remote_count = 0;
+    session->remote_ack = 0;
+    session->rollback_frame = NETPLAY_NO_FRAME;
+    session->next_hash_frame = NETPLAY_HASH_INTERVAL;
+    session->last_hash = (NetplayHash){.frame = NETPLAY_NO_FRAME, .hash = 0};
+    session->rng = session->config.seed * 2654435761u + session->config.local_player + 1;
+    memset(session->local_keys, 0, sizeof(session->local_keys));
+    memset(session->remote_keys, 0, sizeof(session->remote_keys));
+    memset(session->queue, 0, sizeof(session->queue));
+    memset(&session->stats, 0, sizeof(session->stats));
+
+    for(uint32_t i = 0; i < NETPLAY_HASH_SLOTS; ++i)
+    {
+        session->local_hashes[i].frame = NETPLAY_NO_FRAME;
+        session->remote_hashes[i].frame = NETPLAY_NO_FRAME;
+    }
+}
+
+void netplay_poll(NetplaySession* session, Chip8* vm, const uint64_t now_ns)
+{
+    netplay_receive(session);
+    netplay_rollback(session, vm);
+    netplay_hash_confirmed(session);
+    netplay_send(session, now_ns);
+}
+
+bool netplay_advance(NetplaySession* session, Chip8* vm, const uint16_t local_keys, const uint64_t now_ns)
+{
+    netplay_receive(session);
+    netplay_rollback(session, vm);
+    netplay_hash_confirmed(session);
+
+    // Stall rather than predict too far ahead or drop inputs the remote peer still needs
+    if(session->frame >= session->remote_count + session->config.max_prediction ||
+        session->frame - session->remote_ack >= NETPLAY_MAX_INPUTS)
+    {
+        ++session->stats.stalls;
+        netplay_send(session, now_ns);
+        return false;
+    }
+
+    session->local_keys[session->frame % NETPLAY_WINDOW] = local_keys;
+    netplay_run_frame(session, vm, session->frame);
+    ++session->frame;
+    ++session->stats.frames;
+    netplay_send(session, now_ns);
+    return true;
+}
+
+uint32_t netplay_confirmed_frames(const NetplaySession* session)
+{
+    return session->remote_count < session->frame ? session->remote_count : session->frame;
+}
+
+void netplay_get_stats(const NetplaySession* session, NetplayStats* stats)
+{
+    *stats = session->stats;
+}
+
+uint64_t netplay_state_hash(const Chip8* vm)
+{
+    uint64_t hash = hash_fnv1a64(vm->display, sizeof(vm->display), HASH_FNV1A64_SEED);
+    hash = hash_fnv1a64(vm->v, sizeof(vm->v), hash);
+    hash = hash_fnv1a64(vm->stack, sizeof(vm->stack), hash);
+    hash = hash_fnv1a64(&vm->index, sizeof(vm->index), hash);
+    hash = hash_fnv1a64(&vm->pc, sizeof(vm->pc), hash);
+    hash = hash_fnv1a64(&vm->sp, sizeof(vm->sp), hash);
+    hash = hash_fnv1a64(&vm->delay_timer, sizeof(vm->delay_timer), hash);
+    hash = hash_fnv1a64(&vm->sound_timer, sizeof(vm->sound_timer), hash);
+    hash = hash_fnv1a64(vm->audio_pattern, sizeof(vm->audio_pattern), hash);
+    hash = hash_fnv1a64(&vm->pitch, sizeof(vm->pitch), hash);
+    hash = hash_fnv1a64(&vm->rng, sizeof(vm->rng), hash);
+
+    for(uint32_t i = 0; i < CHIP8_PAGE_COUNT; ++i)
+    {
+        hash = hash_fnv1a64(vm->pages[i]->bytes, CHIP8_PAGE_SIZE, hash);
+    }
+
+    return hash;
+}
+
+static bool netplay_open_socket(NetplaySession* session)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+
+    if(WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    {
+        return false;
+    }
+#endif
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    char port[8];
+    snprintf(port, sizeof(port), "%u", session->config.remote_port);
+    struct addrinfo* remote = NULL;
+
+    if(getaddrinfo(session->config.remote_host, port, &hints, &remote) != 0 || !remote)
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    memcpy(&session->remote, remote->ai_addr, remote->ai_addrlen);
+    session->remote_size = (socklen_t)remote->ai_addrlen;
+    freeaddrinfo(remote);
+
+    session->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if(session->socket == NETPLAY_INVALID_SOCKET)
+    {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(session->config.local_port);
+
+    if(bind(session->socket, (const struct sockaddr*)&local, sizeof(local)) != 0)
+    {
+        return false;
+    }
+
+    // Reads happen once per frame and must never wait for the remote peer
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    return ioctlsocket(session->socket, FIONBIO, &non_blocking) == 0;
+#else
+    const int flags = fcntl(session->socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(session->socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+static void netplay_receive(NetplaySession* session)
+{
+    uint8_t bytes[NETPLAY_MAX_PACKET];
+
+    for(;;)
+    {
+        const int size = (int)recvfrom(session->socket, (char*)bytes, sizeof(bytes), 0, NULL, NULL);
+
+        if(size < 0)
+        {
+            return;
+        }
+
+        netplay_read_packet(session, bytes, (size_t)size);
+    }
+}
+
+static void netplay_read_packet(NetplaySession* session, const uint8_t* bytes, const size_t size)
+{
+    if(size < NETPLAY_HEADER_SIZE || netplay_get32(bytes) != NETPLAY_MAGIC || bytes[4] == session->config.local_player)
+    {
+        return;
+    }
+
+    const uint32_t count = bytes[5];
+    const uint32_t first_frame = netplay_get32(bytes + 8);
+    const uint32_t ack = netplay_get32(bytes + 12);
+    const uint32_t hash_frame = netplay_get32(bytes + 16);
+    const uint64_t hash = (uint64_t)netplay_get32(bytes + 20) | (uint64_t)netplay_get32(bytes + 24) << 32;
+
+    if(size < NETPLAY_HEADER_SIZE + count * 2 || count > NETPLAY_MAX_INPUTS)
+    {
+        return;
+    }
+
+    ++session->stats.packets_received;
+
+    if(ack > session->remote_ack && ack <= session->frame)
+    {
+        session->remote_ack = ack;
+    }
+
+    // Inputs are taken in order only, anything after a gap is resent later
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t frame = first_frame + i;
+
+        if(frame != session->remote_count || frame >= session->frame + NETPLAY_WINDOW / 2)
+        {
+            continue;
+        }
+
+        const uint16_t keys = netplay_get16(bytes + NETPLAY_HEADER_SIZE + i * 2);
+        const uint32_t slot = frame % NETPLAY_WINDOW;
+
+        if(frame < session->frame && session->remote_keys[slot] != keys && frame < session->rollback_frame)
+        {
+            session->rollback_frame = frame;
+        }
+
+        session->remote_keys[slot] = keys;
+        ++session->remote_count;
+    }
+
+    if(hash_frame != NETPLAY_NO_FRAME)
+    {
+        NetplayHash* remote = &session->remote_hashes[(hash_frame / NETPLAY_HASH_INTERVAL) % NETPLAY_HASH_SLOTS];
+
+        if(remote->frame != hash_frame)
+        {
+            remote->frame = hash_frame;
+            remote->hash = hash;
+            netplay_compare_hash(session, hash_frame);
+        }
+    }
+}
+
+static void netplay_rollback(NetplaySession* session, Chip8* vm)
+{
+    if(session->rollback_frame >= session->frame)
+    {
+        session->rollback_frame = NETPLAY_NO_FRAME;
+        return;
+    }
+
+    const uint64_t start = timing_now_ns();
+    const uint32_t first = session->rollback_frame;
+    chip8_copy(vm, &session->states[first % NETPLAY_WINDOW]);
+
+    for(uint32_t frame = first; frame < session->frame; ++frame)
+    {
+        netplay_run_frame(session, vm, frame);
+    }
+
+    const uint64_t elapsed = timing_now_ns() - start;
+    const uint32_t frames = session->frame - first;
+    session->rollback_frame = NETPLAY_NO_FRAME;
+    ++session->stats.rollbacks;
+    session->stats.resimulated_frames += frames;
+
+    if(frames > session->stats.max_rollback_frames)
+    {
+        session->stats.max_rollback_frames = frames;
+    }
+
+    if(elapsed > session->stats.max_rollback_ns)
+    {
+        session->stats.max_rollback_ns = elapsed;
+    }
+}
+
+static void netplay_run_frame(NetplaySession* session, Chip8* vm, const uint32_t frame)
+{
+    const uint32_t slot = frame % NETPLAY_WINDOW;
+    const uint32_t previous = (frame + NETPLAY_WINDOW - 1) % NETPLAY_WINDOW;
+
+    // Unknown remote keys are predicted to stay as they were last seen
+    if(frame >= session->remote_count)
+    {
+        session->remote_keys[slot] = session->remote_count > 0 ? session->remote_keys[(session->remote_count - 1) % NETPLAY_WINDOW] : 0;
+    }
+
+    const uint16_t keys = session->local_keys[slot] | session->remote_keys[slot];
+    const uint16_t held = frame > 0 ? session->local_keys[previous] | session->remote_keys[previous] : 0;
+
+    chip8_copy(&session->states[slot], vm);
+    vm->keys = keys;
+    vm->keys_pressed = keys & (uint16_t)~held;
+    chip8_step(vm);
+}
+
+static void netplay_hash_confirmed(NetplaySession* session)
+{
+    // The state before a frame is final once every input before it is known
+    while(session->next_hash_frame <= session->remote_count && session->next_hash_frame < session->frame)
+    {
+        const uint32_t frame = session->next_hash_frame;
+        NetplayHash* local = &session->local_hashes[(frame / NETPLAY_HASH_INTERVAL) % NETPLAY_HASH_SLOTS];
+        local->frame = frame;
+        local->hash = netplay_state_hash(&session->states[frame % NETPLAY_WINDOW]);
+        session->last_hash = *local;
+        session->next_hash_frame += NETPLAY_HASH_INTERVAL;
+        netplay_compare_hash(session, frame);
+    }
+}
+
+static void netplay_compare_hash(NetplaySession* session, const uint32_t frame)
+{
+    const uint32_t slot = (frame / NETPLAY_HASH_INTERVAL) % NETPLAY_HASH_SLOTS;
+    const NetplayHash* local = &session->local_hashes[slot];
+    const NetplayHash* remote = &session->remote_hashes[slot];
+
+    if(local->frame != frame || remote->frame != frame)
+    {
+        return;
+    }
+
+    ++session->stats.hashes_compared;
+
+    if(local->hash != remote->hash)
+    {
+        if(session->stats.desyncs == 0)
+        {
+            session->stats.desync_frame = frame;
+        }
+
+        ++session->stats.desyncs;
+    }
+}
+
+static void netplay_send(NetplaySession* session, const uint64_t now_ns)
+{
+    // Every input the remote peer has not acknowledged, oldest first
+    const uint32_t first = session->remote_ack;
+    const uint32_t pending = session->frame - first;
+    const uint32_t count = pending < NETPLAY_MAX_INPUTS ? pending : NETPLAY_MAX_INPUTS;
+
+    uint8_t packet[NETPLAY_MAX_PACKET];
+    netplay_put32(packet, NETPLAY_MAGIC);
+    packet[4] = session->config.local_player;
+    packet[5] = (uint8_t)count;
+    netplay_put16(packet + 6, 0);
+    netplay_put32(packet + 8, first);
+    netplay_put32(packet + 12, session->remote_count);
+    netplay_put32(packet + 16, session->last_hash.frame);
+    netplay_put32(packet + 20, (uint32_t)session->last_hash.hash);
+    netplay_put32(packet + 24, (uint32_t)(session->last_hash.hash >> 32));
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        netplay_put16(packet + NETPLAY_HEADER_SIZE + i * 2, session->local_keys[(first + i) % NETPLAY_WINDOW]);
+    }
+
+    const uint32_t size = NETPLAY_HEADER_SIZE + count * 2;
+    ++session->stats.packets_sent;
+
+    if(session->config.loss_percent > 0 && netplay_random(session) % 100 < session->config.loss_percent)
+    {
+        ++session->stats.packets_dropped;
+        netplay_flush(session, now_ns);
+        return;
+    }
+
+    if(session->config.delay_ms == 0 && session->config.jitter_ms == 0)
+    {
+        sendto(session->socket, (const char*)packet, size, 0, (const struct sockaddr*)&session->remote, session->remote_size);
+        return;
+    }
+
+    const uint32_t jitter = session->config.jitter_ms > 0 ? netplay_random(session) % (session->config.jitter_ms + 1) : 0;
+    bool queued = false;
+
+    for(uint32_t i = 0; i < NETPLAY_QUEUE_SIZE && !queued; ++i)
+    {
+        NetplayDelayed* delayed = &session->queue[i];
+
+        if(!delayed->used)
+        {
+            delayed->used = true;
+            delayed->release_ns = now_ns + (uint64_t)(session->config.delay_ms + jitter) * 1000000ull;
+            delayed->size = size;
+            memcpy(delayed->bytes, packet, size);
+            queued = true;
+        }
+    }
+
+    if(!queued)
+    {
+        ++session->stats.packets_dropped;
+    }
+
+    netplay_flush(session, now_ns);
+}
+
+static void netplay_flush(NetplaySession* session, const uint64_t now_ns)
+{
+    for(uint32_t i = 0; i < NETPLAY_QUEUE_SIZE; ++i)
+    {
+        NetplayDelayed* delayed = &session->queue[i];
+
+        if(delayed->used && delayed->release_ns <= now_ns)
+        {
+            sendto(session->socket, (const char*)delayed->bytes, delayed->size, 0, (const struct sockaddr*)&session->remote, session->remote_size);
+            delayed->used = false;
+        }
+    }
+}
+
+static uint32_t netplay_random(NetplaySession* session)
+{
+    // xorshift32, so a simulated network drops the same packets every run
+    uint32_t x = session->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    session->rng = x;
+    return x;
+}
+
+static void netplay_put16(uint8_t* out, const uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void netplay_put32(uint8_t* out, const uint32_t value)
+{
+    netplay_put16(out, (uint16_t)value);
+    netplay_put16(out + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t netplay_get16(const uint8_t* in)
+{
+    return (uint16_t)(in[0] | in[1] << 8);
+}
+
+static uint32_t netplay_get32(const uint8_t* in)
+{
+    return (uint32_t)netplay_get16(in) | (uint32_t)netplay_get16(in + 2) << 16;
+}
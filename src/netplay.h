@@ -0,0 +1,74 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Rollback netplay between two peers. Each peer runs its own machine and sends the
+// keys it holds every frame over UDP, resending every input the other side has not
+// acknowledged, so a lost packet is covered by the next one. Frames run right away
+// with the remote keys predicted to be the last ones received. When a late input
+// differs from the prediction, the machine is restored to the state saved before that
+// frame and run forward again before the frame is shown. Both peers hash the machine
+// at confirmed frames and exchange the hashes to detect a desync.
+//
+// The machine the session drives is the caller's, both peers must start it from the
+// same ROM and seed. Keys of the two players are combined, so each player uses the
+// keys the ROM gives their side.
+
+#define NETPLAY_WINDOW 64
+#define NETPLAY_DEFAULT_PREDICTION 8
+
+typedef struct NetplayConfig
+{
+    uint16_t local_port;
+    const char* remote_host;
+    uint16_t remote_port;
+    // 0 or 1, only used to tell the peers' packets apart
+    uint8_t local_player;
+    // Frames run ahead of the last remote input before stalling, 0 uses the default
+    uint32_t max_prediction;
+    // Simulated network on the sending side, for testing over loopback
+    uint32_t delay_ms;
+    uint32_t jitter_ms;
+    uint32_t loss_percent;
+    uint32_t seed;
+} NetplayConfig;
+
+typedef struct NetplayStats
+{
+    uint64_t frames;
+    uint64_t stalls;
+    uint64_t rollbacks;
+    uint64_t resimulated_frames;
+    uint32_t max_rollback_frames;
+    uint64_t max_rollback_ns;
+    uint64_t packets_sent;
+    uint64_t packets_received;
+    uint64_t packets_dropped;
+    uint64_t hashes_compared;
+    uint64_t desyncs;
+    // First frame the hashes differed at, valid when desyncs > 0
+    uint32_t desync_frame;
+} NetplayStats;
+
+typedef struct NetplaySession NetplaySession;
+
+NetplaySession* netplay_create(const NetplayConfig* config);
+void netplay_destroy(NetplaySession* session);
+// Starts again from frame 0, call after loading the ROM into the machine
+void netplay_reset(NetplaySession* session);
+// Reads packets, rolls the machine back and forward if an input was mispredicted and
+// sends the inputs and hashes the remote peer is missing
+void netplay_poll(NetplaySession* session, Chip8* vm, uint64_t now_ns);
+// Polls then runs one frame with local_keys, false if stalled waiting for the remote peer
+bool netplay_advance(NetplaySession* session, Chip8* vm, uint16_t local_keys, uint64_t now_ns);
+// Frames whose inputs from both peers are known
+uint32_t netplay_confirmed_frames(const NetplaySession* session);
+void netplay_get_stats(const NetplaySession* session, NetplayStats* stats);
+// Display, registers and RAM, the hash peers compare
+uint64_t netplay_state_hash(const Chip8* vm);
+
+#endif
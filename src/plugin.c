@@ -0,0 +1,590 @@
+#include "plugin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define PLUGIN_SUFFIX ".dll"
+#else
+#include <dirent.h>
+#include <dlfcn.h>
+#ifdef __APPLE__
+#define PLUGIN_SUFFIX ".dylib"
+#else
+#define PLUGIN_SUFFIX ".so"
+#endif
+#endif
+
+#define PLUGIN_MAX_PLUGINS 32
+#define PLUGIN_MAX_HOOKS 256
+#define PLUGIN_NAME_SIZE 64
+#define PLUGIN_PATH_SIZE 1024
+
+typedef enum PluginHookKind
+{
+    PLUGIN_HOOK_FRAME_END,
+    PLUGIN_HOOK_ROM_LOAD,
+    PLUGIN_HOOK_HALT,
+    PLUGIN_HOOK_KEY,
+    PLUGIN_HOOK_PC,
+    PLUGIN_HOOK_OPCODE,
+    PLUGIN_HOOK_KIND_COUNT
+} PluginHookKind;
+
+typedef struct PluginHook
+{
+    PluginHookKind kind;
+    Chip8Plugin* plugin;
+    union
+    {
+        Chip8FrameHook frame;
+        Chip8RomHook rom;
+        Chip8HaltHook halt;
+        Chip8KeyHook key;
+        Chip8InstructionHook instruction;
+    } func;
+    void* user;
+    // The address of PC hooks, mask and value of opcode hooks
+    uint16_t mask;
+    uint16_t value;
+} PluginHook;
+
+struct Chip8Plugin
+{
+    PluginHost* host;
+    void* library;
+    Chip8PluginUnloadFunc unload;
+    // Plugins may keep the table they were loaded with
+    Chip8PluginHost table;
+    char name[PLUGIN_NAME_SIZE];
+    // Hooks may only be registered while the plugin's load runs
+    bool is_loading;
+};
+
+struct PluginHost
+{
+    PluginLogFunc log;
+    Chip8Plugin plugins[PLUGIN_MAX_PLUGINS];
+    uint32_t plugin_count;
+    PluginHook hooks[PLUGIN_MAX_HOOKS];
+    uint32_t hook_count;
+    uint32_t kind_counts[PLUGIN_HOOK_KIND_COUNT];
+    Chip8Breakpoints breakpoints;
+    uint64_t frame;
+    uint16_t keys;
+    bool was_halted;
+};
+
+static bool plugin_load_file(PluginHost* host, const char* path, const char* name);
+static void plugin_drop_hooks(PluginHost* host, const Chip8Plugin* plugin);
+static void plugin_mark_breakpoints(PluginHost* host);
+static void plugin_fill_view(const PluginHost* host, const Chip8* vm, Chip8PluginView* view);
+static void plugin_instruction(const Chip8* vm, uint16_t instruction, void* context);
+static bool plugin_add_hook(Chip8Plugin* plugin, PluginHook hook);
+static bool plugin_on_frame_end(Chip8Plugin* plugin, Chip8FrameHook hook, void* user);
+static bool plugin_on_rom_load(Chip8Plugin* plugin, Chip8RomHook hook, void* user);
+static bool plugin_on_halt(Chip8Plugin* plugin, Chip8HaltHook hook, void* user);
+static bool plugin_on_key(Chip8Plugin* plugin, Chip8KeyHook hook, void* user);
+static bool plugin_on_pc(Chip8Plugin* plugin, uint16_t pc, Chip8InstructionHook hook, void* user);
+static bool plugin_on_opcode(Chip8Plugin* plugin, uint16_t mask, uint16_t value, Chip8InstructionHook hook, void* user);
+static uint8_t plugin_read_ram(const Chip8PluginView* view, uint16_t address);
+static void plugin_read_ram_range(const Chip8PluginView* view, uint16_t address, uint8_t* out, uint32_t count);
+static void plugin_log(Chip8Plugin* plugin, const char* text);
+static int plugin_compare_names(const void* a, const void* b);
+static void* plugin_open_library(const char* path);
+static void* plugin_find_symbol(void* library, const char* symbol);
+static void plugin_close_library(void* library);
+
+PluginHost* plugin_host_create(const PluginLogFunc log)
+{
+    PluginHost* host = calloc(1, sizeof(PluginHost));
+
+    if(!host)
+    {
+        return NULL;
+    }
+
+    host->log = log;
+    host->breakpoints.func = plugin_instruction;
+    host->breakpoints.context = host;
+    return host;
+}
+
+void plugin_host_destroy(PluginHost* host)
+{
+    if(!host)
+    {
+        return;
+    }
+
+    for(uint32_t i = host->plugin_count; i-- > 0;)
+    {
+        if(host->plugins[i].unload)
+        {
+            host->plugins[i].unload();
+        }
+
+        plugin_close_library(host->plugins[i].library);
+    }
+
+    free(host);
+}
+
+uint32_t plugin_load_directory(PluginHost* host, const char* path)
+{
+    char names[PLUGIN_MAX_PLUGINS][PLUGIN_NAME_SIZE];
+    uint32_t name_count = 0;
+    const size_t suffix_size = strlen(PLUGIN_SUFFIX);
+
+#ifdef _WIN32
+    char pattern[PLUGIN_PATH_SIZE];
+    snprintf(pattern, sizeof(pattern), "%s\\*" PLUGIN_SUFFIX, path);
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    do
+    {
+        const char* file = entry.cFileName;
+#else
+    DIR* directory = opendir(path);
+
+    if(!directory)
+    {
+        return 0;
+    }
+
+    for(const struct dirent* entry = readdir(directory); entry; entry = readdir(directory))
+    {
+        const char* file = entry->d_name;
+#endif
+        const size_t size = strlen(file);
+
+        if(size > suffix_size && size < PLUGIN_NAME_SIZE && strcmp(file + size - suffix_size, PLUGIN_SUFFIX) == 0
+            && name_count < PLUGIN_MAX_PLUGINS)
+        {
+            memcpy(names[name_count++], file, size + 1);
+        }
+#ifdef _WIN32
+    } while(FindNextFileA(find, &entry));
+
+    FindClose(find);
+#else
+    }
+
+    closedir(directory);
+#endif
+
+    // Hooks of the same kind run in the order their plugins loaded
+    qsort(names, name_count, sizeof(names[0]), plugin_compare_names);
+    uint32_t loaded = 0;
+
+    for(uint32_t i = 0; i < name_count; ++i)
+    {
+        char file[PLUGIN_PATH_SIZE];
+        const int size = snprintf(file, sizeof(file), "%s/%s", path, names[i]);
+
+        if(size < 0 || (size_t)size >= sizeof(file))
+        {
+            continue;
+        }
+
+        loaded += plugin_load_file(host, file, names[i]);
+    }
+
+    plugin_mark_breakpoints(host);
+    return loaded;
+}
+
+uint32_t plugin_count(const PluginHost* host)
+{
+    return host->plugin_count;
+}
+
+const Chip8Breakpoints* plugin_breakpoints(const PluginHost* host)
+{
+    return host->kind_counts[PLUGIN_HOOK_PC] + host->kind_counts[PLUGIN_HOOK_OPCODE] > 0 ? &host->breakpoints : NULL;
+}
+
+void plugin_rom_loaded(PluginHost* host, const Chip8* vm, const char* path)
+{
+    host->frame = 0;
+    host->keys = vm->keys;
+    host->was_halted = vm->halted;
+
+    if(host->kind_counts[PLUGIN_HOOK_ROM_LOAD] == 0)
+    {
+        return;
+    }
+
+    Chip8PluginView view;
+    plugin_fill_view(host, vm, &view);
+
+    for(uint32_t i = 0; i < host->hook_count; ++i)
+    {
+        const PluginHook* hook = &host->hooks[i];
+
+        if(hook->kind == PLUGIN_HOOK_ROM_LOAD)
+        {
+            hook->func.rom(&view, path, hook->user);
+        }
+    }
+}
+
+void plugin_keys(PluginHost* host, const Chip8* vm)
+{
+    const uint16_t changed = host->keys ^ vm->keys;
+    host->keys = vm->keys;
+
+    if(changed == 0 || host->kind_counts[PLUGIN_HOOK_KEY] == 0)
+    {
+        return;
+    }
+
+    Chip8PluginView view;
+    plugin_fill_view(host, vm, &view);
+
+    for(uint8_t key = 0; key < 16; ++key)
+    {
+        if(!(changed & (1u << key)))
+        {
+            continue;
+        }
+
+        for(uint32_t i = 0; i < host->hook_count; ++i)
+        {
+            const PluginHook* hook = &host->hooks[i];
+
+            if(hook->kind == PLUGIN_HOOK_KEY)
+            {
+                hook->func.key(&view, key, (vm->keys >> key) & 1, hook->user);
+            }
+        }
+    }
+}
+
+void plugin_frame_end(PluginHost* host, const Chip8* vm)
+{
+    const bool is_halting = vm->halted && !host->was_halted;
+    host->was_halted = vm->halted;
+
+    if(host->kind_counts[PLUGIN_HOOK_FRAME_END] + (is_halting ? host->kind_counts[PLUGIN_HOOK_HALT] : 0) > 0)
+    {
+        Chip8PluginView view;
+        plugin_fill_view(host, vm, &view);
+
+        for(uint32_t i = 0; i < host->hook_count && is_halting; ++i)
+        {
+            const PluginHook* hook = &host->hooks[i];
+
+            if(hook->kind == PLUGIN_HOOK_HALT)
+            {
+                hook->func.halt(&view, hook->user);
+            }
+        }
+
+        for(uint32_t i = 0; i < host->hook_count; ++i)
+        {
+            const PluginHook* hook = &host->hooks[i];
+
+            if(hook->kind == PLUGIN_HOOK_FRAME_END)
+            {
+                hook->func.frame(&view, hook->user);
+            }
+        }
+    }
+
+    ++host->frame;
+}
+
+static bool plugin_load_file(PluginHost* host, const char* path, const char* name)
+{
+    if(host->plugin_count == PLUGIN_MAX_PLUGINS)
+    {
+        return false;
+    }
+
+    Chip8Plugin* plugin = &host->plugins[host->plugin_count];
+    memset(plugin, 0, sizeof(*plugin));
+    plugin->host = host;
+    // The directory scan only takes names shorter than PLUGIN_NAME_SIZE
+    memcpy(plugin->name, name, strlen(name) + 1);
+    plugin->library = plugin_open_library(path);
+
+    if(!plugin->library)
+    {
+        plugin_log(plugin, "Failed to open the library");
+        return false;
+    }
+
+    // Converting the symbols to function pointers is what POSIX and Windows both promise works
+    const uint32_t* abi_version = plugin_find_symbol(plugin->library, CHIP8_PLUGIN_ABI_SYMBOL);
+    const Chip8PluginLoadFunc load = (Chip8PluginLoadFunc)plugin_find_symbol(plugin->library, CHIP8_PLUGIN_LOAD_SYMBOL);
+    plugin->unload = (Chip8PluginUnloadFunc)plugin_find_symbol(plugin->library, CHIP8_PLUGIN_UNLOAD_SYMBOL);
+
+    if(!abi_version)
+    {
+        plugin_log(plugin, "No " CHIP8_PLUGIN_ABI_SYMBOL " exported");
+        plugin_close_library(plugin->library);
+        return false;
+    }
+
+    if(*abi_version != CHIP8_PLUGIN_ABI_VERSION)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "Built against plugin ABI %u, the emulator has %u", (unsigned)*abi_version,
+            (unsigned)CHIP8_PLUGIN_ABI_VERSION);
+        plugin_log(plugin, text);
+        plugin_close_library(plugin->library);
+        return false;
+    }
+
+    if(!load)
+    {
+        plugin_log(plugin, "No " CHIP8_PLUGIN_LOAD_SYMBOL " exported");
+        plugin_close_library(plugin->library);
+        return false;
+    }
+
+    plugin->table = (Chip8PluginHost){
+        .size = sizeof(Chip8PluginHost),
+        .abi_version = CHIP8_PLUGIN_ABI_VERSION,
+        .plugin = plugin,
+        .on_frame_end = plugin_on_frame_end,
+        .on_rom_load = plugin_on_rom_load,
+        .on_halt = plugin_on_halt,
+        .on_key = plugin_on_key,
+        .on_pc = plugin_on_pc,
+        .on_opcode = plugin_on_opcode,
+        .read_ram = plugin_read_ram,
+        .read_ram_range = plugin_read_ram_range,
+        .log = plugin_log
+    };
+
+    plugin->is_loading = true;
+    const bool is_loaded = load(&plugin->table);
+    plugin->is_loading = false;
+
+    if(!is_loaded)
+    {
+        plugin_log(plugin, "Declined to load");
+        plugin_drop_hooks(host, plugin);
+        plugin_close_library(plugin->library);
+        return false;
+    }
+
+    ++host->plugin_count;
+    return true;
+}
+
+static void plugin_drop_hooks(PluginHost* host, const Chip8Plugin* plugin)
+{
+    uint32_t kept = 0;
+
+    for(uint32_t i = 0; i < host->hook_count; ++i)
+    {
+        if(host->hooks[i].plugin != plugin)
+        {
+            host->hooks[kept++] = host->hooks[i];
+        }
+        else
+        {
+            --host->kind_counts[host->hooks[i].kind];
+        }
+    }
+
+    host->hook_count = kept;
+}
+
+// The table is only rebuilt between frames, after plugins load
+static void plugin_mark_breakpoints(PluginHost* host)
+{
+    memset(host->breakpoints.pcs, 0, sizeof(host->breakpoints.pcs));
+    memset(host->breakpoints.opcodes, 0, sizeof(host->breakpoints.opcodes));
+
+    for(uint32_t i = 0; i < host->hook_count; ++i)
+    {
+        const PluginHook* hook = &host->hooks[i];
+
+        if(hook->kind == PLUGIN_HOOK_PC)
+        {
+            host->breakpoints.pcs[hook->value] = 1;
+        }
+        else if(hook->kind == PLUGIN_HOOK_OPCODE)
+        {
+            // Masks that leave the top nibble open mark every opcode group
+            for(uint32_t group = 0; group < 16; ++group)
+            {
+                if(((group << 12) & hook->mask) == (hook->value & hook->mask & 0xF000))
+                {
+                    host->breakpoints.opcodes[group] = 1;
+                }
+            }
+        }
+    }
+}
+
+static void plugin_fill_view(const PluginHost* host, const Chip8* vm, Chip8PluginView* view)
+{
+    view->size = sizeof(Chip8PluginView);
+    view->frame = host->frame;
+    view->pc = vm->pc;
+    view->index = vm->index;
+    memcpy(view->v, vm->v, sizeof(view->v));
+    memcpy(view->stack, vm->stack, sizeof(view->stack));
+    view->sp = vm->sp;
+    view->delay_timer = vm->delay_timer;
+    view->sound_timer = vm->sound_timer;
+    view->keys = vm->keys;
+    view->fault = (uint8_t)vm->fault;
+    view->fault_pc = vm->fault_pc;
+    view->display = vm->display;
+    view->machine = vm;
+}
+
+// Reached only through a marked address or opcode group, the hooks then filter exactly
+static void plugin_instruction(const Chip8* vm, const uint16_t instruction, void* context)
+{
+    const PluginHost* host = context;
+    const uint16_t pc = vm->pc & (CHIP8_RAM_SIZE - 1);
+    Chip8PluginView view;
+    bool is_filled = false;
+
+    for(uint32_t i = 0; i < host->hook_count; ++i)
+    {
+        const PluginHook* hook = &host->hooks[i];
+        const bool is_hit = (hook->kind == PLUGIN_HOOK_PC && hook->value == pc)
+            || (hook->kind == PLUGIN_HOOK_OPCODE && (instruction & hook->mask) == hook->value);
+
+        if(is_hit)
+        {
+            if(!is_filled)
+            {
+                plugin_fill_view(host, vm, &view);
+                is_filled = true;
+            }
+
+            hook->func.instruction(&view, instruction, hook->user);
+        }
+    }
+}
+
+static bool plugin_add_hook(Chip8Plugin* plugin, const PluginHook hook)
+{
+    PluginHost* host = plugin->host;
+
+    if(!plugin->is_loading || host->hook_count == PLUGIN_MAX_HOOKS)
+    {
+        return false;
+    }
+
+    host->hooks[host->hook_count] = hook;
+    host->hooks[host->hook_count].plugin = plugin;
+    ++host->hook_count;
+    ++host->kind_counts[hook.kind];
+    return true;
+}
+
+static bool plugin_on_frame_end(Chip8Plugin* plugin, const Chip8FrameHook hook, void* user)
+{
+    return hook && plugin_add_hook(plugin, (PluginHook){.kind = PLUGIN_HOOK_FRAME_END, .func.frame = hook, .user = user});
+}
+
+static bool plugin_on_rom_load(Chip8Plugin* plugin, const Chip8RomHook hook, void* user)
+{
+    return hook && plugin_add_hook(plugin, (PluginHook){.kind = PLUGIN_HOOK_ROM_LOAD, .func.rom = hook, .user = user});
+}
+
+static bool plugin_on_halt(Chip8Plugin* plugin, const Chip8HaltHook hook, void* user)
+{
+    return hook && plugin_add_hook(plugin, (PluginHook){.kind = PLUGIN_HOOK_HALT, .func.halt = hook, .user = user});
+}
+
+static bool plugin_on_key(Chip8Plugin* plugin, const Chip8KeyHook hook, void* user)
+{
+    return hook && plugin_add_hook(plugin, (PluginHook){.kind = PLUGIN_HOOK_KEY, .func.key = hook, .user = user});
+}
+
+static bool plugin_on_pc(Chip8Plugin* plugin, const uint16_t pc, const Chip8InstructionHook hook, void* user)
+{
+    return hook && plugin_add_hook(plugin, (PluginHook){
+        .kind = PLUGIN_HOOK_PC,
+        .func.instruction = hook,
+        .user = user,
+        .mask = 0xFFFF,
+        .value = pc & (CHIP8_RAM_SIZE - 1)
+    });
+}
+
+static bool plugin_on_opcode(Chip8Plugin* plugin, const uint16_t mask, const uint16_t value, const Chip8InstructionHook hook, void* user)
+{
+    return hook && plugin_add_hook(plugin, (PluginHook){
+        .kind = PLUGIN_HOOK_OPCODE,
+        .func.instruction = hook,
+        .user = user,
+        .mask = mask,
+        .value = value & mask
+    });
+}
+
+static uint8_t plugin_read_ram(const Chip8PluginView* view, const uint16_t address)
+{
+    return chip8_read(view->machine, address);
+}
+
+static void plugin_read_ram_range(const Chip8PluginView* view, const uint16_t address, uint8_t* out, const uint32_t count)
+{
+    chip8_read_range(view->machine, address, out, count);
+}
+
+static void plugin_log(Chip8Plugin* plugin, const char* text)
+{
+    if(plugin->host->log)
+    {
+        plugin->host->log(plugin->name, text);
+    }
+}
+
+static int plugin_compare_names(const void* a, const void* b)
+{
+    return strcmp(a, b);
+}
+
+#ifdef _WIN32
+static void* plugin_open_library(const char* path)
+{
+    return (void*)LoadLibraryA(path);
+}
+
+static void* plugin_find_symbol(void* library, const char* symbol)
+{
+    return (void*)GetProcAddress((HMODULE)library, symbol);
+}
+
+static void plugin_close_library(void* library)
+{
+    FreeLibrary((HMODULE)library);
+}
+#else
+static void* plugin_open_library(const char* path)
+{
+    return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+}
+
+static void* plugin_find_symbol(void* library, const char* symbol)
+{
+    return dlsym(library, symbol);
+}
+
+static void plugin_close_library(void* library)
+{
+    dlclose(library);
+}
+#endif
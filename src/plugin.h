@@ -0,0 +1,33 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include "chip8.h"
+#include "chip8_plugin.h"
+
+// Host side of chip8_plugin.h. Loads the plugins of a directory, keeps the hooks they
+// register and calls them from the emulation thread. Instruction hooks are marked in a
+// Chip8Breakpoints the caller steps traced frames with while plugin_breakpoints is set.
+
+typedef struct PluginHost PluginHost;
+
+// Receives what plugins log, name is the file the plugin was loaded from
+typedef void (*PluginLogFunc)(const char* name, const char* text);
+
+PluginHost* plugin_host_create(PluginLogFunc log);
+// Calls every plugin's unload and closes the libraries
+void plugin_host_destroy(PluginHost* host);
+// Loads every shared library in path in name order, returns how many loaded
+uint32_t plugin_load_directory(PluginHost* host, const char* path);
+uint32_t plugin_count(const PluginHost* host);
+
+// NULL while no plugin hooks an instruction, so frames can run untraced
+const Chip8Breakpoints* plugin_breakpoints(const PluginHost* host);
+
+// A ROM was loaded into vm, restarts the frame count
+void plugin_rom_loaded(PluginHost* host, const Chip8* vm, const char* path);
+// Before a frame, calls the key hooks for every key that went down or up since the last
+void plugin_keys(PluginHost* host, const Chip8* vm);
+// After a frame, calls the halt hooks if vm just halted and then the frame hooks
+void plugin_frame_end(PluginHost* host, const Chip8* vm);
+
+#endif
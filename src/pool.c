@@ -0,0 +1,184 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "pool.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct ThreadPool
+{
+    thrd_t* workers;
+    uint32_t worker_count;
+    mtx_t lock;
+    cnd_t work_ready;
+    cnd_t work_done;
+    uint64_t generation;
+    uint32_t busy_workers;
+    bool stopping;
+    PoolTaskFunc func;
+    void* context;
+    uint32_t count;
+    atomic_uint next;
+};
+
+static int pool_worker(void* arg);
+static void pool_drain(ThreadPool* pool);
+
+ThreadPool* pool_create(uint32_t worker_count)
+{
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+
+    if(!pool)
+    {
+        return NULL;
+    }
+
+    // The calling thread also takes work in pool_for
+    worker_count = worker_count == 0 ? pool_hardware_threads() : worker_count;
+    pool->worker_count = worker_count > 1 ? worker_count - 1 : 0;
+    pool->workers = calloc(pool->worker_count + 1, sizeof(thrd_t));
+
+    if(!pool->workers)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    mtx_init(&pool->lock, mtx_plain);
+    cnd_init(&pool->work_ready);
+    cnd_init(&pool->work_done);
+    atomic_init(&pool->next, 0);
+
+    for(uint32_t i = 0; i < pool->worker_count; ++i)
+    {
+        if(thrd_create(&pool->workers[i], pool_worker, pool) != thrd_success)
+        {
+            pool->worker_count = i;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+void pool_destroy(ThreadPool* pool)
+{
+    if(!pool)
+    {
+        return;
+    }
+
+    mtx_lock(&pool->lock);
+    pool->stopping = true;
+    cnd_broadcast(&pool->work_ready);
+    mtx_unlock(&pool->lock);
+
+    for(uint32_t i = 0; i < pool->worker_count; ++i)
+    {
+        thrd_join(pool->workers[i], NULL);
+    }
+
+    cnd_destroy(&pool->work_done);
+    cnd_destroy(&pool->work_ready);
+    mtx_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+uint32_t pool_worker_count(const ThreadPool* pool)
+{
+    return pool->worker_count + 1;
+}
+
+uint32_t pool_hardware_threads(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+void pool_for(ThreadPool* pool, const uint32_t count, const PoolTaskFunc func, void* context)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    mtx_lock(&pool->lock);
+    pool->func = func;
+    pool->context = context;
+    pool->count = count;
+    atomic_store(&pool->next, 0);
+    pool->busy_workers = pool->worker_count;
+    pool->generation++;
+    cnd_broadcast(&pool->work_ready);
+    mtx_unlock(&pool->lock);
+
+    pool_drain(pool);
+
+    mtx_lock(&pool->lock);
+    while(pool->busy_workers > 0)
+    {
+        cnd_wait(&pool->work_done, &pool->lock);
+    }
+    mtx_unlock(&pool->lock);
+}
+
+static void pool_drain(ThreadPool* pool)
+{
+    for(uint32_t i = atomic_fetch_add(&pool->next, 1); i < pool->count; i = atomic_fetch_add(&pool->next, 1))
+    {
+        pool->func(pool->context, i);
+    }
+}
+
+static int pool_worker(void* arg)
+{
+    ThreadPool* pool = arg;
+    uint64_t seen_generation = 0;
+
+    mtx_lock(&pool->lock);
+
+    for(;;)
+    {
+        while(!pool->stopping && pool->generation == seen_generation)
+        {
+            cnd_wait(&pool->work_ready, &pool->lock);
+        }
+
+        if(pool->stopping)
+        {
+            break;
+        }
+
+        seen_generation = pool->generation;
+        mtx_unlock(&pool->lock);
+
+        pool_drain(pool);
+
+        mtx_lock(&pool->lock);
+        if(--pool->busy_workers == 0)
+        {
+            cnd_signal(&pool->work_done);
+        }
+    }
+
+    mtx_unlock(&pool->lock);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+typedef struct ThreadPool ThreadPool;
+typedef void (*PoolTaskFunc)(void* context, uint32_t index);
+
+// A worker_count of 0 uses one worker per hardware thread
+ThreadPool* pool_create(uint32_t worker_count);
+void pool_destroy(ThreadPool* pool);
+uint32_t pool_worker_count(const ThreadPool* pool);
+uint32_t pool_hardware_threads(void);
+
+// Runs func(context, i) for i in [0, count) across the workers and the calling
+// thread, returning once every index has completed.
+void pool_for(ThreadPool* pool, uint32_t count, PoolTaskFunc func, void* context);
+
+#endif
@@ -0,0 +1,509 @@
+#include "preview.h"
+#include "chip8.h"
+#include "codes.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#define PREVIEW_CACHE_MAGIC 0x56503843u // "C8PV"
+#define PREVIEW_CACHE_VERSION 1
+#define PREVIEW_MAX_PATH 512
+#define PREVIEW_DEFAULT_BUDGET (512u * 1024u)
+#define PREVIEW_DEFAULT_RADIUS 2
+
+typedef struct PreviewCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t unique_count;
+    uint32_t loop_frames;
+    uint64_t rom_hash;
+} PreviewCacheHeader;
+
+typedef struct PreviewLoop
+{
+    uint32_t unique_count;
+    uint8_t sequence[PREVIEW_LOOP_FRAMES];
+    uint32_t frames[][CHIP8_DISPLAY_COLUMNS];
+} PreviewLoop;
+
+typedef struct PreviewEntry
+{
+    char path[PREVIEW_MAX_PATH];
+    PreviewState state;
+    PreviewLoop* loop;
+    bool busy;
+} PreviewEntry;
+
+struct PreviewCache
+{
+    PreviewConfig config;
+    char cache_dir[PREVIEW_MAX_PATH];
+    PreviewEntry* entries;
+    uint32_t count;
+    uint32_t focus;
+    PreviewStats stats;
+    mtx_t lock;
+    cnd_t work_ready;
+    cnd_t work_done;
+    bool stopping;
+    thrd_t worker;
+};
+
+static int preview_worker(void* arg);
+static int32_t preview_next(const PreviewCache* cache);
+static uint32_t preview_distance(const PreviewCache* cache, uint32_t index);
+static void preview_publish(PreviewCache* cache, uint32_t index, PreviewLoop* loop);
+static PreviewLoop* preview_build(PreviewCache* cache, const char* rom_path, bool* is_cache_hit);
+static PreviewLoop* preview_generate(const char* rom_path);
+static PreviewLoop* preview_read_cache(const char* cache_path, uint64_t rom_hash);
+static void preview_write_cache(const char* cache_path, uint64_t rom_hash, const PreviewLoop* loop);
+static size_t preview_loop_size(uint32_t unique_count);
+
+PreviewCache* preview_create(const PreviewConfig* config, const char* const* rom_paths, const uint32_t count)
+{
+    PreviewCache* cache = calloc(1, sizeof(PreviewCache));
+
+    if(!cache)
+    {
+        return NULL;
+    }
+
+    cache->config = *config;
+    cache->config.memory_budget = config->memory_budget > 0 ? config->memory_budget : PREVIEW_DEFAULT_BUDGET;
+    cache->config.radius = config->radius > 0 ? config->radius : PREVIEW_DEFAULT_RADIUS;
+
+    // Every entry within the radius must fit at once, or they would keep evicting each other
+    const size_t largest = preview_loop_size(PREVIEW_LOOP_FRAMES);
+
+    while(cache->config.radius > 0 && (2 * cache->config.radius + 1) * largest > cache->config.memory_budget)
+    {
+        --cache->config.radius;
+    }
+
+    if(config->cache_dir)
+    {
+        snprintf(cache->cache_dir, sizeof(cache->cache_dir), "%s", config->cache_dir);
+        cache->config.cache_dir = cache->cache_dir;
+    }
+
+    cache->count = count;
+    cache->entries = calloc(count > 0 ? count : 1, sizeof(PreviewEntry));
+
+    if(!cache->entries)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        snprintf(cache->entries[i].path, sizeof(cache->entries[i].path), "%s", rom_paths[i]);
+        cache->entries[i].state = PREVIEW_PENDING;
+    }
+
+    mtx_init(&cache->lock, mtx_plain);
+    cnd_init(&cache->work_ready);
+    cnd_init(&cache->work_done);
+
+    if(thrd_create(&cache->worker, preview_worker, cache) != thrd_success)
+    {
+        cnd_destroy(&cache->work_done);
+        cnd_destroy(&cache->work_ready);
+        mtx_destroy(&cache->lock);
+        free(cache->entries);
+        free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+void preview_destroy(PreviewCache* cache)
+{
+    if(!cache)
+    {
+        return;
+    }
+
+    mtx_lock(&cache->lock);
+    cache->stopping = true;
+    cnd_broadcast(&cache->work_ready);
+    mtx_unlock(&cache->lock);
+    thrd_join(cache->worker, NULL);
+
+    for(uint32_t i = 0; i < cache->count; ++i)
+    {
+        free(cache->entries[i].loop);
+    }
+
+    cnd_destroy(&cache->work_done);
+    cnd_destroy(&cache->work_ready);
+    mtx_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache);
+}
+
+void preview_focus(PreviewCache* cache, const uint32_t index)
+{
+    mtx_lock(&cache->lock);
+
+    if(cache->focus != index && index < cache->count)
+    {
+        cache->focus = index;
+        cnd_signal(&cache->work_ready);
+    }
+
+    mtx_unlock(&cache->lock);
+}
+
+PreviewState preview_frame(PreviewCache* cache, const uint32_t index, const uint64_t tick, uint32_t* display)
+{
+    if(index >= cache->count)
+    {
+        return PREVIEW_UNAVAILABLE;
+    }
+
+    // The worker only holds the lock to pick an entry and publish it, never while running a ROM
+    mtx_lock(&cache->lock);
+    const PreviewEntry* entry = &cache->entries[index];
+    const PreviewState state = entry->state;
+
+    if(state == PREVIEW_READY)
+    {
+        const PreviewLoop* loop = entry->loop;
+        memcpy(display, loop->frames[loop->sequence[tick % PREVIEW_LOOP_FRAMES]], sizeof(loop->frames[0]));
+    }
+
+    mtx_unlock(&cache->lock);
+    return state;
+}
+
+void preview_wait(PreviewCache* cache)
+{
+    mtx_lock(&cache->lock);
+
+    for(;;)
+    {
+        bool busy = false;
+
+        for(uint32_t i = 0; i < cache->count; ++i)
+        {
+            busy = busy || cache->entries[i].busy;
+        }
+
+        if(!busy && preview_next(cache) < 0)
+        {
+            break;
+        }
+
+        cnd_wait(&cache->work_done, &cache->lock);
+    }
+
+    mtx_unlock(&cache->lock);
+}
+
+void preview_get_stats(PreviewCache* cache, PreviewStats* stats)
+{
+    mtx_lock(&cache->lock);
+    *stats = cache->stats;
+    mtx_unlock(&cache->lock);
+}
+
+static int preview_worker(void* arg)
+{
+    PreviewCache* cache = (PreviewCache*)arg;
+    mtx_lock(&cache->lock);
+
+    while(!cache->stopping)
+    {
+        const int32_t index = preview_next(cache);
+
+        if(index < 0)
+        {
+            cnd_broadcast(&cache->work_done);
+            cnd_wait(&cache->work_ready, &cache->lock);
+            continue;
+        }
+
+        PreviewEntry* entry = &cache->entries[index];
+        entry->busy = true;
+        char path[PREVIEW_MAX_PATH];
+        memcpy(path, entry->path, sizeof(path));
+        mtx_unlock(&cache->lock);
+
+        bool is_cache_hit = false;
+        PreviewLoop* loop = preview_build(cache, path, &is_cache_hit);
+
+        mtx_lock(&cache->lock);
+        entry->busy = false;
+        cache->stats.cache_hits += is_cache_hit;
+        cache->stats.generated += !is_cache_hit;
+        preview_publish(cache, (uint32_t)index, loop);
+        cnd_broadcast(&cache->work_done);
+    }
+
+    mtx_unlock(&cache->lock);
+    return 0;
+}
+
+// The pending entry nearest the focused one, or -1 when all within the radius are done
+static int32_t preview_next(const PreviewCache* cache)
+{
+    int32_t best = -1;
+    uint32_t best_distance = cache->config.radius + 1;
+
+    for(uint32_t i = 0; i < cache->count; ++i)
+    {
+        const uint32_t distance = preview_distance(cache, i);
+
+        if(cache->entries[i].state == PREVIEW_PENDING && !cache->entries[i].busy && distance < best_distance)
+        {
+            best = (int32_t)i;
+            best_distance = distance;
+        }
+    }
+
+    return best;
+}
+
+// Entries wrap around like the menu does when cycling
+static uint32_t preview_distance(const PreviewCache* cache, const uint32_t index)
+{
+    const uint32_t forward = (index + cache->count - cache->focus) % cache->count;
+    return forward < cache->count - forward ? forward : cache->count - forward;
+}
+
+static void preview_publish(PreviewCache* cache, const uint32_t index, PreviewLoop* loop)
+{
+    PreviewEntry* entry = &cache->entries[index];
+
+    if(!loop)
+    {
+        entry->state = PREVIEW_UNAVAILABLE;
+        return;
+    }
+
+    const size_t size = preview_loop_size(loop->unique_count);
+
+    // Make room by dropping the loops furthest from the focused entry, which are
+    // outside the radius since the radius was sized to fit
+    while(cache->stats.memory_used + size > cache->config.memory_budget)
+    {
+        int32_t victim = -1;
+        uint32_t victim_distance = 0;
+
+        for(uint32_t i = 0; i < cache->count; ++i)
+        {
+            const uint32_t distance = preview_distance(cache, i);
+
+            if(i != index && cache->entries[i].loop && distance > victim_distance)
+            {
+                victim = (int32_t)i;
+                victim_distance = distance;
+            }
+        }
+
+        if(victim < 0)
+        {
+            break;
+        }
+
+        PreviewEntry* evicted = &cache->entries[victim];
+        cache->stats.memory_used -= preview_loop_size(evicted->loop->unique_count);
+        free(evicted->loop);
+        evicted->loop = NULL;
+        evicted->state = PREVIEW_PENDING;
+        ++cache->stats.evicted;
+    }
+
+    entry->loop = loop;
+    entry->state = PREVIEW_READY;
+    cache->stats.memory_used += size;
+
+    if(cache->stats.memory_used > cache->stats.memory_peak)
+    {
+        cache->stats.memory_peak = cache->stats.memory_used;
+    }
+}
+
+static PreviewLoop* preview_build(PreviewCache* cache, const char* rom_path, bool* is_cache_hit)
+{
+    uint8_t rom[CHIP8_RAM_SIZE - PROGRAM_START];
+    FILE* file = fopen(rom_path, "rb");
+
+    if(!file)
+    {
+        return NULL;
+    }
+
+    const size_t rom_size = fread(rom, sizeof(uint8_t), sizeof(rom), file);
+    fclose(file);
+
+    const uint64_t rom_hash = hash_fnv1a64(rom, rom_size, HASH_FNV1A64_SEED);
+    char cache_path[PREVIEW_MAX_PATH];
+
+    if(cache->config.cache_dir)
+    {
+        const char* slash = strrchr(rom_path, '/');
+        const char* backslash = strrchr(rom_path, '\\');
+        const char* name = slash > backslash ? slash + 1 : backslash ? backslash + 1 : rom_path;
+        snprintf(cache_path, sizeof(cache_path), "%s/%s.preview", cache->config.cache_dir, name);
+    }
+    else
+    {
+        snprintf(cache_path, sizeof(cache_path), "%s.preview", rom_path);
+    }
+
+    PreviewLoop* loop = preview_read_cache(cache_path, rom_hash);
+    *is_cache_hit = loop != NULL;
+
+    if(!loop)
+    {
+        loop = preview_generate(rom_path);
+
+        if(loop)
+        {
+            preview_write_cache(cache_path, rom_hash, loop);
+        }
+    }
+
+    if(loop && loop->unique_count == 0)
+    {
+        free(loop);
+        loop = NULL;
+    }
+
+    return loop;
+}
+
+// Returns a loop with no frames for ROMs that never draw, so that is cached too
+static PreviewLoop* preview_generate(const char* rom_path)
+{
+    Chip8 vm = {0};
+    chip8_reset(&vm, 0);
+
+    if(!chip8_load_rom_file(&vm, rom_path))
+    {
+        chip8_release(&vm);
+        return NULL;
+    }
+
+    vm.muted = true;
+    static const uint32_t blank[CHIP8_DISPLAY_COLUMNS] = {0};
+
+    for(uint32_t frame = 0; frame < PREVIEW_WARMUP_FRAMES && !vm.halted && memcmp(vm.display, blank, sizeof(blank)) == 0; ++frame)
+    {
+        chip8_step(&vm);
+    }
+
+    PreviewLoop* loop = calloc(1, preview_loop_size(PREVIEW_LOOP_FRAMES));
+
+    if(!loop || memcmp(vm.display, blank, sizeof(blank)) == 0)
+    {
+        chip8_release(&vm);
+        return loop;
+    }
+
+    for(uint32_t i = 0; i < PREVIEW_LOOP_FRAMES; ++i)
+    {
+        uint32_t unique = 0;
+
+        while(unique < loop->unique_count && memcmp(loop->frames[unique], vm.display, sizeof(vm.display)) != 0)
+        {
+            ++unique;
+        }
+
+        if(unique == loop->unique_count)
+        {
+            memcpy(loop->frames[loop->unique_count++], vm.display, sizeof(vm.display));
+        }
+
+        loop->sequence[i] = (uint8_t)unique;
+
+        for(uint32_t step = 0; step < PREVIEW_FRAME_STEP; ++step)
+        {
+            chip8_step(&vm);
+        }
+    }
+
+    chip8_release(&vm);
+
+    // Shrink to the frames the loop kept
+    PreviewLoop* shrunk = realloc(loop, preview_loop_size(loop->unique_count));
+    return shrunk ? shrunk : loop;
+}
+
+static PreviewLoop* preview_read_cache(const char* cache_path, const uint64_t rom_hash)
+{
+    FILE* file = fopen(cache_path, "rb");
+
+    if(!file)
+    {
+        return NULL;
+    }
+
+    PreviewCacheHeader header;
+    PreviewLoop* loop = NULL;
+
+    if(fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == PREVIEW_CACHE_MAGIC
+        && header.version == PREVIEW_CACHE_VERSION
+        && header.loop_frames == PREVIEW_LOOP_FRAMES
+        && header.unique_count <= PREVIEW_LOOP_FRAMES
+        && header.rom_hash == rom_hash)
+    {
+        loop = calloc(1, preview_loop_size(header.unique_count));
+    }
+
+    if(loop)
+    {
+        loop->unique_count = header.unique_count;
+        bool ok = fread(loop->sequence, sizeof(loop->sequence), 1, file) == 1
+            && fread(loop->frames, sizeof(loop->frames[0]), loop->unique_count, file) == loop->unique_count;
+
+        for(uint32_t i = 0; i < PREVIEW_LOOP_FRAMES && ok && loop->unique_count > 0; ++i)
+        {
+            ok = loop->sequence[i] < loop->unique_count;
+        }
+
+        if(!ok)
+        {
+            free(loop);
+            loop = NULL;
+        }
+    }
+
+    fclose(file);
+    return loop;
+}
+
+static void preview_write_cache(const char* cache_path, const uint64_t rom_hash, const PreviewLoop* loop)
+{
+    const PreviewCacheHeader header = {
+        .magic = PREVIEW_CACHE_MAGIC,
+        .version = PREVIEW_CACHE_VERSION,
+        .unique_count = loop->unique_count,
+        .loop_frames = PREVIEW_LOOP_FRAMES,
+        .rom_hash = rom_hash
+    };
+
+    // A read only ROM directory only costs the cache
+    FILE* file = fopen(cache_path, "wb");
+
+    if(file)
+    {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(loop->sequence, sizeof(loop->sequence), 1, file);
+        fwrite(loop->frames, sizeof(loop->frames[0]), loop->unique_count, file);
+        fclose(file);
+    }
+}
+
+static size_t preview_loop_size(const uint32_t unique_count)
+{
+    return sizeof(PreviewLoop) + (size_t)unique_count * sizeof(uint32_t[CHIP8_DISPLAY_COLUMNS]);
+}
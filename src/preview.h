@@ -0,0 +1,59 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Animated menu previews. A worker thread runs each ROM with no input, skips the frames
+// before anything is drawn and keeps a short loop of frames. Identical frames are stored
+// once, so a loop is its distinct 256 byte frames plus one index per frame. Loops are
+// cached on disk keyed by the ROM hash, generated nearest the focused entry first and
+// evicted furthest from it once they no longer fit in the memory budget.
+
+// Captured frames in a loop and the frames the emulator runs per captured frame
+#define PREVIEW_LOOP_FRAMES 120
+#define PREVIEW_FRAME_STEP 2
+// Frames run looking for the first one that draws anything
+#define PREVIEW_WARMUP_FRAMES 600
+
+typedef enum PreviewState
+{
+    PREVIEW_PENDING,
+    PREVIEW_READY,
+    // The ROM failed to load or never drew anything
+    PREVIEW_UNAVAILABLE,
+} PreviewState;
+
+typedef struct PreviewConfig
+{
+    // Bytes all loaded loops may take, 0 uses the default
+    size_t memory_budget;
+    // Entries either side of the focused one that are generated
+    uint32_t radius;
+    // Directory for the cache files, NULL writes them next to the ROMs
+    const char* cache_dir;
+} PreviewConfig;
+
+typedef struct PreviewStats
+{
+    uint32_t generated;
+    uint32_t cache_hits;
+    uint32_t evicted;
+    size_t memory_used;
+    size_t memory_peak;
+} PreviewStats;
+
+typedef struct PreviewCache PreviewCache;
+
+// Starts the worker on a copy of the ROM paths
+PreviewCache* preview_create(const PreviewConfig* config, const char* const* rom_paths, uint32_t count);
+void preview_destroy(PreviewCache* cache);
+void preview_focus(PreviewCache* cache, uint32_t index);
+// Copies the frame of the loop shown at tick, the loop repeats every PREVIEW_LOOP_FRAMES ticks
+PreviewState preview_frame(PreviewCache* cache, uint32_t index, uint64_t tick, uint32_t* display);
+// Blocks until every entry within the radius of the focused one is done
+void preview_wait(PreviewCache* cache);
+void preview_get_stats(PreviewCache* cache, PreviewStats* stats);
+
+#endif
@@ -0,0 +1,450 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "recorder.h"
+#include "chip8.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+// The frontend links raylib, which already builds these encoders
+#if defined(RUN_TESTS) || defined(CHIP8_HEADLESS)
+#define MSF_GIF_IMPL
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define QOI_IMPLEMENTATION
+#endif
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif
+
+#include "external/msf_gif.h"
+#include "external/qoi.h"
+#include "external/stb_image_write.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+#define RECORDER_DEFAULT_CAPACITY 256
+#define RECORDER_MAX_PATH 512
+#define RECORDER_FRAME_RATE 60
+// Browsers stretch GIF delays below 2 cs to 10 cs, so shorter frames are merged
+#define RECORDER_GIF_MIN_DELAY 2
+
+typedef struct RecorderBuffer
+{
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} RecorderBuffer;
+
+struct Recorder
+{
+    RecorderConfig config;
+    char path[RECORDER_MAX_PATH];
+    uint32_t width;
+    uint32_t height;
+    uint32_t capacity;
+    uint32_t (*ring)[CHIP8_DISPLAY_COLUMNS];
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_bool worker_waiting;
+    atomic_bool producer_waiting;
+    mtx_t lock;
+    cnd_t frame_ready;
+    cnd_t space_ready;
+    bool stopping;
+    thrd_t worker;
+    uint64_t frames;
+    uint64_t dropped;
+
+    // Worker state
+    uint8_t* rgba;
+    uint32_t last[CHIP8_DISPLAY_COLUMNS];
+    bool has_last;
+    uint64_t encoded;
+    bool failed;
+    MsfGifState gif;
+    FILE* gif_file;
+    uint64_t gif_ticks;
+    uint32_t pending_ticks;
+    RecorderBuffer image;
+    uint64_t sequence_index;
+};
+
+static int recorder_worker(void* arg);
+static void recorder_consume(Recorder* recorder, const uint32_t* display);
+static bool recorder_gif_flush(Recorder* recorder, bool final);
+static void recorder_sequence_frame(Recorder* recorder, const uint32_t* display, bool repeat);
+static void recorder_rasterize(Recorder* recorder, const uint32_t* display);
+static void recorder_buffer_write(void* context, void* data, int size);
+
+Recorder* recorder_open(const RecorderConfig* config)
+{
+    Recorder* recorder = calloc(1, sizeof(Recorder));
+
+    if(!recorder || snprintf(recorder->path, sizeof(recorder->path), "%s", config->path) >= (int)sizeof(recorder->path))
+    {
+        free(recorder);
+        return NULL;
+    }
+
+    recorder->config = *config;
+    recorder->config.path = recorder->path;
+    recorder->config.scale = config->scale > 0 ? config->scale : 1;
+    recorder->capacity = config->capacity > 0 ? config->capacity : RECORDER_DEFAULT_CAPACITY;
+    recorder->width = CHIP8_DISPLAY_COLUMNS * recorder->config.scale;
+    recorder->height = CHIP8_DISPLAY_ROWS * recorder->config.scale;
+    recorder->ring = calloc(recorder->capacity, sizeof(recorder->ring[0]));
+    recorder->rgba = malloc((size_t)recorder->width * recorder->height * 4);
+
+    if(!recorder->ring || !recorder->rgba)
+    {
+        free(recorder->rgba);
+        free(recorder->ring);
+        free(recorder);
+        return NULL;
+    }
+
+    if(config->format == RECORDER_GIF)
+    {
+        recorder->gif_file = fopen(recorder->path, "wb");
+
+        if(!recorder->gif_file || !msf_gif_begin_to_file(&recorder->gif, (int)recorder->width, (int)recorder->height, (MsfGifFileWriteFunc)fwrite, recorder->gif_file))
+        {
+            fprintf(stderr, "Failed to open %s for recording\n", recorder->path);
+
+            if(recorder->gif_file)
+            {
+                fclose(recorder->gif_file);
+            }
+
+            free(recorder->rgba);
+            free(recorder->ring);
+            free(recorder);
+            return NULL;
+        }
+    }
+
+    atomic_init(&recorder->head, 0);
+    atomic_init(&recorder->tail, 0);
+    atomic_init(&recorder->worker_waiting, false);
+    atomic_init(&recorder->producer_waiting, false);
+    mtx_init(&recorder->lock, mtx_plain);
+    cnd_init(&recorder->frame_ready);
+    cnd_init(&recorder->space_ready);
+
+    if(thrd_create(&recorder->worker, recorder_worker, recorder) != thrd_success)
+    {
+        recorder->stopping = true;
+        recorder_close(recorder, NULL);
+        return NULL;
+    }
+
+    return recorder;
+}
+
+bool recorder_close(Recorder* recorder, RecorderStats* stats)
+{
+    if(!recorder)
+    {
+        return false;
+    }
+
+    if(!recorder->stopping)
+    {
+        mtx_lock(&recorder->lock);
+        recorder->stopping = true;
+        cnd_signal(&recorder->frame_ready);
+        mtx_unlock(&recorder->lock);
+        thrd_join(recorder->worker, NULL);
+    }
+
+    if(recorder->gif_file)
+    {
+        recorder->failed |= !msf_gif_end_to_file(&recorder->gif);
+        recorder->failed |= fclose(recorder->gif_file) != 0;
+    }
+
+    const bool ok = !recorder->failed;
+
+    if(stats)
+    {
+        stats->frames = recorder->frames;
+        stats->encoded = recorder->encoded;
+        stats->dropped = recorder->dropped;
+    }
+
+    cnd_destroy(&recorder->space_ready);
+    cnd_destroy(&recorder->frame_ready);
+    mtx_destroy(&recorder->lock);
+    free(recorder->image.data);
+    free(recorder->rgba);
+    free(recorder->ring);
+    free(recorder);
+    return ok;
+}
+
+void recorder_push(Recorder* recorder, const uint32_t* display)
+{
+    const uint32_t head = atomic_load_explicit(&recorder->head, memory_order_relaxed);
+    ++recorder->frames;
+
+    if(head - atomic_load(&recorder->tail) >= recorder->capacity)
+    {
+        if(!recorder->config.wait_when_full)
+        {
+            ++recorder->dropped;
+            return;
+        }
+
+        mtx_lock(&recorder->lock);
+        atomic_store(&recorder->producer_waiting, true);
+
+        while(head - atomic_load(&recorder->tail) >= recorder->capacity)
+        {
+            cnd_wait(&recorder->space_ready, &recorder->lock);
+        }
+
+        atomic_store(&recorder->producer_waiting, false);
+        mtx_unlock(&recorder->lock);
+    }
+
+    memcpy(recorder->ring[head % recorder->capacity], display, sizeof(recorder->ring[0]));
+    atomic_store(&recorder->head, head + 1);
+
+    // Only take the lock when the worker went to sleep on an empty ring
+    if(atomic_load(&recorder->worker_waiting))
+    {
+        mtx_lock(&recorder->lock);
+        cnd_signal(&recorder->frame_ready);
+        mtx_unlock(&recorder->lock);
+    }
+}
+
+bool recorder_format_from_name(const char* name, RecorderFormat* format)
+{
+    for(RecorderFormat i = RECORDER_GIF; i <= RECORDER_QOI; ++i)
+    {
+        if(strcmp(name, recorder_format_extension(i)) == 0)
+        {
+            *format = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* recorder_format_extension(const RecorderFormat format)
+{
+    switch(format)
+    {
+        case RECORDER_GIF: return "gif";
+        case RECORDER_PNG: return "png";
+        case RECORDER_QOI: return "qoi";
+    }
+
+    return "";
+}
+
+static int recorder_worker(void* arg)
+{
+    Recorder* recorder = arg;
+
+    for(;;)
+    {
+        const uint32_t tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+
+        if(tail != atomic_load(&recorder->head))
+        {
+            recorder_consume(recorder, recorder->ring[tail % recorder->capacity]);
+            atomic_store(&recorder->tail, tail + 1);
+
+            if(atomic_load(&recorder->producer_waiting))
+            {
+                mtx_lock(&recorder->lock);
+                cnd_signal(&recorder->space_ready);
+                mtx_unlock(&recorder->lock);
+            }
+
+            continue;
+        }
+
+        mtx_lock(&recorder->lock);
+        atomic_store(&recorder->worker_waiting, true);
+
+        while(!recorder->stopping && atomic_load(&recorder->head) == tail)
+        {
+            cnd_wait(&recorder->frame_ready, &recorder->lock);
+        }
+
+        atomic_store(&recorder->worker_waiting, false);
+        const bool done = recorder->stopping && atomic_load(&recorder->head) == tail;
+        mtx_unlock(&recorder->lock);
+
+        if(done)
+        {
+            break;
+        }
+    }
+
+    if(recorder->config.format == RECORDER_GIF && recorder->has_last)
+    {
+        recorder_gif_flush(recorder, true);
+    }
+
+    return 0;
+}
+
+static void recorder_consume(Recorder* recorder, const uint32_t* display)
+{
+    const bool repeat = recorder->has_last && memcmp(recorder->last, display, sizeof(recorder->last)) == 0;
+
+    if(recorder->config.format != RECORDER_GIF)
+    {
+        recorder_sequence_frame(recorder, display, repeat);
+    }
+    else if(repeat)
+    {
+        ++recorder->pending_ticks;
+        return;
+    }
+    else if(recorder->has_last && !recorder_gif_flush(recorder, false))
+    {
+        // The previous frame was too short to show, its time goes to this one
+        ++recorder->pending_ticks;
+    }
+    else
+    {
+        recorder->pending_ticks = 1;
+    }
+
+    memcpy(recorder->last, display, sizeof(recorder->last));
+    recorder->has_last = true;
+}
+
+// Delays come from the total elapsed time, so rounding never drifts over a long clip
+static bool recorder_gif_flush(Recorder* recorder, const bool final)
+{
+    const uint64_t start = recorder->gif_ticks;
+    const uint64_t end = start + recorder->pending_ticks;
+    const uint64_t delay = (end * 100 + RECORDER_FRAME_RATE / 2) / RECORDER_FRAME_RATE
+        - (start * 100 + RECORDER_FRAME_RATE / 2) / RECORDER_FRAME_RATE;
+
+    if(delay < RECORDER_GIF_MIN_DELAY && !final)
+    {
+        return false;
+    }
+
+    recorder_rasterize(recorder, recorder->last);
+    recorder->failed |= !msf_gif_frame_to_file(&recorder->gif, recorder->rgba, (int)delay, 16, (int)recorder->width * 4);
+    recorder->gif_ticks = end;
+    recorder->pending_ticks = 0;
+    ++recorder->encoded;
+    return true;
+}
+
+static void recorder_sequence_frame(Recorder* recorder, const uint32_t* display, const bool repeat)
+{
+    if(!repeat)
+    {
+        recorder_rasterize(recorder, display);
+        recorder->image.size = 0;
+
+        if(recorder->config.format == RECORDER_PNG)
+        {
+            const int stride = (int)recorder->width * 4;
+            recorder->failed |= !stbi_write_png_to_func(recorder_buffer_write, &recorder->image, (int)recorder->width, (int)recorder->height, 4, recorder->rgba, stride);
+        }
+        else
+        {
+            const qoi_desc desc = {.width = recorder->width, .height = recorder->height, .channels = 4, .colorspace = QOI_SRGB};
+            int size = 0;
+            void* data = qoi_encode(recorder->rgba, &desc, &size);
+            recorder->failed |= data == NULL;
+            recorder_buffer_write(&recorder->image, data, size);
+            free(data);
+        }
+
+        ++recorder->encoded;
+    }
+
+    char name[RECORDER_MAX_PATH + 32];
+    snprintf(name, sizeof(name), "%s_%06llu.%s", recorder->path, (unsigned long long)recorder->sequence_index++, recorder_format_extension(recorder->config.format));
+
+    FILE* file = fopen(name, "wb");
+
+    if(!file)
+    {
+        recorder->failed = true;
+        return;
+    }
+
+    recorder->failed |= fwrite(recorder->image.data, 1, recorder->image.size, file) != recorder->image.size;
+    recorder->failed |= fclose(file) != 0;
+}
+
+static void recorder_rasterize(Recorder* recorder, const uint32_t* display)
+{
+    const uint32_t scale = recorder->config.scale;
+    const size_t pitch = (size_t)recorder->width * 4;
+
+    for(uint32_t row = 0; row < CHIP8_DISPLAY_ROWS; ++row)
+    {
+        uint8_t* line = recorder->rgba + (size_t)row * scale * pitch;
+        uint8_t* pixel = line;
+
+        for(uint32_t column = 0; column < CHIP8_DISPLAY_COLUMNS; ++column)
+        {
+            const uint8_t value = (uint8_t)(0 - ((display[column] >> row) & 0x1));
+
+            for(uint32_t i = 0; i < scale; ++i)
+            {
+                pixel[0] = value;
+                pixel[1] = value;
+                pixel[2] = value;
+                pixel[3] = 0xFF;
+                pixel += 4;
+            }
+        }
+
+        for(uint32_t i = 1; i < scale; ++i)
+        {
+            memcpy(line + i * pitch, line, pitch);
+        }
+    }
+}
+
+static void recorder_buffer_write(void* context, void* data, const int size)
+{
+    RecorderBuffer* buffer = context;
+
+    if(!data || size <= 0)
+    {
+        return;
+    }
+
+    if(buffer->size + (size_t)size > buffer->capacity)
+    {
+        const size_t capacity = (buffer->size + (size_t)size) * 2;
+        uint8_t* grown = realloc(buffer->data, capacity);
+
+        if(!grown)
+        {
+            return;
+        }
+
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, (size_t)size);
+    buffer->size += (size_t)size;
+}
@@ -0,0 +1,50 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Records the display to a GIF or to a PNG or QOI image sequence. Frames are copied
+// into a ring buffer and encoded on a worker thread, so the caller only pays for a
+// 256 byte copy per frame. Runs of identical frames are encoded once: GIFs hold them
+// as one frame with a longer delay, sequences write the same encoded bytes again.
+
+typedef enum RecorderFormat
+{
+    RECORDER_GIF,
+    RECORDER_PNG,
+    RECORDER_QOI,
+} RecorderFormat;
+
+typedef struct RecorderConfig
+{
+    // GIF file, or the prefix of a sequence written as path_000000.png
+    const char* path;
+    RecorderFormat format;
+    // Output pixels per CHIP-8 pixel, 0 is treated as 1
+    uint32_t scale;
+    // Frames at 60 Hz the ring buffer holds, 0 uses the default
+    uint32_t capacity;
+    // Block recorder_push while the ring is full instead of dropping the frame,
+    // for offline rendering that must not lose frames
+    bool wait_when_full;
+} RecorderConfig;
+
+typedef struct RecorderStats
+{
+    uint64_t frames;
+    uint64_t encoded;
+    uint64_t dropped;
+} RecorderStats;
+
+typedef struct Recorder Recorder;
+
+Recorder* recorder_open(const RecorderConfig* config);
+// Encodes the frames still queued and finishes the file, false if writing failed
+bool recorder_close(Recorder* recorder, RecorderStats* stats);
+// display is column major, 64 columns with bit n of a column being row n
+void recorder_push(Recorder* recorder, const uint32_t* display);
+bool recorder_format_from_name(const char* name, RecorderFormat* format);
+const char* recorder_format_extension(RecorderFormat format);
+
+#endif
@@ -1,21 +1,68 @@
 #include "renderer.h"
+#include "agent.h"
+#include "analyze.h"
+#include "audio.h"
 #include "chip8.h"
+#include "env.h"
+#include "heatmap.h"
+#include "latency.h"
+#include "logger.h"
+#include "preview.h"
+#include "recorder.h"
+#include "speculate.h"
+#include "telemetry.h"
+#include "timing.h"
+#include "upscale.h"
+#include "wall.h"
 
 #include "raylib.h"
 #include "raymath.h"
 
 #include <assert.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <time.h>
 
 #define MAX_ROMS 10
 #define MAX_ROM_NAME_SIZE 64
+#define MAX_BOOT_PHASES 8
+#define LATENCY_RECORDS 4096
+// Frames of telemetry kept, a minute at 60 Hz
+#define TELEMETRY_FRAMES 3600
+// Frames the F1 panel summarizes and F8 writes to the trace
+#define TELEMETRY_PANEL_NS 5000000000ull
+#define TELEMETRY_TRACE_NS 30000000000ull
+#define WALL_DEFAULT_MACHINES 16
+// Seconds attract mode shows each machine's tone before moving focus on
+#define WALL_ATTRACT_SECONDS 10.0
 
 #ifndef CHIP8_LOGLEVEL
 #define CHIP8_LOGLEVEL 0
 #endif
 
+// monitor_log for the renderer, whose log levels are raylib's. monitor.h cannot be
+// included next to raylib.h, as both name their levels LOG_DEBUG to LOG_ERROR.
+#define renderer_log(level, ...)                                                                        \
+    do                                                                                                  \
+    {                                                                                                   \
+        const int renderer_log_level = (int)(level) - LOG_DEBUG;                                        \
+        if(renderer_log_level >= CHIP8_LOGLEVEL                                                         \
+            && renderer_log_level >= atomic_load_explicit(&g_logger_level, memory_order_relaxed))       \
+        {                                                                                               \
+            static LoggerSite renderer_log_site;                                                        \
+            logger_write(&renderer_log_site, renderer_log_level, __VA_ARGS__);                          \
+        }                                                                                               \
+    } while(0)
+
 extern Chip8 g_chip8;
+extern Chip8Analysis g_chip8_analysis;
+extern Chip8RunAhead g_chip8_runahead;
+extern Chip8Trace g_chip8_trace;
+extern KeySpeculator* g_chip8_speculator;
 
 static const struct KeypadPair
 {
@@ -30,13 +77,11 @@ static const struct KeypadPair
 
 static const struct ToneConstants
 {
-    float AudioFrequency;
     uint32_t SampleRate;
     uint32_t SampleSize;
     uint32_t Channels;
     int32_t MaxSamplesPerUpdate;
 } ToneK = {
-    .AudioFrequency = 440.0f,
     .SampleRate = 44100,
     .SampleSize = 16,
     .Channels = 1,
@@ -52,7 +97,6 @@ static struct RendererContext
     const float TransitionExtraDelay;
     const float TransitionTimeInSeconds;
     float transition_time;
-    float sine_idx;
     char roms[MAX_ROMS][MAX_ROM_NAME_SIZE];
     bool is_info_menu_shown;
     bool step;
@@ -62,13 +106,56 @@ static struct RendererContext
     int32_t old_window_height;
     Texture2D menu_bg_tex2d;
     AudioStream tone;
+    bool is_audio_ready;
+    // What the machine sounds like, queued to the engine stamped with the frame it changed in
+    AudioEngine* audio;
+    AudioState audio_state;
+    AudioState audio_queued;
+    uint64_t audio_frame;
+    Recorder* recorder;
+    // Search agent playing instead of the keyboard, toggled with F6
+    Agent* bot;
+    uint16_t bot_keys;
+    uint16_t bot_pressed;
+    double bot_nodes_per_second;
+    // Input to photon tracking, on when CHIP8_LATENCY names the CSV to write
+    LatencyTracker* latency;
+    const char* latency_path;
+    uint16_t latency_keys;
+    uint64_t latency_poll_ns;
+    uint32_t latency_shown[64];
+    // Frame timing, toggled with F3, shown in the F1 panel and written as a trace with F8
+    Telemetry* telemetry;
+    uint64_t telemetry_spike_ns;
+    // RAM heatmap toggled with F11, drawn in the F1 panel with a hex view scrolled by the
+    // wheel, the counters themselves are g_chip8_trace.heatmap
+    Texture2D heatmap_tex2d;
+    uint8_t heatmap_pixels[HEATMAP_SIDE * HEATMAP_SIDE * 4];
+    uint16_t hex_address;
+    // The display upscaled on the CPU into a texture, filter picked by CHIP8_FILTER and F5
+    Upscaler* upscaler;
+    Texture2D screen_tex2d;
+    // Animated previews of the menu entries, built in the background once the scan is done
+    PreviewCache* previews;
+    // Wall of machines opened with F4 from the menu
+    Wall* wall;
+    Texture2D wall_atlas;
+    AudioStream wall_tone;
+    bool is_wall_tone_ready;
+    bool is_wall_focus_playing;
+    bool is_wall_audio_mixed;
+    double wall_focus_time;
+    thrd_t rom_scan;
+    bool is_rom_scan_running;
+    atomic_bool is_rom_scan_done;
+    uint64_t rom_scan_start_ns;
+    uint64_t rom_scan_end_ns;
 } s_ctx = {
     .RasterRows = 32,
     .RasterColumns = 64,
     .TransitionExtraDelay = 0.5f,
     .TransitionTimeInSeconds = 1.5f,
     .Monitor = NULL,
-    .sine_idx = 0.0f,
     .Scale = 15,
     .tone = {0},
     .is_info_menu_shown = false,
@@ -79,67 +166,135 @@ static struct RendererContext
     .roms = {{0}},
     .selected_rom = 0,
     .transition_time = 0.0f,
-    .old_window_height = 0
+    .old_window_height = 0,
+    .is_audio_ready = false,
+    .audio = NULL,
+    .audio_state = {.pitch = AUDIO_DEFAULT_PITCH, .is_sounding = false},
+    .audio_frame = 0,
+    .recorder = NULL,
+    .bot = NULL,
+    .bot_keys = 0,
+    .bot_pressed = 0,
+    .bot_nodes_per_second = 0.0,
+    .latency = NULL,
+    .latency_path = NULL,
+    .latency_keys = 0,
+    .latency_poll_ns = 0,
+    .telemetry = NULL,
+    .telemetry_spike_ns = 0,
+    .previews = NULL,
+    .upscaler = NULL,
+    .screen_tex2d = {0},
+    .wall = NULL,
+    .wall_atlas = {0},
+    .wall_tone = {0},
+    .is_wall_tone_ready = false,
+    .is_wall_focus_playing = false,
+    .is_wall_audio_mixed = false,
+    .wall_focus_time = 0.0,
+    .is_rom_scan_running = false,
+    .rom_scan_start_ns = 0,
+    .rom_scan_end_ns = 0
 };
 
+// Wall time of each startup phase, logged once the menu is interactive and written
+// to the file named by CHIP8_BOOT_REPORT when it is set
+static struct BootReport
+{
+    uint64_t start_ns;
+    uint64_t mark_ns;
+    uint64_t first_frame_ns;
+    uint32_t phase_count;
+    const char* phase_names[MAX_BOOT_PHASES];
+    uint64_t phase_ns[MAX_BOOT_PHASES];
+    bool is_reported;
+} s_boot = {0};
+
 static InitFunc vm_init;
 static UpdateFunc vm_update;
 static ShutdownFunc vm_shutdown;
-static void draw_column(uint32_t x);
+static void load_screen_texture(void);
+static void cycle_filter(void);
 static void audio_processor(void *bufferData, uint32_t frames);
 static void draw_mini_sprite(int32_t x, int32_t y, int32_t width, int32_t height);
 static void draw_stack(int32_t x, int32_t y, int32_t width, int32_t height);
+static void draw_disassembly(int32_t x, int32_t y, int32_t width, int32_t height);
 static void update_window(bool is_info_showing);
 static void set_working_directory(void);
+static void toggle_recording(void);
+static void toggle_bot(void);
+static void toggle_telemetry(void);
+static void write_trace(void);
+static void draw_telemetry(int32_t x, int32_t y, int32_t width, int32_t height);
+static void toggle_heatmap(void);
+static void draw_heatmap(int32_t x, int32_t y, int32_t width, int32_t height);
+static uint16_t read_keys(void);
+static void report_latency(void);
+static void init_audio(void);
+static void queue_audio(void);
+static int scan_roms(void* arg);
+static void finish_rom_scan(void);
+static void start_previews(void);
+static PreviewState draw_preview(int32_t x, int32_t y, int32_t scale);
+static void open_wall(void);
+static void close_wall(void);
+static void wall_audio_processor(void* buffer, uint32_t frames);
+static void boot_phase(const char* name);
+static void boot_report(void);
 
 static void render_menu(void);
 static void render_transition(void);
 static void render_game(void);
+static void render_wall(void);
 static void (*render_state)(void) = render_menu;
 
 void renderer_initialize(const uint32_t* monitor)
 {
+    s_boot.start_ns = timing_now_ns();
+    s_boot.mark_ns = s_boot.start_ns;
     s_ctx.Monitor = monitor;
     InitWindow(s_ctx.RasterColumns * s_ctx.Scale, s_ctx.RasterRows * s_ctx.Scale, "Chip8 Emulator");
     set_working_directory();
     SetTargetFPS(60);
     SetTraceLogLevel(LOG_DEBUG + CHIP8_LOGLEVEL);
-    
-    InitAudioDevice();
-    SetAudioStreamBufferSizeDefault(ToneK.MaxSamplesPerUpdate);
-    s_ctx.tone = LoadAudioStream(ToneK.SampleRate, ToneK.SampleSize, ToneK.Channels);
-    SetAudioStreamCallback(s_ctx.tone, audio_processor);
+    s_ctx.old_window_height = GetScreenHeight();
+    boot_phase("window");
 
-    SetAudioStreamVolume(s_ctx.tone, 1.0f);
+    // The ROM list fills in while the menu is already up, audio waits for the first tone
+    audio_default_pattern(s_ctx.audio_state.pattern);
+    atomic_init(&s_ctx.is_rom_scan_done, false);
+    s_ctx.rom_scan_start_ns = timing_now_ns();
+    s_ctx.is_rom_scan_running = thrd_create(&s_ctx.rom_scan, scan_roms, NULL) == thrd_success;
 
-    if(IsAudioStreamReady(s_ctx.tone))
+    if(!s_ctx.is_rom_scan_running)
     {
-        TraceLog(LOG_INFO, "Audio stream is ready");
-        PlayAudioStream(s_ctx.tone);
-        PauseAudioStream(s_ctx.tone);
+        scan_roms(NULL);
+        start_previews();
     }
 
-    s_ctx.old_window_height = GetScreenHeight();
-
     s_ctx.menu_bg_tex2d = LoadTexture("../menu_bg_img.png");
-
-    FilePathList roms = LoadDirectoryFiles(".");
-    assert(roms.count <= MAX_ROMS);
-    s_ctx.rom_count = MAX_ROMS < roms.count ? MAX_ROMS : roms.count;
-
-    for(uint32_t i = 0; i < s_ctx.rom_count; ++i)
+    const char* filter = getenv("CHIP8_FILTER");
+    UpscaleConfig upscale_config = {
+        .filter = UPSCALE_NONE,
+        .on = {WHITE.r, WHITE.g, WHITE.b, WHITE.a},
+        .off = {BLACK.r, BLACK.g, BLACK.b, BLACK.a},
+        .is_scalar = false
+    };
+
+    if(filter && !upscale_parse_filter(filter, &upscale_config.filter))
     {
-        const char* rom_name = GetFileName(roms.paths[i]);
+        renderer_log(LOG_WARNING, "Unknown filter %s, drawing without one", filter);
+    }
 
-        if(strlen(rom_name) > MAX_ROM_NAME_SIZE)
-        {
-            continue;
-        }
+    s_ctx.upscaler = upscale_create(&upscale_config);
+    load_screen_texture();
+    s_ctx.latency_path = getenv("CHIP8_LATENCY");
 
-        strcpy(s_ctx.roms[i], rom_name);
+    if(s_ctx.latency_path)
+    {
+        s_ctx.latency = latency_create(LATENCY_RECORDS);
     }
-
-    UnloadDirectoryFiles(roms);
+    boot_phase("menu texture");
 }
 
 void renderer_do_update(void)
@@ -152,11 +307,53 @@ void renderer_do_update(void)
 
 void renderer_shutdown(void)
 {
-    TraceLog(LOG_INFO, "Shutting down Chip8 VM");
+    renderer_log(LOG_INFO, "Shutting down Chip8 VM");
+
+    if(s_ctx.recorder)
+    {
+        toggle_recording();
+    }
+
+    if(s_ctx.bot)
+    {
+        toggle_bot();
+    }
+
+    report_latency();
+    latency_destroy(s_ctx.latency);
+    telemetry_destroy(s_ctx.telemetry);
+    close_wall();
+    finish_rom_scan();
+    preview_destroy(s_ctx.previews);
     vm_shutdown();
+
+    if(g_chip8_trace.heatmap)
+    {
+        heatmap_destroy(g_chip8_trace.heatmap);
+        g_chip8_trace.heatmap = NULL;
+        UnloadTexture(s_ctx.heatmap_tex2d);
+    }
+
     UnloadTexture(s_ctx.menu_bg_tex2d);
-    UnloadAudioStream(s_ctx.tone);
-    CloseAudioDevice();
+    UnloadTexture(s_ctx.screen_tex2d);
+    upscale_destroy(s_ctx.upscaler);
+
+    if(s_ctx.is_audio_ready)
+    {
+        UnloadAudioStream(s_ctx.tone);
+        CloseAudioDevice();
+    }
+
+    if(s_ctx.audio)
+    {
+        AudioStats stats;
+        audio_get_stats(s_ctx.audio, &stats);
+        renderer_log(LOG_INFO, "Audio queued %llu changes, %llu late, %llu dropped, callback %.1f ns per sample",
+            (unsigned long long)stats.events, (unsigned long long)stats.late, (unsigned long long)stats.dropped,
+            stats.samples > 0 ? (double)stats.render_ns / (double)stats.samples : 0.0);
+        audio_destroy(s_ctx.audio);
+    }
+
     CloseWindow();
 }
 
@@ -175,35 +372,43 @@ void renderer_set_shutdown_func(const ShutdownFunc shutdown_func)
     vm_shutdown = shutdown_func;
 }
 
-void renderer_log(const int32_t log_level, const char* message, const va_list args)
-{
-    TraceLogV(LOG_DEBUG + log_level, message, args);
-}
-
 void renderer_play_tone(void)
 {
-    if(IsAudioStreamPlaying(s_ctx.tone))
+    if(!s_ctx.is_audio_ready)
     {
-        return;
+        init_audio();
     }
 
-    ResumeAudioStream(s_ctx.tone);
-    TraceLog(LOG_INFO, "Playing tone");
+    s_ctx.audio_state.is_sounding = true;
 }
 
 void renderer_stop_tone(void)
 {
-    if(!IsAudioStreamPlaying(s_ctx.tone))
-    {
-        return;
-    }
+    s_ctx.audio_state.is_sounding = false;
+}
 
-    PauseAudioStream(s_ctx.tone);
-    TraceLog(LOG_INFO, "Stopping tone");
+void renderer_set_audio(const uint8_t* pattern, const uint8_t pitch)
+{
+    memcpy(s_ctx.audio_state.pattern, pattern, sizeof(s_ctx.audio_state.pattern));
+    s_ctx.audio_state.pitch = pitch;
 }
 
 bool renderer_get_key(uint8_t* out_key)
 {
+    if(s_ctx.bot)
+    {
+        for(uint8_t key = 0; key < 16; ++key)
+        {
+            if(s_ctx.bot_pressed & (1u << key))
+            {
+                *out_key = key;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     for(size_t i = 0; i < sizeof(KeyBindings) / sizeof(KeyBindings[0]); ++i)
     {
         if(IsKeyPressed(KeyBindings[i].Key))
@@ -218,6 +423,11 @@ bool renderer_get_key(uint8_t* out_key)
 
 bool renderer_is_key_down(const uint8_t key)
 {
+    if(s_ctx.bot)
+    {
+        return (s_ctx.bot_keys >> (key & 0xF)) & 1;
+    }
+
     for(size_t i = 0; i < sizeof(KeyBindings) / sizeof(KeyBindings[0]); ++i)
     {
         if(KeyBindings[i].Value == key && IsKeyDown(KeyBindings[i].Key))
@@ -229,35 +439,57 @@ bool renderer_is_key_down(const uint8_t key)
     return false;
 }
 
-static void draw_column(const uint32_t x)
+static void load_screen_texture(void)
 {
-    assert((int32_t)x < s_ctx.RasterColumns);
-    for(int32_t i = 0; i < s_ctx.RasterRows; ++i)
-    {
-        const Color color = s_ctx.Monitor[x] & (1 <<  i) ? WHITE : BLACK;
-        DrawRectangle((int32_t)x * s_ctx.Scale,  i * s_ctx.Scale + s_ctx.info_menu_height, s_ctx.Scale, s_ctx.Scale, color);
-    }
+    const Image screen = {
+        .data = (void*)upscale_pixels(s_ctx.upscaler),
+        .width = (int32_t)upscale_width(s_ctx.upscaler),
+        .height = (int32_t)upscale_height(s_ctx.upscaler),
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+    };
+    s_ctx.screen_tex2d = LoadTextureFromImage(screen);
+}
+
+static void cycle_filter(void)
+{
+    upscale_set_filter(s_ctx.upscaler, (UpscaleFilter)((upscale_filter(s_ctx.upscaler) + 1) % UPSCALE_FILTER_COUNT));
+    UnloadTexture(s_ctx.screen_tex2d);
+    load_screen_texture();
+    renderer_log(LOG_INFO, "Display filter %s", upscale_filter_name(upscale_filter(s_ctx.upscaler)));
 }
 
 void audio_processor(void *buffer, const uint32_t frames)
 {
-    const float incr = ToneK.AudioFrequency / (float)ToneK.SampleRate;
-    int16_t *d = buffer;
+    audio_render(s_ctx.audio, buffer, frames);
+}
+
+// Queues the sound after a machine frame when it changed, then marks the frame done
+static void queue_audio(void)
+{
+    ++s_ctx.audio_frame;
 
-    for (uint32_t i = 0; i < frames; ++i)
+    if(!s_ctx.audio)
     {
-        d[i] = (int16_t)(32000.0f * sinf(2.0f * PI * s_ctx.sine_idx));
-        s_ctx.sine_idx += incr;
+        return;
+    }
 
-        if (s_ctx.sine_idx > 1.0f)
-        {
-            s_ctx.sine_idx -= 1.0f;
-        }
+    if(memcmp(&s_ctx.audio_state, &s_ctx.audio_queued, sizeof(AudioState)) != 0)
+    {
+        audio_push(s_ctx.audio, s_ctx.audio_frame, &s_ctx.audio_state);
+        s_ctx.audio_queued = s_ctx.audio_state;
     }
+
+    audio_advance(s_ctx.audio, s_ctx.audio_frame);
 }
 
 static void render_menu(void)
 {
+    if(s_ctx.is_rom_scan_running && atomic_load(&s_ctx.is_rom_scan_done))
+    {
+        finish_rom_scan();
+    }
+
     const Vector2 mousePos = GetMousePosition();
     const Rectangle playButtonBounds = (Rectangle){419, 411, 128, 53};
     const Rectangle cycleRightButtonBounds = (Rectangle){834, 340, 41, 36};
@@ -265,7 +497,7 @@ static void render_menu(void)
 
     BeginDrawing();
     DrawTexture(s_ctx.menu_bg_tex2d, 0, 0, WHITE);
-    DrawText(s_ctx.roms[s_ctx.selected_rom], (int32_t)(cycleLeftButtonBounds.x + cycleLeftButtonBounds.width + 10), (int32_t)cycleLeftButtonBounds.y, 30, WHITE);
+    DrawText(s_ctx.is_rom_scan_running ? "Loading..." : s_ctx.roms[s_ctx.selected_rom], (int32_t)(cycleLeftButtonBounds.x + cycleLeftButtonBounds.width + 10), (int32_t)cycleLeftButtonBounds.y, 30, WHITE);
 
     const bool isOverPlayButton = CheckCollisionPointRec(mousePos, playButtonBounds);
     const bool isOverCycleRightButton = CheckCollisionPointRec(mousePos, cycleRightButtonBounds);
@@ -274,14 +506,45 @@ static void render_menu(void)
     DrawText("PLAY", (int32_t)playButtonBounds.x, (int32_t)playButtonBounds.y, 48, isOverPlayButton ? GREEN : WHITE);
     DrawRectangle((int32_t)cycleLeftButtonBounds.x, (int32_t)cycleLeftButtonBounds.y, (int32_t)cycleLeftButtonBounds.width, (int32_t)cycleLeftButtonBounds.height, isOverCycleLeftButton ? (Color){0, 255, 0, 66} : (Color){0, 255, 0, 33});
     DrawRectangle((int32_t)cycleRightButtonBounds.x, (int32_t)cycleRightButtonBounds.y, (int32_t)cycleRightButtonBounds.width, (int32_t)cycleRightButtonBounds.height, isOverCycleRightButton ? (Color){0, 255, 0, 66} : (Color){0, 255, 0, 33});
+    const PreviewState preview = draw_preview(320, 150, 5);
+
+    // The menu sleeps until input unless it is scanning, animating or waiting for a preview
+    if(s_ctx.is_rom_scan_running || preview != PREVIEW_UNAVAILABLE)
+    {
+        DisableEventWaiting();
+    }
+    else
+    {
+        EnableEventWaiting();
+    }
+
     EndDrawing();
 
+    if(s_boot.first_frame_ns == 0)
+    {
+        boot_phase("first menu frame");
+        s_boot.first_frame_ns = s_boot.mark_ns;
+    }
+
+    boot_report();
+
+    if(s_ctx.is_rom_scan_running || s_ctx.rom_count == 0)
+    {
+        return;
+    }
+
     if(isOverPlayButton && IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
     {
+        // The transition and the game animate every frame
+        DisableEventWaiting();
         render_state = render_transition;
         s_ctx.transition_time = (float)GetTime() + s_ctx.TransitionTimeInSeconds;
         vm_init(s_ctx.roms[s_ctx.selected_rom]);
     }
+    else if(IsKeyPressed(KEY_F4))
+    {
+        open_wall();
+    }
     else if(isOverCycleRightButton && IsMouseButtonPressed(MOUSE_LEFT_BUTTON))
     {
         s_ctx.selected_rom = (s_ctx.selected_rom + 1) % s_ctx.rom_count;
@@ -291,10 +554,7 @@ static void render_menu(void)
         s_ctx.selected_rom = (s_ctx.selected_rom + s_ctx.rom_count - 1) % s_ctx.rom_count;
     }
 
-    if(IsAudioStreamPlaying(s_ctx.tone))
-    {
-        PauseAudioStream(s_ctx.tone);
-    }
+    renderer_stop_tone();
 }
 
 static void render_transition(void)
@@ -320,6 +580,11 @@ static void render_transition(void)
 
 static void render_game(void)
 {
+    // Timestamps are only taken while telemetry is on
+    const uint64_t frame_start_ns = s_ctx.telemetry ? timing_now_ns() : 0;
+    uint64_t update_ns = 0;
+    bool is_updated = false;
+
     if(s_ctx.is_info_menu_shown && IsKeyPressed(KEY_F10))
     {
         s_ctx.step = true;
@@ -329,17 +594,115 @@ static void render_game(void)
         s_ctx.step = false;
     }
 
-    if(s_ctx.step && IsKeyPressed(KEY_F10))
+    if(!s_ctx.step || IsKeyPressed(KEY_F10))
     {
-        vm_update();
+        if(s_ctx.bot)
+        {
+            AgentStats stats;
+            const uint16_t keys = agent_choose(s_ctx.bot, &g_chip8, &stats);
+            s_ctx.bot_pressed = keys & (uint16_t)~s_ctx.bot_keys;
+            s_ctx.bot_keys = keys;
+            s_ctx.bot_nodes_per_second = (double)stats.nodes * 1e9 / (double)(stats.elapsed_ns > 0 ? stats.elapsed_ns : 1);
+        }
+
+        if(s_ctx.latency)
+        {
+            // Input is polled by the previous EndDrawing, so that is when new presses arrived
+            const uint16_t keys = read_keys();
+
+            for(uint8_t key = 0; key < 16; ++key)
+            {
+                if((keys & (uint16_t)~s_ctx.latency_keys) >> key & 1)
+                {
+                    latency_key_down(s_ctx.latency, key, s_ctx.latency_poll_ns);
+                }
+            }
+
+            s_ctx.latency_keys = keys;
+            latency_frame_start(s_ctx.latency, timing_now_ns());
+        }
+
+        if(s_ctx.telemetry)
+        {
+            const uint64_t update_start_ns = timing_now_ns();
+            vm_update();
+            update_ns = timing_now_ns() - update_start_ns;
+        }
+        else
+        {
+            vm_update();
+        }
+
+        is_updated = true;
+        queue_audio();
+
+        if(g_chip8_trace.heatmap)
+        {
+            heatmap_decay(g_chip8_trace.heatmap);
+        }
+
+        if(s_ctx.latency)
+        {
+            const bool changed = memcmp(s_ctx.latency_shown, s_ctx.Monitor, sizeof(s_ctx.latency_shown)) != 0;
+            memcpy(s_ctx.latency_shown, s_ctx.Monitor, sizeof(s_ctx.latency_shown));
+            latency_frame_end(s_ctx.latency, s_ctx.latency_keys, g_chip8.keys_read, g_chip8.key_read_pc, changed, timing_now_ns());
+        }
+
+        if(s_ctx.recorder)
+        {
+            recorder_push(s_ctx.recorder, s_ctx.Monitor);
+        }
+    }
+
+    if (IsKeyPressed(KEY_F9))
+    {
+        toggle_recording();
+    }
+
+    if (IsKeyPressed(KEY_F6))
+    {
+        toggle_bot();
+    }
+
+    if (IsKeyPressed(KEY_F3))
+    {
+        toggle_telemetry();
     }
-    else if(!s_ctx.step)
+
+    if (IsKeyPressed(KEY_F8))
+    {
+        write_trace();
+    }
+
+    if (IsKeyPressed(KEY_F11))
+    {
+        toggle_heatmap();
+    }
+
+    if (IsKeyPressed(KEY_F5))
     {
-        vm_update();
+        cycle_filter();
+    }
+
+    if (IsKeyPressed(KEY_F7))
+    {
+        g_chip8_runahead.mode = (Chip8RunAheadMode)((g_chip8_runahead.mode + 1) % CHIP8_RUNAHEAD_MODE_COUNT);
+        renderer_log(LOG_INFO, "Run-ahead %s, %u frames", chip8_run_ahead_mode_name(g_chip8_runahead.mode), g_chip8_runahead.frames);
     }
 
     if (IsKeyPressed(KEY_F2))
     {
+        if(s_ctx.recorder)
+        {
+            toggle_recording();
+        }
+
+        if(s_ctx.bot)
+        {
+            toggle_bot();
+        }
+
+        report_latency();
         render_state = render_menu;
         s_ctx.is_info_menu_shown = false;
         update_window(false);
@@ -365,32 +728,177 @@ static void render_game(void)
     BeginDrawing();
     ClearBackground(BLACK);
 
-    for(int x = 0; x < s_ctx.RasterColumns; ++x)
+    // The filter only runs when the display changed, the texture is redrawn every frame
+    if(upscale_run(s_ctx.upscaler, s_ctx.Monitor))
     {
-        draw_column(x);
+        UpdateTexture(s_ctx.screen_tex2d, upscale_pixels(s_ctx.upscaler));
     }
 
+    const Rectangle screen = {0.0f, (float)s_ctx.info_menu_height, (float)(s_ctx.RasterColumns * s_ctx.Scale), (float)(s_ctx.RasterRows * s_ctx.Scale)};
+    DrawTexturePro(s_ctx.screen_tex2d, (Rectangle){0.0f, 0.0f, (float)s_ctx.screen_tex2d.width, (float)s_ctx.screen_tex2d.height}, screen, (Vector2){0.0f, 0.0f}, 0.0f, WHITE);
+
     if(s_ctx.is_info_menu_shown)
     {
         const char* chip8Info = TextFormat("v0: %.02x  v1: %.02x  v2: %.02x  v3: %.02x  v4: %.02x  v5: %.02x  v6: %.02x  v7: %.02x\n\n"
             "v8: %.02x  v9: %.02x  va: %.02x  vb: %.02x  vc: %.02x  vd: %.02x  ve: %.02x  vf: %.02x\n\n"
             "index: %.04x  pc: %.04x  sp: %.02x  delay_timer: %.02x  sound_timer: %.02x\n\n"
-            "speed: %d\n",
+            "speed: %d  quirks: %s  run-ahead: %s %u, %.3f ms  filter: %s %.3f ms\n",
             g_chip8.v[0], g_chip8.v[1], g_chip8.v[2], g_chip8.v[3], g_chip8.v[4], g_chip8.v[5], g_chip8.v[6], g_chip8.v[7], 
             g_chip8.v[8], g_chip8.v[9], g_chip8.v[10], g_chip8.v[11], g_chip8.v[12], g_chip8.v[13], g_chip8.v[14], g_chip8.v[15],
-            g_chip8.index, g_chip8.pc, g_chip8.sp, g_chip8.delay_timer, g_chip8.sound_timer, g_chip8.speed);
+            g_chip8.index, g_chip8.pc, g_chip8.sp, g_chip8.delay_timer, g_chip8.sound_timer, g_chip8.speed, chip8_profile_name(g_chip8.profile),
+            chip8_run_ahead_mode_name(g_chip8_runahead.mode), g_chip8_runahead.frames, (double)g_chip8_runahead.cost_ns / 1e6,
+            upscale_filter_name(upscale_filter(s_ctx.upscaler)), (double)upscale_cost_ns(s_ctx.upscaler) / 1e6);
         DrawRectangle(0, 0, 650, 150, DARKGRAY);
         DrawText(chip8Info, 10, 36, 20, GREEN);
         draw_stack(0, 150, 650, 60);
         draw_mini_sprite(650, 0, 240, 210);
+        draw_disassembly(0, 210, 890, 160);
+        draw_telemetry(0, 370, 890, 100);
+
+        if(g_chip8_trace.heatmap)
+        {
+            draw_heatmap(0, 470, 890, 200);
+        }
+
         DrawFPS(10, 10);
     }
 
+    if(s_ctx.recorder)
+    {
+        DrawText("REC", s_ctx.RasterColumns * s_ctx.Scale - 60, s_ctx.info_menu_height + 10, 20, RED);
+    }
+
+    if(s_ctx.bot)
+    {
+        DrawText(TextFormat("BOT %.0fk nodes/s", s_ctx.bot_nodes_per_second / 1000.0), 10, s_ctx.info_menu_height + 10, 20, YELLOW);
+    }
+
     if(GetTime() < s_ctx.transition_time)
     {
         DrawRectangle(0, 0, s_ctx.RasterColumns * s_ctx.Scale, s_ctx.RasterRows * s_ctx.Scale, BLACK);
     }
 
+    if(s_ctx.telemetry && GetTime() < (double)s_ctx.telemetry_spike_ns / 1e9)
+    {
+        DrawText("SPIKE", s_ctx.RasterColumns * s_ctx.Scale - 80, s_ctx.info_menu_height + 34, 20, ORANGE);
+    }
+
+    const uint64_t present_start_ns = s_ctx.telemetry ? timing_now_ns() : 0;
+    EndDrawing();
+
+    if(s_ctx.latency)
+    {
+        s_ctx.latency_poll_ns = timing_now_ns();
+        latency_present(s_ctx.latency, s_ctx.latency_poll_ns);
+    }
+
+    if(s_ctx.telemetry)
+    {
+        const uint64_t present_end_ns = timing_now_ns();
+        const TelemetryFrame frame = {
+            .start_ns = frame_start_ns,
+            .update_ns = update_ns,
+            .draw_ns = present_start_ns - frame_start_ns - update_ns,
+            .present_ns = present_end_ns - present_start_ns,
+            .instructions = is_updated ? g_chip8.executed : 0,
+            .target_instructions = is_updated ? g_chip8.speed : 0
+        };
+
+        if(telemetry_push(s_ctx.telemetry, &frame))
+        {
+            // Flagged for a second on screen
+            s_ctx.telemetry_spike_ns = (uint64_t)((GetTime() + 1.0) * 1e9);
+            renderer_log(LOG_WARNING, "Frame time spike %.2f ms (update %.2f, draw %.2f, EndDrawing %.2f)",
+                (double)(present_end_ns - frame_start_ns) / 1e6, (double)frame.update_ns / 1e6,
+                (double)frame.draw_ns / 1e6, (double)frame.present_ns / 1e6);
+        }
+    }
+}
+
+static void render_wall(void)
+{
+    const uint32_t count = wall_count(s_ctx.wall);
+    const uint32_t columns = wall_columns(s_ctx.wall);
+    uint32_t focus = wall_focus(s_ctx.wall);
+
+    wall_step(s_ctx.wall, s_ctx.is_wall_focus_playing, s_ctx.is_wall_focus_playing ? read_keys() : 0);
+
+    // Only tiles whose machine drew something are uploaded
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(wall_tile_dirty(s_ctx.wall, i))
+        {
+            const Rectangle tile = {(float)(i % columns * WALL_TILE_WIDTH), (float)(i / columns * WALL_TILE_HEIGHT), WALL_TILE_WIDTH, WALL_TILE_HEIGHT};
+            UpdateTextureRec(s_ctx.wall_atlas, tile, wall_tile_pixels(s_ctx.wall, i));
+            wall_clear_dirty(s_ctx.wall, i);
+        }
+    }
+
+    // Arrow keys hand the keyboard to a machine, F5 goes back to attract mode
+    const int32_t moves[4] = {KEY_RIGHT, KEY_LEFT, KEY_DOWN, KEY_UP};
+    const uint32_t steps[4] = {1, count - 1, columns, count - columns % count};
+
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+        if(IsKeyPressed(moves[i]))
+        {
+            focus = (focus + steps[i]) % count;
+            s_ctx.is_wall_focus_playing = true;
+        }
+    }
+
+    if(IsKeyPressed(KEY_F5))
+    {
+        s_ctx.is_wall_focus_playing = false;
+        s_ctx.wall_focus_time = GetTime();
+    }
+
+    if(!s_ctx.is_wall_focus_playing && GetTime() - s_ctx.wall_focus_time >= WALL_ATTRACT_SECONDS)
+    {
+        focus = (focus + 1) % count;
+        s_ctx.wall_focus_time = GetTime();
+    }
+
+    wall_set_focus(s_ctx.wall, focus);
+
+    if(IsKeyPressed(KEY_M))
+    {
+        s_ctx.is_wall_audio_mixed = !s_ctx.is_wall_audio_mixed;
+    }
+
+    if(IsKeyPressed(KEY_F2))
+    {
+        close_wall();
+        render_state = render_menu;
+        return;
+    }
+
+    // The whole wall is one textured quad, scaled to fit the window
+    const int32_t screen_width = GetScreenWidth();
+    const int32_t screen_height = GetScreenHeight() - 30;
+    const float atlas_width = (float)s_ctx.wall_atlas.width;
+    const float atlas_height = (float)s_ctx.wall_atlas.height;
+    const float scale = fminf((float)screen_width / atlas_width, (float)screen_height / atlas_height);
+    const Rectangle destination = {((float)screen_width - atlas_width * scale) / 2.0f, 0.0f, atlas_width * scale, atlas_height * scale};
+
+    BeginDrawing();
+    ClearBackground(BLACK);
+    DrawTexturePro(s_ctx.wall_atlas, (Rectangle){0.0f, 0.0f, atlas_width, atlas_height}, destination, (Vector2){0.0f, 0.0f}, 0.0f, WHITE);
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const int32_t x = (int32_t)(destination.x + (float)(i % columns * WALL_TILE_WIDTH) * scale);
+        const int32_t y = (int32_t)(destination.y + (float)(i / columns * WALL_TILE_HEIGHT) * scale);
+        const int32_t width = (int32_t)(WALL_TILE_WIDTH * scale);
+        const int32_t height = (int32_t)(WALL_TILE_HEIGHT * scale);
+        DrawRectangleLines(x, y, width, height, i == focus ? (s_ctx.is_wall_focus_playing ? GREEN : YELLOW) : DARKGRAY);
+        DrawText(TextFormat("%.3f ms", (double)wall_tile_average_ns(s_ctx.wall, i) / 1e6), x + 3, y + 3, 10, SKYBLUE);
+    }
+
+    DrawText(TextFormat("%u machines on %u threads, %.2f ms per frame  %s  audio: %s  (arrows play, F5 attract, M audio, F2 menu)",
+        count, wall_threads(s_ctx.wall), (double)wall_step_ns(s_ctx.wall) / 1e6,
+        s_ctx.is_wall_focus_playing ? "playing" : "attract", s_ctx.is_wall_audio_mixed ? "mix" : "focused"),
+        10, screen_height + 8, 16, GREEN);
     EndDrawing();
 }
 
@@ -404,7 +912,7 @@ static void draw_mini_sprite(const int32_t x, const int32_t y, const int32_t wid
     
     for(int32_t i = 0; i < 15; ++i)
     {
-        const uint8_t row = g_chip8.ram[g_chip8.index + i];
+        const uint8_t row = chip8_read(&g_chip8, g_chip8.index + i);
         DrawRectangle(0 * px_width + x, (i + y) * px_height, px_width, px_height, (row & 0x80) ? WHITE : BLACK);
         DrawRectangle(1 * px_width + x, (i + y) * px_height, px_width, px_height, (row & 0x40) ? WHITE : BLACK);
         DrawRectangle(2 * px_width + x, (i + y) * px_height, px_width, px_height, (row & 0x20) ? WHITE : BLACK);
@@ -452,6 +960,123 @@ static void draw_stack(const int32_t x, const int32_t y, const int32_t width, co
     DrawRectangleLines(x, y, width, height, DARKGRAY);
 }
 
+static void draw_disassembly(const int32_t x, const int32_t y, const int32_t width, const int32_t height)
+{
+    const int32_t line_height = 20;
+    const int32_t line_count = height / line_height;
+    const uint16_t pc = g_chip8.pc & (CHIP8_RAM_SIZE - 1);
+    const uint8_t* flags = g_chip8_analysis.flags;
+
+    DrawRectangle(x, y, width, height, BLACK);
+
+    // Step back over whole instructions and data bytes so pc sits in the middle
+    uint16_t address = pc;
+
+    for(int32_t i = 0; i < line_count / 2 && address > 0; ++i)
+    {
+        address -= (address >= 2 && (flags[address - 2] & ANALYSIS_CODE)) ? 2 : 1;
+    }
+
+    for(int32_t i = 0; i < line_count && address < CHIP8_RAM_SIZE; ++i)
+    {
+        const int32_t line_y = y + 2 + i * line_height;
+
+        // Code the analysis did not find is still shown as code once it runs
+        if((flags[address] & ANALYSIS_CODE) || address == pc)
+        {
+            char text[32];
+            const uint16_t instruction = (uint16_t)((chip8_read(&g_chip8, address) << 8) | chip8_read(&g_chip8, address + 1));
+            chip8_disassemble(instruction, text, sizeof(text));
+            DrawText(TextFormat("%s %.03x  %.04x  %s%s", address == pc ? ">" : " ", address, instruction, text,
+                (flags[address] & ANALYSIS_WRITTEN) ? "  ; modified" : ""),
+                x + 10, line_y, 18, address == pc ? YELLOW : GREEN);
+            address += 2;
+        }
+        else
+        {
+            const uint8_t byte = chip8_read(&g_chip8, address);
+            DrawText(TextFormat("  %.03x  %.02x    db 0x%.02x%s", address, byte, byte,
+                (flags[address] & ANALYSIS_DATA) ? "  ; data" : ""),
+                x + 10, line_y, 18, GRAY);
+            address += 1;
+        }
+    }
+
+    const AnalysisBlock* block = chip8_analysis_block_at(&g_chip8_analysis, pc);
+
+    if(block)
+    {
+        DrawText(TextFormat("block %.03x-%.03x  %s", block->start, block->end - 1, chip8_analysis_exit_name((AnalysisExit)block->exit)),
+            x + width - 300, y + 2, 18, SKYBLUE);
+    }
+
+    DrawText(TextFormat("%u instructions  %u blocks  %u indirect", g_chip8_analysis.instruction_count,
+        g_chip8_analysis.block_count, g_chip8_analysis.indirect_jumps), x + width - 300, y + 22, 18, SKYBLUE);
+    DrawRectangleLines(x, y, width, height, DARKGRAY);
+}
+
+// The heatmap is one texture upload and one textured quad. The hex view next to it
+// colors each byte by what touched it, clicking the heatmap moves the view there and
+// the mouse wheel scrolls it.
+static void draw_heatmap(const int32_t x, const int32_t y, const int32_t width, const int32_t height)
+{
+    const int32_t scale = 3;
+    const int32_t margin = 4;
+    const int32_t line_height = 20;
+    const int32_t line_count = (height - 2 * margin) / line_height;
+    const int32_t hex_x = x + 2 * margin + HEATMAP_SIDE * scale + 10;
+    const Heatmap* heatmap = g_chip8_trace.heatmap;
+    const Rectangle map = {(float)(x + margin), (float)(y + margin), (float)(HEATMAP_SIDE * scale), (float)(HEATMAP_SIDE * scale)};
+
+    DrawRectangle(x, y, width, height, BLACK);
+    heatmap_render(heatmap, &g_chip8, s_ctx.heatmap_pixels);
+    UpdateTexture(s_ctx.heatmap_tex2d, s_ctx.heatmap_pixels);
+    DrawTextureEx(s_ctx.heatmap_tex2d, (Vector2){map.x, map.y}, 0.0f, (float)scale, WHITE);
+
+    const Vector2 mouse = GetMousePosition();
+    int32_t address = s_ctx.hex_address;
+
+    if(IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && CheckCollisionPointRec(mouse, map))
+    {
+        const int32_t column = (int32_t)(mouse.x - map.x) / scale;
+        const int32_t row = (int32_t)(mouse.y - map.y) / scale;
+        address = (row * HEATMAP_SIDE + column) & ~0xF;
+    }
+    else if(mouse.y >= (float)y && mouse.y < (float)(y + height))
+    {
+        address -= (int32_t)GetMouseWheelMove() * 3 * 16;
+    }
+
+    const int32_t last = CHIP8_RAM_SIZE - line_count * 16;
+    s_ctx.hex_address = (uint16_t)(address < 0 ? 0 : address > last ? last : address);
+
+    for(int32_t i = 0; i < line_count; ++i)
+    {
+        const uint16_t line = (uint16_t)(s_ctx.hex_address + i * 16);
+        const int32_t line_y = y + margin + i * line_height;
+        DrawText(TextFormat("%.03x", line), hex_x, line_y, 18, GRAY);
+
+        for(int32_t b = 0; b < 16; ++b)
+        {
+            const uint16_t a = (uint16_t)(line + b);
+            const Color color = (a & ~1) == (g_chip8.pc & ~1) ? YELLOW
+                : heatmap->writes[a] ? RED
+                : heatmap->reads[a] ? GREEN
+                : heatmap->executes[a] ? SKYBLUE : DARKGRAY;
+            DrawText(TextFormat("%.02x", chip8_read(&g_chip8, a)), hex_x + 50 + b * 30, line_y, 18, color);
+        }
+    }
+
+    // Rows of the heatmap the hex view shows
+    const int32_t first_row = s_ctx.hex_address / HEATMAP_SIDE;
+    const int32_t last_row = (s_ctx.hex_address + line_count * 16 - 1) / HEATMAP_SIDE;
+    DrawRectangleLines((int32_t)map.x - 1, (int32_t)map.y + first_row * scale - 1, HEATMAP_SIDE * scale + 2, (last_row - first_row + 1) * scale + 2, YELLOW);
+    DrawText("writes", x + width - 80, y + height - 66, 18, RED);
+    DrawText("reads", x + width - 80, y + height - 46, 18, GREEN);
+    DrawText("executes", x + width - 80, y + height - 26, 18, SKYBLUE);
+    DrawRectangleLines(x, y, width, height, DARKGRAY);
+}
+
 static void update_window(const bool is_info_showing)
 {
     const int32_t window_width = GetScreenWidth();
@@ -459,7 +1084,7 @@ static void update_window(const bool is_info_showing)
 
     if(is_info_showing)
     {
-        s_ctx.info_menu_height = 210;
+        s_ctx.info_menu_height = g_chip8_trace.heatmap ? 670 : 470;
         window_height = s_ctx.old_window_height + s_ctx.info_menu_height;
     }
     else
@@ -477,7 +1102,470 @@ static void set_working_directory(void)
     if(!FileExists(TextFormat("%s/../../chip8.exe", wd)))
     {
         const char* new_wd = TextFormat("%s/assets/rom", GetApplicationDirectory());
-        TraceLog(LOG_INFO, "Setting working directory to %s", new_wd);
+        renderer_log(LOG_INFO, "Setting working directory to %s", new_wd);
         ChangeDirectory(new_wd);
     }
 }
+
+static void toggle_recording(void)
+{
+    if(s_ctx.recorder)
+    {
+        RecorderStats stats;
+        const bool ok = recorder_close(s_ctx.recorder, &stats);
+        s_ctx.recorder = NULL;
+        renderer_log(ok ? LOG_INFO : LOG_ERROR, "Recording stopped, %llu frames, %llu encoded, %llu dropped",
+            (unsigned long long)stats.frames, (unsigned long long)stats.encoded, (unsigned long long)stats.dropped);
+        return;
+    }
+
+    // Clips go next to the executable, the working directory is the ROM list
+    char stamp[32];
+    const time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+
+    const RecorderConfig config = {
+        .path = TextFormat("%s%s-%s.gif", GetApplicationDirectory(), GetFileNameWithoutExt(s_ctx.roms[s_ctx.selected_rom]), stamp),
+        .format = RECORDER_GIF,
+        .scale = 4,
+        .capacity = 0,
+        .wait_when_full = false
+    };
+
+    s_ctx.recorder = recorder_open(&config);
+    renderer_log(s_ctx.recorder ? LOG_INFO : LOG_ERROR, "Recording to %s", config.path);
+}
+
+static void toggle_bot(void)
+{
+    if(s_ctx.bot)
+    {
+        agent_destroy(s_ctx.bot);
+        s_ctx.bot = NULL;
+        s_ctx.bot_keys = 0;
+        s_ctx.bot_pressed = 0;
+        renderer_log(LOG_INFO, "Bot stopped");
+        return;
+    }
+
+    // The working directory is the ROM list, so the ROM name finds its score address
+    const AgentConfig config = {
+        .beam_width = 8,
+        .depth = 4,
+        .hold_frames = 4,
+        .threads = 0,
+        .score = NULL,
+        .score_address = chip8_env_score_address(s_ctx.roms[s_ctx.selected_rom])
+    };
+
+    s_ctx.bot = agent_create(&config);
+    renderer_log(s_ctx.bot ? LOG_INFO : LOG_ERROR, "Bot playing %s, score at 0x%.03x", s_ctx.roms[s_ctx.selected_rom], config.score_address);
+}
+
+static void toggle_telemetry(void)
+{
+    if(s_ctx.telemetry)
+    {
+        telemetry_destroy(s_ctx.telemetry);
+        s_ctx.telemetry = NULL;
+        renderer_log(LOG_INFO, "Telemetry stopped");
+        return;
+    }
+
+    s_ctx.telemetry = telemetry_create(TELEMETRY_FRAMES);
+    renderer_log(s_ctx.telemetry ? LOG_INFO : LOG_ERROR, "Telemetry started");
+}
+
+static void toggle_heatmap(void)
+{
+    if(g_chip8_trace.heatmap)
+    {
+        heatmap_destroy(g_chip8_trace.heatmap);
+        g_chip8_trace.heatmap = NULL;
+        UnloadTexture(s_ctx.heatmap_tex2d);
+        renderer_log(LOG_INFO, "Heatmap stopped");
+    }
+    else
+    {
+        g_chip8_trace.heatmap = heatmap_create();
+
+        if(g_chip8_trace.heatmap)
+        {
+            const Image heatmap = {
+                .data = s_ctx.heatmap_pixels,
+                .width = HEATMAP_SIDE,
+                .height = HEATMAP_SIDE,
+                .mipmaps = 1,
+                .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8
+            };
+            s_ctx.heatmap_tex2d = LoadTextureFromImage(heatmap);
+        }
+
+        renderer_log(g_chip8_trace.heatmap ? LOG_INFO : LOG_ERROR, "Heatmap started");
+    }
+
+    update_window(s_ctx.is_info_menu_shown);
+}
+
+static void write_trace(void)
+{
+    if(!s_ctx.telemetry)
+    {
+        renderer_log(LOG_WARNING, "Telemetry is off, F3 starts it");
+        return;
+    }
+
+    // Traces go next to the executable like clips
+    char stamp[32];
+    const time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    const char* path = TextFormat("%s%s-%s.trace.json", GetApplicationDirectory(), GetFileNameWithoutExt(s_ctx.roms[s_ctx.selected_rom]), stamp);
+    const bool ok = telemetry_write_trace(s_ctx.telemetry, TELEMETRY_TRACE_NS, path);
+    renderer_log(ok ? LOG_INFO : LOG_ERROR, "Trace of the last %.0f s written to %s", (double)TELEMETRY_TRACE_NS / 1e9, path);
+}
+
+static void draw_telemetry(const int32_t x, const int32_t y, const int32_t width, const int32_t height)
+{
+    DrawRectangle(x, y, width, height, DARKGRAY);
+
+    if(!s_ctx.telemetry)
+    {
+        DrawText("F3 starts frame telemetry", x + 10, y + 10, 20, GRAY);
+        DrawRectangleLines(x, y, width, height, BLACK);
+        return;
+    }
+
+    TelemetrySummary summary;
+    telemetry_summarize(s_ctx.telemetry, TELEMETRY_PANEL_NS, &summary);
+
+    const double target = summary.target_instructions_per_second > 0.0 ? summary.target_instructions_per_second : 1.0;
+    // Speculation takes a fourth line, the lines close up to make room for it
+    const char* gap = g_chip8_speculator ? "\n" : "\n\n";
+    DrawText(TextFormat("update %.2f  draw %.2f  EndDrawing %.2f ms%s"
+        "frame p50 %.2f  p95 %.2f  p99 %.2f  max %.2f ms%s"
+        "%.0f instructions/s, %.0f%% of target  %u spikes",
+        summary.update_ms, summary.draw_ms, summary.present_ms, gap, summary.p50_ms, summary.p95_ms, summary.p99_ms, summary.max_ms,
+        gap, summary.instructions_per_second, summary.instructions_per_second * 100.0 / target, summary.spikes),
+        x + 10, y + 10, 18, GREEN);
+
+    if(g_chip8_speculator)
+    {
+        // Every adopted fork shows its key press a frame sooner
+        SpeculateStats stats;
+        speculate_get_stats(g_chip8_speculator, &stats);
+        DrawText(TextFormat("Fx0A %llu/%llu presses speculated, %.0f ms saved, %.1f us per fork",
+            (unsigned long long)stats.hits, (unsigned long long)stats.presses, (double)stats.hits * 1000.0 / 60.0,
+            stats.forks > 0 ? (double)stats.fork_ns / (double)stats.forks / 1e3 : 0.0),
+            x + 10, y + 70, 18, GREEN);
+    }
+
+    // One bar per bin, the 60 Hz frame time marked
+    const int32_t bar_width = 3;
+    const int32_t chart_x = x + width - TELEMETRY_BINS * bar_width - 10;
+    const int32_t chart_height = height - 20;
+    uint32_t highest = 1;
+
+    for(uint32_t bin = 0; bin < TELEMETRY_BINS; ++bin)
+    {
+        highest = summary.histogram[bin] > highest ? summary.histogram[bin] : highest;
+    }
+
+    for(uint32_t bin = 0; bin < TELEMETRY_BINS; ++bin)
+    {
+        const int32_t bar_height = (int32_t)((uint64_t)summary.histogram[bin] * (uint64_t)chart_height / highest);
+        const Color color = (uint64_t)bin * TELEMETRY_BIN_NS >= 16666667ull ? ORANGE : SKYBLUE;
+        DrawRectangle(chart_x + (int32_t)bin * bar_width, y + 10 + chart_height - bar_height, bar_width - 1, bar_height, color);
+    }
+
+    const int32_t vsync_x = chart_x + (int32_t)(16666667ull / TELEMETRY_BIN_NS) * bar_width;
+    DrawLine(vsync_x, y + 10, vsync_x, y + 10 + chart_height, WHITE);
+    DrawRectangleLines(x, y, width, height, BLACK);
+}
+
+static void open_wall(void)
+{
+    const char* paths[MAX_ROMS];
+
+    for(uint32_t i = 0; i < s_ctx.rom_count; ++i)
+    {
+        paths[i] = s_ctx.roms[i];
+    }
+
+    const char* machines = getenv("CHIP8_WALL");
+    const WallConfig config = {
+        .count = machines ? (uint32_t)strtoul(machines, NULL, 10) : WALL_DEFAULT_MACHINES,
+        .threads = 0,
+        .rom_paths = paths,
+        .rom_count = s_ctx.rom_count,
+        .seed = (uint32_t)time(NULL)
+    };
+
+    s_ctx.wall = wall_create(&config);
+
+    if(!s_ctx.wall)
+    {
+        renderer_log(LOG_ERROR, "Failed to create the wall");
+        return;
+    }
+
+    // Tiles start black and are uploaded as their machines draw
+    const int32_t width = (int32_t)(wall_columns(s_ctx.wall) * WALL_TILE_WIDTH);
+    const int32_t height = (int32_t)(wall_rows(s_ctx.wall) * WALL_TILE_HEIGHT);
+    Image atlas = GenImageColor(width, height, BLACK);
+    ImageFormat(&atlas, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+    s_ctx.wall_atlas = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+
+    if(!s_ctx.is_audio_ready)
+    {
+        init_audio();
+    }
+
+    if(IsAudioDeviceReady())
+    {
+        s_ctx.wall_tone = LoadAudioStream(ToneK.SampleRate, ToneK.SampleSize, ToneK.Channels);
+        SetAudioStreamCallback(s_ctx.wall_tone, wall_audio_processor);
+        PlayAudioStream(s_ctx.wall_tone);
+        s_ctx.is_wall_tone_ready = true;
+    }
+
+    s_ctx.is_wall_focus_playing = false;
+    s_ctx.wall_focus_time = GetTime();
+    DisableEventWaiting();
+    render_state = render_wall;
+    renderer_log(LOG_INFO, "Wall of %u machines on %u threads", wall_count(s_ctx.wall), wall_threads(s_ctx.wall));
+}
+
+static void close_wall(void)
+{
+    if(!s_ctx.wall)
+    {
+        return;
+    }
+
+    // Unloading waits out the audio callback, so the wall is not mixed once destroyed
+    if(s_ctx.is_wall_tone_ready)
+    {
+        UnloadAudioStream(s_ctx.wall_tone);
+        s_ctx.is_wall_tone_ready = false;
+    }
+
+    UnloadTexture(s_ctx.wall_atlas);
+    wall_destroy(s_ctx.wall);
+    s_ctx.wall = NULL;
+}
+
+static void wall_audio_processor(void* buffer, const uint32_t frames)
+{
+    wall_mix_audio(s_ctx.wall, buffer, frames, ToneK.SampleRate, !s_ctx.is_wall_audio_mixed);
+}
+
+static uint16_t read_keys(void)
+{
+    uint16_t keys = 0;
+
+    for(uint8_t key = 0; key < 16; ++key)
+    {
+        keys |= (uint16_t)(renderer_is_key_down(key) << key);
+    }
+
+    return keys;
+}
+
+// Logs the percentiles of the game just left and writes its presses to the CSV
+static void report_latency(void)
+{
+    if(!s_ctx.latency)
+    {
+        return;
+    }
+
+    LatencySummary summary;
+    latency_summarize(s_ctx.latency, &summary);
+
+    if(summary.events > 0)
+    {
+        renderer_log(LOG_INFO, "Input to photon %u presses, %u unanswered: p50 %.2f p95 %.2f p99 %.2f ms "
+            "(polling p95 %.2f, emulation p95 %.2f, present p95 %.2f)",
+            summary.events, summary.unanswered, summary.total.p50_ms, summary.total.p95_ms, summary.total.p99_ms,
+            summary.polling.p95_ms, summary.emulation.p95_ms, summary.present.p95_ms);
+
+        if(!latency_write_csv(s_ctx.latency, s_ctx.latency_path))
+        {
+            renderer_log(LOG_ERROR, "Failed to write %s", s_ctx.latency_path);
+        }
+    }
+
+    latency_reset(s_ctx.latency);
+    s_ctx.latency_keys = 0;
+}
+
+static void init_audio(void)
+{
+    const uint64_t start = timing_now_ns();
+
+    InitAudioDevice();
+    SetAudioStreamBufferSizeDefault(ToneK.MaxSamplesPerUpdate);
+    s_ctx.tone = LoadAudioStream(ToneK.SampleRate, ToneK.SampleSize, ToneK.Channels);
+    s_ctx.audio = audio_create(ToneK.SampleRate);
+
+    if(IsAudioStreamReady(s_ctx.tone) && s_ctx.audio)
+    {
+        // The engine starts from the current sound, then the stream plays for good and
+        // silence is the engine's to make
+        audio_push(s_ctx.audio, s_ctx.audio_frame, &s_ctx.audio_state);
+        audio_advance(s_ctx.audio, s_ctx.audio_frame);
+        s_ctx.audio_queued = s_ctx.audio_state;
+        SetAudioStreamCallback(s_ctx.tone, audio_processor);
+        SetAudioStreamVolume(s_ctx.tone, 1.0f);
+        renderer_log(LOG_INFO, "Audio stream is ready");
+        PlayAudioStream(s_ctx.tone);
+    }
+
+    // Set even on failure so a missing audio device is not retried on every tone
+    s_ctx.is_audio_ready = true;
+    renderer_log(LOG_INFO, "Audio initialized on first tone in %.2f ms", (double)(timing_now_ns() - start) / 1e6);
+}
+
+// Runs on its own thread and owns the ROM list until is_rom_scan_done is set
+static int scan_roms(void* arg)
+{
+    (void)arg;
+    FilePathList roms = LoadDirectoryFiles(".");
+    uint32_t rom_count = 0;
+
+    for(uint32_t i = 0; i < roms.count && rom_count < MAX_ROMS; ++i)
+    {
+        const char* rom_name = GetFileName(roms.paths[i]);
+
+        // Analysis and preview caches live next to the ROMs they describe
+        if(strlen(rom_name) > MAX_ROM_NAME_SIZE || IsFileExtension(rom_name, ".analysis;.preview"))
+        {
+            continue;
+        }
+
+        strcpy(s_ctx.roms[rom_count++], rom_name);
+    }
+
+    UnloadDirectoryFiles(roms);
+    s_ctx.rom_count = rom_count;
+    s_ctx.rom_scan_end_ns = timing_now_ns();
+    atomic_store(&s_ctx.is_rom_scan_done, true);
+    return 0;
+}
+
+static void finish_rom_scan(void)
+{
+    if(!s_ctx.is_rom_scan_running)
+    {
+        return;
+    }
+
+    thrd_join(s_ctx.rom_scan, NULL);
+    s_ctx.is_rom_scan_running = false;
+    s_boot.phase_names[s_boot.phase_count] = "rom scan";
+    s_boot.phase_ns[s_boot.phase_count++] = s_ctx.rom_scan_end_ns - s_ctx.rom_scan_start_ns;
+    start_previews();
+}
+
+static void start_previews(void)
+{
+    const char* paths[MAX_ROMS];
+
+    for(uint32_t i = 0; i < s_ctx.rom_count; ++i)
+    {
+        paths[i] = s_ctx.roms[i];
+    }
+
+    const PreviewConfig config = {
+        .memory_budget = 0,
+        .radius = 0,
+        .cache_dir = NULL
+    };
+
+    s_ctx.previews = s_ctx.rom_count > 0 ? preview_create(&config, paths, s_ctx.rom_count) : NULL;
+}
+
+// Plays the selected entry's preview, or says it is on the way
+static PreviewState draw_preview(const int32_t x, const int32_t y, const int32_t scale)
+{
+    if(!s_ctx.previews)
+    {
+        return PREVIEW_UNAVAILABLE;
+    }
+
+    preview_focus(s_ctx.previews, s_ctx.selected_rom);
+    uint32_t display[64];
+    const uint64_t tick = (uint64_t)(GetTime() * 60.0) / PREVIEW_FRAME_STEP;
+    const PreviewState state = preview_frame(s_ctx.previews, s_ctx.selected_rom, tick, display);
+
+    if(state == PREVIEW_UNAVAILABLE)
+    {
+        return state;
+    }
+
+    DrawRectangle(x - 2, y - 2, 64 * scale + 4, 32 * scale + 4, DARKGRAY);
+    DrawRectangle(x, y, 64 * scale, 32 * scale, BLACK);
+
+    if(state == PREVIEW_PENDING)
+    {
+        DrawText("...", x + 32 * scale - 12, y + 16 * scale - 10, 20, GRAY);
+        return state;
+    }
+
+    for(int32_t column = 0; column < 64; ++column)
+    {
+        for(int32_t row = 0; row < 32; ++row)
+        {
+            if(display[column] & (1u << row))
+            {
+                DrawRectangle(x + column * scale, y + row * scale, scale, scale, WHITE);
+            }
+        }
+    }
+
+    return state;
+}
+
+// Phases on the main thread run back to back, each one ends where the next begins
+static void boot_phase(const char* name)
+{
+    const uint64_t now = timing_now_ns();
+    s_boot.phase_names[s_boot.phase_count] = name;
+    s_boot.phase_ns[s_boot.phase_count++] = now - s_boot.mark_ns;
+    s_boot.mark_ns = now;
+}
+
+static void boot_report(void)
+{
+    if(s_boot.is_reported || s_ctx.is_rom_scan_running)
+    {
+        return;
+    }
+
+    // Interactive once the first menu frame is up and the ROM list is filled in
+    s_boot.is_reported = true;
+    const uint64_t interactive_ns = s_boot.first_frame_ns > s_ctx.rom_scan_end_ns ? s_boot.first_frame_ns : s_ctx.rom_scan_end_ns;
+    const double interactive_ms = (double)(interactive_ns - s_boot.start_ns) / 1e6;
+    const char* path = getenv("CHIP8_BOOT_REPORT");
+    FILE* file = path && path[0] != '\0' ? fopen(path, "w") : NULL;
+
+    renderer_log(LOG_INFO, "Interactive %.2f ms after startup", interactive_ms);
+
+    for(uint32_t i = 0; i < s_boot.phase_count; ++i)
+    {
+        const double ms = (double)s_boot.phase_ns[i] / 1e6;
+        renderer_log(LOG_INFO, "Boot phase %-16s %8.2f ms", s_boot.phase_names[i], ms);
+
+        if(file)
+        {
+            fprintf(file, "%s,%.3f\n", s_boot.phase_names[i], ms);
+        }
+    }
+
+    if(file)
+    {
+        fprintf(file, "interactive,%.3f\n", interactive_ms);
+        fclose(file);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+// Byte vectors as wide as the build targets, AVX2, SSE2 or a single byte. Masks are
+// 0x00 or 0xFF per byte, as the compares return them.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_VEC_BYTES 32
+typedef __m256i SimdVec;
+#define vec_load(p) _mm256_loadu_si256((const __m256i*)(const void*)(p))
+#define vec_store(p, a) _mm256_storeu_si256((__m256i*)(void*)(p), (a))
+#define vec_set1(b) _mm256_set1_epi8((char)(b))
+#define vec_add(a, b) _mm256_add_epi8((a), (b))
+#define vec_adds(a, b) _mm256_adds_epu8((a), (b))
+#define vec_sub(a, b) _mm256_sub_epi8((a), (b))
+#define vec_subs(a, b) _mm256_subs_epu8((a), (b))
+#define vec_and(a, b) _mm256_and_si256((a), (b))
+#define vec_or(a, b) _mm256_or_si256((a), (b))
+#define vec_xor(a, b) _mm256_xor_si256((a), (b))
+#define vec_eq(a, b) _mm256_cmpeq_epi8((a), (b))
+#define vec_select(mask, a, b) _mm256_blendv_epi8((b), (a), (mask))
+#define vec_srl1(a) _mm256_and_si256(_mm256_srli_epi16((a), 1), _mm256_set1_epi8(0x7F))
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_VEC_BYTES 16
+typedef __m128i SimdVec;
+#define vec_load(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+#define vec_store(p, a) _mm_storeu_si128((__m128i*)(void*)(p), (a))
+#define vec_set1(b) _mm_set1_epi8((char)(b))
+#define vec_add(a, b) _mm_add_epi8((a), (b))
+#define vec_adds(a, b) _mm_adds_epu8((a), (b))
+#define vec_sub(a, b) _mm_sub_epi8((a), (b))
+#define vec_subs(a, b) _mm_subs_epu8((a), (b))
+#define vec_and(a, b) _mm_and_si128((a), (b))
+#define vec_or(a, b) _mm_or_si128((a), (b))
+#define vec_xor(a, b) _mm_xor_si128((a), (b))
+#define vec_eq(a, b) _mm_cmpeq_epi8((a), (b))
+#define vec_select(mask, a, b) _mm_or_si128(_mm_and_si128((mask), (a)), _mm_andnot_si128((mask), (b)))
+#define vec_srl1(a) _mm_and_si128(_mm_srli_epi16((a), 1), _mm_set1_epi8(0x7F))
+#else
+#define SIMD_VEC_BYTES 1
+typedef uint8_t SimdVec;
+#define vec_load(p) (*(const uint8_t*)(p))
+#define vec_store(p, a) (*(uint8_t*)(p) = (a))
+#define vec_set1(b) ((uint8_t)(b))
+#define vec_add(a, b) ((uint8_t)((a) + (b)))
+#define vec_adds(a, b) ((uint8_t)((a) + (b) > 0xFF ? 0xFF : (a) + (b)))
+#define vec_sub(a, b) ((uint8_t)((a) - (b)))
+#define vec_subs(a, b) ((uint8_t)((a) > (b) ? (a) - (b) : 0))
+#define vec_and(a, b) ((uint8_t)((a) & (b)))
+#define vec_or(a, b) ((uint8_t)((a) | (b)))
+#define vec_xor(a, b) ((uint8_t)((a) ^ (b)))
+#define vec_eq(a, b) ((uint8_t)((a) == (b) ? 0xFF : 0x00))
+#define vec_select(mask, a, b) ((uint8_t)(((mask) & (a)) | (~(mask) & (b))))
+#define vec_srl1(a) ((uint8_t)((a) >> 1))
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+#include "speculate.h"
+#include "pool.h"
+#include "timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct KeySpeculator
+{
+    ThreadPool* pool;
+    // The waiting machine the forks were made from, sharing its pages, so any write
+    // to the machine since shows as a page that differs
+    Chip8 base;
+    Chip8 forks[SPECULATE_KEYS];
+    bool is_ready;
+    SpeculateStats stats;
+};
+
+static void speculate_fork(void* context, uint32_t index);
+static bool speculate_same(const Chip8* a, const Chip8* b);
+
+KeySpeculator* speculate_create(const uint32_t threads)
+{
+    KeySpeculator* speculator = calloc(1, sizeof(KeySpeculator));
+
+    if(!speculator)
+    {
+        return NULL;
+    }
+
+    speculator->pool = pool_create(threads);
+
+    if(!speculator->pool)
+    {
+        free(speculator);
+        return NULL;
+    }
+
+    return speculator;
+}
+
+void speculate_destroy(KeySpeculator* speculator)
+{
+    if(!speculator)
+    {
+        return;
+    }
+
+    speculate_reset(speculator);
+    pool_destroy(speculator->pool);
+    free(speculator);
+}
+
+void speculate_prepare(KeySpeculator* speculator, const Chip8* vm)
+{
+    if(!vm->paused || vm->halted)
+    {
+        speculate_reset(speculator);
+        return;
+    }
+
+    if(speculator->is_ready && vm->keys == speculator->base.keys && speculate_same(vm, &speculator->base))
+    {
+        return;
+    }
+
+    const uint64_t start = timing_now_ns();
+    chip8_copy(&speculator->base, vm);
+
+    for(uint32_t key = 0; key < SPECULATE_KEYS; ++key)
+    {
+        chip8_copy(&speculator->forks[key], vm);
+    }
+
+    pool_for(speculator->pool, SPECULATE_KEYS, speculate_fork, speculator);
+    speculator->is_ready = true;
+    ++speculator->stats.forks;
+    speculator->stats.fork_ns += timing_now_ns() - start;
+}
+
+bool speculate_resolve(KeySpeculator* speculator, Chip8* vm)
+{
+    if(!vm->paused || vm->halted || !vm->keys_pressed)
+    {
+        return false;
+    }
+
+    ++speculator->stats.presses;
+
+    // chip8_step takes the lowest key pressed, the frontend only ever presses one
+    uint8_t key = 0;
+    while(!(vm->keys_pressed & (1u << key)))
+    {
+        ++key;
+    }
+
+    const Chip8* fork = &speculator->forks[key];
+
+    if(!speculator->is_ready || vm->keys_pressed != (1u << key) || vm->keys != (speculator->base.keys | (1u << key))
+        || !speculate_same(vm, &speculator->base))
+    {
+        return false;
+    }
+
+    const bool is_muted = vm->muted;
+    chip8_copy(vm, fork);
+    vm->muted = is_muted;
+    speculate_reset(speculator);
+    ++speculator->stats.hits;
+    return true;
+}
+
+void speculate_reset(KeySpeculator* speculator)
+{
+    if(!speculator->is_ready)
+    {
+        return;
+    }
+
+    chip8_release(&speculator->base);
+
+    for(uint32_t key = 0; key < SPECULATE_KEYS; ++key)
+    {
+        chip8_release(&speculator->forks[key]);
+    }
+
+    speculator->is_ready = false;
+}
+
+void speculate_get_stats(const KeySpeculator* speculator, SpeculateStats* out)
+{
+    *out = speculator->stats;
+}
+
+// Presses key index over the keys held, stores it and runs the next frame with the key
+// still held, the frames the machine would run without speculation
+static void speculate_fork(void* context, const uint32_t index)
+{
+    KeySpeculator* speculator = context;
+    Chip8* fork = &speculator->forks[index];
+    fork->keys = (uint16_t)(speculator->base.keys | (1u << index));
+    fork->keys_pressed = (uint16_t)(1u << index);
+    fork->muted = true;
+    chip8_step(fork);
+
+    const uint16_t keys_read = fork->keys_read;
+    const uint16_t key_read_pc = fork->key_read_pc;
+    fork->keys_pressed = 0;
+    chip8_step(fork);
+
+    // The adopted frame reports the wait it ended as the first key read
+    fork->key_read_pc = keys_read ? key_read_pc : fork->key_read_pc;
+    fork->keys_read |= keys_read;
+}
+
+static bool speculate_same(const Chip8* a, const Chip8* b)
+{
+    return memcmp(a->pages, b->pages, sizeof(a->pages)) == 0
+        && memcmp(a->v, b->v, sizeof(a->v)) == 0
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && memcmp(a->display, b->display, sizeof(a->display)) == 0
+        && memcmp(a->audio_pattern, b->audio_pattern, sizeof(a->audio_pattern)) == 0
+        && a->index == b->index && a->pc == b->pc && a->sp == b->sp
+        && a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer
+        && a->pitch == b->pitch && a->speed == b->speed && a->rng == b->rng
+        && a->profile == b->profile && a->halted == b->halted && a->paused == b->paused;
+}
@@ -0,0 +1,45 @@
+#ifndef SPECULATE_H
+#define SPECULATE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Speculative Fx0A resolution. A machine waiting for a key press normally spends the
+// frame the key goes down only storing the key, and shows the game's reaction a frame
+// later. While it waits, speculate_prepare forks it once per key on the thread pool,
+// presses that key on top of the keys held, and runs the fork to the end of its next
+// frame. When the press comes speculate_resolve adopts the matching fork, so the
+// reaction shows the frame the key went down. A fork only matches the exact machine and
+// held keys it was made from, anything else is a miss and the machine steps as usual.
+
+#define SPECULATE_KEYS 16
+
+typedef struct SpeculateStats
+{
+    // Times the forks were made, and what making them cost altogether
+    uint64_t forks;
+    uint64_t fork_ns;
+    // Key presses that ended a wait, and those a fork was adopted for
+    uint64_t presses;
+    uint64_t hits;
+} SpeculateStats;
+
+typedef struct KeySpeculator KeySpeculator;
+
+// Threads including the caller, 0 uses one per hardware thread
+KeySpeculator* speculate_create(uint32_t threads);
+void speculate_destroy(KeySpeculator* speculator);
+
+// After a frame, forks vm if it waits for a key and its forks are not already made from
+// this machine and these held keys
+void speculate_prepare(KeySpeculator* speculator, const Chip8* vm);
+// Before a frame, with the frame's keys set. Adopts the fork made for this press into
+// vm and returns true, otherwise leaves vm alone for chip8_step.
+bool speculate_resolve(KeySpeculator* speculator, Chip8* vm);
+// Drops the forks, for when the machine is replaced
+void speculate_reset(KeySpeculator* speculator);
+void speculate_get_stats(const KeySpeculator* speculator, SpeculateStats* out);
+
+#endif
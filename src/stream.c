@@ -0,0 +1,766 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "stream.h"
+#include "monitor.h"
+#include "timing.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <threads.h>
+#include <unistd.h>
+#endif
+
+#define STREAM_COLUMNS (STREAM_FRAME_BYTES / 4)
+#define STREAM_HELLO_SIZE 8
+#define STREAM_HEADER_SIZE 8
+#define STREAM_MAX_MESSAGE (STREAM_HEADER_SIZE + STREAM_MAX_PAYLOAD)
+#define STREAM_RUN_MAX 128
+
+static uint32_t stream_encode_delta_bytes(const uint8_t* from, const uint8_t* to, uint8_t* out);
+static void stream_pack(const uint32_t* display, uint8_t* bytes);
+static void stream_unpack(const uint8_t* bytes, uint32_t* display);
+
+#ifdef __linux__
+#define STREAM_INDEX 0x3u
+// Set in a channel's middle index while the buffer there has not been taken yet
+#define STREAM_FRESH 0x4u
+#define STREAM_EVENTS 64
+#define STREAM_BACKLOG 16
+
+// Frames pass from the emulation thread to the server through three buffers, each
+// side owns one and they swap the third through middle
+typedef struct StreamChannel
+{
+    uint32_t buffers[3][STREAM_COLUMNS];
+    uint32_t frames[3];
+    atomic_uint middle;
+    // Emulation thread
+    uint32_t back;
+    uint32_t published;
+    // Server thread, the newest frame taken and the delta to it from the one before,
+    // which every viewer that is keeping up shares
+    uint32_t front;
+    uint32_t frame;
+    uint32_t previous_frame;
+    uint8_t packed[STREAM_FRAME_BYTES];
+    uint8_t delta[STREAM_MAX_PAYLOAD];
+    uint32_t delta_size;
+    // A frame was taken on this pass of the event loop
+    bool is_new;
+} StreamChannel;
+
+typedef struct StreamViewer
+{
+    struct StreamViewer* next;
+    int socket;
+    uint32_t id;
+    // One message at a time is in flight, frames published before it drains are dropped
+    uint8_t* out;
+    uint32_t out_size;
+    uint32_t out_sent;
+    // Per channel, what the viewer was last sent, frame 0 before its keyframe
+    uint8_t (*shown)[STREAM_FRAME_BYTES];
+    uint32_t* shown_frames;
+    uint64_t connect_ns;
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t dropped;
+} StreamViewer;
+
+struct StreamServer
+{
+    uint32_t channel_count;
+    StreamChannel* channels;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+    int listener;
+    int epoll;
+    int wake;
+    thrd_t thread;
+    atomic_bool is_stopping;
+    // Set while the server may be about to sleep, a publish then wakes it
+    atomic_bool is_waiting;
+    atomic_ullong frames_published;
+    StreamViewer* viewers;
+    uint32_t next_id;
+    mtx_t stats_lock;
+    StreamStats stats;
+};
+
+static int stream_listen(StreamServer* server, const char* address);
+static int stream_thread(void* context);
+static bool stream_take_frames(StreamServer* server);
+static void stream_accept(StreamServer* server);
+static void stream_serve(StreamServer* server, StreamViewer* viewer, bool has_new_frames);
+static void stream_fill(StreamServer* server, StreamViewer* viewer);
+static bool stream_flush(StreamViewer* viewer);
+static void stream_drop_viewer(StreamServer* server, StreamViewer* viewer);
+static uint32_t stream_put_header(uint8_t* out, uint8_t type, uint8_t channel, uint16_t size, uint32_t frame);
+
+StreamServer* stream_open(const char* address, const uint32_t channels)
+{
+    if(channels == 0 || channels > STREAM_MAX_CHANNELS)
+    {
+        return NULL;
+    }
+
+    StreamServer* server = calloc(1, sizeof(StreamServer));
+
+    if(!server)
+    {
+        return NULL;
+    }
+
+    server->channel_count = channels;
+    server->channels = calloc(channels, sizeof(StreamChannel));
+    server->listener = -1;
+    server->epoll = -1;
+    server->wake = -1;
+    atomic_init(&server->is_stopping, false);
+    atomic_init(&server->is_waiting, false);
+    atomic_init(&server->frames_published, 0);
+
+    if(!server->channels || mtx_init(&server->stats_lock, mtx_plain) != thrd_success)
+    {
+        free(server->channels);
+        free(server);
+        return NULL;
+    }
+
+    for(uint32_t c = 0; c < channels; ++c)
+    {
+        atomic_init(&server->channels[c].middle, 1);
+        server->channels[c].back = 0;
+        server->channels[c].front = 2;
+    }
+
+    server->listener = stream_listen(server, address);
+    server->epoll = epoll_create1(EPOLL_CLOEXEC);
+    server->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = &server->listener};
+    struct epoll_event wake_event = {.events = EPOLLIN, .data.ptr = &server->wake};
+
+    if(server->listener < 0 || server->epoll < 0 || server->wake < 0
+        || epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->listener, &listen_event) != 0
+        || epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->wake, &wake_event) != 0
+        || thrd_create(&server->thread, stream_thread, server) != thrd_success)
+    {
+        monitor_log(LOG_ERROR, "Could not start the stream server on %s", address);
+        atomic_store(&server->is_stopping, true);
+        stream_close(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void stream_close(StreamServer* server)
+{
+    if(!server)
+    {
+        return;
+    }
+
+    // Only a running server still has its thread to join
+    if(!atomic_exchange(&server->is_stopping, true))
+    {
+        const uint64_t one = 1;
+        (void)!write(server->wake, &one, sizeof(one));
+        thrd_join(server->thread, NULL);
+    }
+
+    while(server->viewers)
+    {
+        stream_drop_viewer(server, server->viewers);
+    }
+
+    if(server->listener >= 0)
+    {
+        close(server->listener);
+    }
+
+    if(server->path[0])
+    {
+        unlink(server->path);
+    }
+
+    if(server->epoll >= 0)
+    {
+        close(server->epoll);
+    }
+
+    if(server->wake >= 0)
+    {
+        close(server->wake);
+    }
+
+    mtx_destroy(&server->stats_lock);
+    free(server->channels);
+    free(server);
+}
+
+void stream_publish(StreamServer* server, const uint32_t channel, const uint32_t* display)
+{
+    StreamChannel* c = &server->channels[channel];
+    memcpy(c->buffers[c->back], display, sizeof(c->buffers[c->back]));
+    c->frames[c->back] = ++c->published;
+    c->back = atomic_exchange(&c->middle, c->back | STREAM_FRESH) & STREAM_INDEX;
+    atomic_fetch_add_explicit(&server->frames_published, 1, memory_order_relaxed);
+
+    // No syscall while the server is busy, it looks at every channel before sleeping
+    if(atomic_exchange(&server->is_waiting, false))
+    {
+        const uint64_t one = 1;
+        (void)!write(server->wake, &one, sizeof(one));
+    }
+}
+
+void stream_get_stats(StreamServer* server, StreamStats* out)
+{
+    mtx_lock(&server->stats_lock);
+    *out = server->stats;
+    mtx_unlock(&server->stats_lock);
+    out->frames_published = atomic_load_explicit(&server->frames_published, memory_order_relaxed);
+}
+
+static int stream_listen(StreamServer* server, const char* address)
+{
+    int listener = -1;
+
+    if(strncmp(address, "tcp:", 4) == 0)
+    {
+        struct sockaddr_in local = {0};
+        local.sin_family = AF_INET;
+        local.sin_port = htons((uint16_t)strtoul(address + 4, NULL, 10));
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        const int reuse = 1;
+        listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if(listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || bind(listener, (struct sockaddr*)&local, sizeof(local)) != 0)
+        {
+            goto failed;
+        }
+    }
+    else
+    {
+        struct sockaddr_un local = {0};
+        local.sun_family = AF_UNIX;
+
+        if(strlen(address) >= sizeof(local.sun_path))
+        {
+            return -1;
+        }
+
+        strcpy(local.sun_path, address);
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        // A socket left behind by an earlier run would fail the bind
+        unlink(address);
+
+        if(listener < 0 || bind(listener, (struct sockaddr*)&local, sizeof(local)) != 0)
+        {
+            goto failed;
+        }
+
+        strcpy(server->path, address);
+    }
+
+    if(listen(listener, STREAM_BACKLOG) != 0)
+    {
+        goto failed;
+    }
+
+    return listener;
+
+failed:
+    if(listener >= 0)
+    {
+        close(listener);
+    }
+
+    return -1;
+}
+
+static int stream_thread(void* context)
+{
+    StreamServer* server = context;
+    struct epoll_event events[STREAM_EVENTS];
+
+    while(!atomic_load(&server->is_stopping))
+    {
+        // Announce the sleep before the last look at the channels, so a frame published
+        // after that look always writes the wake event
+        for(uint32_t c = 0; c < server->channel_count; ++c)
+        {
+            server->channels[c].is_new = false;
+        }
+
+        atomic_store(&server->is_waiting, true);
+        bool has_new_frames = stream_take_frames(server);
+        const int count = epoll_wait(server->epoll, events, STREAM_EVENTS, has_new_frames ? 0 : -1);
+        atomic_store(&server->is_waiting, false);
+        has_new_frames = stream_take_frames(server) || has_new_frames;
+
+        for(int i = 0; i < count; ++i)
+        {
+            if(events[i].data.ptr == &server->listener)
+            {
+                stream_accept(server);
+            }
+            else if(events[i].data.ptr == &server->wake)
+            {
+                uint64_t value = 0;
+                (void)!read(server->wake, &value, sizeof(value));
+            }
+            else
+            {
+                StreamViewer* viewer = events[i].data.ptr;
+                bool is_closed = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+                uint8_t discard[256];
+
+                // Viewers send nothing, reading only notices them leaving
+                while(!is_closed && (events[i].events & EPOLLIN))
+                {
+                    const ssize_t got = recv(viewer->socket, discard, sizeof(discard), 0);
+
+                    if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    {
+                        break;
+                    }
+
+                    is_closed = got <= 0;
+                }
+
+                if(is_closed || !stream_flush(viewer))
+                {
+                    stream_drop_viewer(server, viewer);
+                }
+            }
+        }
+
+        StreamViewer* viewer = server->viewers;
+
+        while(viewer)
+        {
+            StreamViewer* next = viewer->next;
+            stream_serve(server, viewer, has_new_frames);
+            viewer = next;
+        }
+    }
+
+    return 0;
+}
+
+static bool stream_take_frames(StreamServer* server)
+{
+    bool is_taken = false;
+
+    for(uint32_t i = 0; i < server->channel_count; ++i)
+    {
+        StreamChannel* c = &server->channels[i];
+
+        if(!(atomic_load(&c->middle) & STREAM_FRESH))
+        {
+            continue;
+        }
+
+        c->front = atomic_exchange(&c->middle, c->front) & STREAM_INDEX;
+        uint8_t previous[STREAM_FRAME_BYTES];
+        memcpy(previous, c->packed, sizeof(previous));
+        stream_pack(c->buffers[c->front], c->packed);
+        c->delta_size = c->frame > 0 ? stream_encode_delta_bytes(previous, c->packed, c->delta) : 0;
+        c->previous_frame = c->frame;
+        c->frame = c->frames[c->front];
+        c->is_new = true;
+        is_taken = true;
+    }
+
+    return is_taken;
+}
+
+static void stream_accept(StreamServer* server)
+{
+    for(;;)
+    {
+        const int socket = accept(server->listener, NULL, NULL);
+
+        if(socket < 0)
+        {
+            return;
+        }
+
+        // The kernel buffer would queue frames for a slow viewer just the same, it only
+        // holds a couple of messages
+        const int no_delay = 1;
+        const int send_buffer = (int)(2 * (STREAM_HELLO_SIZE + server->channel_count * STREAM_MAX_MESSAGE));
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+
+        const size_t shown_bytes = server->channel_count * (size_t)STREAM_FRAME_BYTES;
+        const size_t out_bytes = STREAM_HELLO_SIZE + server->channel_count * (size_t)STREAM_MAX_MESSAGE;
+        StreamViewer* viewer = calloc(1, sizeof(StreamViewer) + shown_bytes + server->channel_count * sizeof(uint32_t) + out_bytes);
+
+        if(!viewer)
+        {
+            close(socket);
+            continue;
+        }
+
+        viewer->shown = (uint8_t(*)[STREAM_FRAME_BYTES])(viewer + 1);
+        viewer->shown_frames = (uint32_t*)((uint8_t*)viewer->shown + shown_bytes);
+        viewer->out = (uint8_t*)(viewer->shown_frames + server->channel_count);
+        viewer->socket = socket;
+        viewer->id = ++server->next_id;
+        viewer->connect_ns = timing_now_ns();
+
+        // Edge triggered, a viewer's socket is only reported again once it changes
+        struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = viewer};
+
+        if(epoll_ctl(server->epoll, EPOLL_CTL_ADD, socket, &event) != 0)
+        {
+            close(socket);
+            free(viewer);
+            continue;
+        }
+
+        const uint8_t hello[STREAM_HELLO_SIZE] = {
+            (uint8_t)STREAM_MAGIC, (uint8_t)(STREAM_MAGIC >> 8), (uint8_t)(STREAM_MAGIC >> 16), (uint8_t)(STREAM_MAGIC >> 24),
+            (uint8_t)STREAM_VERSION, (uint8_t)(STREAM_VERSION >> 8), (uint8_t)server->channel_count, (uint8_t)(server->channel_count >> 8)
+        };
+        memcpy(viewer->out, hello, sizeof(hello));
+        viewer->out_size = sizeof(hello);
+        viewer->next = server->viewers;
+        server->viewers = viewer;
+
+        mtx_lock(&server->stats_lock);
+        ++server->stats.viewers;
+        ++server->stats.viewers_served;
+        mtx_unlock(&server->stats_lock);
+        monitor_log(LOG_INFO, "Stream viewer %u connected", viewer->id);
+
+        if(!stream_flush(viewer))
+        {
+            stream_drop_viewer(server, viewer);
+        }
+    }
+}
+
+// Sends the viewer whatever it has not seen, or counts the new frames as dropped
+// while its last message is still draining
+static void stream_serve(StreamServer* server, StreamViewer* viewer, const bool has_new_frames)
+{
+    if(viewer->out_sent < viewer->out_size)
+    {
+        if(has_new_frames)
+        {
+            uint64_t dropped = 0;
+
+            for(uint32_t c = 0; c < server->channel_count; ++c)
+            {
+                dropped += server->channels[c].is_new;
+            }
+
+            viewer->dropped += dropped;
+            mtx_lock(&server->stats_lock);
+            server->stats.dropped += dropped;
+            mtx_unlock(&server->stats_lock);
+        }
+
+        return;
+    }
+
+    stream_fill(server, viewer);
+
+    if(viewer->out_size > 0 && !stream_flush(viewer))
+    {
+        stream_drop_viewer(server, viewer);
+    }
+}
+
+static void stream_fill(StreamServer* server, StreamViewer* viewer)
+{
+    uint32_t size = 0;
+    uint64_t keyframes = 0;
+    uint64_t deltas = 0;
+
+    for(uint32_t i = 0; i < server->channel_count; ++i)
+    {
+        const StreamChannel* c = &server->channels[i];
+
+        if(c->frame == viewer->shown_frames[i])
+        {
+            continue;
+        }
+
+        uint8_t* message = viewer->out + size;
+
+        if(viewer->shown_frames[i] == 0)
+        {
+            memcpy(message + STREAM_HEADER_SIZE, c->packed, STREAM_FRAME_BYTES);
+            size += stream_put_header(message, STREAM_KEYFRAME, (uint8_t)i, STREAM_FRAME_BYTES, c->frame) + STREAM_FRAME_BYTES;
+            ++keyframes;
+        }
+        else
+        {
+            // Viewers that got the previous frame share its delta, the rest get their own
+            uint32_t delta_size = c->delta_size;
+
+            if(viewer->shown_frames[i] == c->previous_frame)
+            {
+                memcpy(message + STREAM_HEADER_SIZE, c->delta, delta_size);
+            }
+            else
+            {
+                delta_size = stream_encode_delta_bytes(viewer->shown[i], c->packed, message + STREAM_HEADER_SIZE);
+            }
+
+            if(delta_size > 0)
+            {
+                size += stream_put_header(message, STREAM_DELTA, (uint8_t)i, (uint16_t)delta_size, c->frame) + delta_size;
+                ++deltas;
+            }
+        }
+
+        memcpy(viewer->shown[i], c->packed, STREAM_FRAME_BYTES);
+        viewer->shown_frames[i] = c->frame;
+    }
+
+    viewer->out_size = size;
+    viewer->out_sent = 0;
+    viewer->messages += keyframes + deltas;
+
+    if(keyframes + deltas > 0)
+    {
+        mtx_lock(&server->stats_lock);
+        server->stats.keyframes += keyframes;
+        server->stats.deltas += deltas;
+        server->stats.bytes += size;
+        mtx_unlock(&server->stats_lock);
+    }
+}
+
+// False once the viewer is gone
+static bool stream_flush(StreamViewer* viewer)
+{
+    while(viewer->out_sent < viewer->out_size)
+    {
+        const ssize_t sent = send(viewer->socket, viewer->out + viewer->out_sent, viewer->out_size - viewer->out_sent, MSG_NOSIGNAL);
+
+        if(sent < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        viewer->out_sent += (uint32_t)sent;
+        viewer->bytes += (uint64_t)sent;
+    }
+
+    return true;
+}
+
+static void stream_drop_viewer(StreamServer* server, StreamViewer* viewer)
+{
+    StreamViewer** link = &server->viewers;
+
+    while(*link != viewer)
+    {
+        link = &(*link)->next;
+    }
+
+    *link = viewer->next;
+    epoll_ctl(server->epoll, EPOLL_CTL_DEL, viewer->socket, NULL);
+    close(viewer->socket);
+
+    monitor_log(LOG_INFO, "Stream viewer %u left after %.1f s, %.2f KB/s, %llu messages, %llu frames dropped",
+        viewer->id, (double)(timing_now_ns() - viewer->connect_ns) / 1e9,
+        (double)viewer->bytes / 1024.0 / ((double)(timing_now_ns() - viewer->connect_ns + 1) / 1e9),
+        (unsigned long long)viewer->messages, (unsigned long long)viewer->dropped);
+
+    mtx_lock(&server->stats_lock);
+    --server->stats.viewers;
+    mtx_unlock(&server->stats_lock);
+    free(viewer);
+}
+
+static uint32_t stream_put_header(uint8_t* out, const uint8_t type, const uint8_t channel, const uint16_t size, const uint32_t frame)
+{
+    out[0] = type;
+    out[1] = channel;
+    out[2] = (uint8_t)size;
+    out[3] = (uint8_t)(size >> 8);
+    out[4] = (uint8_t)frame;
+    out[5] = (uint8_t)(frame >> 8);
+    out[6] = (uint8_t)(frame >> 16);
+    out[7] = (uint8_t)(frame >> 24);
+    return STREAM_HEADER_SIZE;
+}
+#else
+StreamServer* stream_open(const char* address, const uint32_t channels)
+{
+    (void)channels;
+    monitor_log(LOG_ERROR, "Streaming to %s needs epoll, it is only available on Linux", address);
+    return NULL;
+}
+
+void stream_close(StreamServer* server)
+{
+    (void)server;
+}
+
+void stream_publish(StreamServer* server, const uint32_t channel, const uint32_t* display)
+{
+    (void)server;
+    (void)channel;
+    (void)display;
+}
+
+void stream_get_stats(StreamServer* server, StreamStats* out)
+{
+    (void)server;
+    memset(out, 0, sizeof(*out));
+}
+#endif
+
+bool stream_apply(const uint8_t type, const uint8_t* payload, const uint32_t size, uint32_t* display)
+{
+    if(type == STREAM_KEYFRAME)
+    {
+        if(size != STREAM_FRAME_BYTES)
+        {
+            return false;
+        }
+
+        stream_unpack(payload, display);
+        return true;
+    }
+
+    if(type != STREAM_DELTA)
+    {
+        return false;
+    }
+
+    uint8_t bytes[STREAM_FRAME_BYTES];
+    stream_pack(display, bytes);
+    uint32_t at = 0;
+
+    for(uint32_t i = 0; i < size;)
+    {
+        const uint8_t run = payload[i++];
+
+        if(run < 0x80)
+        {
+            at += run + 1u;
+            continue;
+        }
+
+        const uint32_t count = run - 0x7Fu;
+
+        if(at + count > STREAM_FRAME_BYTES || i + count > size)
+        {
+            return false;
+        }
+
+        for(uint32_t k = 0; k < count; ++k)
+        {
+            bytes[at++] ^= payload[i++];
+        }
+    }
+
+    if(at > STREAM_FRAME_BYTES)
+    {
+        return false;
+    }
+
+    stream_unpack(bytes, display);
+    return true;
+}
+
+uint32_t stream_encode_delta(const uint32_t* previous, const uint32_t* display, uint8_t* out)
+{
+    uint8_t from[STREAM_FRAME_BYTES];
+    uint8_t to[STREAM_FRAME_BYTES];
+    stream_pack(previous, from);
+    stream_pack(display, to);
+    return stream_encode_delta_bytes(from, to, out);
+}
+
+static uint32_t stream_encode_delta_bytes(const uint8_t* from, const uint8_t* to, uint8_t* out)
+{
+    uint32_t size = 0;
+    uint32_t at = 0;
+
+    while(at < STREAM_FRAME_BYTES)
+    {
+        uint32_t same = 0;
+
+        while(at + same < STREAM_FRAME_BYTES && from[at + same] == to[at + same])
+        {
+            ++same;
+        }
+
+        // Unchanged bytes up to the end need no run
+        if(at + same == STREAM_FRAME_BYTES)
+        {
+            break;
+        }
+
+        at += same;
+
+        for(; same > 0; same -= same < STREAM_RUN_MAX ? same : STREAM_RUN_MAX)
+        {
+            out[size++] = (uint8_t)((same < STREAM_RUN_MAX ? same : STREAM_RUN_MAX) - 1);
+        }
+
+        // A literal run ends at two unchanged bytes in a row, one costs less to copy
+        uint32_t count = 0;
+
+        while(at + count < STREAM_FRAME_BYTES && count < STREAM_RUN_MAX
+            && (from[at + count] != to[at + count]
+                || (at + count + 1 < STREAM_FRAME_BYTES && from[at + count + 1] != to[at + count + 1])))
+        {
+            ++count;
+        }
+
+        out[size++] = (uint8_t)(0x7F + count);
+
+        for(uint32_t k = 0; k < count; ++k, ++at)
+        {
+            out[size++] = from[at] ^ to[at];
+        }
+    }
+
+    return size;
+}
+
+static void stream_pack(const uint32_t* display, uint8_t* bytes)
+{
+    for(uint32_t x = 0; x < STREAM_COLUMNS; ++x)
+    {
+        bytes[x * 4 + 0] = (uint8_t)display[x];
+        bytes[x * 4 + 1] = (uint8_t)(display[x] >> 8);
+        bytes[x * 4 + 2] = (uint8_t)(display[x] >> 16);
+        bytes[x * 4 + 3] = (uint8_t)(display[x] >> 24);
+    }
+}
+
+static void stream_unpack(const uint8_t* bytes, uint32_t* display)
+{
+    for(uint32_t x = 0; x < STREAM_COLUMNS; ++x)
+    {
+        display[x] = (uint32_t)bytes[x * 4] | ((uint32_t)bytes[x * 4 + 1] << 8) | ((uint32_t)bytes[x * 4 + 2] << 16) | ((uint32_t)bytes[x * 4 + 3] << 24);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Streams the displays of one or more machines to any number of local viewers over a
+// Unix domain socket, or loopback TCP. The emulation thread only copies the display
+// into a free buffer and swaps a pointer, a server thread running one epoll loop does
+// the encoding and the socket writes. A viewer gets a keyframe of every channel and
+// then XOR deltas against the last frame it was sent, run-length encoded. A viewer
+// still busy with an earlier write misses frames instead of queueing them, its next
+// delta covers everything it missed. Linux only, stream_open fails elsewhere.
+//
+// Every integer is little endian. On connect the server sends a StreamHello, then
+// messages of a StreamMessage header and its payload:
+//   STREAM_KEYFRAME  the 64 display columns, 4 bytes each
+//   STREAM_DELTA     the 256 display bytes XORed with the previous frame the viewer
+//                    got, as runs: a byte n < 0x80 skips n + 1 unchanged bytes, a byte
+//                    n >= 0x80 is followed by n - 0x7F bytes to XOR in. Bytes after
+//                    the last run are unchanged. Frames with no change are not sent.
+
+#define STREAM_MAGIC 0x54533843u // "C8ST"
+#define STREAM_VERSION 1
+#define STREAM_MAX_CHANNELS 64
+#define STREAM_FRAME_BYTES 256
+// A delta is never longer than this, one run header per 128 bytes
+#define STREAM_MAX_PAYLOAD (STREAM_FRAME_BYTES + STREAM_FRAME_BYTES / 128)
+
+enum
+{
+    STREAM_KEYFRAME = 1,
+    STREAM_DELTA = 2,
+};
+
+typedef struct StreamHello
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t channels;
+} StreamHello;
+
+typedef struct StreamMessage
+{
+    uint8_t type;
+    uint8_t channel;
+    uint16_t size;
+    // Counts the channel's published frames from 1
+    uint32_t frame;
+} StreamMessage;
+
+typedef struct StreamStats
+{
+    uint32_t viewers;
+    uint64_t viewers_served;
+    uint64_t frames_published;
+    uint64_t keyframes;
+    uint64_t deltas;
+    // Frames a viewer did not get because its last write had not drained yet
+    uint64_t dropped;
+    uint64_t bytes;
+} StreamStats;
+
+typedef struct StreamServer StreamServer;
+
+// address is a socket path, or tcp:port to listen on 127.0.0.1
+StreamServer* stream_open(const char* address, uint32_t channels);
+void stream_close(StreamServer* server);
+// Called by the emulation thread once per frame, display is column major
+void stream_publish(StreamServer* server, uint32_t channel, const uint32_t* display);
+void stream_get_stats(StreamServer* server, StreamStats* out);
+
+// Decoding, for viewers. Applies a message payload to the channel's display and
+// returns false if it is malformed.
+bool stream_apply(uint8_t type, const uint8_t* payload, uint32_t size, uint32_t* display);
+// Encodes the XOR of two displays as a delta payload, returns its size, 0 if they match
+uint32_t stream_encode_delta(const uint32_t* previous, const uint32_t* display, uint8_t* out);
+
+#endif
@@ -0,0 +1,236 @@
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A frame is a spike when it takes this many times the recent average and at least
+// the minimum longer, so a steady 60 Hz with small jitter is never flagged
+#define TELEMETRY_SPIKE_FACTOR 2
+#define TELEMETRY_SPIKE_MIN_NS 4000000ull
+// The recent average moves a sixteenth of the way to each new frame
+#define TELEMETRY_AVERAGE_SHIFT 4
+
+struct Telemetry
+{
+    TelemetryFrame* frames;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t next;
+    uint64_t average_ns;
+};
+
+static uint64_t telemetry_frame_ns(const TelemetryFrame* frame);
+static const TelemetryFrame* telemetry_frame_at(const Telemetry* telemetry, uint32_t age);
+static uint32_t telemetry_window_count(const Telemetry* telemetry, uint64_t window_ns);
+static double telemetry_percentile(const uint32_t* histogram, uint32_t count, uint32_t percent);
+
+Telemetry* telemetry_create(const uint32_t capacity)
+{
+    Telemetry* telemetry = calloc(1, sizeof(Telemetry));
+
+    if(!telemetry)
+    {
+        return NULL;
+    }
+
+    telemetry->capacity = capacity > 0 ? capacity : 1;
+    telemetry->frames = calloc(telemetry->capacity, sizeof(TelemetryFrame));
+
+    if(!telemetry->frames)
+    {
+        free(telemetry);
+        return NULL;
+    }
+
+    return telemetry;
+}
+
+void telemetry_destroy(Telemetry* telemetry)
+{
+    if(!telemetry)
+    {
+        return;
+    }
+
+    free(telemetry->frames);
+    free(telemetry);
+}
+
+void telemetry_reset(Telemetry* telemetry)
+{
+    telemetry->count = 0;
+    telemetry->next = 0;
+    telemetry->average_ns = 0;
+}
+
+bool telemetry_push(Telemetry* telemetry, const TelemetryFrame* frame)
+{
+    const uint64_t frame_ns = telemetry_frame_ns(frame);
+    TelemetryFrame* stored = &telemetry->frames[telemetry->next];
+    *stored = *frame;
+    stored->spike = telemetry->average_ns > 0 && frame_ns > telemetry->average_ns * TELEMETRY_SPIKE_FACTOR &&
+        frame_ns > telemetry->average_ns + TELEMETRY_SPIKE_MIN_NS;
+
+    if(telemetry->average_ns == 0)
+    {
+        telemetry->average_ns = frame_ns;
+    }
+    else if(frame_ns > telemetry->average_ns)
+    {
+        telemetry->average_ns += (frame_ns - telemetry->average_ns) >> TELEMETRY_AVERAGE_SHIFT;
+    }
+    else
+    {
+        telemetry->average_ns -= (telemetry->average_ns - frame_ns) >> TELEMETRY_AVERAGE_SHIFT;
+    }
+
+    telemetry->next = (telemetry->next + 1) % telemetry->capacity;
+
+    if(telemetry->count < telemetry->capacity)
+    {
+        ++telemetry->count;
+    }
+
+    return stored->spike;
+}
+
+void telemetry_summarize(const Telemetry* telemetry, const uint64_t window_ns, TelemetrySummary* summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    const uint32_t count = telemetry_window_count(telemetry, window_ns);
+
+    if(count == 0)
+    {
+        return;
+    }
+
+    uint64_t update_ns = 0;
+    uint64_t draw_ns = 0;
+    uint64_t present_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t instructions = 0;
+    uint64_t target_instructions = 0;
+
+    for(uint32_t age = 0; age < count; ++age)
+    {
+        const TelemetryFrame* frame = telemetry_frame_at(telemetry, age);
+        const uint64_t frame_ns = telemetry_frame_ns(frame);
+        const uint64_t bin = frame_ns / TELEMETRY_BIN_NS;
+        ++summary->histogram[bin < TELEMETRY_BINS ? bin : TELEMETRY_BINS - 1];
+        summary->spikes += frame->spike;
+        update_ns += frame->update_ns;
+        draw_ns += frame->draw_ns;
+        present_ns += frame->present_ns;
+        max_ns = frame_ns > max_ns ? frame_ns : max_ns;
+        instructions += frame->instructions;
+        target_instructions += frame->target_instructions;
+    }
+
+    // Rates are over the wall time the frames covered, from the oldest start to the newest end
+    const TelemetryFrame* newest = telemetry_frame_at(telemetry, 0);
+    const TelemetryFrame* oldest = telemetry_frame_at(telemetry, count - 1);
+    const uint64_t span_ns = newest->start_ns + telemetry_frame_ns(newest) - oldest->start_ns;
+    const double seconds = (double)(span_ns > 0 ? span_ns : 1) / 1e9;
+
+    summary->frames = count;
+    summary->p50_ms = telemetry_percentile(summary->histogram, count, 50);
+    summary->p95_ms = telemetry_percentile(summary->histogram, count, 95);
+    summary->p99_ms = telemetry_percentile(summary->histogram, count, 99);
+    summary->max_ms = (double)max_ns / 1e6;
+    summary->update_ms = (double)update_ns / 1e6 / count;
+    summary->draw_ms = (double)draw_ns / 1e6 / count;
+    summary->present_ms = (double)present_ns / 1e6 / count;
+    summary->instructions_per_second = (double)instructions / seconds;
+    summary->target_instructions_per_second = (double)target_instructions / seconds;
+}
+
+bool telemetry_write_trace(const Telemetry* telemetry, const uint64_t window_ns, const char* path)
+{
+    FILE* trace = fopen(path, "w");
+
+    if(!trace)
+    {
+        return false;
+    }
+
+    const uint32_t count = telemetry_window_count(telemetry, window_ns);
+    const uint64_t origin = count > 0 ? telemetry_frame_at(telemetry, count - 1)->start_ns : 0;
+    fprintf(trace, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"render\"}}");
+
+    // Oldest first; complete events on one thread nest by time, so each frame holds its stages
+    for(uint32_t age = count; age-- > 0;)
+    {
+        const TelemetryFrame* frame = telemetry_frame_at(telemetry, age);
+        const double start_us = (double)(frame->start_ns - origin) / 1e3;
+        const double update_us = (double)frame->update_ns / 1e3;
+        const double draw_us = (double)frame->draw_ns / 1e3;
+        const double present_us = (double)frame->present_ns / 1e3;
+
+        fprintf(trace, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"instructions\":%u,\"target\":%u}}",
+            start_us, (double)telemetry_frame_ns(frame) / 1e3, frame->instructions, frame->target_instructions);
+        fprintf(trace, ",\n{\"name\":\"vm_update\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}", start_us, update_us);
+        fprintf(trace, ",\n{\"name\":\"draw\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}", start_us + update_us, draw_us);
+        fprintf(trace, ",\n{\"name\":\"EndDrawing\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+            start_us + update_us + draw_us, present_us);
+        fprintf(trace, ",\n{\"name\":\"instructions\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"executed\":%u}}", start_us, frame->instructions);
+
+        if(frame->spike)
+        {
+            fprintf(trace, ",\n{\"name\":\"spike\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":1,\"ts\":%.3f}", start_us);
+        }
+    }
+
+    fprintf(trace, "\n]}\n");
+    return fclose(trace) == 0;
+}
+
+// The stages run back to back and cover the whole frame
+static uint64_t telemetry_frame_ns(const TelemetryFrame* frame)
+{
+    return frame->update_ns + frame->draw_ns + frame->present_ns;
+}
+
+// Age 0 is the newest frame
+static const TelemetryFrame* telemetry_frame_at(const Telemetry* telemetry, const uint32_t age)
+{
+    return &telemetry->frames[(telemetry->next + telemetry->capacity - 1 - age) % telemetry->capacity];
+}
+
+static uint32_t telemetry_window_count(const Telemetry* telemetry, const uint64_t window_ns)
+{
+    if(telemetry->count == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t newest = telemetry_frame_at(telemetry, 0)->start_ns;
+    uint32_t count = 1;
+
+    while(count < telemetry->count && newest - telemetry_frame_at(telemetry, count)->start_ns <= window_ns)
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+static double telemetry_percentile(const uint32_t* histogram, const uint32_t count, const uint32_t percent)
+{
+    // Nearest rank, matching the latency percentiles
+    const uint32_t rank = (count - 1) * percent / 100 + 1;
+    uint32_t seen = 0;
+
+    for(uint32_t bin = 0; bin < TELEMETRY_BINS; ++bin)
+    {
+        seen += histogram[bin];
+
+        if(seen >= rank)
+        {
+            return (double)((bin + 1) * TELEMETRY_BIN_NS) / 1e6;
+        }
+    }
+
+    return (double)(TELEMETRY_BINS * TELEMETRY_BIN_NS) / 1e6;
+}
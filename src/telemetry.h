@@ -0,0 +1,58 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame time telemetry. The frontend timestamps each frame's emulation, drawing and the
+// time blocked presenting it; the last frames are kept in a ring, summarized into a
+// histogram with percentiles and written as Chrome trace events (chrome://tracing or
+// Perfetto). Nothing is timed while the frontend has no tracker.
+
+// Histogram bins are 250 us wide, frames of 32 ms and more land in the last bin
+#define TELEMETRY_BIN_NS 250000ull
+#define TELEMETRY_BINS 129
+
+typedef struct TelemetryFrame
+{
+    uint64_t start_ns;
+    uint64_t update_ns;
+    uint64_t draw_ns;
+    uint64_t present_ns;
+    // Instructions vm_update ran and the ones it was asked to
+    uint32_t instructions;
+    uint32_t target_instructions;
+    // Set by telemetry_push for frames much slower than the recent ones
+    bool spike;
+} TelemetryFrame;
+
+typedef struct TelemetrySummary
+{
+    uint32_t frames;
+    uint32_t spikes;
+    // Percentiles are the upper edge of the histogram bin they fall in
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double max_ms;
+    double update_ms;
+    double draw_ms;
+    double present_ms;
+    double instructions_per_second;
+    double target_instructions_per_second;
+    uint32_t histogram[TELEMETRY_BINS];
+} TelemetrySummary;
+
+typedef struct Telemetry Telemetry;
+
+// Keeps the last capacity frames
+Telemetry* telemetry_create(uint32_t capacity);
+void telemetry_destroy(Telemetry* telemetry);
+void telemetry_reset(Telemetry* telemetry);
+// Returns whether the frame was flagged as a spike
+bool telemetry_push(Telemetry* telemetry, const TelemetryFrame* frame);
+// Summarizes the frames that started in the last window_ns before the newest one
+void telemetry_summarize(const Telemetry* telemetry, uint64_t window_ns, TelemetrySummary* summary);
+bool telemetry_write_trace(const Telemetry* telemetry, uint64_t window_ns, const char* path);
+
+#endif
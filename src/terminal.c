@@ -0,0 +1,395 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "terminal.h"
+#include "logger.h"
+#include "monitor.h"
+#include "timing.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#define TERMINAL_FRAME_NS 16666667ull
+// Terminals send presses and autorepeats but never releases, so a key stays down this
+// long after the last byte it sent
+#define TERMINAL_HOLD_NS 200000000ull
+#define TERMINAL_INPUT_BYTES 256
+// Room after the cells for the status line and the bell
+#define TERMINAL_OUTPUT_BYTES (ANSI_FRAME_BYTES + 512)
+#define TERMINAL_CTRL_C 0x03
+#define TERMINAL_ESCAPE 0x1B
+
+// The keypad on the same keys as the window
+static const struct TerminalBinding
+{
+    char Key;
+    uint8_t Value;
+} TerminalBindings[16] = {
+    {'1', 0x1}, {'2', 0x2}, {'3', 0x3}, {'4', 0xC},
+    {'q', 0x4}, {'w', 0x5}, {'e', 0x6}, {'r', 0xD},
+    {'a', 0x7}, {'s', 0x8}, {'d', 0x9}, {'f', 0xE},
+    {'z', 0xA}, {'x', 0x0}, {'c', 0xB}, {'v', 0xF}
+};
+
+static struct TerminalContext
+{
+    const uint32_t* Monitor;
+    InitFunc init_func;
+    UpdateFunc update_func;
+    ShutdownFunc shutdown_func;
+    const char* rom;
+    AnsiCells cells;
+    AnsiScreen screen;
+    bool is_raw;
+    bool is_quitting;
+    bool is_tone_on;
+    bool is_bell_pending;
+    // Keys that sent a byte this frame and when each held key lets go
+    uint16_t pressed;
+    uint64_t held_until_ns[16];
+    uint64_t now_ns;
+    uint64_t frames;
+    uint64_t bytes;
+    char output[TERMINAL_OUTPUT_BYTES];
+#ifdef _WIN32
+    HANDLE input;
+    HANDLE console;
+    DWORD input_mode;
+    DWORD console_mode;
+#else
+    struct termios saved;
+#endif
+} s_term = {
+    .Monitor = NULL,
+    .init_func = NULL,
+    .update_func = NULL,
+    .shutdown_func = NULL,
+    .rom = NULL,
+    .cells = ANSI_HALF_BLOCK,
+    .is_raw = false,
+    .is_quitting = false,
+    .is_tone_on = false,
+    .is_bell_pending = false,
+    .pressed = 0,
+    .now_ns = 0,
+    .frames = 0,
+    .bytes = 0
+};
+
+static bool terminal_enter_raw(void);
+static void terminal_leave_raw(void);
+static size_t terminal_read(uint8_t* input, size_t size);
+static void terminal_write(const char* output, size_t length);
+static void terminal_read_keys(void);
+static void terminal_draw(void);
+
+void terminal_set_cells(const AnsiCells cells)
+{
+    s_term.cells = cells;
+}
+
+void terminal_initialize(const uint32_t* monitor)
+{
+    s_term.Monitor = monitor;
+    s_term.rom = getenv("CHIP8_ROM");
+
+    if(!s_term.rom)
+    {
+        fprintf(stderr, "Set CHIP8_ROM to the ROM to run in the terminal\n");
+        s_term.is_quitting = true;
+        return;
+    }
+
+    if(!terminal_enter_raw())
+    {
+        fprintf(stderr, "The terminal frontend needs stdin and stdout to be a terminal\n");
+        s_term.is_quitting = true;
+        return;
+    }
+
+    // Log lines would land in the middle of the picture, they only go to CHIP8_LOG_FILE
+    logger_set_stdout(false);
+    s_term.is_raw = true;
+    ansi_screen_init(&s_term.screen, s_term.cells, 1, 1);
+
+    // Alternate screen, hidden cursor, then the status line under the picture once
+    const int length = snprintf(s_term.output, sizeof(s_term.output), "\x1b[?1049h\x1b[?25l\x1b[2J\x1b[%u;1H%s  (1234 QWER ASDF ZXCV, Ctrl-C quits)",
+        s_term.screen.rows + 2, s_term.rom);
+    terminal_write(s_term.output, length > 0 ? (size_t)length : 0);
+}
+
+void terminal_do_update(void)
+{
+    if(s_term.is_quitting)
+    {
+        return;
+    }
+
+    s_term.init_func(s_term.rom);
+    uint64_t next_ns = timing_now_ns();
+
+    while(!s_term.is_quitting)
+    {
+        s_term.now_ns = timing_now_ns();
+        terminal_read_keys();
+        s_term.update_func();
+        terminal_draw();
+        ++s_term.frames;
+
+        // 60 Hz like the window, a frame that ran late does not make the next ones hurry
+        next_ns += TERMINAL_FRAME_NS;
+        const uint64_t now_ns = timing_now_ns();
+
+        if(next_ns > now_ns)
+        {
+            const uint64_t wait_ns = next_ns - now_ns;
+            thrd_sleep(&(struct timespec){.tv_sec = (time_t)(wait_ns / 1000000000ull), .tv_nsec = (long)(wait_ns % 1000000000ull)}, NULL);
+        }
+        else
+        {
+            next_ns = now_ns;
+        }
+    }
+}
+
+void terminal_shutdown(void)
+{
+    if(s_term.is_raw)
+    {
+        static const char Restore[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+        terminal_write(Restore, sizeof(Restore) - 1);
+        terminal_leave_raw();
+        s_term.is_raw = false;
+        logger_set_stdout(true);
+        monitor_log(LOG_INFO, "Terminal frontend drew %llu frames, %.1f bytes per frame",
+            (unsigned long long)s_term.frames, (double)s_term.bytes / (double)(s_term.frames > 0 ? s_term.frames : 1));
+    }
+
+    if(s_term.shutdown_func)
+    {
+        s_term.shutdown_func();
+    }
+}
+
+void terminal_set_init_func(const InitFunc init_func)
+{
+    s_term.init_func = init_func;
+}
+
+void terminal_set_update_func(const UpdateFunc update_func)
+{
+    s_term.update_func = update_func;
+}
+
+void terminal_set_shutdown_func(const ShutdownFunc shutdown_func)
+{
+    s_term.shutdown_func = shutdown_func;
+}
+
+bool terminal_get_key(uint8_t* out_key)
+{
+    for(uint8_t key = 0; key < 16; ++key)
+    {
+        if(s_term.pressed & (1u << key))
+        {
+            *out_key = key;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool terminal_is_key_down(const uint8_t key)
+{
+    return s_term.now_ns < s_term.held_until_ns[key & 0xF];
+}
+
+void terminal_play_tone(void)
+{
+    // The bell rings once as the tone starts, it goes out with the frame
+    s_term.is_bell_pending = s_term.is_bell_pending || !s_term.is_tone_on;
+    s_term.is_tone_on = true;
+}
+
+void terminal_stop_tone(void)
+{
+    s_term.is_tone_on = false;
+}
+
+void terminal_set_audio(const uint8_t* pattern, const uint8_t pitch)
+{
+    // The bell has a single sound
+    (void)pattern;
+    (void)pitch;
+}
+
+static void terminal_read_keys(void)
+{
+    uint8_t input[TERMINAL_INPUT_BYTES];
+    const size_t count = terminal_read(input, sizeof(input));
+    s_term.pressed = 0;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(input[i] == TERMINAL_CTRL_C)
+        {
+            s_term.is_quitting = true;
+        }
+        else if(input[i] == TERMINAL_ESCAPE)
+        {
+            // Escape on its own quits, sequences from arrows and function keys are skipped
+            if(i + 1 == count)
+            {
+                s_term.is_quitting = true;
+            }
+            else if(input[i + 1] == '[' || input[i + 1] == 'O')
+            {
+                for(i += 2; i < count && (input[i] < 0x40 || input[i] > 0x7E); ++i)
+                {
+                }
+            }
+        }
+        else
+        {
+            for(size_t b = 0; b < sizeof(TerminalBindings) / sizeof(TerminalBindings[0]); ++b)
+            {
+                if(TerminalBindings[b].Key == tolower(input[i]))
+                {
+                    s_term.pressed |= (uint16_t)(1u << TerminalBindings[b].Value);
+                    s_term.held_until_ns[TerminalBindings[b].Value] = s_term.now_ns + TERMINAL_HOLD_NS;
+                }
+            }
+        }
+    }
+}
+
+static void terminal_draw(void)
+{
+    size_t length = ansi_screen_draw(&s_term.screen, s_term.Monitor, s_term.output);
+
+    if(s_term.is_bell_pending)
+    {
+        s_term.output[length++] = '\a';
+        s_term.is_bell_pending = false;
+    }
+
+    // Nothing is written for a frame that changed nothing
+    if(length > 0)
+    {
+        terminal_write(s_term.output, length);
+        s_term.bytes += length;
+    }
+}
+
+#ifdef _WIN32
+static bool terminal_enter_raw(void)
+{
+    s_term.input = GetStdHandle(STD_INPUT_HANDLE);
+    s_term.console = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    if(!GetConsoleMode(s_term.input, &s_term.input_mode) || !GetConsoleMode(s_term.console, &s_term.console_mode))
+    {
+        return false;
+    }
+
+    SetConsoleMode(s_term.input, 0);
+    SetConsoleMode(s_term.console, s_term.console_mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    SetConsoleOutputCP(CP_UTF8);
+    return true;
+}
+
+static void terminal_leave_raw(void)
+{
+    SetConsoleMode(s_term.input, s_term.input_mode);
+    SetConsoleMode(s_term.console, s_term.console_mode);
+}
+
+// The console hands out key events rather than bytes, the presses become the characters typed
+static size_t terminal_read(uint8_t* input, const size_t size)
+{
+    size_t count = 0;
+    DWORD events = 0;
+
+    while(count < size && GetNumberOfConsoleInputEvents(s_term.input, &events) && events > 0)
+    {
+        INPUT_RECORD record;
+        DWORD read = 0;
+
+        if(!ReadConsoleInputA(s_term.input, &record, 1, &read) || read == 0)
+        {
+            break;
+        }
+
+        if(record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown && record.Event.KeyEvent.uChar.AsciiChar != 0)
+        {
+            input[count++] = (uint8_t)record.Event.KeyEvent.uChar.AsciiChar;
+        }
+    }
+
+    return count;
+}
+
+static void terminal_write(const char* output, const size_t length)
+{
+    DWORD written = 0;
+    WriteFile(s_term.console, output, (DWORD)length, &written, NULL);
+}
+#else
+static bool terminal_enter_raw(void)
+{
+    if(!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) || tcgetattr(STDIN_FILENO, &s_term.saved) != 0)
+    {
+        return false;
+    }
+
+    // No echo, no line buffering, no signals from Ctrl-C, and reads return at once
+    struct termios raw = s_term.saved;
+    raw.c_lflag &= (tcflag_t)~(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_iflag &= (tcflag_t)~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    return tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == 0;
+}
+
+static void terminal_leave_raw(void)
+{
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &s_term.saved);
+}
+
+static size_t terminal_read(uint8_t* input, const size_t size)
+{
+    const ssize_t count = read(STDIN_FILENO, input, size);
+    return count > 0 ? (size_t)count : 0;
+}
+
+// One write per frame, repeated only if the terminal took part of it
+static void terminal_write(const char* output, const size_t length)
+{
+    size_t done = 0;
+
+    while(done < length)
+    {
+        const ssize_t written = write(STDOUT_FILENO, output + done, length - done);
+
+        if(written <= 0)
+        {
+            return;
+        }
+
+        done += (size_t)written;
+    }
+}
+#endif
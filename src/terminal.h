@@ -0,0 +1,31 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include "ansi.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frontend drawing in the terminal instead of a window, for servers reached over SSH.
+// It implements the renderer interface and is picked at startup by the monitor. The
+// ROM comes from CHIP8_ROM, keys from stdin in raw mode and the tone is the bell.
+
+typedef void (*InitFunc)(const char*);
+typedef void (*UpdateFunc)(void);
+typedef void (*ShutdownFunc)(void);
+
+// Picks half blocks or braille, before terminal_initialize
+void terminal_set_cells(AnsiCells cells);
+void terminal_initialize(const uint32_t* monitor);
+void terminal_do_update(void);
+void terminal_shutdown(void);
+void terminal_set_init_func(InitFunc init_func);
+void terminal_set_update_func(UpdateFunc update_func);
+void terminal_set_shutdown_func(ShutdownFunc shutdown_func);
+bool terminal_get_key(uint8_t* out_key);
+bool terminal_is_key_down(uint8_t key);
+void terminal_play_tone(void);
+void terminal_stop_tone(void);
+void terminal_set_audio(const uint8_t* pattern, uint8_t pitch);
+
+#endif
@@ -1,49 +1,271 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "codes.h"
 #include "chip8.h"
+#include "pool.h"
+#include "timing.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
-void chip8_load_program(uint16_t* program, size_t program_size);
-void chip8_initialize(const char* rom);
-void chip8_cycle(void);
+void chip8_load_program(Chip8* vm, const uint16_t* program, size_t program_size);
+
+#define TESTS_SEED 0x2545F491
+// Instructions a test may run before it fails as timed out, CHIP8_TEST_BUDGET overrides it
+#define TESTS_DEFAULT_BUDGET 100000
+#define TESTS_SLOWEST 5
 
-extern Chip8 g_chip8;
+typedef enum TestStatus
+{
+    TEST_PASSED,
+    TEST_FAILED,
+    TEST_TIMED_OUT,
+} TestStatus;
 
-#define BEGIN_TEST(name) { \
-    chip8_initialize(""); \
-    g_chip8.speed = 1; \
-    total_tests++; \
-    const char* test_name = name; \
-    uint16_t program[] = {
+typedef struct TestResult
+{
+    char name[64];
+    TestStatus status;
+    bool timed_out;
+    uint64_t instructions;
+    uint64_t start_ns;
+    uint64_t ns;
+} TestResult;
+
+typedef struct TestRun
+{
+    // NULL while counting the tests
+    TestResult* results;
+    uint32_t count;
+    uint64_t budget;
+    atomic_uint next;
+} TestRun;
+
+// Every worker walks the whole list of tests and runs the ones whose ticket it drew,
+// so tests stay written inline and a test is only built by the worker that runs it
+typedef struct TestWalk
+{
+    TestRun* run;
+    uint32_t index;
+    uint32_t ticket;
+} TestWalk;
+
+static void tests_walk(TestWalk* walk);
+static void tests_task(void* context, uint32_t index);
+static bool tests_claim(TestWalk* walk);
+static TestResult* tests_begin(TestWalk* walk, Chip8* vm, Chip8Profile profile);
+static void tests_execute(const TestWalk* walk, Chip8* vm, TestResult* result);
+static void tests_end(Chip8* vm, TestResult* result, bool passed);
+static void tests_alu_expect(Chip8Profile profile, uint8_t op, uint8_t a, uint8_t b, uint8_t* out_x, uint8_t* out_f);
+static uint64_t tests_env(const char* name, uint64_t fallback);
+static bool tests_write_json(const TestRun* run, const char* path);
+static bool tests_write_junit(const TestRun* run, const char* path, uint64_t ns);
+static void tests_write_escaped(FILE* file, const char* text, bool is_xml);
+static const char* tests_status_name(TestStatus status);
+
+// Each test runs on a machine of its own, result points at its entry in the run
+#define BEGIN_GENERATED_TEST(quirk_profile, ...) \
+    if(tests_claim(walk)) { \
+        Chip8 vm = {0}; \
+        TestResult* result = tests_begin(walk, &vm, quirk_profile); \
+        snprintf(result->name, sizeof(result->name), __VA_ARGS__); \
+        uint16_t program[] = {
+
+#define BEGIN_TEST(name) BEGIN_GENERATED_TEST(CHIP8_PROFILE_MODERN, "%s", name)
+#define BEGIN_PROFILE_TEST(name, quirk_profile) BEGIN_GENERATED_TEST(quirk_profile, "%s", name)
 
 #define RUN_TEST }; \
-    chip8_load_program(program, sizeof(program) / sizeof(uint16_t));\
-    while(!g_chip8.halted) \
-        chip8_cycle(); \
+    chip8_load_program(&vm, program, sizeof(program) / sizeof(uint16_t)); \
+    tests_execute(walk, &vm, result); \
     bool passed = true;
-    
-#define ASSERT_REG(reg, value) passed = passed && (g_chip8.v[reg] == (value));
-#define ASSERT_SP(value) passed = passed && (g_chip8.sp == (value));
-#define ASSERT_PC(value) passed = passed && (g_chip8.pc == (value));
-#define ASSERT_INDEX(value) passed = passed && (g_chip8.index == (value));
-#define ASSERT_STACK(level, value) passed = passed && (g_chip8.stack[level] == (value));
-#define ASSERT_DT(value) passed = passed && (g_chip8.delay_timer == (value));
-#define ASSERT_ST(value) passed = passed && (g_chip8.sound_timer == (value));
-#define ASSERT_MEM(index, value) passed = passed && (g_chip8.ram[index] == (value));
+
+#define ASSERT_REG(reg, value) passed = passed && (vm.v[reg] == (value));
+#define ASSERT_SP(value) passed = passed && (vm.sp == (value));
+#define ASSERT_PC(value) passed = passed && (vm.pc == (value));
+#define ASSERT_INDEX(value) passed = passed && (vm.index == (value));
+#define ASSERT_STACK(level, value) passed = passed && (vm.stack[level] == (value));
+#define ASSERT_DT(value) passed = passed && (vm.delay_timer == (value));
+#define ASSERT_ST(value) passed = passed && (vm.sound_timer == (value));
+#define ASSERT_PATTERN(byte, value) passed = passed && (vm.audio_pattern[byte] == (value));
+#define ASSERT_PITCH(value) passed = passed && (vm.pitch == (value));
+#define ASSERT_MEM(index, value) passed = passed && (chip8_read(&vm, index) == (value));
+#define ASSERT_DISPLAY(column, value) passed = passed && (vm.display[column] == (value));
+// The budget running out is what the test expects, so it is not a timeout failure
+#define ASSERT_TIMED_OUT passed = passed && result->timed_out; result->timed_out = false;
 
 #define END_TEST \
-    if(passed) { \
-        passed_tests++; \
-    } \
-    printf("Test %s\n%s\n", test_name, passed ? "PASSED" : "FAILED");}
+    tests_end(&vm, result, passed);}
+
+// Operands of the generated ALU tests, the edges of carry and borrow and some bit patterns
+static const uint8_t TestValues[16] = {
+    0x00, 0x01, 0x02, 0x0F, 0x10, 0x3C, 0x40, 0x55, 0x7F, 0x80, 0x81, 0xAA, 0xC3, 0xF0, 0xFE, 0xFF
+};
 
-void chip8_run_tests(void)
+// 8xyn opcodes, n and name
+static const struct TestAluOp
+{
+    uint8_t Op;
+    const char* Name;
+} TestAluOps[8] = {
+    {0x1, "OR"}, {0x2, "AND"}, {0x3, "XOR"}, {0x4, "ADD"},
+    {0x5, "SUB"}, {0x6, "SHR"}, {0x7, "SUBN"}, {0xE, "SHL"}
+};
+
+bool chip8_run_tests(void)
 {
-    int passed_tests = 0, total_tests = 0;
+    TestRun run = {.results = NULL, .count = 0, .budget = tests_env("CHIP8_TEST_BUDGET", TESTS_DEFAULT_BUDGET)};
+    atomic_init(&run.next, 0);
+
+    // Counting walk, it draws no tickets so runs nothing
+    TestWalk count = {.run = &run, .index = 0, .ticket = UINT32_MAX};
+    tests_walk(&count);
+    run.count = count.index;
+    run.results = calloc(run.count, sizeof(TestResult));
+
+    if(!run.results)
+    {
+        return false;
+    }
+
+    ThreadPool* pool = pool_create((uint32_t)tests_env("CHIP8_TEST_THREADS", 0));
+
+    if(!pool)
+    {
+        printf("Could not create the thread pool\n");
+        free(run.results);
+        return false;
+    }
+
+    const uint32_t workers = pool_worker_count(pool);
+    const uint64_t start = timing_now_ns();
+    pool_for(pool, workers, tests_task, &run);
+    const uint64_t ns = timing_now_ns() - start;
+    pool_destroy(pool);
+
+    // Failures in the order the tests are written, then the slowest tests
+    uint32_t passed_tests = 0;
+    uint32_t slowest[TESTS_SLOWEST] = {0};
+    uint32_t slowest_count = 0;
+
+    for(uint32_t i = 0; i < run.count; ++i)
+    {
+        const TestResult* result = &run.results[i];
+        passed_tests += result->status == TEST_PASSED;
+
+        if(result->status == TEST_TIMED_OUT)
+        {
+            printf("Test %s\nTIMED OUT after %llu instructions\n", result->name, (unsigned long long)result->instructions);
+        }
+        else if(result->status == TEST_FAILED)
+        {
+            printf("Test %s\nFAILED\n", result->name);
+        }
+
+        // Kept slowest first
+        uint32_t at = slowest_count;
+
+        while(at > 0 && run.results[slowest[at - 1]].ns < result->ns)
+        {
+            --at;
+        }
+
+        if(at < TESTS_SLOWEST)
+        {
+            const uint32_t kept = slowest_count < TESTS_SLOWEST ? slowest_count : TESTS_SLOWEST - 1;
+            memmove(&slowest[at + 1], &slowest[at], (kept - at) * sizeof(slowest[0]));
+            slowest[at] = i;
+            slowest_count = kept + 1;
+        }
+    }
+
+    for(uint32_t i = 0; i < slowest_count; ++i)
+    {
+        printf("Slow %.3f ms %s\n", (double)run.results[slowest[i]].ns / 1e6, run.results[slowest[i]].name);
+    }
+
+    // Setting CHIP8_TEST_JSON or CHIP8_TEST_JUNIT writes every result to that file
+    const char* json_path = getenv("CHIP8_TEST_JSON");
+    const char* junit_path = getenv("CHIP8_TEST_JUNIT");
+    bool is_written = true;
+
+    if(json_path && !tests_write_json(&run, json_path))
+    {
+        printf("Could not write %s\n", json_path);
+        is_written = false;
+    }
+
+    if(junit_path && !tests_write_junit(&run, junit_path, ns))
+    {
+        printf("Could not write %s\n", junit_path);
+        is_written = false;
+    }
+
+    printf("Ran %u tests in %.1f ms on %u threads\n", run.count, (double)ns / 1e6, workers);
+    printf("Tests passed %u/%u\n", passed_tests, run.count);
+    free(run.results);
+    return is_written && passed_tests == run.count;
+}
+
+static void tests_task(void* context, const uint32_t index)
+{
+    (void)index;
+    TestRun* run = context;
+    TestWalk walk = {.run = run, .index = 0, .ticket = atomic_fetch_add(&run->next, 1)};
+    tests_walk(&walk);
+}
+
+static bool tests_claim(TestWalk* walk)
+{
+    const uint32_t index = walk->index++;
+
+    if(index != walk->ticket)
+    {
+        return false;
+    }
+
+    walk->ticket = atomic_fetch_add(&walk->run->next, 1);
+    return true;
+}
+
+static TestResult* tests_begin(TestWalk* walk, Chip8* vm, const Chip8Profile profile)
+{
+    TestResult* result = &walk->run->results[walk->index - 1];
+    result->start_ns = timing_now_ns();
+    chip8_reset(vm, TESTS_SEED);
+    vm->speed = 1;
+    vm->profile = profile;
+    // Every key down and key 0 pressed, what the monitor in the test build reports
+    vm->keys = 0xFFFF;
+    vm->keys_pressed = 0x1;
+    return result;
+}
 
+static void tests_execute(const TestWalk* walk, Chip8* vm, TestResult* result)
+{
+    while(!vm->halted && result->instructions < walk->run->budget)
+    {
+        chip8_step(vm);
+        ++result->instructions;
+    }
+
+    result->timed_out = !vm->halted;
+}
+
+static void tests_end(Chip8* vm, TestResult* result, const bool passed)
+{
+    result->status = result->timed_out ? TEST_TIMED_OUT : passed ? TEST_PASSED : TEST_FAILED;
+    result->ns = timing_now_ns() - result->start_ns;
+    chip8_release(vm);
+}
+
+static void tests_walk(TestWalk* walk)
+{
     BEGIN_TEST("Jump to address")
         JP(0x300)
         RUN_TEST
@@ -289,6 +511,28 @@ void chip8_run_tests(void)
         ASSERT_ST(58)
     END_TEST
 
+    BEGIN_TEST("Load audio pattern")
+        LDB(D7)
+        AUDIO()
+        RUN_TEST
+        // digits 7, 8 and 9, then the first row of A
+        ASSERT_PATTERN(0x0, 0xF0)
+        ASSERT_PATTERN(0x1, 0x10)
+        ASSERT_PATTERN(0x5, 0xF0)
+        ASSERT_PATTERN(0x6, 0x90)
+        ASSERT_PATTERN(0xD, 0x10)
+        ASSERT_PATTERN(0xE, 0xF0)
+        ASSERT_PATTERN(0xF, 0xF0)
+        ASSERT_INDEX(D7)
+    END_TEST
+
+    BEGIN_TEST("Load pitch")
+        LD1(0x3, 0x70)
+        PITCH(0x3)
+        RUN_TEST
+        ASSERT_PITCH(0x70)
+    END_TEST
+
     BEGIN_TEST("Load vector (write)")
         LD1(0x0, 0xF0)
         LD1(0x1, 0x10)
@@ -463,5 +707,258 @@ void chip8_run_tests(void)
         ASSERT_REG(0xF, 0x00)
     END_TEST
 
-    printf("Tests passed %d/%d\n", passed_tests, total_tests);
+    BEGIN_PROFILE_TEST("Shift right from Vy (COSMAC VIP)", CHIP8_PROFILE_COSMAC_VIP)
+        LD1(0xD, 0x0F)
+        SHR2(0xC, 0xD)
+        RUN_TEST
+        ASSERT_REG(0xC, 0x07)
+        ASSERT_REG(0xD, 0x0F)
+        ASSERT_REG(0xF, 0x01)
+    END_TEST
+
+    BEGIN_PROFILE_TEST("Shift left in place (SCHIP)", CHIP8_PROFILE_SCHIP)
+        LD1(0xC, 0x81)
+        LD1(0xD, 0x01)
+        SHL2(0xC, 0xD)
+        RUN_TEST
+        ASSERT_REG(0xC, 0x02)
+        ASSERT_REG(0xF, 0x01)
+    END_TEST
+
+    BEGIN_PROFILE_TEST("Or resets VF (COSMAC VIP)", CHIP8_PROFILE_COSMAC_VIP)
+        LD1(0xF, 0x01)
+        OR(0xC, 0xD)
+        RUN_TEST
+        ASSERT_REG(0xF, 0x00)
+    END_TEST
+
+    BEGIN_PROFILE_TEST("Load vector moves index (COSMAC VIP)", CHIP8_PROFILE_COSMAC_VIP)
+        LDB(0x800)
+        LD9(0x2)
+        RUN_TEST
+        ASSERT_INDEX(0x803)
+    END_TEST
+
+    BEGIN_PROFILE_TEST("Load vector moves index (CHIP-48)", CHIP8_PROFILE_CHIP48)
+        LDB(0x800)
+        LDA(0x2)
+        RUN_TEST
+        ASSERT_INDEX(0x802)
+    END_TEST
+
+    BEGIN_PROFILE_TEST("Jump w/offset from Vx (CHIP-48)", CHIP8_PROFILE_CHIP48)
+        LD1(0x3, 2)
+        JP1(0x300)
+        RUN_TEST
+        ASSERT_PC(0x304)
+    END_TEST
+
+    BEGIN_TEST("Draw wraps at right edge")
+        LD1(0x0, 62)
+        LDB(D0)
+        DRW(0x0, 0x1, 1)
+        RUN_TEST
+        ASSERT_DISPLAY(62, 0x1)
+        ASSERT_DISPLAY(0, 0x1)
+    END_TEST
+
+    BEGIN_PROFILE_TEST("Draw clips at right edge (COSMAC VIP)", CHIP8_PROFILE_COSMAC_VIP)
+        LD1(0x0, 62)
+        LDB(D0)
+        DRW(0x0, 0x1, 1)
+        RUN_TEST
+        ASSERT_DISPLAY(62, 0x1)
+        ASSERT_DISPLAY(0, 0x0)
+    END_TEST
+
+    BEGIN_TEST("Store copies a shared page on write")
+        LD1(0x0, 0x42)
+        LDB(0x900)
+        LD9(0x0)
+        RUN_TEST
+        ASSERT_MEM(0x900, 0x42)
+        Chip8 copy = {0};
+        chip8_copy(&copy, &vm);
+        chip8_write(&copy, 0x900, 0x24);
+        passed = passed && copy.pages[2] == vm.pages[2] && copy.pages[9] != vm.pages[9];
+        passed = passed && chip8_read(&copy, 0x900) == 0x24;
+        ASSERT_MEM(0x900, 0x42)
+        chip8_release(&copy);
+    END_TEST
+
+    BEGIN_TEST("Budget stops a machine that never halts")
+        JP(PROGRAM_START)
+        RUN_TEST
+        ASSERT_TIMED_OUT
+        ASSERT_PC(PROGRAM_START)
+    END_TEST
+
+    // Every 8xyn opcode in every profile on each pair of operands, checked against
+    // tests_alu_expect. VF starts at 0x5A to show which opcodes leave it alone.
+    for(uint32_t p = 0; p < CHIP8_PROFILE_COUNT; ++p)
+    {
+        for(uint32_t o = 0; o < sizeof(TestAluOps) / sizeof(TestAluOps[0]); ++o)
+        {
+            for(uint32_t i = 0; i < 16 * 16; ++i)
+            {
+                const uint8_t a = TestValues[i / 16];
+                const uint8_t b = TestValues[i % 16];
+
+                BEGIN_GENERATED_TEST((Chip8Profile)p, "%s %.2X %.2X (%s)", TestAluOps[o].Name, a, b, chip8_profile_name((Chip8Profile)p))
+                    LD1(0xF, 0x5A)
+                    LD1(0xC, a)
+                    LD1(0xD, b)
+                    (uint16_t)(0x8000 | REGX(0xC) | REGY(0xD) | TestAluOps[o].Op),
+                    RUN_TEST
+                    uint8_t x = 0;
+                    uint8_t f = 0;
+                    tests_alu_expect((Chip8Profile)p, TestAluOps[o].Op, a, b, &x, &f);
+                    ASSERT_REG(0xC, x)
+                    ASSERT_REG(0xD, b)
+                    ASSERT_REG(0xF, f)
+                END_TEST
+            }
+        }
+    }
+}
+
+// What 8xyn leaves in Vx and VF for Vx = a, Vy = b and VF = 0x5A, written from the
+// quirk table rather than the interpreter
+static void tests_alu_expect(const Chip8Profile profile, const uint8_t op, const uint8_t a, const uint8_t b, uint8_t* out_x, uint8_t* out_f)
+{
+    const Chip8Quirks* quirks = &Chip8ProfileQuirks[profile];
+    const uint8_t shifted = quirks->shift_vy ? b : a;
+    const uint8_t logic_f = quirks->vf_reset ? 0 : 0x5A;
+
+    switch(op)
+    {
+        case 0x1: *out_x = a | b; *out_f = logic_f; break;
+        case 0x2: *out_x = a & b; *out_f = logic_f; break;
+        case 0x3: *out_x = a ^ b; *out_f = logic_f; break;
+        case 0x4: *out_x = (uint8_t)(a + b); *out_f = a + b > 0xFF; break;
+        // The interpreter clears VF when the operands are equal
+        case 0x5: *out_x = (uint8_t)(a - b); *out_f = a > b; break;
+        case 0x6: *out_x = shifted >> 1; *out_f = shifted & 0x1; break;
+        case 0x7: *out_x = (uint8_t)(b - a); *out_f = b > a; break;
+        case 0xE: *out_x = (uint8_t)(shifted << 1); *out_f = shifted >> 7; break;
+        default: *out_x = a; *out_f = 0x5A; break;
+    }
+}
+
+static uint64_t tests_env(const char* name, const uint64_t fallback)
+{
+    const char* value = getenv(name);
+    return value ? strtoull(value, NULL, 10) : fallback;
+}
+
+static bool tests_write_json(const TestRun* run, const char* path)
+{
+    FILE* file = fopen(path, "w");
+
+    if(!file)
+    {
+        return false;
+    }
+
+    fprintf(file, "{\n  \"budget\": %llu,\n  \"tests\": [\n", (unsigned long long)run->budget);
+
+    for(uint32_t i = 0; i < run->count; ++i)
+    {
+        const TestResult* result = &run->results[i];
+        fprintf(file, "    {\"name\": \"");
+        tests_write_escaped(file, result->name, false);
+        fprintf(file, "\", \"status\": \"%s\", \"instructions\": %llu, \"ms\": %.6f}%s\n", tests_status_name(result->status),
+            (unsigned long long)result->instructions, (double)result->ns / 1e6, i + 1 < run->count ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+static bool tests_write_junit(const TestRun* run, const char* path, const uint64_t ns)
+{
+    FILE* file = fopen(path, "w");
+
+    if(!file)
+    {
+        return false;
+    }
+
+    uint32_t failures = 0;
+
+    for(uint32_t i = 0; i < run->count; ++i)
+    {
+        failures += run->results[i].status != TEST_PASSED;
+    }
+
+    fprintf(file, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(file, "<testsuite name=\"chip8\" tests=\"%u\" failures=\"%u\" errors=\"0\" time=\"%.6f\">\n", run->count, failures, (double)ns / 1e9);
+
+    for(uint32_t i = 0; i < run->count; ++i)
+    {
+        const TestResult* result = &run->results[i];
+        fprintf(file, "  <testcase classname=\"chip8\" name=\"");
+        tests_write_escaped(file, result->name, true);
+        fprintf(file, "\" time=\"%.6f\"", (double)result->ns / 1e9);
+
+        if(result->status == TEST_PASSED)
+        {
+            fprintf(file, "/>\n");
+        }
+        else if(result->status == TEST_TIMED_OUT)
+        {
+            fprintf(file, ">\n    <failure message=\"timed out after %llu instructions\"/>\n  </testcase>\n", (unsigned long long)result->instructions);
+        }
+        else
+        {
+            fprintf(file, ">\n    <failure message=\"assertion failed\"/>\n  </testcase>\n");
+        }
+    }
+
+    fprintf(file, "</testsuite>\n");
+    return fclose(file) == 0;
+}
+
+static void tests_write_escaped(FILE* file, const char* text, const bool is_xml)
+{
+    for(; *text; ++text)
+    {
+        if(is_xml && *text == '&')
+        {
+            fputs("&amp;", file);
+        }
+        else if(is_xml && *text == '<')
+        {
+            fputs("&lt;", file);
+        }
+        else if(is_xml && *text == '>')
+        {
+            fputs("&gt;", file);
+        }
+        else if(is_xml && *text == '"')
+        {
+            fputs("&quot;", file);
+        }
+        else if(!is_xml && (*text == '"' || *text == '\\'))
+        {
+            fputc('\\', file);
+            fputc(*text, file);
+        }
+        else
+        {
+            fputc(*text, file);
+        }
+    }
+}
+
+static const char* tests_status_name(const TestStatus status)
+{
+    switch(status)
+    {
+        case TEST_PASSED: return "passed";
+        case TEST_FAILED: return "failed";
+        case TEST_TIMED_OUT: return "timed_out";
+    }
+
+    return "unknown";
 }
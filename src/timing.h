@@ -0,0 +1,9 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+// Monotonic clock in nanoseconds, only meaningful as a difference
+uint64_t timing_now_ns(void);
+
+#endif
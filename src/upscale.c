@@ -0,0 +1,492 @@
+#include "upscale.h"
+#include "chip8.h"
+#include "simd.h"
+#include "timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The pixel masks are 0x00 or 0xFF, so comparing two of them is an XOR and every rule is
+// bitwise. Intensities in between only come out of the blends.
+#if SIMD_VEC_BYTES == 32
+#define vec_andnot(a, b) _mm256_andnot_si256((a), (b))
+#define vec_avg(a, b) _mm256_avg_epu8((a), (b))
+#define vec_max(a, b) _mm256_max_epu8((a), (b))
+#elif SIMD_VEC_BYTES == 16
+#define vec_andnot(a, b) _mm_andnot_si128((a), (b))
+#define vec_avg(a, b) _mm_avg_epu8((a), (b))
+#define vec_max(a, b) _mm_max_epu8((a), (b))
+#else
+#define vec_andnot(a, b) ((uint8_t)(~(a) & (b)))
+#define vec_avg(a, b) ((uint8_t)(((a) + (b) + 1) >> 1))
+#define vec_max(a, b) ((uint8_t)((a) > (b) ? (a) : (b)))
+#endif
+
+#define UPSCALE_COLUMNS CHIP8_DISPLAY_COLUMNS
+#define UPSCALE_ROWS CHIP8_DISPLAY_ROWS
+#define UPSCALE_MAX_FACTOR 3
+// The mask has a border row above and below and padding either side, so the neighbours
+// of every pixel load in bounds. Border pixels repeat the edge, as Scale2x expects.
+#define UPSCALE_PAD 32
+#define UPSCALE_STRIDE (UPSCALE_COLUMNS + 2 * UPSCALE_PAD)
+#define UPSCALE_MAX_PIXELS (UPSCALE_COLUMNS * UPSCALE_ROWS * UPSCALE_MAX_FACTOR * UPSCALE_MAX_FACTOR)
+// Intensity of a scanline row under a lit pixel
+#define UPSCALE_SCANLINE_DIM 0x66
+// Intensity a phosphor loses per frame once its pixel is off, gone after 11 frames
+#define UPSCALE_PHOSPHOR_FADE 24
+
+struct Upscaler
+{
+    UpscaleConfig config;
+    uint32_t factor;
+    uint32_t width;
+    uint32_t height;
+    uint32_t shown[UPSCALE_COLUMNS];
+    bool is_shown_valid;
+    // Phosphors still fading, so the same display upscales differently next frame
+    bool is_settling;
+    uint64_t cost_ns;
+    uint8_t mask[(UPSCALE_ROWS + 2) * UPSCALE_STRIDE];
+    uint8_t intensity[UPSCALE_MAX_PIXELS];
+    uint8_t pixels[UPSCALE_MAX_PIXELS * 4];
+};
+
+// A pixel and its neighbours, B above, D left, F right and H below E
+typedef struct UpscaleNeighbors
+{
+    SimdVec a, b, c, d, e, f, g, h, i;
+} UpscaleNeighbors;
+
+static const char* const UpscaleFilterNames[UPSCALE_FILTER_COUNT] = {
+    "none",
+    "scale2x",
+    "scale3x",
+    "xbr-lite",
+    "scanline",
+    "phosphor",
+};
+
+static const uint32_t UpscaleFactors[UPSCALE_FILTER_COUNT] = {1, 2, 3, 2, 3, 1};
+
+static void upscale_build_mask(Upscaler* upscaler, const uint32_t* display);
+static void upscale_rules(UpscaleFilter filter, const UpscaleNeighbors* n, SimdVec* blocks);
+static void upscale_vector(Upscaler* upscaler);
+static void upscale_reference(Upscaler* upscaler);
+static void upscale_reference_block(UpscaleFilter filter, const uint8_t* row, uint8_t* block);
+static bool upscale_is_settling(const Upscaler* upscaler);
+static void upscale_expand(const Upscaler* upscaler, uint8_t* pixels);
+static void upscale_expand_scalar(const uint8_t* intensity, uint32_t count, const uint8_t* on, const uint8_t* off, uint8_t* pixels);
+
+Upscaler* upscale_create(const UpscaleConfig* config)
+{
+    if(config->filter >= UPSCALE_FILTER_COUNT)
+    {
+        return NULL;
+    }
+
+    Upscaler* upscaler = calloc(1, sizeof(Upscaler));
+
+    if(!upscaler)
+    {
+        return NULL;
+    }
+
+    upscaler->config = *config;
+    upscale_set_filter(upscaler, config->filter);
+    return upscaler;
+}
+
+void upscale_destroy(Upscaler* upscaler)
+{
+    free(upscaler);
+}
+
+void upscale_set_filter(Upscaler* upscaler, const UpscaleFilter filter)
+{
+    upscaler->config.filter = filter < UPSCALE_FILTER_COUNT ? filter : UPSCALE_NONE;
+    upscaler->factor = UpscaleFactors[upscaler->config.filter];
+    upscaler->width = UPSCALE_COLUMNS * upscaler->factor;
+    upscaler->height = UPSCALE_ROWS * upscaler->factor;
+    upscaler->is_shown_valid = false;
+    upscaler->is_settling = false;
+    memset(upscaler->intensity, 0, sizeof(upscaler->intensity));
+}
+
+UpscaleFilter upscale_filter(const Upscaler* upscaler)
+{
+    return upscaler->config.filter;
+}
+
+const char* upscale_filter_name(const UpscaleFilter filter)
+{
+    return filter < UPSCALE_FILTER_COUNT ? UpscaleFilterNames[filter] : "unknown";
+}
+
+bool upscale_parse_filter(const char* name, UpscaleFilter* filter)
+{
+    for(uint32_t i = 0; i < UPSCALE_FILTER_COUNT; ++i)
+    {
+        if(strcmp(name, UpscaleFilterNames[i]) == 0)
+        {
+            *filter = (UpscaleFilter)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32_t upscale_factor(const UpscaleFilter filter)
+{
+    return filter < UPSCALE_FILTER_COUNT ? UpscaleFactors[filter] : 1;
+}
+
+uint32_t upscale_width(const Upscaler* upscaler)
+{
+    return upscaler->width;
+}
+
+uint32_t upscale_height(const Upscaler* upscaler)
+{
+    return upscaler->height;
+}
+
+bool upscale_run(Upscaler* upscaler, const uint32_t* display)
+{
+    if(upscaler->is_shown_valid && !upscaler->is_settling && memcmp(upscaler->shown, display, sizeof(upscaler->shown)) == 0)
+    {
+        return false;
+    }
+
+    const uint64_t start_ns = timing_now_ns();
+    memcpy(upscaler->shown, display, sizeof(upscaler->shown));
+    upscaler->is_shown_valid = true;
+    upscale_build_mask(upscaler, display);
+
+    if(upscaler->config.is_scalar)
+    {
+        upscale_reference(upscaler);
+        upscale_expand_scalar(upscaler->intensity, upscaler->width * upscaler->height, upscaler->config.on, upscaler->config.off, upscaler->pixels);
+    }
+    else
+    {
+        upscale_vector(upscaler);
+        upscale_expand(upscaler, upscaler->pixels);
+    }
+
+    upscaler->is_settling = upscaler->config.filter == UPSCALE_PHOSPHOR && upscale_is_settling(upscaler);
+    upscaler->cost_ns = timing_now_ns() - start_ns;
+    return true;
+}
+
+const uint8_t* upscale_pixels(const Upscaler* upscaler)
+{
+    return upscaler->pixels;
+}
+
+uint64_t upscale_cost_ns(const Upscaler* upscaler)
+{
+    return upscaler->cost_ns;
+}
+
+static void upscale_build_mask(Upscaler* upscaler, const uint32_t* display)
+{
+    for(uint32_t y = 0; y < UPSCALE_ROWS; ++y)
+    {
+        uint8_t* row = &upscaler->mask[(y + 1) * UPSCALE_STRIDE + UPSCALE_PAD];
+
+        for(uint32_t x = 0; x < UPSCALE_COLUMNS; ++x)
+        {
+            row[x] = (uint8_t)(0u - ((display[x] >> y) & 1u));
+        }
+
+        row[-1] = row[0];
+        row[UPSCALE_COLUMNS] = row[UPSCALE_COLUMNS - 1];
+    }
+
+    memcpy(upscaler->mask, &upscaler->mask[UPSCALE_STRIDE], UPSCALE_STRIDE);
+    memcpy(&upscaler->mask[(UPSCALE_ROWS + 1) * UPSCALE_STRIDE], &upscaler->mask[UPSCALE_ROWS * UPSCALE_STRIDE], UPSCALE_STRIDE);
+}
+
+// Fills factor * factor blocks of output row major, as the Scale2x and Scale3x rules
+// are written. c0, c2, c6 and c8 are the corners whose two neighbours agree against the
+// other two.
+static void upscale_rules(const UpscaleFilter filter, const UpscaleNeighbors* n, SimdVec* blocks)
+{
+    const SimdVec c0 = vec_andnot(vec_xor(n->d, n->b), vec_and(vec_xor(n->b, n->f), vec_xor(n->d, n->h)));
+    const SimdVec c2 = vec_andnot(vec_xor(n->b, n->f), vec_and(vec_xor(n->b, n->d), vec_xor(n->f, n->h)));
+    const SimdVec c6 = vec_andnot(vec_xor(n->d, n->h), vec_and(vec_xor(n->d, n->b), vec_xor(n->h, n->f)));
+    const SimdVec c8 = vec_andnot(vec_xor(n->h, n->f), vec_and(vec_xor(n->d, n->h), vec_xor(n->b, n->f)));
+
+    switch(filter)
+    {
+        case UPSCALE_SCALE2X:
+            blocks[0] = vec_select(c0, n->d, n->e);
+            blocks[1] = vec_select(c2, n->f, n->e);
+            blocks[2] = vec_select(c6, n->d, n->e);
+            blocks[3] = vec_select(c8, n->f, n->e);
+            break;
+        case UPSCALE_SCALE3X:
+            blocks[0] = vec_select(c0, n->d, n->e);
+            blocks[1] = vec_select(vec_or(vec_and(c0, vec_xor(n->e, n->c)), vec_and(c2, vec_xor(n->e, n->a))), n->b, n->e);
+            blocks[2] = vec_select(c2, n->f, n->e);
+            blocks[3] = vec_select(vec_or(vec_and(c0, vec_xor(n->e, n->g)), vec_and(c6, vec_xor(n->e, n->a))), n->d, n->e);
+            blocks[4] = n->e;
+            blocks[5] = vec_select(vec_or(vec_and(c2, vec_xor(n->e, n->i)), vec_and(c8, vec_xor(n->e, n->c))), n->f, n->e);
+            blocks[6] = vec_select(c6, n->d, n->e);
+            blocks[7] = vec_select(vec_or(vec_and(c6, vec_xor(n->e, n->i)), vec_and(c8, vec_xor(n->e, n->g))), n->h, n->e);
+            blocks[8] = vec_select(c8, n->f, n->e);
+            break;
+        case UPSCALE_XBR_LITE:
+            // A corner whose diagonal neighbour matches the pixel is a step of a thin
+            // diagonal line and is blended half way, any other corner is cut as in Scale2x
+            blocks[0] = vec_select(vec_and(c0, vec_xor(n->e, n->a)), n->d, vec_select(c0, vec_avg(n->e, n->d), n->e));
+            blocks[1] = vec_select(vec_and(c2, vec_xor(n->e, n->c)), n->f, vec_select(c2, vec_avg(n->e, n->f), n->e));
+            blocks[2] = vec_select(vec_and(c6, vec_xor(n->e, n->g)), n->d, vec_select(c6, vec_avg(n->e, n->d), n->e));
+            blocks[3] = vec_select(vec_and(c8, vec_xor(n->e, n->i)), n->f, vec_select(c8, vec_avg(n->e, n->f), n->e));
+            break;
+        case UPSCALE_SCANLINE:
+            blocks[0] = blocks[1] = blocks[2] = n->e;
+            blocks[3] = blocks[4] = blocks[5] = n->e;
+            blocks[6] = blocks[7] = blocks[8] = vec_and(n->e, vec_set1(UPSCALE_SCANLINE_DIM));
+            break;
+        default:
+            blocks[0] = n->e;
+            break;
+    }
+}
+
+static void upscale_vector(Upscaler* upscaler)
+{
+    const uint32_t factor = upscaler->factor;
+    const uint32_t width = upscaler->width;
+    uint8_t blocks[UPSCALE_MAX_FACTOR * UPSCALE_MAX_FACTOR][SIMD_VEC_BYTES];
+
+    for(uint32_t y = 0; y < UPSCALE_ROWS; ++y)
+    {
+        const uint8_t* up = &upscaler->mask[y * UPSCALE_STRIDE + UPSCALE_PAD];
+        const uint8_t* mid = up + UPSCALE_STRIDE;
+        const uint8_t* down = mid + UPSCALE_STRIDE;
+
+        for(uint32_t x = 0; x < UPSCALE_COLUMNS; x += SIMD_VEC_BYTES)
+        {
+            if(upscaler->config.filter == UPSCALE_PHOSPHOR)
+            {
+                // Lit pixels show at once, the rest lose a step of their glow
+                uint8_t* glow = &upscaler->intensity[y * width + x];
+                vec_store(glow, vec_max(vec_load(&mid[x]), vec_subs(vec_load(glow), vec_set1(UPSCALE_PHOSPHOR_FADE))));
+                continue;
+            }
+
+            const UpscaleNeighbors n = {
+                vec_load(up + x - 1), vec_load(up + x), vec_load(up + x + 1),
+                vec_load(mid + x - 1), vec_load(mid + x), vec_load(mid + x + 1),
+                vec_load(down + x - 1), vec_load(down + x), vec_load(down + x + 1)
+            };
+            SimdVec planes[UPSCALE_MAX_FACTOR * UPSCALE_MAX_FACTOR];
+            upscale_rules(upscaler->config.filter, &n, planes);
+
+            for(uint32_t p = 0; p < factor * factor; ++p)
+            {
+                vec_store(blocks[p], planes[p]);
+            }
+
+            // The rules leave a plane per position in the block, spread them out
+            for(uint32_t sy = 0; sy < factor; ++sy)
+            {
+                uint8_t* out = &upscaler->intensity[(y * factor + sy) * width + x * factor];
+
+                for(uint32_t k = 0; k < SIMD_VEC_BYTES; ++k)
+                {
+                    for(uint32_t sx = 0; sx < factor; ++sx)
+                    {
+                        out[k * factor + sx] = blocks[sy * factor + sx][k];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The rules pixel by pixel as their authors write them, to check the kernels against
+static void upscale_reference(Upscaler* upscaler)
+{
+    const uint32_t factor = upscaler->factor;
+    const uint32_t width = upscaler->width;
+
+    for(uint32_t y = 0; y < UPSCALE_ROWS; ++y)
+    {
+        for(uint32_t x = 0; x < UPSCALE_COLUMNS; ++x)
+        {
+            const uint8_t* mid = &upscaler->mask[(y + 1) * UPSCALE_STRIDE + UPSCALE_PAD + x];
+            uint8_t block[UPSCALE_MAX_FACTOR * UPSCALE_MAX_FACTOR];
+
+            if(upscaler->config.filter == UPSCALE_PHOSPHOR)
+            {
+                uint8_t* glow = &upscaler->intensity[y * width + x];
+                const uint8_t faded = *glow > UPSCALE_PHOSPHOR_FADE ? (uint8_t)(*glow - UPSCALE_PHOSPHOR_FADE) : 0;
+                *glow = *mid > faded ? *mid : faded;
+                continue;
+            }
+
+            upscale_reference_block(upscaler->config.filter, mid, block);
+
+            for(uint32_t sy = 0; sy < factor; ++sy)
+            {
+                for(uint32_t sx = 0; sx < factor; ++sx)
+                {
+                    upscaler->intensity[(y * factor + sy) * width + x * factor + sx] = block[sy * factor + sx];
+                }
+            }
+        }
+    }
+}
+
+static void upscale_reference_block(const UpscaleFilter filter, const uint8_t* row, uint8_t* block)
+{
+    const uint8_t a = row[-UPSCALE_STRIDE - 1], b = row[-UPSCALE_STRIDE], c = row[-UPSCALE_STRIDE + 1];
+    const uint8_t d = row[-1], e = row[0], f = row[1];
+    const uint8_t g = row[UPSCALE_STRIDE - 1], h = row[UPSCALE_STRIDE], i = row[UPSCALE_STRIDE + 1];
+    const bool c0 = d == b && b != f && d != h;
+    const bool c2 = b == f && b != d && f != h;
+    const bool c6 = d == h && d != b && h != f;
+    const bool c8 = h == f && d != h && b != f;
+
+    switch(filter)
+    {
+        case UPSCALE_SCALE2X:
+            block[0] = c0 ? d : e;
+            block[1] = c2 ? f : e;
+            block[2] = c6 ? d : e;
+            block[3] = c8 ? f : e;
+            break;
+        case UPSCALE_SCALE3X:
+            block[0] = c0 ? d : e;
+            block[1] = (c0 && e != c) || (c2 && e != a) ? b : e;
+            block[2] = c2 ? f : e;
+            block[3] = (c0 && e != g) || (c6 && e != a) ? d : e;
+            block[4] = e;
+            block[5] = (c2 && e != i) || (c8 && e != c) ? f : e;
+            block[6] = c6 ? d : e;
+            block[7] = (c6 && e != i) || (c8 && e != g) ? h : e;
+            block[8] = c8 ? f : e;
+            break;
+        case UPSCALE_XBR_LITE:
+            block[0] = c0 ? (e == a ? (uint8_t)((e + d + 1) / 2) : d) : e;
+            block[1] = c2 ? (e == c ? (uint8_t)((e + f + 1) / 2) : f) : e;
+            block[2] = c6 ? (e == g ? (uint8_t)((e + d + 1) / 2) : d) : e;
+            block[3] = c8 ? (e == i ? (uint8_t)((e + f + 1) / 2) : f) : e;
+            break;
+        case UPSCALE_SCANLINE:
+            for(uint32_t k = 0; k < 9; ++k)
+            {
+                block[k] = k < 6 ? e : (uint8_t)(e & UPSCALE_SCANLINE_DIM);
+            }
+            break;
+        default:
+            block[0] = e;
+            break;
+    }
+}
+
+static bool upscale_is_settling(const Upscaler* upscaler)
+{
+    for(uint32_t y = 0; y < UPSCALE_ROWS; ++y)
+    {
+        if(memcmp(&upscaler->intensity[y * UPSCALE_COLUMNS], &upscaler->mask[(y + 1) * UPSCALE_STRIDE + UPSCALE_PAD], UPSCALE_COLUMNS) != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Each channel is off + (on - off) * intensity / 255, rounded, in 16 bit lanes. Every
+// intensity byte is repeated into the four channels of its pixel by unpacking it with
+// itself twice, so 16 pixels (32 with AVX2) expand per loop.
+static void upscale_expand(const Upscaler* upscaler, uint8_t* pixels)
+{
+    const uint8_t* on = upscaler->config.on;
+    const uint8_t* off = upscaler->config.off;
+    const uint32_t count = upscaler->width * upscaler->height;
+    uint32_t j = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i half = _mm256_set1_epi16(128);
+    const __m256i on16 = _mm256_setr_epi16(on[0], on[1], on[2], on[3], on[0], on[1], on[2], on[3], on[0], on[1], on[2], on[3], on[0], on[1], on[2], on[3]);
+    const __m256i off16 = _mm256_setr_epi16(off[0], off[1], off[2], off[3], off[0], off[1], off[2], off[3], off[0], off[1], off[2], off[3], off[0], off[1], off[2], off[3]);
+
+    for(; j + 32 <= count; j += 32)
+    {
+        // Unpacks stay within 128 bit lanes, so the low lane holds pixels 0-15 and the
+        // high lane pixels 16-31; the permutes put them back in order
+        const __m256i in = _mm256_loadu_si256((const __m256i*)(const void*)&upscaler->intensity[j]);
+        const __m256i x = _mm256_unpacklo_epi8(in, in);
+        const __m256i y = _mm256_unpackhi_epi8(in, in);
+        const __m256i repeated[4] = {_mm256_unpacklo_epi16(x, x), _mm256_unpackhi_epi16(x, x), _mm256_unpacklo_epi16(y, y), _mm256_unpackhi_epi16(y, y)};
+        __m256i blended[4];
+
+        for(uint32_t r = 0; r < 4; ++r)
+        {
+            __m256i halves[2] = {_mm256_unpacklo_epi8(repeated[r], zero), _mm256_unpackhi_epi8(repeated[r], zero)};
+
+            for(uint32_t k = 0; k < 2; ++k)
+            {
+                const __m256i t = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(halves[k], on16), _mm256_mullo_epi16(_mm256_sub_epi16(full, halves[k]), off16)), half);
+                halves[k] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+            }
+
+            blended[r] = _mm256_packus_epi16(halves[0], halves[1]);
+        }
+
+        _mm256_storeu_si256((__m256i*)(void*)&pixels[j * 4], _mm256_permute2x128_si256(blended[0], blended[1], 0x20));
+        _mm256_storeu_si256((__m256i*)(void*)&pixels[j * 4 + 32], _mm256_permute2x128_si256(blended[2], blended[3], 0x20));
+        _mm256_storeu_si256((__m256i*)(void*)&pixels[j * 4 + 64], _mm256_permute2x128_si256(blended[0], blended[1], 0x31));
+        _mm256_storeu_si256((__m256i*)(void*)&pixels[j * 4 + 96], _mm256_permute2x128_si256(blended[2], blended[3], 0x31));
+    }
+#elif SIMD_VEC_BYTES == 16
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i on16 = _mm_setr_epi16(on[0], on[1], on[2], on[3], on[0], on[1], on[2], on[3]);
+    const __m128i off16 = _mm_setr_epi16(off[0], off[1], off[2], off[3], off[0], off[1], off[2], off[3]);
+
+    for(; j + 16 <= count; j += 16)
+    {
+        const __m128i in = _mm_loadu_si128((const __m128i*)(const void*)&upscaler->intensity[j]);
+        const __m128i x = _mm_unpacklo_epi8(in, in);
+        const __m128i y = _mm_unpackhi_epi8(in, in);
+        const __m128i repeated[4] = {_mm_unpacklo_epi16(x, x), _mm_unpackhi_epi16(x, x), _mm_unpacklo_epi16(y, y), _mm_unpackhi_epi16(y, y)};
+
+        for(uint32_t r = 0; r < 4; ++r)
+        {
+            __m128i halves[2] = {_mm_unpacklo_epi8(repeated[r], zero), _mm_unpackhi_epi8(repeated[r], zero)};
+
+            for(uint32_t k = 0; k < 2; ++k)
+            {
+                const __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(halves[k], on16), _mm_mullo_epi16(_mm_sub_epi16(full, halves[k]), off16)), half);
+                halves[k] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            }
+
+            _mm_storeu_si128((__m128i*)(void*)&pixels[(j + r * 4) * 4], _mm_packus_epi16(halves[0], halves[1]));
+        }
+    }
+#endif
+
+    upscale_expand_scalar(&upscaler->intensity[j], count - j, on, off, &pixels[j * 4]);
+}
+
+static void upscale_expand_scalar(const uint8_t* intensity, const uint32_t count, const uint8_t* on, const uint8_t* off, uint8_t* pixels)
+{
+    for(uint32_t j = 0; j < count; ++j)
+    {
+        for(uint32_t k = 0; k < 4; ++k)
+        {
+            const uint32_t t = intensity[j] * on[k] + (255u - intensity[j]) * off[k] + 128u;
+            pixels[j * 4 + k] = (uint8_t)((t + (t >> 8)) >> 8);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef UPSCALE_H
+#define UPSCALE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Software upscaling of the display into RGBA pixels for a texture, for machines whose
+// GPU only presents a framebuffer. The display is turned into a byte per pixel mask,
+// the filter's rules run on it 16 or 32 pixels at a time (SSE2, or AVX2 when the
+// compiler targets it) into an intensity per output pixel, and intensities are blended
+// between the off and on colors the same number of pixels per instruction. Nothing
+// runs while the display matches the one last upscaled.
+
+typedef enum UpscaleFilter
+{
+    // One texel per pixel, drawn as the solid squares it always was
+    UPSCALE_NONE,
+    UPSCALE_SCALE2X,
+    UPSCALE_SCALE3X,
+    // Scale2x whose thin diagonals are blended half way instead of stepped
+    UPSCALE_XBR_LITE,
+    // 3x with every third row dimmed
+    UPSCALE_SCANLINE,
+    // Pixels turned off fade out over a few frames, the way a CRT's phosphor does
+    UPSCALE_PHOSPHOR,
+    UPSCALE_FILTER_COUNT
+} UpscaleFilter;
+
+typedef struct UpscaleConfig
+{
+    UpscaleFilter filter;
+    // RGBA bytes of lit and unlit pixels
+    uint8_t on[4];
+    uint8_t off[4];
+    // Runs the plain per pixel reference instead of the vector kernels
+    bool is_scalar;
+} UpscaleConfig;
+
+typedef struct Upscaler Upscaler;
+
+Upscaler* upscale_create(const UpscaleConfig* config);
+void upscale_destroy(Upscaler* upscaler);
+// Changes the filter, the next upscale_run always runs
+void upscale_set_filter(Upscaler* upscaler, UpscaleFilter filter);
+UpscaleFilter upscale_filter(const Upscaler* upscaler);
+const char* upscale_filter_name(UpscaleFilter filter);
+// Parses a filter name, returns false for an unknown one
+bool upscale_parse_filter(const char* name, UpscaleFilter* filter);
+// Output pixels per display pixel across and down
+uint32_t upscale_factor(UpscaleFilter filter);
+uint32_t upscale_width(const Upscaler* upscaler);
+uint32_t upscale_height(const Upscaler* upscaler);
+// Upscales a column major display, returns whether the pixels changed
+bool upscale_run(Upscaler* upscaler, const uint32_t* display);
+// Row major RGBA pixels, upscale_width by upscale_height
+const uint8_t* upscale_pixels(const Upscaler* upscaler);
+// Time the last upscale_run that ran took
+uint64_t upscale_cost_ns(const Upscaler* upscaler);
+
+#endif
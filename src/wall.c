@@ -0,0 +1,317 @@
+#include "wall.h"
+#include "pool.h"
+#include "timing.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scripted keys are held and released for a random number of frames in these ranges
+#define WALL_HOLD_MIN 4
+#define WALL_HOLD_RANGE 12
+#define WALL_RELEASE_MIN 8
+#define WALL_RELEASE_RANGE 40
+// The recent average moves an eighth of the way to each new frame
+#define WALL_AVERAGE_SHIFT 3
+#define WALL_TONE_HZ 440u
+#define WALL_MIX_AMPLITUDE 24000
+
+typedef struct WallTile
+{
+    Chip8 vm;
+    uint32_t shown[CHIP8_DISPLAY_COLUMNS];
+    uint8_t pixels[WALL_TILE_PIXELS];
+    uint64_t frame_ns;
+    uint64_t average_ns;
+    uint32_t rng;
+    uint32_t hold;
+    uint16_t keys;
+    bool dirty;
+} WallTile;
+
+struct Wall
+{
+    ThreadPool* pool;
+    WallTile* tiles;
+    uint32_t count;
+    uint32_t columns;
+    uint32_t rows;
+    atomic_uint focus;
+    bool is_focus_playing;
+    uint16_t focus_keys;
+    uint64_t step_ns;
+    atomic_uint_least64_t sounding;
+    // Audio thread only
+    uint32_t phases[WALL_MAX_MACHINES];
+};
+
+// A pentatonic scale over two octaves, so machines sounding together can be told apart
+static const uint32_t WallPitches[10] = {256, 287, 322, 384, 431, 512, 575, 645, 768, 862};
+
+static void wall_step_task(void* context, uint32_t index);
+static uint16_t wall_script_keys(WallTile* tile);
+static void wall_expand(WallTile* tile);
+
+Wall* wall_create(const WallConfig* config)
+{
+    if(config->rom_count == 0)
+    {
+        return NULL;
+    }
+
+    Wall* wall = calloc(1, sizeof(Wall));
+
+    if(!wall)
+    {
+        return NULL;
+    }
+
+    wall->count = config->count < WALL_MIN_MACHINES ? WALL_MIN_MACHINES : config->count > WALL_MAX_MACHINES ? WALL_MAX_MACHINES : config->count;
+
+    // Tiles have the window's 2:1 shape, so the grid is as close to square as it gets
+    wall->columns = 1;
+
+    while(wall->columns * wall->columns < wall->count)
+    {
+        ++wall->columns;
+    }
+
+    wall->rows = (wall->count + wall->columns - 1) / wall->columns;
+    wall->tiles = calloc(wall->count, sizeof(WallTile));
+    wall->pool = pool_create(config->threads);
+
+    if(!wall->tiles || !wall->pool)
+    {
+        wall_destroy(wall);
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < wall->count; ++i)
+    {
+        WallTile* tile = &wall->tiles[i];
+        chip8_reset(&tile->vm, config->seed + i);
+
+        if(!chip8_load_rom_file(&tile->vm, config->rom_paths[i % config->rom_count]))
+        {
+            tile->vm.halted = true;
+        }
+
+        tile->vm.muted = true;
+        tile->rng = (config->seed + i) * 2654435761u | 1u;
+        tile->hold = WALL_RELEASE_MIN;
+        tile->dirty = true;
+    }
+
+    atomic_init(&wall->focus, 0);
+    atomic_init(&wall->sounding, 0);
+    return wall;
+}
+
+void wall_destroy(Wall* wall)
+{
+    if(!wall)
+    {
+        return;
+    }
+
+    for(uint32_t i = 0; wall->tiles && i < wall->count; ++i)
+    {
+        chip8_release(&wall->tiles[i].vm);
+    }
+
+    pool_destroy(wall->pool);
+    free(wall->tiles);
+    free(wall);
+}
+
+uint32_t wall_count(const Wall* wall)
+{
+    return wall->count;
+}
+
+uint32_t wall_columns(const Wall* wall)
+{
+    return wall->columns;
+}
+
+uint32_t wall_rows(const Wall* wall)
+{
+    return wall->rows;
+}
+
+uint32_t wall_threads(const Wall* wall)
+{
+    return pool_worker_count(wall->pool);
+}
+
+void wall_set_focus(Wall* wall, const uint32_t index)
+{
+    atomic_store(&wall->focus, index % wall->count);
+}
+
+uint32_t wall_focus(const Wall* wall)
+{
+    return atomic_load(&wall->focus);
+}
+
+void wall_step(Wall* wall, const bool is_focus_playing, const uint16_t keys)
+{
+    const uint64_t start = timing_now_ns();
+    wall->is_focus_playing = is_focus_playing;
+    wall->focus_keys = keys;
+    pool_for(wall->pool, wall->count, wall_step_task, wall);
+
+    uint64_t sounding = 0;
+
+    for(uint32_t i = 0; i < wall->count; ++i)
+    {
+        sounding |= (uint64_t)(wall->tiles[i].vm.sound_timer > 0) << i;
+    }
+
+    atomic_store_explicit(&wall->sounding, sounding, memory_order_release);
+    wall->step_ns = timing_now_ns() - start;
+}
+
+uint64_t wall_step_ns(const Wall* wall)
+{
+    return wall->step_ns;
+}
+
+uint64_t wall_tile_ns(const Wall* wall, const uint32_t index)
+{
+    return wall->tiles[index].frame_ns;
+}
+
+uint64_t wall_tile_average_ns(const Wall* wall, const uint32_t index)
+{
+    return wall->tiles[index].average_ns;
+}
+
+const Chip8* wall_machine(const Wall* wall, const uint32_t index)
+{
+    return &wall->tiles[index].vm;
+}
+
+bool wall_tile_dirty(const Wall* wall, const uint32_t index)
+{
+    return wall->tiles[index].dirty;
+}
+
+const uint8_t* wall_tile_pixels(const Wall* wall, const uint32_t index)
+{
+    return wall->tiles[index].pixels;
+}
+
+void wall_clear_dirty(Wall* wall, const uint32_t index)
+{
+    wall->tiles[index].dirty = false;
+}
+
+void wall_mix_audio(Wall* wall, int16_t* samples, const uint32_t frames, const uint32_t sample_rate, const bool is_focus_only)
+{
+    uint64_t sounding = atomic_load_explicit(&wall->sounding, memory_order_acquire);
+    uint32_t steps[WALL_MAX_MACHINES];
+    uint32_t voices[WALL_MAX_MACHINES];
+    uint32_t voice_count = 0;
+
+    if(is_focus_only)
+    {
+        sounding &= 1ull << atomic_load(&wall->focus);
+    }
+
+    for(uint32_t i = 0; i < wall->count; ++i)
+    {
+        if((sounding >> i) & 1)
+        {
+            // Phase steps are 32 bit fractions of a period per sample
+            const uint32_t hz = WALL_TONE_HZ * WallPitches[i % 10] / 256;
+            steps[voice_count] = (uint32_t)(((uint64_t)hz << 32) / sample_rate);
+            voices[voice_count++] = i;
+        }
+    }
+
+    // Voices share the amplitude, so any number of them stays in range
+    const int32_t amplitude = voice_count > 0 ? WALL_MIX_AMPLITUDE / (int32_t)voice_count : 0;
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        int32_t sample = 0;
+
+        for(uint32_t voice = 0; voice < voice_count; ++voice)
+        {
+            uint32_t* phase = &wall->phases[voices[voice]];
+            *phase += steps[voice];
+            sample += (*phase & 0x80000000u) ? amplitude : -amplitude;
+        }
+
+        samples[frame] = (int16_t)sample;
+    }
+}
+
+static void wall_step_task(void* context, const uint32_t index)
+{
+    Wall* wall = (Wall*)context;
+    WallTile* tile = &wall->tiles[index];
+    const uint64_t start = timing_now_ns();
+
+    // The script keeps running under the keyboard, so a machine losing focus picks it up again
+    uint16_t keys = wall_script_keys(tile);
+
+    if(wall->is_focus_playing && index == atomic_load(&wall->focus))
+    {
+        keys = wall->focus_keys;
+    }
+
+    tile->vm.keys_pressed = keys & (uint16_t)~tile->vm.keys;
+    tile->vm.keys = keys;
+    chip8_step(&tile->vm);
+
+    if(memcmp(tile->shown, tile->vm.display, sizeof(tile->shown)) != 0)
+    {
+        memcpy(tile->shown, tile->vm.display, sizeof(tile->shown));
+        wall_expand(tile);
+        tile->dirty = true;
+    }
+
+    tile->frame_ns = timing_now_ns() - start;
+    tile->average_ns = tile->average_ns == 0 ? tile->frame_ns :
+        tile->average_ns - (tile->average_ns >> WALL_AVERAGE_SHIFT) + (tile->frame_ns >> WALL_AVERAGE_SHIFT);
+}
+
+// Holds one random key or none, like someone idly playing
+static uint16_t wall_script_keys(WallTile* tile)
+{
+    if(--tile->hold == 0)
+    {
+        tile->rng ^= tile->rng << 13;
+        tile->rng ^= tile->rng >> 17;
+        tile->rng ^= tile->rng << 5;
+
+        if(tile->keys == 0)
+        {
+            tile->keys = (uint16_t)(1u << (tile->rng >> 28));
+            tile->hold = WALL_HOLD_MIN + tile->rng % WALL_HOLD_RANGE;
+        }
+        else
+        {
+            tile->keys = 0;
+            tile->hold = WALL_RELEASE_MIN + tile->rng % WALL_RELEASE_RANGE;
+        }
+    }
+
+    return tile->keys;
+}
+
+// Columns are stored as bits per row, the tile is row major bytes
+static void wall_expand(WallTile* tile)
+{
+    for(uint32_t y = 0; y < WALL_TILE_HEIGHT; ++y)
+    {
+        uint8_t* row = &tile->pixels[y * WALL_TILE_WIDTH];
+
+        for(uint32_t x = 0; x < WALL_TILE_WIDTH; ++x)
+        {
+            row[x] = (uint8_t)(0u - ((tile->shown[x] >> y) & 1u));
+        }
+    }
+}
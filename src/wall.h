@@ -0,0 +1,60 @@
+#ifndef WALL_H
+#define WALL_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A wall of machines running side by side, for lobby displays. Every frame each machine
+// runs on the thread pool and is timed; a machine whose display changed expands it into
+// its tile's 8 bit pixels and marks the tile dirty, so the frontend uploads only those
+// tiles into its atlas texture. Machines play by themselves with scripted keys, except
+// the focused one when it is given the keyboard. Tones are mixed on the audio thread
+// from the set of machines sounding, all of them or only the focused one.
+
+#define WALL_MIN_MACHINES 4
+#define WALL_MAX_MACHINES 64
+#define WALL_TILE_WIDTH CHIP8_DISPLAY_COLUMNS
+#define WALL_TILE_HEIGHT CHIP8_DISPLAY_ROWS
+#define WALL_TILE_PIXELS (WALL_TILE_WIDTH * WALL_TILE_HEIGHT)
+
+typedef struct WallConfig
+{
+    // Clamped to WALL_MIN_MACHINES..WALL_MAX_MACHINES, ROMs are repeated to fill the wall
+    uint32_t count;
+    // Threads including the caller, 0 uses one per hardware thread
+    uint32_t threads;
+    const char* const* rom_paths;
+    uint32_t rom_count;
+    uint32_t seed;
+} WallConfig;
+
+typedef struct Wall Wall;
+
+Wall* wall_create(const WallConfig* config);
+void wall_destroy(Wall* wall);
+uint32_t wall_count(const Wall* wall);
+uint32_t wall_columns(const Wall* wall);
+uint32_t wall_rows(const Wall* wall);
+uint32_t wall_threads(const Wall* wall);
+void wall_set_focus(Wall* wall, uint32_t index);
+uint32_t wall_focus(const Wall* wall);
+// Runs every machine one frame. With is_focus_playing the focused machine gets keys
+// instead of its script.
+void wall_step(Wall* wall, bool is_focus_playing, uint16_t keys);
+// Time the last wall_step took and the last and recent average cost of one machine's frame
+uint64_t wall_step_ns(const Wall* wall);
+uint64_t wall_tile_ns(const Wall* wall, uint32_t index);
+uint64_t wall_tile_average_ns(const Wall* wall, uint32_t index);
+const Chip8* wall_machine(const Wall* wall, uint32_t index);
+// Pixels of a tile, 0 or 255, valid until the next wall_step. The dirty flag stays set
+// until cleared, so steps the frontend did not draw are not lost.
+bool wall_tile_dirty(const Wall* wall, uint32_t index);
+const uint8_t* wall_tile_pixels(const Wall* wall, uint32_t index);
+void wall_clear_dirty(Wall* wall, uint32_t index);
+// Fills 16 bit mono samples with a square wave per sounding machine, each at its own
+// pitch. Only called from the audio thread.
+void wall_mix_audio(Wall* wall, int16_t* samples, uint32_t frames, uint32_t sample_rate, bool is_focus_only);
+
+#endif
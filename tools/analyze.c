@@ -0,0 +1,214 @@
+// Static ROM analyzer.
+//
+// Builds the control flow graph of a ROM by recursive descent from 0x200 and prints
+// a summary, an annotated listing or the basic blocks. The result is cached next to
+// the ROM, the same cache the emulator reads when it loads the ROM.
+//
+//   chip8-analyze [--no-cache] [--listing] [--blocks] [--check FRAMES] rom...
+//
+// --check runs each ROM with changing key presses and verifies every executed
+// instruction was found statically. ROMs with indirect jumps or writes through an
+// unknown I are reported but do not fail the check, their code is not fully knowable.
+
+#include "analyze.h"
+#include "chip8.h"
+#include "codes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANALYZE_MAX_MISSES 8
+
+static void analyze_print_listing(const Chip8Analysis* analysis, const Chip8* vm);
+static void analyze_print_blocks(const Chip8Analysis* analysis);
+static bool analyze_check(const Chip8Analysis* analysis, const char* rom_path, uint32_t frames);
+
+int main(int argc, char** argv)
+{
+    bool use_cache = true;
+    bool listing = false;
+    bool blocks = false;
+    uint32_t check_frames = 0;
+    int rom_count = 0;
+    int failures = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--no-cache") == 0)
+        {
+            use_cache = false;
+        }
+        else if(strcmp(argv[i], "--listing") == 0)
+        {
+            listing = true;
+        }
+        else if(strcmp(argv[i], "--blocks") == 0)
+        {
+            blocks = true;
+        }
+        else if(strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+        {
+            check_frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-analyze [--no-cache] [--listing] [--blocks] [--check FRAMES] rom...\n");
+        return 2;
+    }
+
+    static Chip8Analysis analysis;
+    static Chip8 vm;
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        const char* rom_path = argv[i];
+
+        if(!chip8_analyze_file(rom_path, use_cache, &analysis))
+        {
+            fprintf(stderr, "Failed to load %s\n", rom_path);
+            ++failures;
+            continue;
+        }
+
+        printf("%s: %u bytes, %u instructions, %u blocks, %u data bytes, %u indirect jumps, %u unknown writes, %u self-modifying writes\n",
+            rom_path, analysis.rom_size, analysis.instruction_count, analysis.block_count, analysis.data_bytes,
+            analysis.indirect_jumps, analysis.unknown_writes, analysis.self_modifying_writes);
+
+        if(listing)
+        {
+            chip8_reset(&vm, 0);
+            chip8_load_rom_file(&vm, rom_path);
+            analyze_print_listing(&analysis, &vm);
+        }
+
+        if(blocks)
+        {
+            analyze_print_blocks(&analysis);
+        }
+
+        if(check_frames > 0 && !analyze_check(&analysis, rom_path, check_frames))
+        {
+            ++failures;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+static void analyze_print_listing(const Chip8Analysis* analysis, const Chip8* vm)
+{
+    const uint32_t end = PROGRAM_START + analysis->rom_size;
+
+    for(uint32_t address = PROGRAM_START; address < end;)
+    {
+        const uint8_t flags = analysis->flags[address];
+
+        if(flags & ANALYSIS_CODE)
+        {
+            char text[32];
+            const uint16_t instruction = (uint16_t)((chip8_read(vm, address) << 8) | chip8_read(vm, address + 1));
+            chip8_disassemble(instruction, text, sizeof(text));
+
+            if(flags & ANALYSIS_BLOCK_START)
+            {
+                printf("%s%.03x:\n", flags & ANALYSIS_CALL_TARGET ? "sub_" : "loc_", address);
+            }
+
+            printf("  %.03x  %.04x  %-16s%s%s\n", address, instruction, text,
+                flags & ANALYSIS_INDIRECT ? " ; indirect" : "",
+                flags & ANALYSIS_WRITTEN ? " ; modified" : "");
+            address += 2;
+        }
+        else
+        {
+            const uint8_t byte = chip8_read(vm, address);
+            printf("  %.03x  %.02x    db 0x%.02x%s\n", address, byte, byte,
+                flags & ANALYSIS_DATA ? " ; data" : flags & ANALYSIS_WRITTEN ? " ; written" : "");
+            address += 1;
+        }
+    }
+}
+
+static void analyze_print_blocks(const Chip8Analysis* analysis)
+{
+    for(uint32_t i = 0; i < analysis->block_count; ++i)
+    {
+        const AnalysisBlock* block = &analysis->blocks[i];
+        printf("  %.03x-%.03x %-11s", block->start, block->end - 1, chip8_analysis_exit_name((AnalysisExit)block->exit));
+
+        for(uint8_t s = 0; s < block->successor_count; ++s)
+        {
+            printf(" %.03x", block->successors[s]);
+        }
+
+        printf("\n");
+    }
+}
+
+static bool analyze_check(const Chip8Analysis* analysis, const char* rom_path, const uint32_t frames)
+{
+    static Chip8 vm;
+    chip8_reset(&vm, 0);
+    chip8_load_rom_file(&vm, rom_path);
+
+    // One instruction per step, so every executed pc is seen
+    const uint32_t speed = vm.speed;
+    vm.speed = 1;
+
+    uint32_t misses = 0;
+    uint32_t rng = 0x2545f491;
+
+    for(uint32_t frame = 0; frame < frames && !vm.halted; ++frame)
+    {
+        // Hold a random key for a few frames at a time to reach input dependent paths
+        const uint16_t held = vm.keys;
+
+        if(frame % 6 == 0)
+        {
+            rng = rng * 1664525u + 1013904223u;
+            vm.keys = (rng >> 28) < 12 ? (uint16_t)(1u << ((rng >> 24) & 0xF)) : 0;
+        }
+
+        vm.keys_pressed = vm.keys & (uint16_t)~held;
+
+        for(uint32_t i = 0; i < speed && !vm.halted; ++i)
+        {
+            const uint16_t pc = vm.pc & (CHIP8_RAM_SIZE - 1);
+
+            if(!vm.paused && !(analysis->flags[pc] & ANALYSIS_CODE))
+            {
+                if(misses < ANALYZE_MAX_MISSES)
+                {
+                    printf("  frame %u: executed 0x%.03x, not found statically\n", frame, pc);
+                }
+
+                ++misses;
+            }
+
+            chip8_step(&vm);
+        }
+    }
+
+    const bool dynamic = analysis->indirect_jumps > 0 || analysis->unknown_writes > 0;
+
+    if(misses == 0)
+    {
+        printf("  check passed\n");
+        return true;
+    }
+
+    printf("  check %s, %u instructions not found statically\n", dynamic ? "incomplete" : "failed", misses);
+    return dynamic;
+}
@@ -0,0 +1,243 @@
+// Terminal output check.
+//
+// Runs each ROM with a changing key held and draws every frame through the terminal
+// frontend's encoder, with half blocks and with braille. The bytes are played back on
+// a model terminal, which understands cursor moves and the glyphs, and every cell it
+// ends up showing must match the display. Prints the bytes per frame against redrawing
+// every cell, and the bandwidth at 60 frames per second.
+//
+//   chip8-ansi [--frames N] rom...
+
+#include "ansi.h"
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ANSI_SEED 1
+#define ANSI_HOLD_FRAMES 20
+#define ANSI_TOP 2
+#define ANSI_LEFT 3
+
+typedef struct AnsiTerminal
+{
+    uint16_t cells[ANSI_TOP + ANSI_MAX_ROWS][ANSI_LEFT + ANSI_MAX_COLUMNS];
+    uint32_t row;
+    uint32_t column;
+} AnsiTerminal;
+
+typedef struct AnsiStats
+{
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t full_bytes;
+    uint64_t mismatches;
+} AnsiStats;
+
+static bool ansi_rom(const char* path, uint32_t frames, AnsiStats* stats);
+static bool ansi_play(AnsiTerminal* terminal, AnsiCells cells, const char* bytes, size_t length);
+static uint16_t ansi_decode(AnsiCells cells, uint32_t code);
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 600;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-ansi [--frames N] rom...\n");
+        return 2;
+    }
+
+    AnsiStats stats[2];
+    memset(stats, 0, sizeof(stats));
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        if(!ansi_rom(argv[i], frames, stats))
+        {
+            fprintf(stderr, "Failed to load %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    int result = 0;
+    static const char* const Names[2] = {"half block", "braille"};
+
+    for(uint32_t c = 0; c < 2; ++c)
+    {
+        const double frames_run = (double)(stats[c].frames > 0 ? stats[c].frames : 1);
+        printf("%-10s %.1f bytes per frame (%.1f redrawing every cell), %.1f KB/s at 60 fps, %llu mismatched frames\n",
+            Names[c], (double)stats[c].bytes / frames_run, (double)stats[c].full_bytes / frames_run,
+            (double)stats[c].bytes / frames_run * 60.0 / 1024.0, (unsigned long long)stats[c].mismatches);
+
+        if(stats[c].mismatches > 0)
+        {
+            printf("FAIL the terminal did not end up showing the display\n");
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+static bool ansi_rom(const char* path, const uint32_t frames, AnsiStats* stats)
+{
+    Chip8 vm = {0};
+    chip8_reset(&vm, ANSI_SEED);
+
+    if(!chip8_load_rom_file(&vm, path))
+    {
+        chip8_release(&vm);
+        return false;
+    }
+
+    AnsiScreen screens[2];
+    AnsiTerminal terminals[2];
+    static char output[ANSI_FRAME_BYTES];
+    uint32_t rng = ANSI_SEED;
+
+    for(uint32_t c = 0; c < 2; ++c)
+    {
+        ansi_screen_init(&screens[c], (AnsiCells)c, ANSI_TOP, ANSI_LEFT);
+        memset(&terminals[c], 0, sizeof(terminals[c]));
+    }
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        if(frame % ANSI_HOLD_FRAMES == 0)
+        {
+            rng = rng * 1664525u + 1013904223u;
+            vm.keys = (uint16_t)(1u << (rng >> 28));
+        }
+
+        chip8_step(&vm);
+
+        for(uint32_t c = 0; c < 2; ++c)
+        {
+            AnsiScreen full = screens[c];
+            ansi_screen_invalidate(&full);
+            stats[c].full_bytes += ansi_screen_draw(&full, vm.display, output);
+
+            const size_t length = ansi_screen_draw(&screens[c], vm.display, output);
+            stats[c].bytes += length;
+            ++stats[c].frames;
+            bool is_match = ansi_play(&terminals[c], (AnsiCells)c, output, length);
+
+            for(uint32_t r = 0; r < screens[c].rows; ++r)
+            {
+                for(uint32_t col = 0; col < screens[c].columns; ++col)
+                {
+                    is_match = is_match && terminals[c].cells[ANSI_TOP - 1 + r][ANSI_LEFT - 1 + col] == ansi_screen_cell(&screens[c], vm.display, r, col);
+                }
+            }
+
+            stats[c].mismatches += !is_match;
+        }
+    }
+
+    chip8_release(&vm);
+    return true;
+}
+
+// Applies cursor moves and glyphs the way a terminal would, anything else is an error
+static bool ansi_play(AnsiTerminal* terminal, const AnsiCells cells, const char* bytes, const size_t length)
+{
+    const uint8_t* b = (const uint8_t*)bytes;
+    size_t i = 0;
+
+    while(i < length)
+    {
+        if(b[i] == 0x1B)
+        {
+            // ESC [ row ; column H
+            uint32_t numbers[2] = {0, 0};
+            uint32_t n = 0;
+
+            if(i + 1 >= length || b[i + 1] != '[')
+            {
+                return false;
+            }
+
+            for(i += 2; i < length && b[i] != 'H'; ++i)
+            {
+                if(b[i] == ';' && n == 0)
+                {
+                    ++n;
+                }
+                else if(b[i] >= '0' && b[i] <= '9')
+                {
+                    numbers[n] = numbers[n] * 10 + (b[i] - '0');
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            if(i == length || n != 1 || numbers[0] == 0 || numbers[1] == 0)
+            {
+                return false;
+            }
+
+            terminal->row = numbers[0] - 1;
+            terminal->column = numbers[1] - 1;
+            ++i;
+            continue;
+        }
+
+        uint32_t code = b[i];
+        size_t size = 1;
+
+        if((b[i] & 0xF0) == 0xE0 && i + 2 < length)
+        {
+            code = ((b[i] & 0x0Fu) << 12) | ((b[i + 1] & 0x3Fu) << 6) | (b[i + 2] & 0x3Fu);
+            size = 3;
+        }
+
+        const uint16_t cell = ansi_decode(cells, code);
+
+        if(cell == ANSI_CELL_UNKNOWN || terminal->row >= ANSI_TOP + ANSI_MAX_ROWS || terminal->column >= ANSI_LEFT + ANSI_MAX_COLUMNS)
+        {
+            return false;
+        }
+
+        terminal->cells[terminal->row][terminal->column++] = cell;
+        i += size;
+    }
+
+    return true;
+}
+
+static uint16_t ansi_decode(const AnsiCells cells, const uint32_t code)
+{
+    if(code == ' ')
+    {
+        return 0;
+    }
+
+    if(cells == ANSI_BRAILLE)
+    {
+        return code > 0x2800 && code <= 0x28FF ? (uint16_t)(code - 0x2800) : ANSI_CELL_UNKNOWN;
+    }
+
+    return code == 0x2580 ? 1 : code == 0x2584 ? 2 : code == 0x2588 ? 3 : ANSI_CELL_UNKNOWN;
+}
@@ -0,0 +1,337 @@
+// XO-CHIP audio engine check.
+//
+// Drives the engine the way the frontend does, a frame of changes at 60 Hz and the
+// callback asking for buffers of its own size in between, all on one thread against a
+// simulated clock. Checks that
+//   - the pattern plays at the frequency its pitch asks for,
+//   - a high pitch aliases far less than point sampling the pattern does,
+//   - changes land on the sample their frame starts at, however the buffers fall,
+// and prints what the callback costs per sample.
+//
+//   chip8-audio [--rate N] [--buffer N]
+
+#include "audio.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define AUDIO_CHECK_FRAMES 240
+#define AUDIO_FRAME_HZ 60
+// Frequencies within this share of the expected one pass
+#define AUDIO_PITCH_TOLERANCE 0.002
+#define AUDIO_ALIAS_MARGIN_DB 10.0
+// Changes may land this many samples away from where their frames start
+#define AUDIO_TIMING_TOLERANCE 2
+#define AUDIO_SILENCE_SAMPLES 64
+
+typedef struct AudioRun
+{
+    AudioEngine* engine;
+    uint32_t rate;
+    uint32_t buffer;
+    int16_t* samples;
+    uint32_t count;
+} AudioRun;
+
+typedef void (*AudioScript)(AudioState* state, uint32_t frame);
+
+static bool audio_run(AudioRun* run, AudioScript script, uint32_t frames);
+static double audio_frequency(const int16_t* samples, uint32_t count, uint32_t rate);
+static double audio_alias_db(const int16_t* samples, uint32_t count, uint32_t rate, double frequency);
+static double audio_power_at(const int16_t* samples, uint32_t count, double mean, double cycles_per_sample);
+static void audio_point_sample(int16_t* samples, uint32_t count, uint32_t rate, const AudioState* state);
+static void audio_script_tone(AudioState* state, uint32_t frame);
+static void audio_script_high(AudioState* state, uint32_t frame);
+static void audio_script_beeps(AudioState* state, uint32_t frame);
+
+static uint8_t s_pitch;
+
+int main(int argc, char** argv)
+{
+    uint32_t rate = 44100;
+    uint32_t buffer = 512;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+        {
+            rate = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--buffer") == 0 && i + 1 < argc)
+        {
+            buffer = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: chip8-audio [--rate N] [--buffer N]\n");
+            return 2;
+        }
+    }
+
+    if(rate < 8000 || buffer == 0)
+    {
+        fprintf(stderr, "The rate must be at least 8000 and the buffer at least 1 sample\n");
+        return 2;
+    }
+
+    AudioRun run = {.rate = rate, .buffer = buffer};
+    int result = 0;
+    uint64_t samples = 0;
+    uint64_t render_ns = 0;
+
+    // Pitches across the range, measured over the second half of the run
+    static const uint8_t Pitches[] = {0, 16, 64, 112, 160};
+
+    for(uint32_t i = 0; i < sizeof(Pitches) / sizeof(Pitches[0]); ++i)
+    {
+        s_pitch = Pitches[i];
+
+        if(!audio_run(&run, audio_script_tone, AUDIO_CHECK_FRAMES))
+        {
+            fprintf(stderr, "Failed to create the engine\n");
+            return 2;
+        }
+
+        // The default pattern repeats every 8 bits
+        const double expected = audio_pattern_rate(s_pitch) / 8.0;
+        const double measured = audio_frequency(run.samples + run.count / 2, run.count / 2, rate);
+        const bool is_pass = fabs(measured - expected) <= expected * AUDIO_PITCH_TOLERANCE;
+        printf("pitch %3u  %8.2f Hz (expected %8.2f)%s\n", s_pitch, measured, expected, is_pass ? "" : "  FAIL");
+        result |= !is_pass;
+
+        AudioStats stats;
+        audio_get_stats(run.engine, &stats);
+        samples += stats.samples;
+        render_ns += stats.render_ns;
+        audio_destroy(run.engine);
+        free(run.samples);
+    }
+
+    // Pitches whose harmonics reach past the Nyquist frequency
+    static const uint8_t HighPitches[] = {200, 230, 255};
+
+    for(uint32_t i = 0; i < sizeof(HighPitches) / sizeof(HighPitches[0]); ++i)
+    {
+        s_pitch = HighPitches[i];
+
+        if(!audio_run(&run, audio_script_high, AUDIO_CHECK_FRAMES))
+        {
+            fprintf(stderr, "Failed to create the engine\n");
+            return 2;
+        }
+
+        const AudioState state = {.pitch = s_pitch, .is_sounding = true};
+        const double frequency = audio_pattern_rate(s_pitch) / 8.0;
+        const uint32_t half = run.count / 2;
+        int16_t* naive = malloc(half * sizeof(int16_t));
+        AudioState square = state;
+        audio_default_pattern(square.pattern);
+        audio_point_sample(naive, half, rate, &square);
+
+        const double engine_db = audio_alias_db(run.samples + half, half, rate, frequency);
+        const double naive_db = audio_alias_db(naive, half, rate, frequency);
+        const bool is_pass = engine_db <= naive_db - AUDIO_ALIAS_MARGIN_DB;
+        printf("pitch %3u  %8.2f Hz aliasing %6.1f dB (point sampled %6.1f dB)%s\n",
+            s_pitch, frequency, engine_db, naive_db, is_pass ? "" : "  FAIL");
+        result |= !is_pass;
+
+        audio_destroy(run.engine);
+        free(run.samples);
+        free(naive);
+    }
+
+    // Beeps a few frames long, every onset must be a whole number of frames after the first
+    if(!audio_run(&run, audio_script_beeps, AUDIO_CHECK_FRAMES))
+    {
+        fprintf(stderr, "Failed to create the engine\n");
+        return 2;
+    }
+
+    const double samples_per_frame = (double)rate / AUDIO_FRAME_HZ;
+    int64_t first = -1;
+    uint32_t onsets = 0;
+    uint32_t worst = 0;
+    uint32_t silent = AUDIO_SILENCE_SAMPLES;
+
+    for(uint32_t i = 0; i < run.count; ++i)
+    {
+        // Silence is exactly zero once a step settles, a beep starts on its first other sample
+        if(run.samples[i] != 0 && silent >= AUDIO_SILENCE_SAMPLES)
+        {
+            first = first < 0 ? i : first;
+            const double frames = (double)(i - first) / samples_per_frame;
+            const uint32_t off = (uint32_t)(fabs(frames - round(frames)) * samples_per_frame + 0.5);
+            worst = off > worst ? off : worst;
+            ++onsets;
+        }
+
+        silent = run.samples[i] == 0 ? silent + 1 : 0;
+    }
+
+    AudioStats stats;
+    audio_get_stats(run.engine, &stats);
+    const bool is_timed = onsets == AUDIO_CHECK_FRAMES / 20 && worst <= AUDIO_TIMING_TOLERANCE && stats.late == 0 && stats.dropped == 0;
+    printf("%u onsets, worst %u samples off a frame start, %llu changes, %llu late, %llu dropped%s\n",
+        onsets, worst, (unsigned long long)stats.events, (unsigned long long)stats.late, (unsigned long long)stats.dropped,
+        is_timed ? "" : "  FAIL");
+    result |= !is_timed;
+    samples += stats.samples;
+    render_ns += stats.render_ns;
+    audio_destroy(run.engine);
+    free(run.samples);
+
+    printf("callback %.1f ns per sample, %.3f%% of a core at %u Hz\n", (double)render_ns / (double)samples,
+        (double)render_ns / (double)samples * rate / 1e7, rate);
+    return result;
+}
+
+// Interleaves frames and buffers by when they would happen and keeps every sample
+static bool audio_run(AudioRun* run, const AudioScript script, const uint32_t frames)
+{
+    run->engine = audio_create(run->rate);
+    const uint64_t total = (uint64_t)frames * run->rate / AUDIO_FRAME_HZ;
+    run->samples = malloc(total * sizeof(int16_t));
+    run->count = 0;
+
+    if(!run->engine || !run->samples)
+    {
+        audio_destroy(run->engine);
+        free(run->samples);
+        return false;
+    }
+
+    AudioState state = {.pitch = AUDIO_DEFAULT_PITCH, .is_sounding = false};
+    AudioState pushed = state;
+    audio_default_pattern(state.pattern);
+    audio_default_pattern(pushed.pattern);
+
+    for(uint32_t frame = 0; run->count < total;)
+    {
+        // Frame n is run at n / 60 seconds, a buffer is asked for once the last one played
+        if((uint64_t)frame * run->rate < (uint64_t)run->count * AUDIO_FRAME_HZ || frame == 0)
+        {
+            script(&state, frame);
+
+            if(memcmp(&state, &pushed, sizeof(state)) != 0 || frame == 0)
+            {
+                audio_push(run->engine, frame, &state);
+                pushed = state;
+            }
+
+            audio_advance(run->engine, frame);
+            ++frame;
+        }
+        else
+        {
+            const uint32_t count = (uint32_t)(total - run->count < run->buffer ? total - run->count : run->buffer);
+            audio_render(run->engine, run->samples + run->count, count);
+            run->count += count;
+        }
+    }
+
+    return true;
+}
+
+// Average rising zero crossing rate, to a fraction of a sample
+static double audio_frequency(const int16_t* samples, const uint32_t count, const uint32_t rate)
+{
+    double first = -1.0;
+    double last = -1.0;
+    uint32_t crossings = 0;
+
+    for(uint32_t i = 1; i < count; ++i)
+    {
+        if(samples[i - 1] < 0 && samples[i] >= 0)
+        {
+            const double at = (i - 1) + (double)-samples[i - 1] / (double)(samples[i] - samples[i - 1]);
+            first = first < 0.0 ? at : first;
+            last = at;
+            ++crossings;
+        }
+    }
+
+    return crossings > 1 ? (double)(crossings - 1) * rate / (last - first) : 0.0;
+}
+
+// Power that is not at a harmonic of the tone below the Nyquist frequency, against the
+// power that is
+static double audio_alias_db(const int16_t* samples, const uint32_t count, const uint32_t rate, const double frequency)
+{
+    double mean = 0.0;
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        mean += samples[i];
+    }
+
+    mean /= count;
+    double total = 0.0;
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        total += (samples[i] - mean) * (samples[i] - mean);
+    }
+
+    double harmonics = 0.0;
+
+    for(double f = frequency; f < rate * 0.5; f += frequency)
+    {
+        harmonics += audio_power_at(samples, count, mean, f / rate);
+    }
+
+    return 10.0 * log10((total - harmonics) / harmonics);
+}
+
+// Energy of the sine at one frequency, the run holds enough cycles that leakage is negligible
+static double audio_power_at(const int16_t* samples, const uint32_t count, const double mean, const double cycles_per_sample)
+{
+    double in_phase = 0.0;
+    double quadrature = 0.0;
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const double angle = 2.0 * M_PI * cycles_per_sample * i;
+        in_phase += (samples[i] - mean) * cos(angle);
+        quadrature += (samples[i] - mean) * sin(angle);
+    }
+
+    return 2.0 * (in_phase * in_phase + quadrature * quadrature) / count;
+}
+
+// The pattern as it sounds when each sample just takes the bit under it
+static void audio_point_sample(int16_t* samples, const uint32_t count, const uint32_t rate, const AudioState* state)
+{
+    const double bits_per_sample = audio_pattern_rate(state->pitch) / rate;
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t bit = (uint32_t)fmod(i * bits_per_sample, AUDIO_PATTERN_BYTES * 8);
+        samples[i] = (state->pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? 8000 : -8000;
+    }
+}
+
+static void audio_script_tone(AudioState* state, const uint32_t frame)
+{
+    state->pitch = s_pitch;
+    state->is_sounding = frame > 0;
+}
+
+static void audio_script_high(AudioState* state, const uint32_t frame)
+{
+    (void)frame;
+    state->pitch = s_pitch;
+    state->is_sounding = true;
+}
+
+// Five frames on and fifteen off, with the pitch changing under the silence
+static void audio_script_beeps(AudioState* state, const uint32_t frame)
+{
+    state->is_sounding = frame % 20 < 5;
+    state->pitch = (uint8_t)(AUDIO_DEFAULT_PITCH + (frame / 20) % 4 * 8);
+}
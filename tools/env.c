@@ -0,0 +1,196 @@
+// Batched environment driver.
+//
+// Steps every environment with pseudo random actions and reports throughput,
+// episodes and reward. With --check the run is repeated on a single worker and
+// the observations, rewards and done flags must hash the same.
+//
+//   chip8-env [--envs N] [--steps N] [--frame-skip N] [--sticky PERCENT]
+//             [--max-frames N] [--threads N] [--bytes] [--check] rom
+
+#include "env.h"
+#include "hash.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct EnvRun
+{
+    uint64_t hash;
+    uint64_t episodes;
+    double reward;
+    uint64_t elapsed_ns;
+    // Pages the environments copied on write, the rest are shared with the prototype
+    uint64_t private_pages;
+} EnvRun;
+
+// Actions come from a fixed sequence, so reruns feed identical input
+static uint16_t env_action(const uint32_t step, const uint32_t index)
+{
+    uint32_t state = (step + 1) * 0x9E3779B1u ^ (index + 1) * 0x85EBCA77u;
+    state ^= state >> 15;
+    state *= 0x2C1B3C6Du;
+    state ^= state >> 12;
+    return (state & 0x3) == 0 ? 0 : (uint16_t)(1 << ((state >> 4) & 0xF));
+}
+
+static bool env_run(Chip8EnvConfig config, const uint32_t steps, EnvRun* run)
+{
+    Chip8Env* env = chip8_env_create(&config);
+
+    if(!env)
+    {
+        fprintf(stderr, "Failed to create environments for %s\n", config.rom_path);
+        return false;
+    }
+
+    const size_t obs_size = chip8_env_obs_size(env) * config.env_count;
+    uint8_t* obs = malloc(obs_size);
+    uint16_t* actions = malloc(sizeof(uint16_t) * config.env_count);
+    float* rewards = malloc(sizeof(float) * config.env_count);
+    uint8_t* dones = malloc(config.env_count);
+
+    memset(run, 0, sizeof(*run));
+    run->hash = HASH_FNV1A64_SEED;
+    chip8_env_reset(env, 1, obs);
+
+    for(uint32_t step = 0; step < steps; ++step)
+    {
+        for(uint32_t i = 0; i < config.env_count; ++i)
+        {
+            actions[i] = env_action(step, i);
+        }
+
+        const uint64_t start = timing_now_ns();
+        chip8_env_step(env, actions, obs, rewards, dones);
+        run->elapsed_ns += timing_now_ns() - start;
+
+        run->hash = hash_fnv1a64(obs, obs_size, run->hash);
+        run->hash = hash_fnv1a64(rewards, sizeof(float) * config.env_count, run->hash);
+        run->hash = hash_fnv1a64(dones, config.env_count, run->hash);
+
+        for(uint32_t i = 0; i < config.env_count; ++i)
+        {
+            run->episodes += dones[i];
+            run->reward += rewards[i];
+        }
+    }
+
+    for(uint32_t i = 0; i < config.env_count; ++i)
+    {
+        run->private_pages += chip8_private_page_count(chip8_env_machine(env, i));
+    }
+
+    free(dones);
+    free(rewards);
+    free(actions);
+    free(obs);
+    chip8_env_destroy(env);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Chip8EnvConfig config = {
+        .rom_path = NULL,
+        .env_count = 64,
+        .frame_skip = 4,
+        .sticky_percent = 25,
+        .max_frames = 0,
+        .threads = 0,
+        .obs_format = CHIP8_OBS_BITS,
+        .score = NULL,
+        .done = NULL
+    };
+    uint32_t steps = 1000;
+    bool check = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--envs") == 0 && i + 1 < argc)
+        {
+            config.env_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+        {
+            steps = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--frame-skip") == 0 && i + 1 < argc)
+        {
+            config.frame_skip = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--sticky") == 0 && i + 1 < argc)
+        {
+            config.sticky_percent = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--max-frames") == 0 && i + 1 < argc)
+        {
+            config.max_frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            config.threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--bytes") == 0)
+        {
+            config.obs_format = CHIP8_OBS_BYTES;
+        }
+        else if(strcmp(argv[i], "--check") == 0)
+        {
+            check = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            config.rom_path = argv[i];
+        }
+    }
+
+    if(!config.rom_path)
+    {
+        fprintf(stderr, "Usage: chip8-env [options] rom\n");
+        return 2;
+    }
+
+    EnvRun run;
+
+    if(!env_run(config, steps, &run))
+    {
+        return 2;
+    }
+
+    const double seconds = (double)run.elapsed_ns / 1e9;
+    printf("%u envs, %u steps, %.0f steps/s, %.0f frames/s, %llu episodes, reward %.0f, hash %016llx\n",
+        config.env_count, steps, (double)steps * config.env_count / seconds,
+        (double)steps * config.env_count * (config.frame_skip > 0 ? config.frame_skip : 1) / seconds,
+        (unsigned long long)run.episodes, run.reward, (unsigned long long)run.hash);
+    printf("guest RAM %.1f KB private (%.2f pages per env), %.1f KB if unshared\n",
+        (double)run.private_pages * CHIP8_PAGE_SIZE / 1024.0, (double)run.private_pages / config.env_count,
+        (double)config.env_count * CHIP8_RAM_SIZE / 1024.0);
+
+    if(check)
+    {
+        EnvRun single;
+        config.threads = 1;
+
+        if(!env_run(config, steps, &single))
+        {
+            return 2;
+        }
+
+        if(single.hash != run.hash)
+        {
+            printf("FAIL single worker run hashed %016llx\n", (unsigned long long)single.hash);
+            return 1;
+        }
+
+        printf("single worker run matches\n");
+    }
+
+    return 0;
+}
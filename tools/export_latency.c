@@ -0,0 +1,164 @@
+// Shared memory export latency test.
+//
+// Publishes frames at a fixed rate through a real shared memory segment while a
+// reader thread attached to the same segment spins on export_read. Every frame
+// carries a display pattern derived from its number, so a torn read is caught.
+// Prints the publish to read latency percentiles and fails on torn or missing frames.
+//
+//   chip8-export-latency [--frames N] [--interval-us N] [--name NAME]
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "export.h"
+#include "timing.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+static struct LatencyContext
+{
+    const char* name;
+    uint32_t frames;
+    uint64_t* latencies;
+    uint32_t seen;
+    uint32_t torn;
+    atomic_bool done;
+} s_latency = {
+    .name = "chip8-latency",
+    .frames = 2000,
+    .latencies = NULL,
+    .seen = 0,
+    .torn = 0
+};
+
+static int latency_compare(const void* a, const void* b)
+{
+    const uint64_t left = *(const uint64_t*)a;
+    const uint64_t right = *(const uint64_t*)b;
+    return left < right ? -1 : left > right;
+}
+
+static int latency_reader(void* arg)
+{
+    (void)arg;
+    const ExportSegment* segment = export_attach(s_latency.name);
+    ExportFrame frame;
+    uint64_t last = 0;
+
+    while(segment && !atomic_load(&s_latency.done))
+    {
+        if(!export_read(segment, &frame) || frame.frame == last)
+        {
+            thrd_yield();
+            continue;
+        }
+
+        const uint64_t now = timing_now_ns();
+        last = frame.frame;
+
+        for(uint32_t column = 0; column < CHIP8_DISPLAY_COLUMNS; ++column)
+        {
+            if(frame.display[column] != (uint32_t)(frame.frame * 0x9E3779B1u + column))
+            {
+                ++s_latency.torn;
+                break;
+            }
+        }
+
+        s_latency.latencies[s_latency.seen++] = now - frame.publish_ns;
+    }
+
+    export_detach(segment);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t interval_ns = 1000000;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            s_latency.frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--interval-us") == 0 && i + 1 < argc)
+        {
+            interval_ns = strtoull(argv[++i], NULL, 10) * 1000;
+        }
+        else if(strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+        {
+            s_latency.name = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: chip8-export-latency [--frames N] [--interval-us N] [--name NAME]\n");
+            return 2;
+        }
+    }
+
+    Exporter* exporter = export_open(s_latency.name);
+
+    if(!exporter)
+    {
+        return 2;
+    }
+
+    s_latency.latencies = calloc(s_latency.frames, sizeof(uint64_t));
+    thrd_t reader;
+    thrd_create(&reader, latency_reader, NULL);
+
+    static Chip8 vm;
+    uint64_t next = timing_now_ns();
+
+    for(uint32_t frame = 1; frame <= s_latency.frames; ++frame)
+    {
+        while(timing_now_ns() < next)
+        {
+            thrd_yield();
+        }
+
+        next += interval_ns;
+
+        for(uint32_t column = 0; column < CHIP8_DISPLAY_COLUMNS; ++column)
+        {
+            vm.display[column] = (uint32_t)(frame * 0x9E3779B1u + column);
+        }
+
+        vm.pc = (uint16_t)frame;
+        export_publish(exporter, &vm);
+    }
+
+    // Give the reader one more interval to pick up the last frame
+    const uint64_t deadline = timing_now_ns() + interval_ns;
+
+    while(timing_now_ns() < deadline)
+    {
+        thrd_yield();
+    }
+
+    atomic_store(&s_latency.done, true);
+    thrd_join(reader, NULL);
+    export_close(exporter);
+
+    if(s_latency.seen == 0)
+    {
+        printf("FAIL reader saw no frames\n");
+        return 1;
+    }
+
+    qsort(s_latency.latencies, s_latency.seen, sizeof(uint64_t), latency_compare);
+    printf("%u frames published, %u read, %u torn, latency p50 %.1f us p99 %.1f us max %.1f us\n",
+        s_latency.frames, s_latency.seen, s_latency.torn,
+        (double)s_latency.latencies[s_latency.seen / 2] / 1e3,
+        (double)s_latency.latencies[s_latency.seen * 99 / 100] / 1e3,
+        (double)s_latency.latencies[s_latency.seen - 1] / 1e3);
+
+    free(s_latency.latencies);
+    return s_latency.torn > 0 ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+// Shared memory reader example.
+//
+// Attaches to the segment the emulator publishes when started with CHIP8_EXPORT
+// set, and prints the registers and display of each new frame.
+//
+//   chip8-export-reader [--name NAME] [--frames N]
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "export.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+static void reader_print(const ExportFrame* frame)
+{
+    printf("frame %llu pc %.04x I %.04x sp %u dt %u st %u%s%s\n", (unsigned long long)frame->frame,
+        frame->pc, frame->index, frame->sp, frame->delay_timer, frame->sound_timer,
+        frame->flags & EXPORT_FLAG_HALTED ? " halted" : "", frame->flags & EXPORT_FLAG_PAUSED ? " paused" : "");
+
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        printf("V%X=%.02x%s", i, frame->v[i], i == 15 ? "\n" : " ");
+    }
+
+    for(uint32_t row = 0; row < CHIP8_DISPLAY_ROWS; ++row)
+    {
+        char line[CHIP8_DISPLAY_COLUMNS + 1];
+
+        for(uint32_t column = 0; column < CHIP8_DISPLAY_COLUMNS; ++column)
+        {
+            line[column] = (frame->display[column] >> row) & 0x1 ? '#' : '.';
+        }
+
+        line[CHIP8_DISPLAY_COLUMNS] = '\0';
+        puts(line);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = EXPORT_DEFAULT_NAME;
+    uint64_t frames = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+        {
+            name = argv[++i];
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = strtoull(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: chip8-export-reader [--name NAME] [--frames N]\n");
+            return 2;
+        }
+    }
+
+    const ExportSegment* segment = export_attach(name);
+
+    if(!segment)
+    {
+        return 1;
+    }
+
+    ExportFrame frame;
+    uint64_t last = 0;
+    uint64_t printed = 0;
+
+    while(frames == 0 || printed < frames)
+    {
+        // Polling costs no syscalls, sleeping a millisecond keeps the example idle friendly
+        if(!export_read(segment, &frame) || frame.frame == last)
+        {
+            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 1000000}, NULL);
+            continue;
+        }
+
+        last = frame.frame;
+        ++printed;
+        printf("\n%.3f ms after publish\n", (double)(timing_now_ns() - frame.publish_ns) / 1e6);
+        reader_print(&frame);
+    }
+
+    export_detach(segment);
+    return 0;
+}
@@ -0,0 +1,228 @@
+// RAM heatmap check.
+//
+// Runs a short program on the traced interpreter and checks every counter it leaves.
+// Then runs each ROM with a changing key held on the plain and the traced interpreter
+// side by side, fails if the machines ever differ, and prints the time per instruction
+// of both, what the heatmap costs while it is shown.
+//
+//   chip8-heatmap [--frames N] rom...
+
+#include "heatmap.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEATMAP_SEED 1
+#define HEATMAP_HOLD_FRAMES 20
+#define HEATMAP_TIMED_SPEED 1000
+#define HEATMAP_TIMED_FRAMES 200
+
+typedef struct HeatmapStats
+{
+    uint64_t frames;
+    uint64_t mismatches;
+    uint64_t instructions;
+    uint64_t plain_ns;
+    uint64_t traced_ns;
+} HeatmapStats;
+
+static bool heatmap_check_counts(void);
+static bool heatmap_rom(const char* path, uint32_t frames, HeatmapStats* stats);
+static bool heatmap_same(const Chip8* a, const Chip8* b);
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 600;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-heatmap [--frames N] rom...\n");
+        return 2;
+    }
+
+    int result = 0;
+
+    if(!heatmap_check_counts())
+    {
+        printf("FAIL the counters do not match the accesses of the test program\n");
+        result = 1;
+    }
+
+    HeatmapStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        if(!heatmap_rom(argv[i], frames, &stats))
+        {
+            fprintf(stderr, "Failed to load %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    const double instructions = (double)(stats.instructions > 0 ? stats.instructions : 1);
+    printf("%llu frames, %llu mismatched, plain %.2f ns per instruction, traced %.2f ns per instruction\n",
+        (unsigned long long)stats.frames, (unsigned long long)stats.mismatches,
+        (double)stats.plain_ns / instructions, (double)stats.traced_ns / instructions);
+
+    if(stats.mismatches > 0)
+    {
+        printf("FAIL the traced interpreter does not run the ROMs the same\n");
+        result = 1;
+    }
+
+    return result;
+}
+
+// Stores three registers, loads two of them back and draws them, then waits in place
+static bool heatmap_check_counts(void)
+{
+    static const uint8_t Program[] = {
+        0xA3, 0x00, // LD I, 0x300
+        0x60, 0x05, // LD V0, 5
+        0xF2, 0x55, // LD [I], V2
+        0xF1, 0x65, // LD V1, [I]
+        0xD0, 0x12, // DRW V0, V1, 2
+        0x12, 0x0A, // JP 0x20A
+    };
+
+    Chip8 vm = {0};
+    chip8_reset(&vm, HEATMAP_SEED);
+
+    for(uint16_t i = 0; i < sizeof(Program); ++i)
+    {
+        chip8_write(&vm, (uint16_t)(0x200 + i), Program[i]);
+    }
+
+    Heatmap* heatmap = heatmap_create();
+
+    if(!heatmap)
+    {
+        chip8_release(&vm);
+        return false;
+    }
+
+    const Chip8Trace trace = {.heatmap = heatmap, .breakpoints = NULL};
+    vm.speed = 8;
+    chip8_step_traced(&vm, &trace);
+
+    bool is_match = true;
+
+    for(uint32_t address = 0; address < CHIP8_RAM_SIZE; ++address)
+    {
+        // The jump runs three times, every other instruction once
+        const uint32_t executes = address >= 0x200 && address < 0x20A ? HEATMAP_HIT : address >= 0x20A && address < 0x20C ? 3 * HEATMAP_HIT : 0;
+        const uint32_t reads = address == 0x300 || address == 0x301 ? 2 * HEATMAP_HIT : 0;
+        const uint32_t writes = address >= 0x300 && address < 0x303 ? HEATMAP_HIT : 0;
+        is_match = is_match && heatmap->executes[address] == (executes > 255 ? 255 : executes)
+            && heatmap->reads[address] == reads && heatmap->writes[address] == writes;
+    }
+
+    // A byte touched once is gone within a couple of seconds
+    for(uint32_t frame = 0; frame < 120; ++frame)
+    {
+        heatmap_decay(heatmap);
+    }
+
+    for(uint32_t address = 0; address < CHIP8_RAM_SIZE; ++address)
+    {
+        is_match = is_match && heatmap->reads[address] == 0 && heatmap->writes[address] == 0;
+    }
+
+    heatmap_destroy(heatmap);
+    chip8_release(&vm);
+    return is_match;
+}
+
+static bool heatmap_rom(const char* path, const uint32_t frames, HeatmapStats* stats)
+{
+    Chip8 plain = {0};
+    Chip8 traced = {0};
+    chip8_reset(&plain, HEATMAP_SEED);
+
+    if(!chip8_load_rom_file(&plain, path))
+    {
+        chip8_release(&plain);
+        return false;
+    }
+
+    chip8_copy(&traced, &plain);
+    Heatmap* heatmap = heatmap_create();
+    const Chip8Trace trace = {.heatmap = heatmap, .breakpoints = NULL};
+    uint32_t rng = HEATMAP_SEED;
+
+    for(uint32_t frame = 0; frame < frames && heatmap; ++frame)
+    {
+        if(frame % HEATMAP_HOLD_FRAMES == 0)
+        {
+            rng = rng * 1664525u + 1013904223u;
+            plain.keys = (uint16_t)(1u << (rng >> 28));
+            plain.keys_pressed = plain.keys;
+            traced.keys = plain.keys;
+            traced.keys_pressed = plain.keys;
+        }
+
+        chip8_step(&plain);
+        chip8_step_traced(&traced, &trace);
+        heatmap_decay(heatmap);
+        stats->mismatches += !heatmap_same(&plain, &traced);
+        ++stats->frames;
+    }
+
+    // Timed apart from the comparison, at a speed that makes the frames long enough to time
+    plain.speed = HEATMAP_TIMED_SPEED;
+    traced.speed = HEATMAP_TIMED_SPEED;
+
+    for(uint32_t frame = 0; frame < HEATMAP_TIMED_FRAMES && heatmap; ++frame)
+    {
+        const uint64_t start = timing_now_ns();
+        chip8_step(&plain);
+        const uint64_t middle = timing_now_ns();
+        chip8_step_traced(&traced, &trace);
+        stats->traced_ns += timing_now_ns() - middle;
+        stats->plain_ns += middle - start;
+        stats->instructions += plain.executed;
+    }
+
+    heatmap_destroy(heatmap);
+    chip8_release(&plain);
+    chip8_release(&traced);
+    return true;
+}
+
+static bool heatmap_same(const Chip8* a, const Chip8* b)
+{
+    uint8_t ram_a[CHIP8_RAM_SIZE];
+    uint8_t ram_b[CHIP8_RAM_SIZE];
+    chip8_read_range(a, 0, ram_a, sizeof(ram_a));
+    chip8_read_range(b, 0, ram_b, sizeof(ram_b));
+
+    return memcmp(ram_a, ram_b, sizeof(ram_a)) == 0
+        && memcmp(a->v, b->v, sizeof(a->v)) == 0
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && memcmp(a->display, b->display, sizeof(a->display)) == 0
+        && a->index == b->index && a->pc == b->pc && a->sp == b->sp
+        && a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer
+        && a->rng == b->rng && a->executed == b->executed
+        && a->halted == b->halted && a->paused == b->paused;
+}
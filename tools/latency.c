@@ -0,0 +1,271 @@
+// Headless input to photon latency.
+//
+// Plays each ROM with scripted key presses against a synthetic clock: presses happen
+// at random times between frames, are polled at the next frame, the frame's emulation
+// takes a fixed time and the result is presented at the next vsync. The same counters
+// as the frontend produce p50/p95/p99 per stage. In update mode the percentiles are
+// written to the golden file, otherwise a ROM fails if any got worse.
+//
+//   chip8-latency [--golden FILE] [--frames N] [--ahead N] [--csv FILE] [rom...]
+//   chip8-latency --update [--golden FILE] rom...
+
+#include "chip8.h"
+#include "latency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LATENCY_FRAME_NS 16666667ull
+// Synthetic time the emulation of a frame takes before it is drawn
+#define LATENCY_EMULATION_NS 1000000ull
+#define LATENCY_MAX_ROMS 64
+#define LATENCY_MAX_PATH 256
+#define LATENCY_CAPACITY 4096
+
+typedef struct LatencyGolden
+{
+    char path[LATENCY_MAX_PATH];
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+} LatencyGolden;
+
+static bool latency_run(const char* rom_path, uint32_t frames, uint32_t ahead, const char* csv_path, LatencySummary* summary);
+static uint32_t latency_random(uint32_t* state);
+static uint32_t latency_read_golden(const char* golden_path, LatencyGolden* golden);
+
+int main(int argc, char** argv)
+{
+    const char* golden_path = "tests/latency.txt";
+    const char* csv_path = NULL;
+    bool update = false;
+    uint32_t frames = 3600;
+    uint32_t ahead = 0;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if(strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+        {
+            golden_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--ahead") == 0 && i + 1 < argc)
+        {
+            ahead = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+        {
+            csv_path = argv[++i];
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    static LatencyGolden golden[LATENCY_MAX_ROMS];
+    uint32_t golden_count = update ? 0 : latency_read_golden(golden_path, golden);
+
+    if(!update && golden_count == 0)
+    {
+        fprintf(stderr, "Failed to read golden file %s\n", golden_path);
+        return 2;
+    }
+
+    // Without ROMs the golden file gives the list
+    const uint32_t run_count = rom_count > 0 ? (uint32_t)rom_count : golden_count;
+    FILE* out = update ? fopen(golden_path, "w") : NULL;
+    uint32_t failures = 0;
+
+    if(update)
+    {
+        if(!out)
+        {
+            fprintf(stderr, "Failed to write golden file %s\n", golden_path);
+            return 2;
+        }
+
+        fprintf(out, "# chip8-latency golden input to photon ms: <p50> <p95> <p99> <rom>\n");
+    }
+
+    for(uint32_t i = 0; i < run_count; ++i)
+    {
+        const char* rom_path = rom_count > 0 ? argv[i] : golden[i].path;
+        LatencySummary summary;
+
+        if(!latency_run(rom_path, frames, ahead, csv_path, &summary))
+        {
+            fprintf(stderr, "Failed to load %s\n", rom_path);
+            ++failures;
+            continue;
+        }
+
+        printf("%s: %u presses, %u unanswered, total p50 %.2f p95 %.2f p99 %.2f ms "
+            "(polling p95 %.2f, emulation p95 %.2f, present p95 %.2f)\n",
+            rom_path, summary.events, summary.unanswered, summary.total.p50_ms, summary.total.p95_ms, summary.total.p99_ms,
+            summary.polling.p95_ms, summary.emulation.p95_ms, summary.present.p95_ms);
+
+        if(update)
+        {
+            fprintf(out, "%.3f %.3f %.3f %s\n", summary.total.p50_ms, summary.total.p95_ms, summary.total.p99_ms, rom_path);
+            continue;
+        }
+
+        const LatencyGolden* expected = NULL;
+
+        for(uint32_t j = 0; j < golden_count && !expected; ++j)
+        {
+            expected = strcmp(golden[j].path, rom_path) == 0 ? &golden[j] : NULL;
+        }
+
+        // The clock is synthetic, so any increase is a regression and not noise
+        if(expected && (summary.total.p50_ms > expected->p50_ms + 0.001 ||
+            summary.total.p95_ms > expected->p95_ms + 0.001 || summary.total.p99_ms > expected->p99_ms + 0.001))
+        {
+            printf("  FAIL latency regressed from p50 %.2f p95 %.2f p99 %.2f ms\n", expected->p50_ms, expected->p95_ms, expected->p99_ms);
+            ++failures;
+        }
+    }
+
+    if(out)
+    {
+        fclose(out);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+static bool latency_run(const char* rom_path, const uint32_t frames, const uint32_t ahead, const char* csv_path, LatencySummary* summary)
+{
+    static Chip8 vm;
+    static Chip8 scratch;
+    chip8_reset(&vm, 0);
+
+    if(!chip8_load_rom_file(&vm, rom_path))
+    {
+        return false;
+    }
+
+    LatencyTracker* tracker = latency_create(LATENCY_CAPACITY);
+
+    if(!tracker)
+    {
+        chip8_release(&vm);
+        return false;
+    }
+
+    uint32_t shown[CHIP8_DISPLAY_COLUMNS];
+    uint32_t previous[CHIP8_DISPLAY_COLUMNS];
+    memcpy(previous, vm.display, sizeof(previous));
+
+    uint32_t rng = 0x2545F491;
+    uint16_t keys = 0;
+    uint16_t keys_seen = 0;
+    uint32_t hold = 10;
+
+    for(uint32_t frame = 0; frame < frames && !vm.halted; ++frame)
+    {
+        const uint64_t poll = (uint64_t)frame * LATENCY_FRAME_NS;
+
+        // Alternate between pressing a key the game reads and letting go
+        if(--hold == 0)
+        {
+            if(keys == 0)
+            {
+                const uint16_t candidates = keys_seen != 0 ? keys_seen : 0xFFFF;
+                uint32_t key = latency_random(&rng) % 16;
+
+                while(!((candidates >> key) & 1))
+                {
+                    key = (key + 1) % 16;
+                }
+
+                keys = (uint16_t)(1u << key);
+                // Pressed some time since the last poll
+                latency_key_down(tracker, (uint8_t)key, poll - latency_random(&rng) % LATENCY_FRAME_NS);
+                hold = 4 + latency_random(&rng) % 12;
+            }
+            else
+            {
+                keys = 0;
+                hold = 4 + latency_random(&rng) % 20;
+            }
+        }
+
+        latency_frame_start(tracker, poll);
+        vm.keys_pressed = keys & (uint16_t)~vm.keys;
+        vm.keys = keys;
+        chip8_step(&vm);
+        keys_seen |= vm.keys_read;
+        chip8_run_ahead(&vm, &scratch, ahead > 0 ? CHIP8_RUNAHEAD_SINGLE : CHIP8_RUNAHEAD_OFF, ahead, shown);
+
+        const bool changed = memcmp(previous, shown, sizeof(shown)) != 0;
+        memcpy(previous, shown, sizeof(previous));
+        latency_frame_end(tracker, keys, vm.keys_read, vm.key_read_pc, changed, poll + LATENCY_EMULATION_NS);
+        latency_present(tracker, poll + LATENCY_FRAME_NS);
+    }
+
+    latency_summarize(tracker, summary);
+
+    if(csv_path && !latency_write_csv(tracker, csv_path))
+    {
+        fprintf(stderr, "Failed to write %s\n", csv_path);
+    }
+
+    latency_destroy(tracker);
+    chip8_release(&vm);
+    chip8_release(&scratch);
+    return true;
+}
+
+static uint32_t latency_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t latency_read_golden(const char* golden_path, LatencyGolden* golden)
+{
+    FILE* file = fopen(golden_path, "r");
+
+    if(!file)
+    {
+        return 0;
+    }
+
+    char line[LATENCY_MAX_PATH + 64];
+    uint32_t count = 0;
+
+    while(count < LATENCY_MAX_ROMS && fgets(line, sizeof(line), file))
+    {
+        LatencyGolden* entry = &golden[count];
+
+        if(line[0] == '#' || sscanf(line, "%lf %lf %lf %255[^\n]", &entry->p50_ms, &entry->p95_ms, &entry->p99_ms, entry->path) != 4)
+        {
+            continue;
+        }
+
+        ++count;
+    }
+
+    fclose(file);
+    return count;
+}
@@ -0,0 +1,116 @@
+// Logger capture check.
+//
+// Logs through the asynchronous logger into a file with stdout off: a line before, one
+// call with two string arguments longer than a record holds, and a line after. The
+// long call must come out with its first string cut short and marked truncated, and the
+// lines around it intact, so the strings never spill into the next queue cell.
+//
+//   chip8-logger [--log FILE]
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "logger.h"
+#include "monitor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGGER_CHECK_LENGTH 200
+#define LOGGER_CHECK_LINES 3
+
+static bool logger_check_lines(const char* path);
+static bool logger_is_long_line(const char* line);
+
+int main(int argc, char** argv)
+{
+    const char* path = "chip8-logger.log";
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+        {
+            path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: chip8-logger [--log FILE]\n");
+            return 2;
+        }
+    }
+
+    // The logger opens CHIP8_LOG_FILE when it starts, on the first call below
+#ifdef _WIN32
+    _putenv_s("CHIP8_LOG_FILE", path);
+#else
+    setenv("CHIP8_LOG_FILE", path, 1);
+#endif
+    logger_set_stdout(false);
+    logger_set_rate_limit(0);
+
+    char first[LOGGER_CHECK_LENGTH + 1];
+    char second[LOGGER_CHECK_LENGTH + 1];
+    memset(first, 'a', LOGGER_CHECK_LENGTH);
+    memset(second, 'b', LOGGER_CHECK_LENGTH);
+    first[LOGGER_CHECK_LENGTH] = '\0';
+    second[LOGGER_CHECK_LENGTH] = '\0';
+
+    static LoggerSite sites[LOGGER_CHECK_LINES];
+    logger_write(&sites[0], LOG_INFO, "before %d", 1);
+    logger_write(&sites[1], LOG_INFO, "long %s %s", first, second);
+    logger_write(&sites[2], LOG_INFO, "after %d %s", 2, "tail");
+    logger_shutdown();
+
+    if(!logger_check_lines(path))
+    {
+        printf("FAIL string arguments longer than a record do not come out cut short and marked\n");
+        return 1;
+    }
+
+    printf("%d lines logged, long string arguments truncated\n", LOGGER_CHECK_LINES);
+    return 0;
+}
+
+static bool logger_check_lines(const char* path)
+{
+    FILE* file = fopen(path, "r");
+
+    if(!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    char lines[LOGGER_CHECK_LINES + 1][1024];
+    uint32_t count = 0;
+
+    while(count <= LOGGER_CHECK_LINES && fgets(lines[count], sizeof(lines[count]), file))
+    {
+        printf("%.80s%s", lines[count], strlen(lines[count]) > 80 ? "...\n" : "");
+        ++count;
+    }
+
+    fclose(file);
+
+    return count == LOGGER_CHECK_LINES
+        && strcmp(lines[0], "INFO: before 1\n") == 0
+        && logger_is_long_line(lines[1])
+        && strcmp(lines[2], "INFO: after 2 tail\n") == 0;
+}
+
+// The first string keeps what fits and the second, with no room left, is empty
+static bool logger_is_long_line(const char* line)
+{
+    const char* prefix = "INFO: long ";
+    const size_t prefix_length = strlen(prefix);
+
+    if(strncmp(line, prefix, prefix_length) != 0)
+    {
+        return false;
+    }
+
+    const size_t kept = strspn(line + prefix_length, "a");
+    return kept > 0 && kept < LOGGER_CHECK_LENGTH && strcmp(line + prefix_length + kept, "  ...\n") == 0;
+}
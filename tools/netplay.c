@@ -0,0 +1,259 @@
+// Rollback netplay over loopback.
+//
+// Runs two peers in one process, each with its own machine and UDP socket, with
+// scripted keys for both players and a simulated network between them. Frames are
+// paced by a synthetic 60 Hz clock, so the run takes no real time. Both peers must
+// end in the state of a local run with the same keys, with no desync reported and
+// every rollback re-simulated within one frame. --desync starts the second peer with
+// another random seed, the check then passes only if the desync is detected.
+//
+//   chip8-netplay [--frames N] [--delay MS] [--jitter MS] [--loss PERCENT]
+//                 [--port BASE] [--desync] rom
+
+#include "netplay.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NETPLAY_FRAME_NS 16666667ull
+// Keys the two players use in two player Pong style ROMs
+#define NETPLAY_PLAYER0_KEYS ((1u << 0x1) | (1u << 0x4))
+#define NETPLAY_PLAYER1_KEYS ((1u << 0xC) | (1u << 0xD))
+
+static uint16_t netplay_script_keys(uint32_t player, uint32_t frame);
+static uint64_t netplay_local_run(const Chip8* start, uint32_t frames);
+static void netplay_print_stats(const char* name, const NetplayStats* stats);
+
+int main(int argc, char** argv)
+{
+    NetplayConfig config = {
+        .local_port = 47000,
+        .remote_host = "127.0.0.1",
+        .remote_port = 47001,
+        .local_player = 0,
+        .max_prediction = 0,
+        .delay_ms = 50,
+        .jitter_ms = 10,
+        .loss_percent = 5,
+        .seed = 1
+    };
+    const char* rom_path = NULL;
+    uint32_t frames = 600;
+    bool desync = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--delay") == 0 && i + 1 < argc)
+        {
+            config.delay_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--jitter") == 0 && i + 1 < argc)
+        {
+            config.jitter_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--loss") == 0 && i + 1 < argc)
+        {
+            config.loss_percent = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            config.local_port = (uint16_t)strtoul(argv[++i], NULL, 10);
+            config.remote_port = (uint16_t)(config.local_port + 1);
+        }
+        else if(strcmp(argv[i], "--desync") == 0)
+        {
+            desync = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            rom_path = argv[i];
+        }
+    }
+
+    if(!rom_path)
+    {
+        fprintf(stderr, "Usage: chip8-netplay [options] rom\n");
+        return 2;
+    }
+
+    static Chip8 start;
+    static Chip8 machines[2];
+    chip8_reset(&start, 0);
+
+    if(!chip8_load_rom_file(&start, rom_path))
+    {
+        fprintf(stderr, "Failed to load %s\n", rom_path);
+        return 2;
+    }
+
+    NetplaySession* peers[2] = {NULL, NULL};
+
+    for(uint32_t i = 0; i < 2; ++i)
+    {
+        NetplayConfig peer = config;
+        peer.local_player = (uint8_t)i;
+        peer.local_port = i == 0 ? config.local_port : config.remote_port;
+        peer.remote_port = i == 0 ? config.remote_port : config.local_port;
+        peers[i] = netplay_create(&peer);
+
+        if(!peers[i])
+        {
+            fprintf(stderr, "Failed to open UDP port %u\n", peer.local_port);
+            netplay_destroy(peers[0]);
+            return 2;
+        }
+
+        chip8_copy(&machines[i], &start);
+    }
+
+    if(desync)
+    {
+        machines[1].rng ^= 0x5A5A5A5Au;
+    }
+
+    // Each tick both peers try to run their next frame, then keep polling until
+    // every input has been confirmed on both sides
+    uint64_t now = 0;
+    uint32_t frame[2] = {0, 0};
+    uint32_t ticks = 0;
+    const uint32_t max_ticks = frames * 4 + 600;
+
+    while((netplay_confirmed_frames(peers[0]) < frames || netplay_confirmed_frames(peers[1]) < frames) && ticks < max_ticks)
+    {
+        for(uint32_t i = 0; i < 2; ++i)
+        {
+            if(frame[i] < frames)
+            {
+                if(netplay_advance(peers[i], &machines[i], netplay_script_keys(i, frame[i]), now))
+                {
+                    ++frame[i];
+                }
+            }
+            else
+            {
+                netplay_poll(peers[i], &machines[i], now);
+            }
+
+        }
+
+        now += NETPLAY_FRAME_NS;
+        ++ticks;
+    }
+
+    // Let the last hashes reach the other side
+    for(uint32_t tick = 0; tick < 60; ++tick)
+    {
+        netplay_poll(peers[0], &machines[0], now);
+        netplay_poll(peers[1], &machines[1], now);
+        now += NETPLAY_FRAME_NS;
+    }
+
+    NetplayStats stats[2];
+    netplay_get_stats(peers[0], &stats[0]);
+    netplay_get_stats(peers[1], &stats[1]);
+    netplay_print_stats("peer 0", &stats[0]);
+    netplay_print_stats("peer 1", &stats[1]);
+
+    const uint64_t expected = netplay_local_run(&start, frames);
+    const uint64_t hashes[2] = {netplay_state_hash(&machines[0]), netplay_state_hash(&machines[1])};
+    const bool converged = frame[0] == frames && frame[1] == frames && hashes[0] == expected && hashes[1] == expected;
+    const uint64_t desyncs = stats[0].desyncs + stats[1].desyncs;
+    const uint64_t max_rollback_ns = stats[0].max_rollback_ns > stats[1].max_rollback_ns ? stats[0].max_rollback_ns : stats[1].max_rollback_ns;
+    int result = 0;
+
+    printf("%s: %u frames in %u ticks, local run %016llx, peers %016llx %016llx\n", rom_path, frames, ticks,
+        (unsigned long long)expected, (unsigned long long)hashes[0], (unsigned long long)hashes[1]);
+
+    if(desync)
+    {
+        // A desynced run passes when the peers caught it
+        if(desyncs > 0)
+        {
+            printf("desync detected at frame %u\n", stats[0].desyncs > 0 ? stats[0].desync_frame : stats[1].desync_frame);
+        }
+        else
+        {
+            printf("FAIL the desync was not detected\n");
+            result = 1;
+        }
+    }
+    else if(!converged || desyncs > 0)
+    {
+        printf("FAIL peers did not end in the state of the local run\n");
+        result = 1;
+    }
+    else if(max_rollback_ns > NETPLAY_FRAME_NS)
+    {
+        printf("FAIL a rollback took %.2f ms, longer than a frame\n", (double)max_rollback_ns / 1e6);
+        result = 1;
+    }
+    else
+    {
+        printf("peers match the local run\n");
+    }
+
+    netplay_destroy(peers[0]);
+    netplay_destroy(peers[1]);
+    chip8_release(&machines[0]);
+    chip8_release(&machines[1]);
+    chip8_release(&start);
+    return result;
+}
+
+// Each player holds one of their keys or none, changing every few frames
+static uint16_t netplay_script_keys(const uint32_t player, const uint32_t frame)
+{
+    const uint32_t key[2] = {player, frame / 7};
+    const uint64_t hash = hash_fnv1a64(key, sizeof(key), HASH_FNV1A64_SEED);
+    const uint16_t keys = (uint16_t)(player == 0 ? NETPLAY_PLAYER0_KEYS : NETPLAY_PLAYER1_KEYS);
+    const uint16_t low = keys & (uint16_t)-keys;
+
+    switch(hash % 3)
+    {
+        case 0: return 0;
+        case 1: return low;
+        default: return keys & (uint16_t)~low;
+    }
+}
+
+static uint64_t netplay_local_run(const Chip8* start, const uint32_t frames)
+{
+    static Chip8 vm;
+    chip8_copy(&vm, start);
+    uint16_t held = 0;
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        const uint16_t keys = netplay_script_keys(0, frame) | netplay_script_keys(1, frame);
+        vm.keys = keys;
+        vm.keys_pressed = keys & (uint16_t)~held;
+        held = keys;
+        chip8_step(&vm);
+    }
+
+    const uint64_t hash = netplay_state_hash(&vm);
+    chip8_release(&vm);
+    return hash;
+}
+
+static void netplay_print_stats(const char* name, const NetplayStats* stats)
+{
+    printf("%s: %llu frames, %llu stalls, %llu rollbacks, %llu frames re-simulated (max %u, %.3f ms), "
+        "%llu packets sent, %llu received, %llu dropped, %llu hashes compared, %llu desyncs\n",
+        name, (unsigned long long)stats->frames, (unsigned long long)stats->stalls, (unsigned long long)stats->rollbacks,
+        (unsigned long long)stats->resimulated_frames, stats->max_rollback_frames, (double)stats->max_rollback_ns / 1e6,
+        (unsigned long long)stats->packets_sent, (unsigned long long)stats->packets_received,
+        (unsigned long long)stats->packets_dropped, (unsigned long long)stats->hashes_compared,
+        (unsigned long long)stats->desyncs);
+}
@@ -0,0 +1,225 @@
+// Search agent driver.
+//
+// Lets the beam search agent play a ROM for a number of frames and reports the
+// score, nodes searched per second and the cost of forking a machine. --out records
+// the game to a GIF for attract mode demos. --check plays again on one worker and
+// the keys chosen every frame must match.
+//
+//   chip8-play [--frames N] [--beam N] [--depth N] [--hold N] [--threads N]
+//              [--out demo.gif] [--check] rom
+
+#include "agent.h"
+#include "env.h"
+#include "hash.h"
+#include "recorder.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAY_FORK_SAMPLES 100000
+
+typedef struct PlayRun
+{
+    uint64_t keys_hash;
+    uint64_t nodes;
+    uint64_t search_ns;
+    int32_t score;
+    bool done;
+} PlayRun;
+
+static bool play_run(const AgentConfig* config, const Chip8* start, uint32_t frames, const char* out_path, PlayRun* run);
+static double play_fork_ns(const Chip8* vm);
+
+int main(int argc, char** argv)
+{
+    AgentConfig config = {
+        .beam_width = 8,
+        .depth = 4,
+        .hold_frames = 4,
+        .threads = 0,
+        .score = NULL,
+        .score_address = 0
+    };
+    const char* rom_path = NULL;
+    const char* out_path = NULL;
+    uint32_t frames = 600;
+    bool check = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--beam") == 0 && i + 1 < argc)
+        {
+            config.beam_width = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+        {
+            config.depth = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--hold") == 0 && i + 1 < argc)
+        {
+            config.hold_frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            config.threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "--check") == 0)
+        {
+            check = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            rom_path = argv[i];
+        }
+    }
+
+    if(!rom_path)
+    {
+        fprintf(stderr, "Usage: chip8-play [options] rom\n");
+        return 2;
+    }
+
+    static Chip8 start;
+    chip8_reset(&start, 0);
+
+    if(!chip8_load_rom_file(&start, rom_path))
+    {
+        fprintf(stderr, "Failed to load %s\n", rom_path);
+        return 2;
+    }
+
+    config.score_address = chip8_env_score_address(rom_path);
+
+    PlayRun run;
+
+    if(!play_run(&config, &start, frames, out_path, &run))
+    {
+        return 2;
+    }
+
+    const double seconds = (double)run.search_ns / 1e9;
+    printf("%s: %u frames, score %d%s, %llu nodes, %.0f nodes/s, fork %.0f ns\n", rom_path, frames, run.score,
+        run.done ? " (game over)" : "", (unsigned long long)run.nodes, (double)run.nodes / (seconds > 0.0 ? seconds : 1e-9),
+        play_fork_ns(&start));
+
+    int result = 0;
+
+    if(check)
+    {
+        PlayRun single;
+        config.threads = 1;
+
+        if(!play_run(&config, &start, frames, NULL, &single))
+        {
+            result = 2;
+        }
+        else if(single.keys_hash != run.keys_hash)
+        {
+            printf("FAIL single worker run chose different keys\n");
+            result = 1;
+        }
+        else
+        {
+            printf("single worker run matches\n");
+        }
+    }
+
+    chip8_release(&start);
+    return result;
+}
+
+static bool play_run(const AgentConfig* config, const Chip8* start, const uint32_t frames, const char* out_path, PlayRun* run)
+{
+    Agent* agent = agent_create(config);
+
+    if(!agent)
+    {
+        fprintf(stderr, "Failed to create the agent\n");
+        return false;
+    }
+
+    Recorder* recorder = NULL;
+
+    if(out_path)
+    {
+        const RecorderConfig recorder_config = {
+            .path = out_path,
+            .format = RECORDER_GIF,
+            .scale = 4,
+            .capacity = 0,
+            .wait_when_full = true
+        };
+        recorder = recorder_open(&recorder_config);
+    }
+
+    static Chip8 vm;
+    chip8_copy(&vm, start);
+    memset(run, 0, sizeof(*run));
+    run->keys_hash = HASH_FNV1A64_SEED;
+
+    for(uint32_t frame = 0; frame < frames && !run->done; ++frame)
+    {
+        AgentStats stats;
+        const uint16_t keys = agent_choose(agent, &vm, &stats);
+        run->nodes += stats.nodes;
+        run->search_ns += stats.elapsed_ns;
+        run->keys_hash = hash_fnv1a64(&keys, sizeof(keys), run->keys_hash);
+
+        vm.keys_pressed = keys & (uint16_t)~vm.keys;
+        vm.keys = keys;
+        chip8_step(&vm);
+        run->done = chip8_env_default_done(&vm);
+
+        if(recorder)
+        {
+            recorder_push(recorder, vm.display);
+        }
+    }
+
+    run->score = config->score_address != 0 ? chip8_env_bcd_at(&vm, config->score_address) : 0;
+
+    if(recorder)
+    {
+        RecorderStats recorder_stats;
+
+        if(!recorder_close(recorder, &recorder_stats))
+        {
+            fprintf(stderr, "Failed to write %s\n", out_path);
+        }
+    }
+
+    chip8_release(&vm);
+    agent_destroy(agent);
+    return true;
+}
+
+static double play_fork_ns(const Chip8* vm)
+{
+    static Chip8 forks[2];
+    const uint64_t start = timing_now_ns();
+
+    for(uint32_t i = 0; i < PLAY_FORK_SAMPLES; ++i)
+    {
+        chip8_copy(&forks[i & 1], vm);
+    }
+
+    const uint64_t elapsed = timing_now_ns() - start;
+    chip8_release(&forks[0]);
+    chip8_release(&forks[1]);
+    return (double)elapsed / PLAY_FORK_SAMPLES;
+}
@@ -0,0 +1,339 @@
+// Plugin host check.
+//
+// Loads the plugins of a directory, which must hold the example plugin alone, the way
+// the frontend does. Runs a short program and checks the entry point and draw hooks
+// fire exactly as often as those instructions run. Then runs each ROM with changing
+// keys on the plain interpreter and on the hooked one side by side, fails if the
+// machines ever differ or the frame, ROM, halt and key counts the plugin logs are off,
+// and prints the time per instruction of both, what the instruction hooks cost. With
+// --stale, also checks the plugins of that directory, built against another ABI
+// version, are refused.
+//
+//   chip8-plugin --plugins DIR [--stale DIR] [--frames N] rom...
+
+#include "plugin.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLUGIN_SEED 1
+#define PLUGIN_HOLD_FRAMES 20
+#define PLUGIN_TIMED_SPEED 1000
+#define PLUGIN_TIMED_FRAMES 200
+#define PLUGIN_LOOPS 10
+
+// What the example plugin logs when it unloads
+typedef struct PluginCounts
+{
+    unsigned long long frames;
+    unsigned long long roms;
+    unsigned long long halts;
+    unsigned long long key_downs;
+    unsigned long long key_ups;
+    unsigned long long entries;
+    unsigned long long draws;
+    unsigned lit;
+} PluginCounts;
+
+typedef struct PluginStats
+{
+    PluginCounts expected;
+    uint64_t mismatches;
+    uint64_t instructions;
+    uint64_t plain_ns;
+    uint64_t hooked_ns;
+} PluginStats;
+
+static PluginHost* plugin_open(const char* path);
+static bool plugin_close(PluginHost* host, PluginCounts* counts);
+static bool plugin_check_hits(const char* path);
+static bool plugin_check_stale(const char* path);
+static bool plugin_rom(PluginHost* host, const char* path, uint32_t frames, PluginStats* stats);
+static bool plugin_same(const Chip8* a, const Chip8* b);
+static void plugin_capture_log(const char* name, const char* text);
+
+static char s_last_log[256];
+
+int main(int argc, char** argv)
+{
+    const char* directory = NULL;
+    const char* stale = NULL;
+    uint32_t frames = 600;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--plugins") == 0 && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else if(strcmp(argv[i], "--stale") == 0 && i + 1 < argc)
+        {
+            stale = argv[++i];
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(!directory || rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-plugin --plugins DIR [--stale DIR] [--frames N] rom...\n");
+        return 2;
+    }
+
+    int result = 0;
+
+    if(!plugin_check_hits(directory))
+    {
+        printf("FAIL the instruction hooks do not fire where the test program runs them\n");
+        result = 1;
+    }
+
+    if(stale && !plugin_check_stale(stale))
+    {
+        printf("FAIL a plugin built against another ABI version was loaded\n");
+        result = 1;
+    }
+
+    PluginHost* host = plugin_open(directory);
+
+    if(!host)
+    {
+        return 2;
+    }
+
+    PluginStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        if(!plugin_rom(host, argv[i], frames, &stats))
+        {
+            fprintf(stderr, "Failed to load %s\n", argv[i]);
+            plugin_host_destroy(host);
+            return 2;
+        }
+    }
+
+    PluginCounts counts;
+
+    if(!plugin_close(host, &counts))
+    {
+        return 2;
+    }
+
+    const PluginCounts* expected = &stats.expected;
+    const bool is_counted = counts.frames == expected->frames && counts.roms == expected->roms
+        && counts.halts == expected->halts && counts.key_downs == expected->key_downs && counts.key_ups == expected->key_ups;
+    const double instructions = (double)(stats.instructions > 0 ? stats.instructions : 1);
+    printf("%llu frames, %llu ROMs, %llu halts, %llu keys down, %llu up, %llu entries, %llu draws\n",
+        counts.frames, counts.roms, counts.halts, counts.key_downs, counts.key_ups, counts.entries, counts.draws);
+    printf("%llu mismatched, plain %.2f ns per instruction, hooked %.2f ns per instruction\n",
+        (unsigned long long)stats.mismatches, (double)stats.plain_ns / instructions, (double)stats.hooked_ns / instructions);
+
+    if(!is_counted)
+    {
+        printf("FAIL expected %llu frames, %llu ROMs, %llu halts, %llu keys down, %llu up\n", expected->frames,
+            expected->roms, expected->halts, expected->key_downs, expected->key_ups);
+        result = 1;
+    }
+
+    if(stats.mismatches > 0)
+    {
+        printf("FAIL the hooked interpreter does not run the ROMs the same\n");
+        result = 1;
+    }
+
+    return result;
+}
+
+static PluginHost* plugin_open(const char* path)
+{
+    PluginHost* host = plugin_host_create(plugin_capture_log);
+
+    if(!host || plugin_load_directory(host, path) != 1 || !plugin_breakpoints(host))
+    {
+        fprintf(stderr, "Failed to load the example plugin from %s\n", path);
+        plugin_host_destroy(host);
+        return NULL;
+    }
+
+    return host;
+}
+
+// Unloads the plugin and reads back the counts it logs on the way out
+static bool plugin_close(PluginHost* host, PluginCounts* counts)
+{
+    s_last_log[0] = '\0';
+    plugin_host_destroy(host);
+
+    if(sscanf(s_last_log, "frames %llu roms %llu halts %llu keys %llu down %llu up entries %llu draws %llu lit %u",
+        &counts->frames, &counts->roms, &counts->halts, &counts->key_downs, &counts->key_ups, &counts->entries,
+        &counts->draws, &counts->lit) != 8)
+    {
+        fprintf(stderr, "The example plugin did not log its counts\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Passes the entry point PLUGIN_LOOPS times, then draws the top row of the 0 glyph and waits in place
+static bool plugin_check_hits(const char* path)
+{
+    static const uint8_t Program[] = {
+        0x70, 0x01, // ADD V0, 1
+        0x30, 0x0A, // SE V0, 10
+        0x12, 0x00, // JP 0x200
+        0xD0, 0x11, // DRW V0, V1, 1
+        0x12, 0x08, // JP 0x208
+    };
+
+    PluginHost* host = plugin_open(path);
+
+    if(!host)
+    {
+        return false;
+    }
+
+    Chip8 vm = {0};
+    chip8_reset(&vm, PLUGIN_SEED);
+
+    for(uint16_t i = 0; i < sizeof(Program); ++i)
+    {
+        chip8_write(&vm, (uint16_t)(0x200 + i), Program[i]);
+    }
+
+    plugin_rom_loaded(host, &vm, "test program");
+    const Chip8Trace trace = {.heatmap = NULL, .breakpoints = plugin_breakpoints(host)};
+
+    for(uint32_t frame = 0; frame < 4; ++frame)
+    {
+        chip8_step_traced(&vm, &trace);
+        plugin_frame_end(host, &vm);
+    }
+
+    chip8_release(&vm);
+    PluginCounts counts;
+    return plugin_close(host, &counts) && counts.entries == PLUGIN_LOOPS && counts.draws == 1 && counts.frames == 4
+        && counts.lit == 4;
+}
+
+// Loads nothing from the directory and logs why
+static bool plugin_check_stale(const char* path)
+{
+    PluginHost* host = plugin_host_create(plugin_capture_log);
+
+    if(!host)
+    {
+        return false;
+    }
+
+    s_last_log[0] = '\0';
+    const uint32_t loaded = plugin_load_directory(host, path);
+    plugin_host_destroy(host);
+    return loaded == 0 && strstr(s_last_log, "plugin ABI") != NULL;
+}
+
+static bool plugin_rom(PluginHost* host, const char* path, const uint32_t frames, PluginStats* stats)
+{
+    Chip8 plain = {0};
+    Chip8 hooked = {0};
+    chip8_reset(&plain, PLUGIN_SEED);
+
+    if(!chip8_load_rom_file(&plain, path))
+    {
+        chip8_release(&plain);
+        return false;
+    }
+
+    chip8_copy(&hooked, &plain);
+    plugin_rom_loaded(host, &hooked, path);
+    ++stats->expected.roms;
+
+    const Chip8Trace trace = {.heatmap = NULL, .breakpoints = plugin_breakpoints(host)};
+    uint32_t rng = PLUGIN_SEED;
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        if(frame % PLUGIN_HOLD_FRAMES == 0)
+        {
+            rng = rng * 1664525u + 1013904223u;
+            const uint16_t keys = (uint16_t)(1u << (rng >> 28));
+            stats->expected.key_downs += (keys & ~plain.keys) != 0;
+            stats->expected.key_ups += (plain.keys & ~keys) != 0;
+            plain.keys = keys;
+            plain.keys_pressed = keys;
+            hooked.keys = keys;
+            hooked.keys_pressed = keys;
+        }
+
+        const bool was_halted = plain.halted;
+        plugin_keys(host, &hooked);
+        chip8_step(&plain);
+        chip8_step_traced(&hooked, &trace);
+        plugin_frame_end(host, &hooked);
+        stats->mismatches += !plugin_same(&plain, &hooked);
+        stats->expected.halts += plain.halted && !was_halted;
+        ++stats->expected.frames;
+    }
+
+    // Timed apart from the comparison, at a speed that makes the frames long enough to time
+    plain.speed = PLUGIN_TIMED_SPEED;
+    hooked.speed = PLUGIN_TIMED_SPEED;
+
+    for(uint32_t frame = 0; frame < PLUGIN_TIMED_FRAMES; ++frame)
+    {
+        const bool was_halted = hooked.halted;
+        const uint64_t start = timing_now_ns();
+        chip8_step(&plain);
+        const uint64_t middle = timing_now_ns();
+        chip8_step_traced(&hooked, &trace);
+        plugin_frame_end(host, &hooked);
+        stats->hooked_ns += timing_now_ns() - middle;
+        stats->plain_ns += middle - start;
+        stats->instructions += plain.executed;
+        stats->expected.halts += hooked.halted && !was_halted;
+        ++stats->expected.frames;
+    }
+
+    chip8_release(&plain);
+    chip8_release(&hooked);
+    return true;
+}
+
+static bool plugin_same(const Chip8* a, const Chip8* b)
+{
+    uint8_t ram_a[CHIP8_RAM_SIZE];
+    uint8_t ram_b[CHIP8_RAM_SIZE];
+    chip8_read_range(a, 0, ram_a, sizeof(ram_a));
+    chip8_read_range(b, 0, ram_b, sizeof(ram_b));
+
+    return memcmp(ram_a, ram_b, sizeof(ram_a)) == 0
+        && memcmp(a->v, b->v, sizeof(a->v)) == 0
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && memcmp(a->display, b->display, sizeof(a->display)) == 0
+        && a->index == b->index && a->pc == b->pc && a->sp == b->sp
+        && a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer
+        && a->rng == b->rng && a->executed == b->executed
+        && a->halted == b->halted && a->paused == b->paused;
+}
+
+static void plugin_capture_log(const char* name, const char* text)
+{
+    printf("%s: %s\n", name, text);
+    snprintf(s_last_log, sizeof(s_last_log), "%s", text);
+}
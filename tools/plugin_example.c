@@ -0,0 +1,136 @@
+// Example plugin, the skeleton of an auto-splitter.
+//
+// Counts frames, ROM loads, halts and key presses, how often execution passes the entry
+// point and how many sprites are drawn, and logs the counts when it is unloaded. Halts
+// are logged with the bytes at the faulting address, read through the RAM view.
+//
+// Build it as a shared library against src/chip8_plugin.h alone and drop it into the
+// directory CHIP8_PLUGINS names.
+
+#include "chip8_plugin.h"
+
+#include <stdio.h>
+
+#define EXAMPLE_ENTRY_POINT 0x200
+
+typedef struct ExampleCounts
+{
+    unsigned long long frames;
+    unsigned long long roms;
+    unsigned long long halts;
+    unsigned long long key_downs;
+    unsigned long long key_ups;
+    unsigned long long entries;
+    unsigned long long draws;
+    // Most pixels lit in any frame
+    unsigned lit;
+} ExampleCounts;
+
+static void example_frame_end(const Chip8PluginView* view, void* user);
+static void example_rom_load(const Chip8PluginView* view, const char* path, void* user);
+static void example_halt(const Chip8PluginView* view, void* user);
+static void example_key(const Chip8PluginView* view, uint8_t key, bool is_down, void* user);
+static void example_entry(const Chip8PluginView* view, uint16_t instruction, void* user);
+static void example_draw(const Chip8PluginView* view, uint16_t instruction, void* user);
+
+static const Chip8PluginHost* s_host;
+static ExampleCounts s_counts;
+
+// Also built claiming another version, as the stale plugin the loader must refuse
+#ifdef EXAMPLE_ABI_VERSION
+CHIP8_PLUGIN_EXPORT const uint32_t chip8_plugin_abi_version = EXAMPLE_ABI_VERSION;
+#else
+CHIP8_PLUGIN_DEFINE_ABI_VERSION;
+#endif
+
+CHIP8_PLUGIN_EXPORT bool chip8_plugin_load(const Chip8PluginHost* host)
+{
+    if(host->abi_version != CHIP8_PLUGIN_ABI_VERSION || host->size < sizeof(Chip8PluginHost))
+    {
+        return false;
+    }
+
+    s_host = host;
+    s_counts = (ExampleCounts){0};
+    return host->on_frame_end(host->plugin, example_frame_end, &s_counts)
+        && host->on_rom_load(host->plugin, example_rom_load, &s_counts)
+        && host->on_halt(host->plugin, example_halt, &s_counts)
+        && host->on_key(host->plugin, example_key, &s_counts)
+        && host->on_pc(host->plugin, EXAMPLE_ENTRY_POINT, example_entry, &s_counts)
+        && host->on_opcode(host->plugin, 0xF000, 0xD000, example_draw, &s_counts);
+}
+
+CHIP8_PLUGIN_EXPORT void chip8_plugin_unload(void)
+{
+    char text[256];
+    snprintf(text, sizeof(text), "frames %llu roms %llu halts %llu keys %llu down %llu up entries %llu draws %llu lit %u",
+        s_counts.frames, s_counts.roms, s_counts.halts, s_counts.key_downs, s_counts.key_ups, s_counts.entries,
+        s_counts.draws, s_counts.lit);
+    s_host->log(s_host->plugin, text);
+}
+
+static void example_frame_end(const Chip8PluginView* view, void* user)
+{
+    ExampleCounts* counts = user;
+    unsigned lit = 0;
+
+    for(uint32_t column = 0; column < 64; ++column)
+    {
+        for(uint32_t bits = view->display[column]; bits; bits &= bits - 1)
+        {
+            ++lit;
+        }
+    }
+
+    counts->lit = lit > counts->lit ? lit : counts->lit;
+    ++counts->frames;
+}
+
+static void example_rom_load(const Chip8PluginView* view, const char* path, void* user)
+{
+    (void)view;
+    (void)path;
+    ++((ExampleCounts*)user)->roms;
+}
+
+static void example_halt(const Chip8PluginView* view, void* user)
+{
+    uint8_t bytes[2];
+    s_host->read_ram_range(view, view->fault_pc, bytes, sizeof(bytes));
+
+    char text[128];
+    snprintf(text, sizeof(text), "halted with fault %u at %03x on %02x%02x in frame %llu",
+        view->fault, view->fault_pc, bytes[0], bytes[1], (unsigned long long)view->frame);
+    s_host->log(s_host->plugin, text);
+    ++((ExampleCounts*)user)->halts;
+}
+
+static void example_key(const Chip8PluginView* view, const uint8_t key, const bool is_down, void* user)
+{
+    ExampleCounts* counts = user;
+    (void)view;
+    (void)key;
+
+    if(is_down)
+    {
+        ++counts->key_downs;
+    }
+    else
+    {
+        ++counts->key_ups;
+    }
+}
+
+static void example_entry(const Chip8PluginView* view, const uint16_t instruction, void* user)
+{
+    (void)view;
+    (void)instruction;
+    ++((ExampleCounts*)user)->entries;
+}
+
+static void example_draw(const Chip8PluginView* view, const uint16_t instruction, void* user)
+{
+    (void)view;
+    (void)instruction;
+    ++((ExampleCounts*)user)->draws;
+}
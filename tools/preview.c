@@ -0,0 +1,159 @@
+// Menu preview generation and cache check.
+//
+// Builds the previews of the given ROMs with the focus moving through them one by one,
+// as cycling the menu does, and checks the loaded loops never took more than the budget.
+// The previews are then built again from the cache files just written, which must all
+// be hits and play back the same frames.
+//
+//   chip8-preview --cache-dir DIR [--budget BYTES] [--radius N] rom...
+
+#include "preview.h"
+#include "chip8.h"
+#include "hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PREVIEW_TOOL_MAX_ROMS 256
+#define PREVIEW_TOOL_MAX_PATH 512
+
+static bool preview_pass(const PreviewConfig* config, const char* const* roms, uint32_t count, uint64_t* hashes, PreviewStats* stats);
+static uint64_t preview_loop_hash(PreviewCache* cache, uint32_t index, PreviewState* state);
+
+int main(int argc, char** argv)
+{
+    PreviewConfig config = {
+        .memory_budget = 0,
+        .radius = 0,
+        .cache_dir = NULL
+    };
+    const char* roms[PREVIEW_TOOL_MAX_ROMS];
+    uint32_t count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc)
+        {
+            config.cache_dir = argv[++i];
+        }
+        else if(strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+        {
+            config.memory_budget = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--radius") == 0 && i + 1 < argc)
+        {
+            config.radius = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else if(count < PREVIEW_TOOL_MAX_ROMS)
+        {
+            roms[count++] = argv[i];
+        }
+    }
+
+    if(!config.cache_dir || count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-preview --cache-dir DIR [--budget BYTES] [--radius N] rom...\n");
+        return 2;
+    }
+
+    // The first pass generates every preview
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const char* slash = strrchr(roms[i], '/');
+        char cache_path[PREVIEW_TOOL_MAX_PATH];
+        snprintf(cache_path, sizeof(cache_path), "%s/%s.preview", config.cache_dir, slash ? slash + 1 : roms[i]);
+        remove(cache_path);
+    }
+
+    static uint64_t generated[PREVIEW_TOOL_MAX_ROMS];
+    static uint64_t cached[PREVIEW_TOOL_MAX_ROMS];
+    PreviewStats first;
+    PreviewStats second;
+
+    if(!preview_pass(&config, roms, count, generated, &first) || !preview_pass(&config, roms, count, cached, &second))
+    {
+        fprintf(stderr, "Failed to start the preview worker\n");
+        return 2;
+    }
+
+    int failures = 0;
+    const size_t budget = config.memory_budget > 0 ? config.memory_budget : 512u * 1024u;
+    printf("generated %u, %u evicted, peak %zu of %zu bytes; from cache %u hits, %u generated, peak %zu bytes\n",
+        first.generated, first.evicted, first.memory_peak, budget, second.cache_hits, second.generated, second.memory_peak);
+
+    if(first.memory_peak > budget || second.memory_peak > budget)
+    {
+        printf("FAIL previews took more than the memory budget\n");
+        ++failures;
+    }
+
+    if(second.generated > 0)
+    {
+        printf("FAIL %u previews were generated again instead of read from the cache\n", second.generated);
+        ++failures;
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        if(generated[i] != cached[i])
+        {
+            printf("FAIL %s plays back different frames from the cache\n", roms[i]);
+            ++failures;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+static bool preview_pass(const PreviewConfig* config, const char* const* roms, const uint32_t count, uint64_t* hashes, PreviewStats* stats)
+{
+    PreviewCache* cache = preview_create(config, roms, count);
+
+    if(!cache)
+    {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        preview_focus(cache, i);
+        preview_wait(cache);
+        PreviewState state;
+        hashes[i] = preview_loop_hash(cache, i, &state);
+
+        if(state != PREVIEW_READY)
+        {
+            printf("  %s: %s\n", roms[i], state == PREVIEW_PENDING ? "still pending" : "no preview");
+        }
+    }
+
+    preview_get_stats(cache, stats);
+    preview_destroy(cache);
+    return true;
+}
+
+static uint64_t preview_loop_hash(PreviewCache* cache, const uint32_t index, PreviewState* state)
+{
+    uint64_t hash = HASH_FNV1A64_SEED;
+    uint32_t display[CHIP8_DISPLAY_COLUMNS];
+
+    for(uint64_t tick = 0; tick < PREVIEW_LOOP_FRAMES; ++tick)
+    {
+        *state = preview_frame(cache, index, tick, display);
+
+        if(*state != PREVIEW_READY)
+        {
+            return 0;
+        }
+
+        hash = hash_fnv1a64(display, sizeof(display), hash);
+    }
+
+    return hash;
+}
@@ -0,0 +1,220 @@
+// Headless recorder.
+//
+// Runs a ROM with an input script as fast as the encoder keeps up and writes the
+// display to a GIF or to a PNG or QOI image sequence, through the same recorder the
+// emulator uses.
+//
+//   chip8-record [--format gif|png|qoi] [--frames N] [--scale N] [--input script]
+//                [--out path] rom
+//
+// An input script holds one event per line, a frame number followed by keys to
+// press (+) or release (-) at the start of that frame. # starts a comment.
+//
+//   60 +5        press 5
+//   90 -5 +4     release 5, press 4
+
+#include "chip8.h"
+#include "recorder.h"
+#include "timing.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORD_MAX_EVENTS 4096
+
+typedef struct RecordEvent
+{
+    uint32_t frame;
+    uint16_t press;
+    uint16_t release;
+} RecordEvent;
+
+static uint32_t record_load_script(const char* path, RecordEvent* events);
+
+int main(int argc, char** argv)
+{
+    RecorderConfig config = {
+        .path = "capture.gif",
+        .format = RECORDER_GIF,
+        .scale = 4,
+        .capacity = 0,
+        .wait_when_full = true
+    };
+    const char* rom_path = NULL;
+    const char* script_path = NULL;
+    const char* out_path = NULL;
+    uint32_t frames = 600;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            if(!recorder_format_from_name(argv[++i], &config.format))
+            {
+                fprintf(stderr, "Unknown format %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+        {
+            config.scale = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            script_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            rom_path = argv[i];
+        }
+    }
+
+    if(!rom_path)
+    {
+        fprintf(stderr, "Usage: chip8-record [options] rom\n");
+        return 2;
+    }
+
+    // Sequences are named after the output prefix, so only GIFs default to a file name
+    config.path = out_path ? out_path : config.format == RECORDER_GIF ? "capture.gif" : "capture";
+
+    static RecordEvent events[RECORD_MAX_EVENTS];
+    const uint32_t event_count = script_path ? record_load_script(script_path, events) : 0;
+
+    if(event_count == UINT32_MAX)
+    {
+        return 2;
+    }
+
+    static Chip8 vm;
+    chip8_reset(&vm, 0);
+
+    if(!chip8_load_rom_file(&vm, rom_path))
+    {
+        fprintf(stderr, "Failed to load %s\n", rom_path);
+        return 2;
+    }
+
+    Recorder* recorder = recorder_open(&config);
+
+    if(!recorder)
+    {
+        return 2;
+    }
+
+    const uint64_t start = timing_now_ns();
+    uint32_t next_event = 0;
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        const uint16_t held = vm.keys;
+
+        for(; next_event < event_count && events[next_event].frame <= frame; ++next_event)
+        {
+            vm.keys = (uint16_t)((vm.keys | events[next_event].press) & ~events[next_event].release);
+        }
+
+        vm.keys_pressed = vm.keys & (uint16_t)~held;
+        chip8_step(&vm);
+        recorder_push(recorder, vm.display);
+    }
+
+    RecorderStats stats;
+    const bool ok = recorder_close(recorder, &stats);
+    const double seconds = (double)(timing_now_ns() - start) / 1e9;
+
+    printf("%s: %llu frames, %llu encoded, %.2f s, %.1fx real time\n", config.path,
+        (unsigned long long)stats.frames, (unsigned long long)stats.encoded, seconds,
+        (double)frames / 60.0 / (seconds > 0.0 ? seconds : 1e-9));
+
+    if(!ok)
+    {
+        fprintf(stderr, "Failed to write %s\n", config.path);
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint32_t record_load_script(const char* path, RecordEvent* events)
+{
+    FILE* script = fopen(path, "r");
+
+    if(!script)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return UINT32_MAX;
+    }
+
+    char line[256];
+    uint32_t count = 0;
+    uint32_t line_number = 0;
+
+    while(fgets(line, sizeof(line), script))
+    {
+        ++line_number;
+        char* comment = strchr(line, '#');
+
+        if(comment)
+        {
+            *comment = '\0';
+        }
+
+        char* token = strtok(line, " \t\r\n");
+
+        if(!token)
+        {
+            continue;
+        }
+
+        if(count == RECORD_MAX_EVENTS)
+        {
+            fprintf(stderr, "%s:%u: too many events\n", path, line_number);
+            fclose(script);
+            return UINT32_MAX;
+        }
+
+        RecordEvent* event = &events[count++];
+        event->frame = (uint32_t)strtoul(token, NULL, 10);
+        event->press = 0;
+        event->release = 0;
+
+        if(count > 1 && event->frame < events[count - 2].frame)
+        {
+            fprintf(stderr, "%s:%u: events must be in frame order\n", path, line_number);
+            fclose(script);
+            return UINT32_MAX;
+        }
+
+        while((token = strtok(NULL, " \t\r\n")))
+        {
+            if((token[0] != '+' && token[0] != '-') || !isxdigit((unsigned char)token[1]) || token[2] != '\0')
+            {
+                fprintf(stderr, "%s:%u: expected +K or -K with a hex key, got %s\n", path, line_number, token);
+                fclose(script);
+                return UINT32_MAX;
+            }
+
+            const uint16_t key = (uint16_t)(1 << strtoul(&token[1], NULL, 16));
+            *(token[0] == '+' ? &event->press : &event->release) |= key;
+        }
+    }
+
+    fclose(script);
+    return count;
+}
@@ -0,0 +1,706 @@
+// Golden framebuffer regression harness.
+//
+// Runs every ROM headlessly for a fixed number of frames with scripted input and
+// hashes the display at regular checkpoints. In update mode the hashes are written
+// to the golden file, otherwise they are compared against it. Without ROMs given,
+// every ROM in assets/rom and extras runs, and comparing fails for any the golden
+// file has no entry for.
+//
+// Batch mode runs each ROM as N lockstep lanes with staggered input next to N
+// scalar machines, checks every lane against its scalar twin each frame and
+// reports the throughput of both. It also runs a short program drawing at (VF, VF)
+// with VF different per lane the same way.
+//
+//   chip8-regress [--golden FILE] [--frames N] [--interval N] [--jobs N]
+//   chip8-regress --update [--golden FILE] [rom...]
+//   chip8-regress --batch N [--golden FILE] [--frames N] [rom...]
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "batch.h"
+#include "chip8.h"
+#include "hash.h"
+#include "pool.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#define REGRESS_MAX_ROMS 256
+#define REGRESS_MAX_CHECKPOINTS 128
+#define REGRESS_MAX_PATH 260
+
+typedef struct RomRun
+{
+    char path[REGRESS_MAX_PATH];
+    uint64_t expected[REGRESS_MAX_CHECKPOINTS];
+    uint64_t actual[REGRESS_MAX_CHECKPOINTS];
+    uint16_t checkpoint_pc[REGRESS_MAX_CHECKPOINTS];
+    uint32_t expected_count;
+    uint32_t fault_frame;
+    uint32_t mismatch_frame;
+    uint32_t mismatch_lane;
+    uint64_t batch_ns;
+    uint64_t scalar_ns;
+    uint64_t lockstep_instructions;
+    uint64_t scalar_instructions;
+    uint16_t fault_pc;
+    Chip8Fault fault;
+    bool loaded;
+    bool has_golden;
+} RomRun;
+
+static struct RegressContext
+{
+    RomRun* runs;
+    uint32_t run_count;
+    uint32_t frames;
+    uint32_t interval;
+    uint32_t lanes;
+} s_regress = {
+    .runs = NULL,
+    .run_count = 0,
+    .frames = 1200,
+    .interval = 60,
+    .lanes = 0
+};
+
+static const char* RomDirectories[] = {"assets/rom", "extras"};
+
+// Key order starts with the keys most games use for movement and fire
+static const uint8_t ScriptKeys[16] = {0x5, 0x4, 0x6, 0x2, 0x8, 0x7, 0x9, 0x1, 0x3, 0xA, 0x0, 0xB, 0xC, 0xD, 0xE, 0xF};
+
+static void regress_script_keys(uint32_t frame, uint16_t* keys, uint16_t* keys_pressed);
+static uint64_t regress_hash(const Chip8* vm);
+static void regress_run_rom(void* context, uint32_t index);
+static bool regress_same_state(const Chip8* a, const Chip8* b);
+static void regress_run_batch(void* context, uint32_t index);
+static bool regress_check_batch_vf_draw(uint32_t lanes);
+static uint32_t regress_report_batch(void);
+static RomRun* regress_find_or_add(const char* path);
+static bool regress_scan_directory(const char* directory);
+static bool regress_is_rom_name(const char* name);
+static bool regress_read_golden(const char* golden_path);
+static bool regress_write_golden(const char* golden_path);
+static uint32_t regress_report(void);
+
+int main(int argc, char** argv)
+{
+    const char* golden_path = "tests/golden.txt";
+    bool update = false;
+    uint32_t jobs = 0;
+
+    s_regress.runs = calloc(REGRESS_MAX_ROMS, sizeof(RomRun));
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if(strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+        {
+            golden_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            s_regress.frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+        {
+            s_regress.interval = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+        {
+            jobs = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            s_regress.lanes = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else if(!regress_find_or_add(argv[i]))
+        {
+            fprintf(stderr, "Too many ROMs, limit is %d\n", REGRESS_MAX_ROMS);
+            return 2;
+        }
+    }
+
+    if(s_regress.interval == 0 || s_regress.frames / s_regress.interval > REGRESS_MAX_CHECKPOINTS)
+    {
+        fprintf(stderr, "At most %d checkpoints are supported\n", REGRESS_MAX_CHECKPOINTS);
+        return 2;
+    }
+
+    const bool is_scanned = s_regress.run_count == 0;
+
+    // Batch mode takes its ROM list from the golden file unless ROMs are given
+    if(!update && (s_regress.lanes == 0 || is_scanned) && !regress_read_golden(golden_path))
+    {
+        return 2;
+    }
+
+    for(size_t i = 0; is_scanned && i < sizeof(RomDirectories) / sizeof(RomDirectories[0]); ++i)
+    {
+        if(!regress_scan_directory(RomDirectories[i]))
+        {
+            return 2;
+        }
+    }
+
+    ThreadPool* pool = pool_create(jobs);
+
+    if(!pool)
+    {
+        fprintf(stderr, "Failed to create the thread pool\n");
+        free(s_regress.runs);
+        return 2;
+    }
+
+    const uint64_t start = timing_now_ns();
+    pool_for(pool, s_regress.run_count, s_regress.lanes > 0 ? regress_run_batch : regress_run_rom, NULL);
+    const uint64_t elapsed = timing_now_ns() - start;
+    const uint32_t workers = pool_worker_count(pool);
+    pool_destroy(pool);
+
+    if(s_regress.lanes > 0)
+    {
+        uint32_t failures = regress_report_batch();
+
+        if(!regress_check_batch_vf_draw(s_regress.lanes))
+        {
+            printf("FAIL lanes drawing at (VF, VF) diverged from scalar\n");
+            ++failures;
+        }
+
+        printf("%u ROMs, %u lanes, %u frames each, %u workers, %.3f s, %u failed\n",
+            s_regress.run_count, s_regress.lanes, s_regress.frames, workers, (double)elapsed / 1e9, failures);
+        free(s_regress.runs);
+        return failures > 0 ? 1 : 0;
+    }
+
+    const uint32_t failures = update ? 0 : regress_report();
+
+    if(update && !regress_write_golden(golden_path))
+    {
+        return 2;
+    }
+
+    printf("%u ROMs, %u frames each, %u workers, %.3f s, %u failed\n",
+        s_regress.run_count, s_regress.frames, workers, (double)elapsed / 1e9, failures);
+
+    free(s_regress.runs);
+    return failures > 0 ? 1 : 0;
+}
+
+// Presses one key for 6 frames out of every 20, walking ScriptKeys, so menus
+// get past their key waits and games see some movement.
+static void regress_script_keys(const uint32_t frame, uint16_t* keys, uint16_t* keys_pressed)
+{
+    const uint32_t phase = frame % 20;
+    const uint8_t key = ScriptKeys[(frame / 20) % 16];
+
+    *keys = phase < 6 ? (uint16_t)(1 << key) : 0;
+    *keys_pressed = phase == 0 ? (uint16_t)(1 << key) : 0;
+}
+
+static uint64_t regress_hash(const Chip8* vm)
+{
+    uint64_t hash = hash_fnv1a64(vm->display, sizeof(vm->display), HASH_FNV1A64_SEED);
+
+    if(vm->fault != CHIP8_FAULT_NONE)
+    {
+        const uint32_t fault[2] = {(uint32_t)vm->fault, vm->fault_pc};
+        hash = hash_fnv1a64(fault, sizeof(fault), hash);
+    }
+
+    return hash;
+}
+
+static void regress_run_rom(void* context, const uint32_t index)
+{
+    (void)context;
+    RomRun* run = &s_regress.runs[index];
+    Chip8* vm = calloc(1, sizeof(Chip8));
+
+    chip8_reset(vm, 0);
+    run->loaded = chip8_load_rom_file(vm, run->path);
+
+    for(uint32_t frame = 1; run->loaded && frame <= s_regress.frames; ++frame)
+    {
+        regress_script_keys(frame, &vm->keys, &vm->keys_pressed);
+        chip8_step(vm);
+
+        if(vm->fault != CHIP8_FAULT_NONE && run->fault == CHIP8_FAULT_NONE)
+        {
+            run->fault = vm->fault;
+            run->fault_pc = vm->fault_pc;
+            run->fault_frame = frame;
+        }
+
+        if(frame % s_regress.interval == 0)
+        {
+            run->actual[frame / s_regress.interval - 1] = regress_hash(vm);
+            run->checkpoint_pc[frame / s_regress.interval - 1] = vm->pc;
+        }
+    }
+
+    chip8_release(vm);
+    free(vm);
+}
+
+static bool regress_same_state(const Chip8* a, const Chip8* b)
+{
+    for(uint32_t i = 0; i < CHIP8_PAGE_COUNT; ++i)
+    {
+        if(a->pages[i] != b->pages[i] && memcmp(a->pages[i]->bytes, b->pages[i]->bytes, CHIP8_PAGE_SIZE) != 0)
+        {
+            return false;
+        }
+    }
+
+    return memcmp(a->v, b->v, sizeof(a->v)) == 0
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && memcmp(a->display, b->display, sizeof(a->display)) == 0
+        && a->index == b->index && a->pc == b->pc && a->sp == b->sp
+        && a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer
+        && memcmp(a->audio_pattern, b->audio_pattern, sizeof(a->audio_pattern)) == 0 && a->pitch == b->pitch
+        && a->rng == b->rng && a->fault == b->fault && a->fault_pc == b->fault_pc
+        && a->halted == b->halted && a->paused == b->paused;
+}
+
+// Lanes get the key script shifted by a few frames per lane group, so they share
+// most of their code paths but still split and rejoin around input handling
+static void regress_run_batch(void* context, const uint32_t index)
+{
+    (void)context;
+    RomRun* run = &s_regress.runs[index];
+    const uint32_t lanes = s_regress.lanes;
+    Chip8* scalar = calloc(lanes, sizeof(Chip8));
+    Chip8* lane_state = calloc(1, sizeof(Chip8));
+
+    chip8_reset(&scalar[0], 0);
+    run->loaded = chip8_load_rom_file(&scalar[0], run->path);
+
+    for(uint32_t lane = 1; lane < lanes; ++lane)
+    {
+        chip8_copy(&scalar[lane], &scalar[0]);
+    }
+
+    Chip8Batch* batch = run->loaded ? chip8_batch_create(lanes, &scalar[0]) : NULL;
+    run->loaded = batch != NULL;
+
+    for(uint32_t frame = 1; run->loaded && frame <= s_regress.frames && run->mismatch_frame == 0; ++frame)
+    {
+        for(uint32_t lane = 0; lane < lanes; ++lane)
+        {
+            regress_script_keys(frame + (lane % 4) * 3, &scalar[lane].keys, &scalar[lane].keys_pressed);
+            chip8_batch_set_keys(batch, lane, scalar[lane].keys, scalar[lane].keys_pressed);
+        }
+
+        uint64_t start = timing_now_ns();
+        chip8_batch_step(batch);
+        run->batch_ns += timing_now_ns() - start;
+
+        start = timing_now_ns();
+        for(uint32_t lane = 0; lane < lanes; ++lane)
+        {
+            chip8_step(&scalar[lane]);
+        }
+        run->scalar_ns += timing_now_ns() - start;
+
+        for(uint32_t lane = 0; lane < lanes; ++lane)
+        {
+            chip8_batch_get(batch, lane, lane_state);
+
+            if(!regress_same_state(lane_state, &scalar[lane]))
+            {
+                run->mismatch_frame = frame;
+                run->mismatch_lane = lane;
+                run->fault_pc = scalar[lane].pc;
+                break;
+            }
+        }
+    }
+
+    if(batch)
+    {
+        run->lockstep_instructions = batch->lockstep_instructions;
+        run->scalar_instructions = batch->scalar_instructions;
+    }
+
+    chip8_batch_destroy(batch);
+    chip8_release(lane_state);
+
+    for(uint32_t lane = 0; lane < lanes; ++lane)
+    {
+        chip8_release(&scalar[lane]);
+    }
+
+    free(lane_state);
+    free(scalar);
+}
+
+// Lanes holding key 0 set VF to 8 and the rest to 0, then all wait for key 1 and draw
+// the same sprite at (VF, VF). Lanes split at the skip only regroup on the next frame,
+// both paths take as many instructions so they wait in step and draw in lockstep.
+static bool regress_check_batch_vf_draw(const uint32_t lanes)
+{
+    static const uint8_t Program[] = {
+        0x61, 0x01, // LD V1, 1
+        0x6F, 0x08, // LD VF, 8
+        0xE0, 0xA1, // SKNP V0
+        0x12, 0x0A, // JP 0x20A
+        0x6F, 0x00, // LD VF, 0
+        0xE1, 0x9E, // SKP V1
+        0x12, 0x0A, // JP 0x20A
+        0xA0, 0x00, // LD I, 0
+        0xDF, 0xF5, // DRW VF, VF, 5
+        0x12, 0x12, // JP 0x212
+    };
+
+    const uint32_t lane_count = lanes < 2 ? 2 : lanes;
+    Chip8* scalar = calloc(lane_count, sizeof(Chip8));
+    Chip8* lane_state = calloc(1, sizeof(Chip8));
+
+    chip8_reset(&scalar[0], 0);
+
+    for(uint16_t i = 0; i < sizeof(Program); ++i)
+    {
+        chip8_write(&scalar[0], (uint16_t)(0x200 + i), Program[i]);
+    }
+
+    for(uint32_t lane = 1; lane < lane_count; ++lane)
+    {
+        chip8_copy(&scalar[lane], &scalar[0]);
+    }
+
+    Chip8Batch* batch = chip8_batch_create(lane_count, &scalar[0]);
+    bool is_same = batch != NULL;
+
+    for(uint32_t frame = 0; is_same && frame < 3; ++frame)
+    {
+        for(uint32_t lane = 0; lane < lane_count; ++lane)
+        {
+            // Lane 0 draws first, so its collision flag lands in VF before lane 1 reads it
+            scalar[lane].keys = (uint16_t)((lane % 2 == 0 ? 0x1 : 0x0) | (frame > 0 ? 0x2 : 0x0));
+            scalar[lane].keys_pressed = 0;
+            chip8_batch_set_keys(batch, lane, scalar[lane].keys, scalar[lane].keys_pressed);
+        }
+
+        chip8_batch_step(batch);
+
+        for(uint32_t lane = 0; is_same && lane < lane_count; ++lane)
+        {
+            chip8_step(&scalar[lane]);
+            chip8_batch_get(batch, lane, lane_state);
+            is_same = regress_same_state(lane_state, &scalar[lane]);
+        }
+    }
+
+    chip8_batch_destroy(batch);
+    chip8_release(lane_state);
+
+    for(uint32_t lane = 0; lane < lane_count; ++lane)
+    {
+        chip8_release(&scalar[lane]);
+    }
+
+    free(lane_state);
+    free(scalar);
+    return is_same;
+}
+
+static uint32_t regress_report_batch(void)
+{
+    uint32_t failures = 0;
+    uint64_t batch_ns = 0;
+    uint64_t scalar_ns = 0;
+    uint64_t lockstep = 0;
+    uint64_t total = 0;
+
+    for(uint32_t i = 0; i < s_regress.run_count; ++i)
+    {
+        const RomRun* run = &s_regress.runs[i];
+
+        if(!run->loaded)
+        {
+            printf("FAIL %s: failed to load\n", run->path);
+            ++failures;
+            continue;
+        }
+
+        if(run->mismatch_frame != 0)
+        {
+            printf("FAIL %s: lane %u diverged from scalar at frame %u pc %.04x\n",
+                run->path, run->mismatch_lane, run->mismatch_frame, run->fault_pc);
+            ++failures;
+        }
+
+        batch_ns += run->batch_ns;
+        scalar_ns += run->scalar_ns;
+        lockstep += run->lockstep_instructions;
+        total += run->lockstep_instructions + run->scalar_instructions;
+    }
+
+    printf("batch %.1f M lane-instructions/s, scalar %.1f M/s, %.1f%% lockstep\n",
+        batch_ns ? (double)total * 1e3 / (double)batch_ns : 0.0,
+        scalar_ns ? (double)total * 1e3 / (double)scalar_ns : 0.0,
+        total ? 100.0 * (double)lockstep / (double)total : 0.0);
+
+    return failures;
+}
+
+static RomRun* regress_find_or_add(const char* rom_path)
+{
+    // Golden files are shared between platforms, so paths are stored with forward slashes
+    char path[REGRESS_MAX_PATH];
+
+    if(strlen(rom_path) >= REGRESS_MAX_PATH)
+    {
+        return NULL;
+    }
+
+    strcpy(path, rom_path[0] == '.' && (rom_path[1] == '/' || rom_path[1] == '\\') ? rom_path + 2 : rom_path);
+
+    for(char* c = strchr(path, '\\'); c; c = strchr(c, '\\'))
+    {
+        *c = '/';
+    }
+
+    for(uint32_t i = 0; i < s_regress.run_count; ++i)
+    {
+        if(strcmp(s_regress.runs[i].path, path) == 0)
+        {
+            return &s_regress.runs[i];
+        }
+    }
+
+    if(s_regress.run_count >= REGRESS_MAX_ROMS)
+    {
+        return NULL;
+    }
+
+    RomRun* run = &s_regress.runs[s_regress.run_count++];
+    strcpy(run->path, path);
+    return run;
+}
+
+// Adds every file of directory except the caches the frontend writes next to ROMs
+static bool regress_scan_directory(const char* directory)
+{
+    bool is_added = true;
+
+#ifdef _WIN32
+    char pattern[REGRESS_MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", directory);
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Failed to open ROM directory %s\n", directory);
+        return false;
+    }
+
+    do
+    {
+        const char* name = entry.cFileName;
+#else
+    DIR* dir = opendir(directory);
+
+    if(!dir)
+    {
+        fprintf(stderr, "Failed to open ROM directory %s\n", directory);
+        return false;
+    }
+
+    for(const struct dirent* entry = readdir(dir); entry; entry = readdir(dir))
+    {
+        const char* name = entry->d_name;
+#endif
+        char path[REGRESS_MAX_PATH];
+        const int length = snprintf(path, sizeof(path), "%s/%s", directory, name);
+        const bool is_fit = length > 0 && (size_t)length < sizeof(path);
+#ifdef _WIN32
+        const bool is_file = !(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+        struct stat info;
+        const bool is_file = is_fit && stat(path, &info) == 0 && S_ISREG(info.st_mode);
+#endif
+
+        if(is_file && regress_is_rom_name(name) && (!is_fit || !regress_find_or_add(path)))
+        {
+            fprintf(stderr, "Too many ROMs or too long a path at %s/%s, limit is %d\n", directory, name, REGRESS_MAX_ROMS);
+            is_added = false;
+            break;
+        }
+#ifdef _WIN32
+    } while(FindNextFileA(find, &entry));
+
+    FindClose(find);
+#else
+    }
+
+    closedir(dir);
+#endif
+
+    return is_added;
+}
+
+static bool regress_is_rom_name(const char* name)
+{
+    static const char* Caches[] = {".analysis", ".preview"};
+    const size_t length = strlen(name);
+
+    for(size_t i = 0; i < sizeof(Caches) / sizeof(Caches[0]); ++i)
+    {
+        const size_t suffix_length = strlen(Caches[i]);
+
+        if(length >= suffix_length && strcmp(name + length - suffix_length, Caches[i]) == 0)
+        {
+            return false;
+        }
+    }
+
+    return name[0] != '.';
+}
+
+// Golden lines are "<frame> <hash> <rom path>", the path may contain spaces
+static bool regress_read_golden(const char* golden_path)
+{
+    FILE* golden = fopen(golden_path, "r");
+
+    if(!golden)
+    {
+        fprintf(stderr, "Failed to open golden file %s\n", golden_path);
+        return false;
+    }
+
+    char line[REGRESS_MAX_PATH + 64];
+
+    while(fgets(line, sizeof(line), golden))
+    {
+        unsigned frame;
+        unsigned long long hash;
+        int path_start = 0;
+
+        if(line[0] == '#' || sscanf(line, "%u %llx %n", &frame, &hash, &path_start) != 2 || path_start == 0)
+        {
+            continue;
+        }
+
+        line[strcspn(line, "\r\n")] = '\0';
+        RomRun* run = regress_find_or_add(line + path_start);
+
+        if(run && frame % s_regress.interval == 0 && frame / s_regress.interval <= REGRESS_MAX_CHECKPOINTS && frame <= s_regress.frames)
+        {
+            const uint32_t checkpoint = frame / s_regress.interval;
+            run->expected[checkpoint - 1] = hash;
+            run->expected_count = checkpoint > run->expected_count ? checkpoint : run->expected_count;
+        }
+
+        if(run)
+        {
+            run->has_golden = true;
+        }
+    }
+
+    fclose(golden);
+    return true;
+}
+
+static bool regress_write_golden(const char* golden_path)
+{
+    FILE* golden = fopen(golden_path, "w");
+
+    if(!golden)
+    {
+        fprintf(stderr, "Failed to write golden file %s\n", golden_path);
+        return false;
+    }
+
+    fprintf(golden, "# chip8-regress golden display hashes: <frame> <hash> <rom>\n");
+
+    for(uint32_t i = 0; i < s_regress.run_count; ++i)
+    {
+        const RomRun* run = &s_regress.runs[i];
+
+        if(!run->loaded)
+        {
+            fprintf(stderr, "Skipping %s, failed to load\n", run->path);
+            continue;
+        }
+
+        for(uint32_t j = 0; j < s_regress.frames / s_regress.interval; ++j)
+        {
+            fprintf(golden, "%u %016llx %s\n", (j + 1) * s_regress.interval, (unsigned long long)run->actual[j], run->path);
+        }
+
+        if(run->fault != CHIP8_FAULT_NONE)
+        {
+            printf("NOTE %s: %s at frame %u pc %.04x\n", run->path, chip8_fault_name(run->fault), run->fault_frame, run->fault_pc);
+        }
+    }
+
+    fclose(golden);
+    return true;
+}
+
+static uint32_t regress_report(void)
+{
+    uint32_t failures = 0;
+
+    for(uint32_t i = 0; i < s_regress.run_count; ++i)
+    {
+        const RomRun* run = &s_regress.runs[i];
+        bool passed = run->loaded;
+
+        if(!run->loaded)
+        {
+            printf("FAIL %s: failed to load\n", run->path);
+        }
+        else if(!run->has_golden)
+        {
+            printf("FAIL %s: no golden entry\n", run->path);
+            passed = false;
+        }
+
+        for(uint32_t j = 0; run->loaded && j < run->expected_count; ++j)
+        {
+            if(run->actual[j] != run->expected[j])
+            {
+                printf("FAIL %s: diverged at frame %u pc %.04x (expected %016llx, got %016llx)\n",
+                    run->path, (j + 1) * s_regress.interval, run->checkpoint_pc[j],
+                    (unsigned long long)run->expected[j], (unsigned long long)run->actual[j]);
+                passed = false;
+                break;
+            }
+        }
+
+        if(run->fault != CHIP8_FAULT_NONE)
+        {
+            printf("%s %s: %s at frame %u pc %.04x\n", passed ? "NOTE" : "FAIL", run->path,
+                chip8_fault_name(run->fault), run->fault_frame, run->fault_pc);
+        }
+
+        failures += passed ? 0 : 1;
+    }
+
+    return failures;
+}
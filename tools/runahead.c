@@ -0,0 +1,291 @@
+// Run-ahead measurement and check.
+//
+// --measure finds how many frames each ROM takes to show a key press: from states
+// sampled along a run with changing keys, every key is pressed and held and the
+// display compared with the run where it is not. The first frame they differ at,
+// less one, is the run-ahead recommended for the ROM. It also reports what running
+// that far ahead costs per frame in each mode.
+//
+// --check runs each ROM with run-ahead in both modes and verifies the machine is
+// left exactly as a run without it, and that while the keys stay the same the frame
+// shown is the one the machine really reaches that many frames later.
+//
+//   chip8-runahead [--measure] [--check] [--frames N] [--ahead N] rom...
+
+#include "chip8.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUNAHEAD_MAX_FRAMES 4
+// Frames a key is held for while looking for a reaction
+#define RUNAHEAD_REACTION_FRAMES 8
+#define RUNAHEAD_SAMPLE_INTERVAL 30
+#define RUNAHEAD_KEY_HOLD 6
+#define RUNAHEAD_HISTORY (RUNAHEAD_MAX_FRAMES + 1)
+
+static uint16_t runahead_script_keys(uint32_t frame);
+static void runahead_step(Chip8* vm, uint16_t keys);
+static bool runahead_measure(const Chip8* start, uint32_t frames, uint32_t* lag);
+static double runahead_cost_ms(const Chip8* start, Chip8RunAheadMode mode, uint32_t ahead, uint32_t frames);
+static bool runahead_check(const Chip8* start, Chip8RunAheadMode mode, uint32_t ahead, uint32_t frames);
+static bool runahead_same_state(const Chip8* left, const Chip8* right);
+
+int main(int argc, char** argv)
+{
+    bool measure = false;
+    bool check = false;
+    uint32_t frames = 1200;
+    uint32_t ahead_override = 0;
+    int rom_count = 0;
+    int failures = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--measure") == 0)
+        {
+            measure = true;
+        }
+        else if(strcmp(argv[i], "--check") == 0)
+        {
+            check = true;
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--ahead") == 0 && i + 1 < argc)
+        {
+            ahead_override = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0 || (!measure && !check))
+    {
+        fprintf(stderr, "Usage: chip8-runahead [--measure] [--check] [--frames N] [--ahead N] rom...\n");
+        return 2;
+    }
+
+    if(ahead_override > RUNAHEAD_MAX_FRAMES)
+    {
+        ahead_override = RUNAHEAD_MAX_FRAMES;
+    }
+
+    static Chip8 start;
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        const char* rom_path = argv[i];
+        chip8_reset(&start, 0);
+
+        if(!chip8_load_rom_file(&start, rom_path))
+        {
+            fprintf(stderr, "Failed to load %s\n", rom_path);
+            ++failures;
+            continue;
+        }
+
+        const uint32_t ahead = ahead_override > 0 ? ahead_override : start.run_ahead;
+
+        if(measure)
+        {
+            uint32_t lag = 0;
+
+            if(runahead_measure(&start, frames, &lag))
+            {
+                // Running further ahead than the ROM lags shows key presses before they happen
+                const uint32_t recommended = lag - 1 < RUNAHEAD_MAX_FRAMES ? lag - 1 : RUNAHEAD_MAX_FRAMES;
+                const uint32_t costed = recommended > 0 ? recommended : 1;
+                printf("%s: shows keys after %u frames, recommended run-ahead %u (table %u), %u frames cost %.4f ms single, %.4f ms secondary\n",
+                    rom_path, lag, recommended, start.run_ahead, costed,
+                    runahead_cost_ms(&start, CHIP8_RUNAHEAD_SINGLE, costed, frames),
+                    runahead_cost_ms(&start, CHIP8_RUNAHEAD_SECONDARY, costed, frames));
+            }
+            else
+            {
+                printf("%s: no reaction to keys within %u frames (table %u)\n", rom_path, RUNAHEAD_REACTION_FRAMES, start.run_ahead);
+            }
+        }
+
+        if(check)
+        {
+            const bool single = runahead_check(&start, CHIP8_RUNAHEAD_SINGLE, ahead, frames);
+            const bool secondary = runahead_check(&start, CHIP8_RUNAHEAD_SECONDARY, ahead, frames);
+            printf("%s: run-ahead %u, single %s, secondary %s\n", rom_path, ahead, single ? "ok" : "FAIL", secondary ? "ok" : "FAIL");
+
+            if(!single || !secondary)
+            {
+                ++failures;
+            }
+        }
+
+        chip8_release(&start);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+
+// Holds one random key or none, changing every few frames
+static uint16_t runahead_script_keys(const uint32_t frame)
+{
+    uint32_t x = frame / RUNAHEAD_KEY_HOLD * 2654435761u + 0x9E3779B9u;
+    x ^= x >> 15;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12;
+    return (x & 3) == 0 ? 0 : (uint16_t)(1u << ((x >> 8) & 0xF));
+}
+
+static void runahead_step(Chip8* vm, const uint16_t keys)
+{
+    vm->keys_pressed = keys & (uint16_t)~vm->keys;
+    vm->keys = keys;
+    chip8_step(vm);
+}
+
+static bool runahead_measure(const Chip8* start, const uint32_t frames, uint32_t* lag)
+{
+    static Chip8 vm;
+    static Chip8 idle;
+    static Chip8 pressed;
+    uint32_t best = RUNAHEAD_REACTION_FRAMES + 1;
+    chip8_copy(&vm, start);
+
+    for(uint32_t frame = 0; frame < frames && !vm.halted; ++frame)
+    {
+        if(frame % RUNAHEAD_SAMPLE_INTERVAL == RUNAHEAD_SAMPLE_INTERVAL - 1)
+        {
+            for(uint8_t key = 0; key < 16; ++key)
+            {
+                chip8_copy(&idle, &vm);
+                chip8_copy(&pressed, &vm);
+
+                for(uint32_t i = 1; i <= RUNAHEAD_REACTION_FRAMES && i < best; ++i)
+                {
+                    runahead_step(&idle, 0);
+                    runahead_step(&pressed, (uint16_t)(1u << key));
+
+                    if(memcmp(idle.display, pressed.display, sizeof(idle.display)) != 0)
+                    {
+                        best = i;
+                        break;
+                    }
+                }
+            }
+        }
+
+        runahead_step(&vm, runahead_script_keys(frame));
+    }
+
+    chip8_release(&vm);
+    chip8_release(&idle);
+    chip8_release(&pressed);
+
+    if(best > RUNAHEAD_REACTION_FRAMES)
+    {
+        return false;
+    }
+
+    *lag = best;
+    return true;
+}
+
+static double runahead_cost_ms(const Chip8* start, const Chip8RunAheadMode mode, const uint32_t ahead, const uint32_t frames)
+{
+    static Chip8 vm;
+    static Chip8 scratch;
+    uint32_t display[CHIP8_DISPLAY_COLUMNS];
+    uint64_t elapsed = 0;
+    chip8_copy(&vm, start);
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        runahead_step(&vm, runahead_script_keys(frame));
+        const uint64_t begin = timing_now_ns();
+        chip8_run_ahead(&vm, &scratch, mode, ahead, display);
+        elapsed += timing_now_ns() - begin;
+    }
+
+    chip8_release(&vm);
+    chip8_release(&scratch);
+    return (double)elapsed / 1e6 / (frames > 0 ? frames : 1);
+}
+
+static bool runahead_check(const Chip8* start, const Chip8RunAheadMode mode, const uint32_t ahead, const uint32_t frames)
+{
+    static Chip8 vm;
+    static Chip8 reference;
+    static Chip8 scratch;
+    // Frames shown, kept until the reference reaches them
+    uint32_t shown[RUNAHEAD_HISTORY][CHIP8_DISPLAY_COLUMNS];
+    bool ok = true;
+    chip8_copy(&vm, start);
+    chip8_copy(&reference, start);
+
+    for(uint32_t frame = 0; frame < frames && ok; ++frame)
+    {
+        const uint16_t keys = runahead_script_keys(frame);
+        runahead_step(&vm, keys);
+        runahead_step(&reference, keys);
+        chip8_run_ahead(&vm, &scratch, mode, ahead, shown[frame % RUNAHEAD_HISTORY]);
+
+        if(!runahead_same_state(&vm, &reference))
+        {
+            printf("  frame %u: %s run-ahead changed the machine\n", frame, chip8_run_ahead_mode_name(mode));
+            ok = false;
+        }
+
+        // The frame shown ahead frames ago is exact if the keys did not change since
+        bool held = frame >= ahead;
+
+        for(uint32_t i = 1; i <= ahead && held; ++i)
+        {
+            held = runahead_script_keys(frame - i) == keys;
+        }
+
+        if(held && memcmp(shown[(frame - ahead) % RUNAHEAD_HISTORY], reference.display, sizeof(reference.display)) != 0)
+        {
+            printf("  frame %u: %s run-ahead showed a frame the machine did not reach\n", frame, chip8_run_ahead_mode_name(mode));
+            ok = false;
+        }
+    }
+
+    chip8_release(&vm);
+    chip8_release(&reference);
+    chip8_release(&scratch);
+    return ok;
+}
+
+static bool runahead_same_state(const Chip8* left, const Chip8* right)
+{
+    if(memcmp(left->display, right->display, sizeof(left->display)) != 0 ||
+        memcmp(left->v, right->v, sizeof(left->v)) != 0 ||
+        memcmp(left->stack, right->stack, sizeof(left->stack)) != 0 ||
+        left->index != right->index || left->pc != right->pc || left->sp != right->sp ||
+        left->delay_timer != right->delay_timer || left->sound_timer != right->sound_timer ||
+        left->rng != right->rng || left->keys != right->keys || left->halted != right->halted ||
+        left->paused != right->paused || left->muted != right->muted)
+    {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < CHIP8_PAGE_COUNT; ++i)
+    {
+        if(memcmp(left->pages[i]->bytes, right->pages[i]->bytes, CHIP8_PAGE_SIZE) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,200 @@
+// Speculative key wait check.
+//
+// Runs each ROM the way the frontend does with speculation on, pressing and releasing
+// keys on a script, sometimes with a gap and sometimes switching keys in the same
+// frame. At every press that ends a wait it also resolves the wait the usual way on a
+// copy and runs the next frame, and fails if an adopted fork ever differs from that.
+// Prints how many presses adopted a fork and what forking costs.
+//
+//   chip8-speculate [--threads N] [--frames N] rom...
+
+#include "speculate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPECULATE_SEED 1
+#define SPECULATE_HOLD_FRAMES 12
+// Every third press switches straight from the key held before, which forks never match
+#define SPECULATE_SWITCH_EVERY 3
+
+typedef struct SpeculateTotals
+{
+    uint64_t frames;
+    uint64_t mismatches;
+    uint64_t waits;
+} SpeculateTotals;
+
+static bool speculate_rom(KeySpeculator* speculator, const char* path, uint32_t frames, SpeculateTotals* totals);
+static void speculate_reference(const Chip8* vm, Chip8* out);
+static bool speculate_matches(const Chip8* a, const Chip8* b);
+
+int main(int argc, char** argv)
+{
+    uint32_t threads = 0;
+    uint32_t frames = 1200;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-speculate [--threads N] [--frames N] rom...\n");
+        return 2;
+    }
+
+    KeySpeculator* speculator = speculate_create(threads);
+
+    if(!speculator)
+    {
+        fprintf(stderr, "Failed to create the speculator\n");
+        return 2;
+    }
+
+    SpeculateTotals totals;
+    memset(&totals, 0, sizeof(totals));
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        if(!speculate_rom(speculator, argv[i], frames, &totals))
+        {
+            fprintf(stderr, "Failed to load %s\n", argv[i]);
+            speculate_destroy(speculator);
+            return 2;
+        }
+    }
+
+    SpeculateStats stats;
+    speculate_get_stats(speculator, &stats);
+    speculate_destroy(speculator);
+
+    printf("%llu frames, %llu key waits, %llu presses, %llu adopted (%.1f%%), %llu mismatched\n",
+        (unsigned long long)totals.frames, (unsigned long long)totals.waits, (unsigned long long)stats.presses,
+        (unsigned long long)stats.hits, stats.presses > 0 ? (double)stats.hits * 100.0 / (double)stats.presses : 0.0,
+        (unsigned long long)totals.mismatches);
+    printf("%llu forks, %.1f us per fork of %u machines, %.0f ms of key latency saved\n", (unsigned long long)stats.forks,
+        stats.forks > 0 ? (double)stats.fork_ns / (double)stats.forks / 1e3 : 0.0, SPECULATE_KEYS,
+        (double)stats.hits * 1000.0 / 60.0);
+
+    int result = 0;
+
+    if(totals.mismatches > 0)
+    {
+        printf("FAIL an adopted fork differs from the frames it stands for\n");
+        result = 1;
+    }
+
+    if(totals.waits > 0 && stats.hits == 0)
+    {
+        printf("FAIL no key press adopted a fork\n");
+        result = 1;
+    }
+
+    return result;
+}
+
+static bool speculate_rom(KeySpeculator* speculator, const char* path, const uint32_t frames, SpeculateTotals* totals)
+{
+    Chip8 vm = {0};
+    chip8_reset(&vm, SPECULATE_SEED);
+
+    if(!chip8_load_rom_file(&vm, path))
+    {
+        chip8_release(&vm);
+        return false;
+    }
+
+    speculate_reset(speculator);
+    uint32_t rng = SPECULATE_SEED;
+    bool was_paused = false;
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        const uint32_t phase = frame % (2 * SPECULATE_HOLD_FRAMES);
+        const bool is_switch = (frame / (2 * SPECULATE_HOLD_FRAMES)) % SPECULATE_SWITCH_EVERY == 0;
+        uint16_t pressed = 0;
+
+        if(phase == 0 || (phase == SPECULATE_HOLD_FRAMES && is_switch))
+        {
+            rng = rng * 1664525u + 1013904223u;
+            pressed = (uint16_t)(1u << (rng >> 28));
+        }
+
+        // Keys are held for SPECULATE_HOLD_FRAMES, a switch replaces one with the next
+        vm.keys = pressed ? pressed : phase < SPECULATE_HOLD_FRAMES || is_switch ? vm.keys : 0;
+        vm.keys_pressed = pressed;
+
+        Chip8 expected = {0};
+        const bool is_checked = vm.paused && !vm.halted && pressed;
+
+        if(is_checked)
+        {
+            speculate_reference(&vm, &expected);
+        }
+
+        if(speculate_resolve(speculator, &vm))
+        {
+            totals->mismatches += !speculate_matches(&vm, &expected);
+        }
+        else
+        {
+            chip8_step(&vm);
+        }
+
+        speculate_prepare(speculator, &vm);
+        totals->waits += vm.paused && !was_paused;
+        was_paused = vm.paused;
+        ++totals->frames;
+        chip8_release(&expected);
+    }
+
+    speculate_reset(speculator);
+    chip8_release(&vm);
+    return true;
+}
+
+// The wait resolved without speculation, the frame storing the key and the next one
+static void speculate_reference(const Chip8* vm, Chip8* out)
+{
+    chip8_copy(out, vm);
+    chip8_step(out);
+    out->keys_pressed = 0;
+    chip8_step(out);
+}
+
+static bool speculate_matches(const Chip8* a, const Chip8* b)
+{
+    uint8_t ram_a[CHIP8_RAM_SIZE];
+    uint8_t ram_b[CHIP8_RAM_SIZE];
+    chip8_read_range(a, 0, ram_a, sizeof(ram_a));
+    chip8_read_range(b, 0, ram_b, sizeof(ram_b));
+
+    return memcmp(ram_a, ram_b, sizeof(ram_a)) == 0
+        && memcmp(a->v, b->v, sizeof(a->v)) == 0
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && memcmp(a->display, b->display, sizeof(a->display)) == 0
+        && a->index == b->index && a->pc == b->pc && a->sp == b->sp
+        && a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer
+        && a->rng == b->rng && a->executed == b->executed
+        && a->halted == b->halted && a->paused == b->paused;
+}
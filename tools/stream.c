@@ -0,0 +1,416 @@
+// Frame streaming check.
+//
+// Runs a machine per channel, publishes every frame to a stream server and connects
+// viewers to it, some reading as fast as they can and some slowly through a small
+// socket buffer so the server has to drop frames for them. Every frame a viewer decodes
+// must match the frame published under that number, and once publishing stops each
+// viewer must end up showing the last frame of every channel. Prints the bandwidth of
+// each viewer against sending every frame whole.
+//
+//   chip8-stream [--channels N] [--frames N] [--viewers N] [--slow N] [--address path|tcp:port] rom...
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "stream.h"
+#include "chip8.h"
+#include "timing.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <threads.h>
+#include <unistd.h>
+
+#define STREAM_SEED 1
+#define STREAM_HOLD_FRAMES 20
+#define STREAM_PUBLISH_NS 2000000ull
+#define STREAM_SETTLE_NS 5000000000ull
+#define STREAM_SLOW_BUFFER 2048
+#define STREAM_SLOW_READ 512
+#define STREAM_SLOW_PAUSE_NS 20000000
+#define STREAM_READ_BYTES 65536
+
+typedef struct StreamViewerRun
+{
+    thrd_t thread;
+    const char* address;
+    bool is_slow;
+    uint32_t channels;
+    uint32_t frames;
+    // Published frames by channel and frame number - 1, shared by every viewer
+    const uint32_t (*history)[CHIP8_DISPLAY_COLUMNS];
+    uint32_t displays[STREAM_MAX_CHANNELS][CHIP8_DISPLAY_COLUMNS];
+    atomic_uint last_frames[STREAM_MAX_CHANNELS];
+    atomic_bool is_connected;
+    atomic_bool is_stopping;
+    int socket;
+    bool is_greeted;
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t mismatches;
+    bool is_broken;
+} StreamViewerRun;
+
+static int stream_connect(const char* address, bool is_slow);
+static int stream_viewer(void* context);
+static bool stream_viewer_parse(StreamViewerRun* run, uint8_t* bytes, size_t* size);
+static bool stream_viewer_done(StreamViewerRun* run, const uint32_t (*finals)[CHIP8_DISPLAY_COLUMNS]);
+
+int main(int argc, char** argv)
+{
+    uint32_t channels = 8;
+    uint32_t frames = 600;
+    uint32_t fast_count = 3;
+    uint32_t slow_count = 1;
+    char default_address[64];
+    snprintf(default_address, sizeof(default_address), "/tmp/chip8-stream-%ld.sock", (long)getpid());
+    const char* address = default_address;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+        {
+            channels = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--viewers") == 0 && i + 1 < argc)
+        {
+            fast_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--slow") == 0 && i + 1 < argc)
+        {
+            slow_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--address") == 0 && i + 1 < argc)
+        {
+            address = argv[++i];
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0 || channels == 0 || channels > STREAM_MAX_CHANNELS || frames == 0)
+    {
+        fprintf(stderr, "Usage: chip8-stream [--channels N] [--frames N] [--viewers N] [--slow N] [--address path|tcp:port] rom...\n");
+        return 2;
+    }
+
+    Chip8* machines = calloc(channels, sizeof(Chip8));
+    uint32_t (*history)[CHIP8_DISPLAY_COLUMNS] = calloc((size_t)channels * frames, sizeof(*history));
+    const uint32_t viewer_count = fast_count + slow_count;
+    StreamViewerRun* viewers = calloc(viewer_count > 0 ? viewer_count : 1, sizeof(StreamViewerRun));
+
+    if(!machines || !history || !viewers)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    for(uint32_t c = 0; c < channels; ++c)
+    {
+        chip8_reset(&machines[c], STREAM_SEED + c);
+
+        if(!chip8_load_rom_file(&machines[c], argv[c % (uint32_t)rom_count]))
+        {
+            fprintf(stderr, "Failed to load %s\n", argv[c % (uint32_t)rom_count]);
+            return 2;
+        }
+    }
+
+    StreamServer* server = stream_open(address, channels);
+
+    if(!server)
+    {
+        fprintf(stderr, "Could not listen on %s\n", address);
+        return 2;
+    }
+
+    for(uint32_t v = 0; v < viewer_count; ++v)
+    {
+        StreamViewerRun* run = &viewers[v];
+        run->address = address;
+        run->is_slow = v >= fast_count;
+        run->channels = channels;
+        run->frames = frames;
+        run->history = history;
+        run->socket = -1;
+
+        if(thrd_create(&run->thread, stream_viewer, run) != thrd_success)
+        {
+            fprintf(stderr, "Could not start a viewer\n");
+            return 2;
+        }
+    }
+
+    // Publishing starts once every viewer is connected, so all of them see every channel change
+    const uint64_t connect_start = timing_now_ns();
+
+    for(uint32_t v = 0; v < viewer_count; ++v)
+    {
+        while(!atomic_load(&viewers[v].is_connected) && timing_now_ns() - connect_start < STREAM_SETTLE_NS)
+        {
+            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 1000000}, NULL);
+        }
+    }
+
+    uint32_t rng = STREAM_SEED;
+    const uint64_t start = timing_now_ns();
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        for(uint32_t c = 0; c < channels; ++c)
+        {
+            if(frame % STREAM_HOLD_FRAMES == 0)
+            {
+                rng = rng * 1664525u + 1013904223u;
+                machines[c].keys = (uint16_t)(1u << (rng >> 28));
+            }
+
+            chip8_step(&machines[c]);
+            memcpy(history[(size_t)c * frames + frame], machines[c].display, sizeof(history[0]));
+            stream_publish(server, c, machines[c].display);
+        }
+
+        const uint64_t next_ns = start + (frame + 1) * STREAM_PUBLISH_NS;
+        const uint64_t now_ns = timing_now_ns();
+
+        if(next_ns > now_ns)
+        {
+            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = (long)(next_ns - now_ns)}, NULL);
+        }
+    }
+
+    const double publish_seconds = (double)(timing_now_ns() - start) / 1e9;
+    const uint32_t (*finals)[CHIP8_DISPLAY_COLUMNS] = (const uint32_t (*)[CHIP8_DISPLAY_COLUMNS])history;
+    int result = 0;
+
+    for(uint32_t v = 0; v < viewer_count; ++v)
+    {
+        StreamViewerRun* run = &viewers[v];
+        const uint64_t settle_start = timing_now_ns();
+        bool is_done = false;
+
+        while(!(is_done = stream_viewer_done(run, finals + frames - 1)) && timing_now_ns() - settle_start < STREAM_SETTLE_NS)
+        {
+            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 5000000}, NULL);
+        }
+
+        atomic_store(&run->is_stopping, true);
+        thrd_join(run->thread, NULL);
+
+        const double frame_bytes = (double)run->bytes / (double)frames;
+        printf("viewer %u %-4s %8llu bytes, %7.1f per frame (%u whole), %6.2f KB/s, %llu messages, %llu mismatched\n",
+            v, run->is_slow ? "slow" : "fast", (unsigned long long)run->bytes, frame_bytes, channels * (STREAM_FRAME_BYTES + 8),
+            (double)run->bytes / publish_seconds / 1024.0, (unsigned long long)run->messages, (unsigned long long)run->mismatches);
+
+        if(run->is_broken || run->mismatches > 0 || !is_done)
+        {
+            printf("FAIL viewer %u %s\n", v, run->is_broken ? "got a malformed stream" : run->mismatches > 0 ? "decoded frames that were never published" : "did not catch up with the last frame");
+            result = 1;
+        }
+    }
+
+    StreamStats stats;
+    stream_get_stats(server, &stats);
+    printf("%llu frames published on %u channels, %llu keyframes, %llu deltas, %llu frames dropped for slow viewers, %.1f KB sent\n",
+        (unsigned long long)stats.frames_published, channels, (unsigned long long)stats.keyframes, (unsigned long long)stats.deltas,
+        (unsigned long long)stats.dropped, (double)stats.bytes / 1024.0);
+    stream_close(server);
+
+    for(uint32_t c = 0; c < channels; ++c)
+    {
+        chip8_release(&machines[c]);
+    }
+
+    free(viewers);
+    free(history);
+    free(machines);
+    return result;
+}
+
+static int stream_connect(const char* address, const bool is_slow)
+{
+    int fd = -1;
+
+    if(strncmp(address, "tcp:", 4) == 0)
+    {
+        struct sockaddr_in remote = {0};
+        remote.sin_family = AF_INET;
+        remote.sin_port = htons((uint16_t)strtoul(address + 4, NULL, 10));
+        remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        const int size = STREAM_SLOW_BUFFER;
+
+        if(fd >= 0 && is_slow)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
+        if(fd >= 0 && connect(fd, (struct sockaddr*)&remote, sizeof(remote)) == 0)
+        {
+            return fd;
+        }
+    }
+    else
+    {
+        struct sockaddr_un remote = {0};
+        remote.sun_family = AF_UNIX;
+        strncpy(remote.sun_path, address, sizeof(remote.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        const int size = STREAM_SLOW_BUFFER;
+
+        if(fd >= 0 && is_slow)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
+        if(fd >= 0 && connect(fd, (struct sockaddr*)&remote, sizeof(remote)) == 0)
+        {
+            return fd;
+        }
+    }
+
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+
+    return -1;
+}
+
+static int stream_viewer(void* context)
+{
+    StreamViewerRun* run = context;
+    run->socket = stream_connect(run->address, run->is_slow);
+
+    if(run->socket < 0)
+    {
+        run->is_broken = true;
+        atomic_store(&run->is_connected, true);
+        return 0;
+    }
+
+    // Wakes the blocking reads now and then to look at is_stopping
+    struct timeval timeout = {.tv_sec = 0, .tv_usec = 20000};
+    setsockopt(run->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    atomic_store(&run->is_connected, true);
+
+    static _Thread_local uint8_t bytes[STREAM_READ_BYTES];
+    size_t size = 0;
+
+    while(!atomic_load(&run->is_stopping) && !run->is_broken)
+    {
+        const size_t want = run->is_slow ? STREAM_SLOW_READ : sizeof(bytes) - size;
+        const ssize_t got = recv(run->socket, bytes + size, want < sizeof(bytes) - size ? want : sizeof(bytes) - size, 0);
+
+        if(got == 0)
+        {
+            break;
+        }
+
+        if(got > 0)
+        {
+            size += (size_t)got;
+            run->bytes += (uint64_t)got;
+            run->is_broken = !stream_viewer_parse(run, bytes, &size);
+        }
+
+        if(run->is_slow)
+        {
+            thrd_sleep(&(struct timespec){.tv_sec = 0, .tv_nsec = STREAM_SLOW_PAUSE_NS}, NULL);
+        }
+    }
+
+    close(run->socket);
+    return 0;
+}
+
+// Applies every whole message in bytes and keeps the partial one at the front
+static bool stream_viewer_parse(StreamViewerRun* run, uint8_t* bytes, size_t* size)
+{
+    size_t at = 0;
+
+    // The hello comes first, before anything is shown
+    if(!run->is_greeted)
+    {
+        if(*size < 8)
+        {
+            return true;
+        }
+
+        const uint32_t magic = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+        const uint32_t channels = (uint32_t)bytes[6] | ((uint32_t)bytes[7] << 8);
+
+        if(magic != STREAM_MAGIC || channels != run->channels)
+        {
+            return false;
+        }
+
+        at = 8;
+        run->is_greeted = true;
+    }
+
+    while(*size - at >= 8)
+    {
+        const uint8_t* header = bytes + at;
+        const uint32_t channel = header[1];
+        const uint32_t length = (uint32_t)header[2] | ((uint32_t)header[3] << 8);
+        const uint32_t frame = (uint32_t)header[4] | ((uint32_t)header[5] << 8) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+
+        if(*size - at < 8 + length)
+        {
+            break;
+        }
+
+        if(channel >= run->channels || frame == 0 || frame > run->frames
+            || !stream_apply(header[0], header + 8, length, run->displays[channel]))
+        {
+            return false;
+        }
+
+        run->mismatches += memcmp(run->displays[channel], run->history[(size_t)channel * run->frames + frame - 1], sizeof(run->displays[channel])) != 0;
+        atomic_store(&run->last_frames[channel], frame);
+        ++run->messages;
+        at += 8 + length;
+    }
+
+    memmove(bytes, bytes + at, *size - at);
+    *size -= at;
+    return true;
+}
+
+// True once the viewer shows the last frame of every channel. Frames that change
+// nothing are never sent, so the last one a viewer got may be older.
+static bool stream_viewer_done(StreamViewerRun* run, const uint32_t (*finals)[CHIP8_DISPLAY_COLUMNS])
+{
+    for(uint32_t c = 0; c < run->channels; ++c)
+    {
+        const uint32_t frame = atomic_load(&run->last_frames[c]);
+
+        if(frame == 0 || memcmp(run->history[(size_t)c * run->frames + frame - 1], finals[(size_t)c * run->frames], sizeof(finals[0])) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,179 @@
+// Upscaler cost and kernel check.
+//
+// Runs each ROM with a changing key held and upscales every frame with every filter,
+// through the vector kernels and through the per pixel reference. Prints how often a
+// filter had to run, its average and worst cost per run, and fails if any run averaged
+// a millisecond or more. --check also requires the kernels to match the reference
+// pixel for pixel on every frame.
+//
+//   chip8-upscale [--frames N] [--check] rom...
+
+#include "upscale.h"
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UPSCALE_SEED 1
+// Frames each key is held for, so the games move around
+#define UPSCALE_HOLD_FRAMES 20
+#define UPSCALE_BUDGET_NS 1000000ull
+
+typedef struct UpscaleStats
+{
+    uint64_t frames;
+    uint64_t runs;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t mismatches;
+} UpscaleStats;
+
+static bool upscale_rom(const char* path, uint32_t frames, bool check, UpscaleStats* stats);
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 600;
+    bool check = false;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--check") == 0)
+        {
+            check = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-upscale [--frames N] [--check] rom...\n");
+        return 2;
+    }
+
+    UpscaleStats stats[UPSCALE_FILTER_COUNT];
+    memset(stats, 0, sizeof(stats));
+
+    for(int i = 0; i < rom_count; ++i)
+    {
+        if(!upscale_rom(argv[i], frames, check, stats))
+        {
+            fprintf(stderr, "Failed to load %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    int result = 0;
+
+    for(uint32_t f = 0; f < UPSCALE_FILTER_COUNT; ++f)
+    {
+        const double average_ms = (double)stats[f].total_ns / 1e6 / (double)(stats[f].runs > 0 ? stats[f].runs : 1);
+        printf("%-9s %ux: ran %llu of %llu frames, %.4f ms average, %.4f ms worst", upscale_filter_name((UpscaleFilter)f),
+            upscale_factor((UpscaleFilter)f), (unsigned long long)stats[f].runs, (unsigned long long)stats[f].frames,
+            average_ms, (double)stats[f].max_ns / 1e6);
+
+        if(check)
+        {
+            printf(", %llu mismatches", (unsigned long long)stats[f].mismatches);
+        }
+
+        printf("\n");
+
+        if(average_ms * 1e6 >= (double)UPSCALE_BUDGET_NS)
+        {
+            printf("FAIL %s takes %.4f ms per run\n", upscale_filter_name((UpscaleFilter)f), average_ms);
+            result = 1;
+        }
+
+        if(stats[f].mismatches > 0)
+        {
+            printf("FAIL %s kernels differ from the reference\n", upscale_filter_name((UpscaleFilter)f));
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+static bool upscale_rom(const char* path, const uint32_t frames, const bool check, UpscaleStats* stats)
+{
+    Chip8 vm = {0};
+    chip8_reset(&vm, UPSCALE_SEED);
+
+    if(!chip8_load_rom_file(&vm, path))
+    {
+        chip8_release(&vm);
+        return false;
+    }
+
+    Upscaler* vector[UPSCALE_FILTER_COUNT];
+    Upscaler* reference[UPSCALE_FILTER_COUNT];
+
+    for(uint32_t f = 0; f < UPSCALE_FILTER_COUNT; ++f)
+    {
+        UpscaleConfig config = {
+            .filter = (UpscaleFilter)f,
+            .on = {0xFF, 0xFF, 0xFF, 0xFF},
+            .off = {0x10, 0x20, 0x10, 0xFF},
+            .is_scalar = false
+        };
+        vector[f] = upscale_create(&config);
+        config.is_scalar = true;
+        reference[f] = upscale_create(&config);
+    }
+
+    uint32_t rng = UPSCALE_SEED;
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        if(frame % UPSCALE_HOLD_FRAMES == 0)
+        {
+            rng = rng * 1664525u + 1013904223u;
+            vm.keys = (uint16_t)(1u << (rng >> 28));
+        }
+
+        chip8_step(&vm);
+
+        for(uint32_t f = 0; f < UPSCALE_FILTER_COUNT; ++f)
+        {
+            ++stats[f].frames;
+
+            if(upscale_run(vector[f], vm.display))
+            {
+                const uint64_t cost = upscale_cost_ns(vector[f]);
+                ++stats[f].runs;
+                stats[f].total_ns += cost;
+                stats[f].max_ns = cost > stats[f].max_ns ? cost : stats[f].max_ns;
+            }
+
+            if(check)
+            {
+                upscale_run(reference[f], vm.display);
+                const size_t bytes = (size_t)upscale_width(vector[f]) * upscale_height(vector[f]) * 4;
+                stats[f].mismatches += memcmp(upscale_pixels(vector[f]), upscale_pixels(reference[f]), bytes) != 0;
+            }
+        }
+    }
+
+    for(uint32_t f = 0; f < UPSCALE_FILTER_COUNT; ++f)
+    {
+        upscale_destroy(vector[f]);
+        upscale_destroy(reference[f]);
+    }
+
+    chip8_release(&vm);
+    return true;
+}
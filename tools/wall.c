@@ -0,0 +1,165 @@
+// Wall throughput and determinism.
+//
+// Runs a wall of machines for a number of frames with one thread and again with the
+// pool, and reports frames per second, the speedup, the average cost of a tile's frame
+// and how many tiles were dirty per frame. --check also requires both runs to end with
+// every machine in the same state, since each machine's keys only depend on its index.
+//
+//   chip8-wall [--machines N] [--frames N] [--threads N] [--check] rom...
+
+#include "wall.h"
+#include "hash.h"
+#include "pool.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WALL_SEED 1
+#define WALL_SAMPLE_RATE 44100
+#define WALL_AUDIO_FRAMES 735
+
+typedef struct WallRun
+{
+    double frames_per_second;
+    double tile_ms;
+    double dirty_per_frame;
+    uint32_t threads;
+    uint64_t hash;
+} WallRun;
+
+static bool wall_run(const WallConfig* config, uint32_t frames, WallRun* run);
+static uint64_t wall_machine_hash(const Chip8* vm, uint64_t seed);
+
+int main(int argc, char** argv)
+{
+    WallConfig config = {
+        .count = 16,
+        .threads = 0,
+        .rom_paths = NULL,
+        .rom_count = 0,
+        .seed = WALL_SEED
+    };
+    uint32_t frames = 600;
+    bool check = false;
+    int rom_count = 0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--machines") == 0 && i + 1 < argc)
+        {
+            config.count = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            config.threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--check") == 0)
+        {
+            check = true;
+        }
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+        else
+        {
+            argv[rom_count++] = argv[i];
+        }
+    }
+
+    if(rom_count == 0)
+    {
+        fprintf(stderr, "Usage: chip8-wall [--machines N] [--frames N] [--threads N] [--check] rom...\n");
+        return 2;
+    }
+
+    config.rom_paths = (const char* const*)argv;
+    config.rom_count = (uint32_t)rom_count;
+
+    WallConfig single = config;
+    single.threads = 1;
+    WallRun runs[2];
+
+    if(!wall_run(&single, frames, &runs[0]) || !wall_run(&config, frames, &runs[1]))
+    {
+        fprintf(stderr, "Failed to create the wall\n");
+        return 2;
+    }
+
+    for(uint32_t i = 0; i < 2; ++i)
+    {
+        printf("%u machines, %u threads: %.0f frames/s, %.4f ms per tile frame, %.1f dirty tiles per frame\n",
+            config.count, runs[i].threads, runs[i].frames_per_second, runs[i].tile_ms, runs[i].dirty_per_frame);
+    }
+
+    printf("speedup %.2fx on %u threads (%u hardware threads)\n",
+        runs[1].frames_per_second / (runs[0].frames_per_second > 0.0 ? runs[0].frames_per_second : 1.0), runs[1].threads, pool_hardware_threads());
+
+    if(check && runs[0].hash != runs[1].hash)
+    {
+        printf("FAIL machines ended in different states with %u threads\n", runs[1].threads);
+        return 1;
+    }
+
+    return 0;
+}
+
+static bool wall_run(const WallConfig* config, const uint32_t frames, WallRun* run)
+{
+    Wall* wall = wall_create(config);
+
+    if(!wall)
+    {
+        return false;
+    }
+
+    static int16_t samples[WALL_AUDIO_FRAMES];
+    uint64_t tile_ns = 0;
+    uint64_t dirty = 0;
+    const uint64_t start = timing_now_ns();
+
+    for(uint32_t frame = 0; frame < frames; ++frame)
+    {
+        wall_step(wall, false, 0);
+        // A frame's worth of audio, as the stream callback would ask for
+        wall_mix_audio(wall, samples, WALL_AUDIO_FRAMES, WALL_SAMPLE_RATE, false);
+
+        for(uint32_t i = 0; i < wall_count(wall); ++i)
+        {
+            tile_ns += wall_tile_ns(wall, i);
+            dirty += wall_tile_dirty(wall, i);
+            wall_clear_dirty(wall, i);
+        }
+    }
+
+    const uint64_t elapsed = timing_now_ns() - start;
+    run->frames_per_second = (double)frames * 1e9 / (double)(elapsed > 0 ? elapsed : 1);
+    run->tile_ms = (double)tile_ns / 1e6 / ((double)frames * wall_count(wall));
+    run->dirty_per_frame = (double)dirty / (frames > 0 ? frames : 1);
+    run->threads = wall_threads(wall);
+    run->hash = HASH_FNV1A64_SEED;
+
+    for(uint32_t i = 0; i < wall_count(wall); ++i)
+    {
+        run->hash = wall_machine_hash(wall_machine(wall, i), run->hash);
+    }
+
+    wall_destroy(wall);
+    return true;
+}
+
+static uint64_t wall_machine_hash(const Chip8* vm, uint64_t seed)
+{
+    seed = hash_fnv1a64(vm->display, sizeof(vm->display), seed);
+    seed = hash_fnv1a64(vm->v, sizeof(vm->v), seed);
+    seed = hash_fnv1a64(&vm->pc, sizeof(vm->pc), seed);
+    seed = hash_fnv1a64(&vm->index, sizeof(vm->index), seed);
+    return hash_fnv1a64(&vm->rng, sizeof(vm->rng), seed);
+}